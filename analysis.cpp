@@ -0,0 +1,305 @@
+#include "analysis.hpp"
+#include <climits>
+#include <algorithm>
+
+std::string expressionKey(const std::unique_ptr<ASTNode>& node) {
+    if (!node) return "_";
+
+    switch (node->type) {
+        case ASTNodeType::INTLIT:
+            return "#" + std::to_string(node->intValue);
+        case ASTNodeType::BOOLLIT:
+            return node->boolValue ? "#1" : "#0";
+        case ASTNodeType::FLOATLIT:
+            return "#f" + node->value;
+        case ASTNodeType::IDENTIFIER:
+            return "$" + node->value;
+        default:
+            break;
+    }
+
+    std::string key = "(" + std::to_string(static_cast<int>(node->type));
+    if (!node->value.empty()) key += ":" + node->value;
+    key += " " + expressionKey(node->left);
+    if (node->right) key += " " + expressionKey(node->right);
+    if (node->condition) key += " ?" + expressionKey(node->condition);
+    for (const auto& child : node->children) {
+        key += " " + expressionKey(child);
+    }
+    return key + ")";
+}
+
+void collectAssignedVariables(const std::unique_ptr<ASTNode>& node, std::set<std::string>& names) {
+    if (!node) return;
+
+    if (node->type == ASTNodeType::ASSIGN && node->left &&
+        node->left->type == ASTNodeType::IDENTIFIER) {
+        names.insert(node->left->value);
+    } else if (node->type == ASTNodeType::VAR_DECL) {
+        names.insert(node->value);
+    } else if (node->type == ASTNodeType::CIN_STMT) {
+        for (const auto& child : node->children) {
+            if (child && child->type == ASTNodeType::IDENTIFIER) names.insert(child->value);
+        }
+    }
+
+    collectAssignedVariables(node->condition, names);
+    collectAssignedVariables(node->left, names);
+    collectAssignedVariables(node->right, names);
+    for (const auto& child : node->children) {
+        collectAssignedVariables(child, names);
+    }
+}
+
+bool isSafeExpression(const std::unique_ptr<ASTNode>& node) {
+    if (!node) return false;
+
+    switch (node->type) {
+        case ASTNodeType::INTLIT:
+        case ASTNodeType::BOOLLIT:
+        case ASTNodeType::IDENTIFIER:
+            return true;
+
+        case ASTNodeType::DIVIDE:
+        case ASTNodeType::MODULO:
+            // Only a known divisor other than 0 and -1 cannot trap; -1 traps
+            // on the most negative dividend
+            return isSafeExpression(node->left) && node->right && node->right->type == ASTNodeType::INTLIT &&
+                   node->right->intValue != 0 && node->right->intValue != -1;
+
+        case ASTNodeType::ADD:
+        case ASTNodeType::SUBTRACT:
+        case ASTNodeType::MULTIPLY:
+        case ASTNodeType::EQ:
+        case ASTNodeType::NE:
+        case ASTNodeType::LT:
+        case ASTNodeType::GT:
+        case ASTNodeType::LE:
+        case ASTNodeType::GE:
+        case ASTNodeType::AND:
+        case ASTNodeType::OR:
+        case ASTNodeType::BITAND:
+        case ASTNodeType::BITOR:
+        case ASTNodeType::BITXOR:
+        case ASTNodeType::LSHIFT:
+        case ASTNodeType::RSHIFT:
+            return isSafeExpression(node->left) && isSafeExpression(node->right);
+
+        case ASTNodeType::NEGATE:
+        case ASTNodeType::POSITIVE:
+        case ASTNodeType::NOT:
+        case ASTNodeType::BITNOT:
+            return isSafeExpression(node->left);
+
+        case ASTNodeType::CONDITIONAL:
+            return isSafeExpression(node->condition) && isSafeExpression(node->left) &&
+                   isSafeExpression(node->right);
+
+        default:
+            return false;
+    }
+}
+
+bool readsAnyVariable(const std::unique_ptr<ASTNode>& node, const std::set<std::string>& names) {
+    if (!node) return false;
+    if (node->type == ASTNodeType::IDENTIFIER && names.count(node->value)) return true;
+    if (readsAnyVariable(node->left, names) || readsAnyVariable(node->right, names) ||
+        readsAnyVariable(node->condition, names)) {
+        return true;
+    }
+    for (const auto& child : node->children) {
+        if (readsAnyVariable(child, names)) return true;
+    }
+    return false;
+}
+
+bool isInvariantExpression(const std::unique_ptr<ASTNode>& node, const std::set<std::string>& modified) {
+    return isSafeExpression(node) && !readsAnyVariable(node, modified);
+}
+
+// Arithmetic wraps like the generated 64-bit instructions; a division that
+// would trap is left for run time
+bool foldBinaryConstant(ASTNodeType type, long long left, long long right, long long& value) {
+    unsigned long long a = static_cast<unsigned long long>(left);
+    unsigned long long b = static_cast<unsigned long long>(right);
+
+    switch (type) {
+        case ASTNodeType::ADD:      value = static_cast<long long>(a + b); return true;
+        case ASTNodeType::SUBTRACT: value = static_cast<long long>(a - b); return true;
+        case ASTNodeType::MULTIPLY: value = static_cast<long long>(a * b); return true;
+        case ASTNodeType::DIVIDE:
+        case ASTNodeType::MODULO:
+            if (right == 0 || (left == LLONG_MIN && right == -1)) return false;
+            value = type == ASTNodeType::DIVIDE ? left / right : left % right;
+            return true;
+        case ASTNodeType::EQ: value = left == right; return true;
+        case ASTNodeType::NE: value = left != right; return true;
+        case ASTNodeType::LT: value = left < right; return true;
+        case ASTNodeType::GT: value = left > right; return true;
+        case ASTNodeType::LE: value = left <= right; return true;
+        case ASTNodeType::GE: value = left >= right; return true;
+        case ASTNodeType::BITAND: value = left & right; return true;
+        case ASTNodeType::BITOR:  value = left | right; return true;
+        case ASTNodeType::BITXOR: value = left ^ right; return true;
+        // Shift counts keep their low six bits, as the instructions do
+        case ASTNodeType::LSHIFT: value = static_cast<long long>(a << (b & 63)); return true;
+        case ASTNodeType::RSHIFT: value = left >> (b & 63); return true;
+        default: return false;
+    }
+}
+
+int registerNeed(const std::unique_ptr<ASTNode>& node) {
+    if (!node) return 0;
+
+    switch (node->type) {
+        case ASTNodeType::ASSIGN:
+            // A stored element's value is held while its index is evaluated
+            if (node->left && node->left->type == ASTNodeType::INDEX) {
+                return std::max(registerNeed(node->right), registerNeed(node->left->left) + 1);
+            }
+            return registerNeed(node->right);
+
+        case ASTNodeType::INIT_LIST: {
+            // Elements are stored one at a time
+            int need = 1;
+            for (const auto& child : node->children) {
+                need = std::max(need, registerNeed(child));
+            }
+            return need;
+        }
+
+        case ASTNodeType::AND:
+        case ASTNodeType::OR:
+            // The result register stays live while each operand is evaluated
+            return 1 + std::max(registerNeed(node->left), registerNeed(node->right));
+
+        case ASTNodeType::CONDITIONAL:
+            // A select holds one arm while the other and the condition are
+            // evaluated; a branch holds the result while any of them is
+            return std::max({registerNeed(node->left), registerNeed(node->right) + 1,
+                             registerNeed(node->condition) + 2,
+                             1 + std::max({registerNeed(node->condition), registerNeed(node->left),
+                                           registerNeed(node->right)})});
+
+        case ASTNodeType::CALL: {
+            // Each argument is held while the ones after it are evaluated
+            int need = 1;
+            for (size_t i = 0; i < node->children.size(); i++) {
+                need = std::max(need, static_cast<int>(i) + registerNeed(node->children[i]));
+            }
+            return need;
+        }
+
+        // Statements run one after another, each freeing its registers
+        case ASTNodeType::COMPOUND_STMT: {
+            int need = 1;
+            for (const auto& child : node->children) {
+                need = std::max(need, registerNeed(child));
+            }
+            return need;
+        }
+
+        case ASTNodeType::IF_STMT:
+            return std::max({registerNeed(node->condition), registerNeed(node->left), registerNeed(node->right)});
+
+        case ASTNodeType::SWITCH_STMT:
+            // A jump table dispatch holds the index, the table address and the entry
+            return std::max(registerNeed(node->condition), 3);
+
+        default:
+            break;
+    }
+
+    if (node->left && node->right) {
+        // The left result is held while the right operand is evaluated
+        return std::max(registerNeed(node->left), registerNeed(node->right) + 1);
+    }
+    if (node->left) {
+        return registerNeed(node->left);
+    }
+    return 1;
+}
+
+int countNodes(const std::unique_ptr<ASTNode>& node) {
+    if (!node) return 0;
+    int count = 1 + countNodes(node->left) + countNodes(node->right) + countNodes(node->condition);
+    for (const auto& child : node->children) {
+        count += countNodes(child);
+    }
+    return count;
+}
+
+bool containsNodeType(const std::unique_ptr<ASTNode>& node, ASTNodeType type) {
+    if (!node) return false;
+    if (node->type == type) return true;
+    if (containsNodeType(node->left, type) || containsNodeType(node->right, type) ||
+        containsNodeType(node->condition, type)) {
+        return true;
+    }
+    for (const auto& child : node->children) {
+        if (containsNodeType(child, type)) return true;
+    }
+    return false;
+}
+
+bool hasSideEffects(const std::unique_ptr<ASTNode>& node) {
+    return containsNodeType(node, ASTNodeType::ASSIGN) || containsNodeType(node, ASTNodeType::CALL);
+}
+
+std::unique_ptr<ASTNode> cloneAST(const std::unique_ptr<ASTNode>& node) {
+    if (!node) return nullptr;
+
+    auto copy = std::make_unique<ASTNode>(node->type);
+    copy->value = node->value;
+    copy->intValue = node->intValue;
+    copy->floatValue = node->floatValue;
+    copy->boolValue = node->boolValue;
+    copy->left = cloneAST(node->left);
+    copy->right = cloneAST(node->right);
+    copy->condition = cloneAST(node->condition);
+    for (const auto& child : node->children) {
+        copy->children.push_back(cloneAST(child));
+    }
+    return copy;
+}
+
+std::unique_ptr<ASTNode> makeIntLiteral(int value) {
+    auto node = std::make_unique<ASTNode>(ASTNodeType::INTLIT);
+    node->intValue = value;
+    node->value = std::to_string(value);
+    return node;
+}
+
+std::unique_ptr<ASTNode> makeIdentifier(const std::string& name) {
+    auto node = std::make_unique<ASTNode>(ASTNodeType::IDENTIFIER);
+    node->value = name;
+    return node;
+}
+
+std::unique_ptr<ASTNode> makeBinary(ASTNodeType type, std::unique_ptr<ASTNode> left, std::unique_ptr<ASTNode> right) {
+    auto node = std::make_unique<ASTNode>(type);
+    node->left = std::move(left);
+    node->right = std::move(right);
+    return node;
+}
+
+std::unique_ptr<ASTNode> makeAssignment(const std::string& name, std::unique_ptr<ASTNode> value) {
+    return makeBinary(ASTNodeType::ASSIGN, makeIdentifier(name), std::move(value));
+}
+
+std::unique_ptr<ASTNode> makeExpressionStatement(std::unique_ptr<ASTNode> expr) {
+    auto node = std::make_unique<ASTNode>(ASTNodeType::EXPRESSION_STMT);
+    node->left = std::move(expr);
+    return node;
+}
+
+std::unique_ptr<ASTNode> makeVarDecl(const std::string& name, std::unique_ptr<ASTNode> init) {
+    auto node = std::make_unique<ASTNode>(ASTNodeType::VAR_DECL);
+    node->value = name;
+    node->left = std::move(init);
+    return node;
+}
+
+std::unique_ptr<ASTNode> makeCompound() {
+    return std::make_unique<ASTNode>(ASTNodeType::COMPOUND_STMT);
+}
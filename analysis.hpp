@@ -0,0 +1,57 @@
+#ifndef ANALYSIS_HPP
+#define ANALYSIS_HPP
+
+#include "parser.hpp"
+#include <memory>
+#include <set>
+#include <string>
+
+// Canonical text form of an expression; structurally identical trees map
+// to the same key
+std::string expressionKey(const std::unique_ptr<ASTNode>& node);
+
+// Collect the names of variables assigned or declared anywhere in a subtree
+void collectAssignedVariables(const std::unique_ptr<ASTNode>& node, std::set<std::string>& names);
+
+// Whether evaluating an expression has no side effects and cannot trap
+bool isSafeExpression(const std::unique_ptr<ASTNode>& node);
+
+// Whether a subtree reads any of the given variables
+bool readsAnyVariable(const std::unique_ptr<ASTNode>& node, const std::set<std::string>& names);
+
+// Whether an expression is safe and reads none of the 'modified' variables,
+// so its value is the same every time it is evaluated inside a region that
+// only writes those variables
+bool isInvariantExpression(const std::unique_ptr<ASTNode>& node, const std::set<std::string>& modified);
+
+// Value of a binary operation on constants, wrapping like the generated
+// 64-bit instructions; false if the operation would trap
+bool foldBinaryConstant(ASTNodeType type, long long left, long long right, long long& value);
+
+// Number of registers needed to evaluate an expression left to right, to
+// run a block or if statement, or to dispatch a switch statement
+int registerNeed(const std::unique_ptr<ASTNode>& node);
+
+// Number of nodes in a subtree, a rough measure of code size
+int countNodes(const std::unique_ptr<ASTNode>& node);
+
+// Whether a subtree contains a node of the given type
+bool containsNodeType(const std::unique_ptr<ASTNode>& node, ASTNodeType type);
+
+// Whether evaluating an expression may have an effect beyond its value: it
+// assigns a variable or calls a function
+bool hasSideEffects(const std::unique_ptr<ASTNode>& node);
+
+// Deep copy of a subtree
+std::unique_ptr<ASTNode> cloneAST(const std::unique_ptr<ASTNode>& node);
+
+// AST construction helpers for transformations
+std::unique_ptr<ASTNode> makeIntLiteral(int value);
+std::unique_ptr<ASTNode> makeIdentifier(const std::string& name);
+std::unique_ptr<ASTNode> makeBinary(ASTNodeType type, std::unique_ptr<ASTNode> left, std::unique_ptr<ASTNode> right);
+std::unique_ptr<ASTNode> makeAssignment(const std::string& name, std::unique_ptr<ASTNode> value);
+std::unique_ptr<ASTNode> makeExpressionStatement(std::unique_ptr<ASTNode> expr);
+std::unique_ptr<ASTNode> makeVarDecl(const std::string& name, std::unique_ptr<ASTNode> init);
+std::unique_ptr<ASTNode> makeCompound();
+
+#endif // ANALYSIS_HPP
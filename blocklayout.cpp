@@ -0,0 +1,363 @@
+#include "blocklayout.hpp"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+BlockLayout::BlockLayout(std::vector<AsmBlock>& b) : blocks(b) {}
+
+int BlockLayout::findBlock(const std::string& label) const {
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (blocks[i].label == label) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+// Successor reached when the block does not jump: its unconditional jump
+// target, or the next block in emission order
+int BlockLayout::fallthroughOf(int index) const {
+    const AsmBlock& block = blocks[index];
+    if (block.returns || !block.tableTargets.empty()) {
+        return -1;
+    }
+    if (!block.jumpTarget.empty()) {
+        return findBlock(block.jumpTarget);
+    }
+    return index + 1 < static_cast<int>(blocks.size()) ? index + 1 : -1;
+}
+
+std::string BlockLayout::invertBranch(const std::string& op) {
+    static const std::unordered_map<std::string, std::string> inverse = {
+        {"je", "jne"}, {"jne", "je"}, {"jz", "jnz"}, {"jnz", "jz"},
+        {"jl", "jge"}, {"jge", "jl"}, {"jg", "jle"}, {"jle", "jg"},
+        {"jb", "jae"}, {"jae", "jb"}, {"ja", "jbe"}, {"jbe", "ja"},
+        {"js", "jns"}, {"jns", "js"}, {"jc", "jnc"}, {"jnc", "jc"}
+    };
+    auto it = inverse.find(op);
+    return it != inverse.end() ? it->second : "";
+}
+
+void BlockLayout::buildCFG() {
+    int count = static_cast<int>(blocks.size());
+    successors.assign(count, {});
+    predecessors.assign(count, {});
+
+    for (int i = 0; i < count; i++) {
+        const AsmBlock& block = blocks[i];
+        int next = fallthroughOf(i);
+
+        if (!block.branchOp.empty()) {
+            int target = findBlock(block.branchTarget);
+            double p = block.branchProbability;
+            if (target == next) {
+                successors[i].push_back({i, target, 1.0});
+            } else {
+                // Fallthrough first, so equally likely arms keep source order
+                if (next != -1) successors[i].push_back({i, next, 1.0 - p});
+                if (target != -1) successors[i].push_back({i, target, p});
+            }
+        } else if (!block.tableTargets.empty()) {
+            // Every distinct table destination is taken equally often
+            std::vector<int> targets;
+            for (const std::string& label : block.tableTargets) {
+                int target = findBlock(label);
+                if (target != -1 && std::find(targets.begin(), targets.end(), target) == targets.end()) {
+                    targets.push_back(target);
+                }
+            }
+            for (int target : targets) {
+                successors[i].push_back({i, target, 1.0 / targets.size()});
+            }
+        } else if (next != -1) {
+            successors[i].push_back({i, next, 1.0});
+        }
+
+        for (const Edge& e : successors[i]) {
+            predecessors[e.to].push_back(e);
+        }
+    }
+
+    // Blocks that cannot be reached from the entry are dropped
+    reachable.assign(count, false);
+    std::vector<int> worklist = {0};
+    reachable[0] = true;
+    while (!worklist.empty()) {
+        int b = worklist.back();
+        worklist.pop_back();
+        for (const Edge& e : successors[b]) {
+            if (!reachable[e.to]) {
+                reachable[e.to] = true;
+                worklist.push_back(e.to);
+            }
+        }
+    }
+
+    // Code is emitted top-down, so an edge to an earlier block is a back
+    // edge. Each one defines a natural loop: the header plus every block
+    // that reaches the latch without passing through the header.
+    loopHeader.assign(count, false);
+    loops.clear();
+    for (int latch = 0; latch < count; latch++) {
+        if (!reachable[latch]) continue;
+        for (const Edge& e : successors[latch]) {
+            int header = e.to;
+            if (header > latch) continue;
+
+            loopHeader[header] = true;
+            std::vector<bool> body(count, false);
+            body[header] = true;
+            std::vector<int> pending;
+            if (!body[latch]) {
+                body[latch] = true;
+                pending.push_back(latch);
+            }
+            while (!pending.empty()) {
+                int b = pending.back();
+                pending.pop_back();
+                for (const Edge& in : predecessors[b]) {
+                    if (reachable[in.from] && !body[in.from]) {
+                        body[in.from] = true;
+                        pending.push_back(in.from);
+                    }
+                }
+            }
+            loops.push_back(body);
+        }
+    }
+}
+
+bool BlockLayout::isLoopExit(const Edge& e) const {
+    for (const auto& body : loops) {
+        if (body[e.from] && !body[e.to]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Propagate the entry frequency along edge probabilities until the loop
+// frequencies settle (iterative solution of the flow equations)
+void BlockLayout::computeFrequencies() {
+    int count = static_cast<int>(blocks.size());
+    frequency.assign(count, 0.0);
+    frequency[0] = 1.0;
+
+    const double maxFrequency = 1e9;
+    for (int iteration = 0; iteration < 1000; iteration++) {
+        double maxChange = 0.0;
+        for (int b = 1; b < count; b++) {
+            if (!reachable[b]) continue;
+            double f = 0.0;
+            for (const Edge& e : predecessors[b]) {
+                if (reachable[e.from]) {
+                    f += frequency[e.from] * e.probability;
+                }
+            }
+            f = std::min(f, maxFrequency);
+            maxChange = std::max(maxChange, std::fabs(f - frequency[b]) / std::max(f, 1.0));
+            frequency[b] = f;
+        }
+        if (maxChange < 1e-9) break;
+    }
+}
+
+// A block is cold when every way into it is an unlikely edge or comes from
+// another cold block. Leaving a loop is rare per iteration but not cold, so
+// loop exits never make a block cold. Computed as a greatest fixed point so
+// that loops inside cold regions stay cold.
+void BlockLayout::computeColdness() {
+    int count = static_cast<int>(blocks.size());
+    cold.assign(count, true);
+    cold[0] = false;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = 1; b < count; b++) {
+            if (!reachable[b] || !cold[b]) continue;
+            for (const Edge& e : predecessors[b]) {
+                if (reachable[e.from] && !cold[e.from] &&
+                    (e.probability > COLD_EDGE_PROBABILITY || isLoopExit(e))) {
+                    cold[b] = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Bottom-up chain formation (Pettis-Hansen): visit forward edges from
+// heaviest to lightest and make the target the fallthrough of the source
+// whenever both ends are still free. Chains are then placed greedily by connection
+// weight, with cold chains last.
+void BlockLayout::buildOrder() {
+    int count = static_cast<int>(blocks.size());
+    std::vector<std::vector<int>> chains(count);
+    std::vector<int> chainOf(count);
+    for (int i = 0; i < count; i++) {
+        chains[i] = {i};
+        chainOf[i] = i;
+    }
+
+    std::vector<Edge> edges;
+    for (int i = 0; i < count; i++) {
+        if (!reachable[i]) continue;
+        for (const Edge& e : successors[i]) {
+            // Back edges stay taken: the code generator already rotated
+            // its loops so the latch branches up to the header
+            if (e.to > e.from) {
+                edges.push_back(e);
+            }
+        }
+    }
+    std::stable_sort(edges.begin(), edges.end(), [this](const Edge& a, const Edge& b) {
+        return frequency[a.from] * a.probability > frequency[b.from] * b.probability;
+    });
+
+    for (const Edge& e : edges) {
+        int from = chainOf[e.from];
+        int to = chainOf[e.to];
+        if (from == to || cold[e.from] != cold[e.to]) continue;
+        if (chains[from].back() != e.from || chains[to].front() != e.to) continue;
+
+        for (int b : chains[to]) {
+            chains[from].push_back(b);
+            chainOf[b] = from;
+        }
+        chains[to].clear();
+    }
+
+    // Place the entry chain, then repeatedly the hot chain most strongly
+    // connected to what is already placed
+    std::vector<bool> placed(count, false);
+    order.clear();
+    auto place = [&](int chain) {
+        for (int b : chains[chain]) {
+            order.push_back(b);
+            placed[b] = true;
+        }
+        chains[chain].clear();
+    };
+    place(chainOf[0]);
+
+    while (true) {
+        int best = -1;
+        double bestWeight = -1.0;
+        for (int c = 0; c < count; c++) {
+            if (chains[c].empty() || !reachable[chains[c].front()] || cold[chains[c].front()]) continue;
+            double weight = 0.0;
+            for (int b : chains[c]) {
+                for (const Edge& e : predecessors[b]) {
+                    if (placed[e.from]) weight += frequency[e.from] * e.probability;
+                }
+            }
+            if (weight > bestWeight) {
+                best = c;
+                bestWeight = weight;
+            }
+        }
+        if (best == -1) break;
+        place(best);
+    }
+
+    for (int c = 0; c < count; c++) {
+        if (!chains[c].empty() && reachable[chains[c].front()]) {
+            place(c);
+        }
+    }
+}
+
+// Aligning a loop header pays off when the loop runs several times per
+// entry; the padding itself is only executed when falling into the header
+bool BlockLayout::shouldAlign(int position) const {
+    int b = order[position];
+    if (!loopHeader[b] || cold[b]) {
+        return false;
+    }
+
+    double entryFlow = 0.0;
+    for (const Edge& e : predecessors[b]) {
+        if (reachable[e.from] && e.from < b) {
+            entryFlow += frequency[e.from] * e.probability;
+        }
+    }
+    return entryFlow <= 0.0 || frequency[b] / entryFlow >= ALIGN_MIN_TRIP_COUNT;
+}
+
+void BlockLayout::run() {
+    if (blocks.empty()) {
+        order.clear();
+        return;
+    }
+    buildCFG();
+    computeFrequencies();
+    computeColdness();
+    buildOrder();
+}
+
+void BlockLayout::print(std::ostream& out) {
+    int count = static_cast<int>(order.size());
+    std::vector<std::vector<std::string>> exits(count);
+    std::vector<bool> fallsThrough(count, false);
+    std::vector<bool> referenced(blocks.size(), false);
+
+    auto jumpTo = [&](const std::string& op, int target) {
+        referenced[target] = true;
+        return "    " + op + " " + blocks[target].label;
+    };
+
+    // Rewrite block exits for the chosen order
+    for (int pos = 0; pos < count; pos++) {
+        int b = order[pos];
+        int next = pos + 1 < count ? order[pos + 1] : -1;
+        const AsmBlock& block = blocks[b];
+        int fallthrough = fallthroughOf(b);
+
+        if (!block.branchOp.empty()) {
+            int target = findBlock(block.branchTarget);
+            std::string inverted = invertBranch(block.branchOp);
+            if (target == fallthrough) {
+                if (target != next) exits[pos].push_back(jumpTo("jmp", target));
+            } else if (target == next && fallthrough != -1 && !inverted.empty()) {
+                exits[pos].push_back(jumpTo(inverted, fallthrough));
+            } else {
+                exits[pos].push_back(jumpTo(block.branchOp, target));
+                if (fallthrough != -1 && fallthrough != next) {
+                    exits[pos].push_back(jumpTo("jmp", fallthrough));
+                }
+            }
+        } else if (fallthrough != -1 && fallthrough != next) {
+            exits[pos].push_back(jumpTo("jmp", fallthrough));
+        }
+
+        bool endsInJump = !exits[pos].empty() && exits[pos].back().compare(0, 8, "    jmp ") == 0;
+        fallsThrough[pos] = !block.returns && block.tableTargets.empty() && !endsInJump;
+        for (const std::string& label : block.tableTargets) {
+            int target = findBlock(label);
+            if (target != -1) referenced[target] = true;
+        }
+    }
+
+    for (int pos = 0; pos < count; pos++) {
+        int b = order[pos];
+        const AsmBlock& block = blocks[b];
+
+        if (shouldAlign(pos)) {
+            // Padding reached by falling through is executed once per loop
+            // entry, so cap it; after an unconditional jump it is free
+            bool paddingExecuted = pos > 0 && fallsThrough[pos - 1];
+            out << "    .p2align 4" << (paddingExecuted ? ",,10" : "") << std::endl;
+        }
+        if (!block.label.empty() && (!block.synthetic || referenced[b])) {
+            out << block.label << ":" << std::endl;
+        }
+        for (const std::string& line : block.lines) {
+            out << line << std::endl;
+        }
+        for (const std::string& line : exits[pos]) {
+            out << line << std::endl;
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef BLOCKLAYOUT_HPP
+#define BLOCKLAYOUT_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// A basic block of generated assembly. The body holds formatted instructions
+// and comments; control flow leaving the block is kept separately so the
+// layout stage can rewrite jumps once the final block order is known.
+struct AsmBlock {
+    std::string label;                // Block label ("" for the function entry)
+    bool synthetic;                   // Label invented to split a fallthrough
+    std::vector<std::string> lines;   // Formatted instructions and comments
+
+    std::string branchOp;             // Conditional jump mnemonic, e.g. "jl"
+    std::string branchTarget;         // Label the conditional jump goes to
+    double branchProbability;         // Estimated chance the jump is taken
+    std::string jumpTarget;           // Unconditional successor ("" = next block)
+    bool returns;                     // Ends in ret, no successors
+    std::vector<std::string> tableTargets;  // Labels an indirect jump through a table reaches
+    std::vector<std::string> table;         // Read-only data of that table, written with the block
+
+    AsmBlock(const std::string& l = "", bool synth = false)
+        : label(l), synthetic(synth), branchProbability(0.5), returns(false) {}
+
+    bool isTerminated() const { return returns || !jumpTarget.empty() || !tableTargets.empty(); }
+};
+
+// Block placement stage. Estimates block frequencies from the branch
+// probabilities recorded by the code generator, chains blocks so the likely
+// successor is the fallthrough, moves cold blocks to the end of the function
+// and aligns hot loop headers.
+class BlockLayout {
+private:
+    struct Edge {
+        int from;
+        int to;
+        double probability;
+    };
+
+    std::vector<AsmBlock>& blocks;
+    std::vector<std::vector<Edge>> successors;
+    std::vector<std::vector<Edge>> predecessors;
+    std::vector<double> frequency;
+    std::vector<bool> reachable;
+    std::vector<bool> cold;
+    std::vector<bool> loopHeader;
+    std::vector<std::vector<bool>> loops;   // Natural loop bodies
+    std::vector<int> order;
+
+    // Probability at or below which an edge is considered unlikely
+    static constexpr double COLD_EDGE_PROBABILITY = 0.3;
+    // Loop headers executed at least this many times per function entry
+    // are worth aligning
+    static constexpr double ALIGN_MIN_TRIP_COUNT = 4.0;
+
+    int findBlock(const std::string& label) const;
+    int fallthroughOf(int index) const;
+    void buildCFG();
+    bool isLoopExit(const Edge& e) const;
+    void computeFrequencies();
+    void computeColdness();
+    void buildOrder();
+    bool shouldAlign(int position) const;
+
+    static std::string invertBranch(const std::string& op);
+
+public:
+    explicit BlockLayout(std::vector<AsmBlock>& b);
+
+    // Compute the block order
+    void run();
+
+    // Write the blocks in layout order, fixing up jumps
+    void print(std::ostream& out);
+
+    // Whether a block is reached from the entry and so written by print;
+    // unreachable blocks and their labels are dropped
+    bool isReachable(size_t index) const { return reachable[index]; }
+};
+
+#endif // BLOCKLAYOUT_HPP
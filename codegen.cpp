@@ -1,4 +1,9 @@
 #include "codegen.hpp"
+#include "analysis.hpp"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdint>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
@@ -7,22 +12,94 @@
 // x86-64 registers we'll use for temporaries (r8-r15)
 const std::string CodeGenerator::registers[] = {
     "%r8",  "%r9",  "%r10", "%r11",
-    "%r12", "%r13", "%r14", "%r15"
+    "%r12", "%r13", "%r14", "%r15",
+    "%rbx", "%rsi", "%rdi", "%rcx"
 };
 
+// Orders in which variables get the dedicated registers (indices into
+// 'registers'). %rbx survives calls, so it comes first where there are any;
+// a leaf function prefers the registers it need not preserve, starting
+// with the first two argument registers.
+static const int CALLER_VARIABLE_REGISTERS[] = {8, 9, 10, 11};
+static const int LEAF_VARIABLE_REGISTERS[] = {10, 9, 11, 8};
+
+// System V integer argument registers, in order
+static const char* const ARGUMENT_REGISTERS[] = {"%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"};
+
+// The 32-bit form of a register or immediate operand, for element stores
+static std::string doublewordOperand(const std::string& operand) {
+    if (operand.compare(0, 2, "%r") != 0) {
+        return operand;
+    }
+    if (std::isdigit(static_cast<unsigned char>(operand[2]))) {
+        return operand + "d";
+    }
+    return "%e" + operand.substr(2);
+}
+
+// Two-address instruction of an arithmetic or bitwise operation
+static std::string arithmeticMnemonic(ASTNodeType type) {
+    switch (type) {
+        case ASTNodeType::ADD: return "addq";
+        case ASTNodeType::SUBTRACT: return "subq";
+        case ASTNodeType::BITAND: return "andq";
+        case ASTNodeType::BITOR: return "orq";
+        case ASTNodeType::BITXOR: return "xorq";
+        default: return "imulq";
+    }
+}
+
+// Value of an initializer built from literals
+static bool constantValue(const std::unique_ptr<ASTNode>& node, long long& value) {
+    switch (node->type) {
+        case ASTNodeType::INTLIT:
+            value = node->intValue;
+            return true;
+        case ASTNodeType::BOOLLIT:
+            value = node->boolValue ? 1 : 0;
+            return true;
+        case ASTNodeType::NEGATE:
+            if (!constantValue(node->left, value)) return false;
+            value = static_cast<long long>(0ULL - static_cast<unsigned long long>(value));
+            return true;
+        case ASTNodeType::BITNOT:
+            if (!constantValue(node->left, value)) return false;
+            value = ~value;
+            return true;
+        case ASTNodeType::POSITIVE:
+            return constantValue(node->left, value);
+        default: {
+            long long left, right;
+            return node->left && node->right && !node->condition && constantValue(node->left, left) &&
+                   constantValue(node->right, right) && foldBinaryConstant(node->type, left, right, value);
+        }
+    }
+}
+
+// Registers a System V function must preserve for its caller
+static bool isPreservedAcrossCalls(const std::string& reg) {
+    return reg == "%rbx" || reg == "%r12" || reg == "%r13" || reg == "%r14" || reg == "%r15";
+}
+
 CodeGenerator::CodeGenerator(std::ostream* out)
-    : output(out), ownsStream(false), nextRegister(0), labelCounter(0), stackOffset(0) {
-    usedRegisters.resize(MAX_REGISTERS, false);
+    : output(out), ownsStream(false), nextRegister(0), labelCounter(0), stackOffset(0),
+      collectBlocks(false), cyclesBefore(0), cyclesAfter(0), variableRegisterOrder(CALLER_VARIABLE_REGISTERS),
+      currentFunction(nullptr), emittedCall(false), vectorISA(VectorISA::NONE), counterLanes(-1), vectorIndex(-1), vectorAligned(nullptr) {
+    usedRegisters.resize(NUM_REGISTERS, false);
+    usedVectorRegisters.resize(NUM_VECTOR_REGISTERS, false);
 }
 
 CodeGenerator::CodeGenerator(const std::string& filename)
-    : ownsStream(true), nextRegister(0), labelCounter(0), stackOffset(0) {
+    : ownsStream(true), nextRegister(0), labelCounter(0), stackOffset(0),
+      collectBlocks(false), cyclesBefore(0), cyclesAfter(0), variableRegisterOrder(CALLER_VARIABLE_REGISTERS),
+      currentFunction(nullptr), emittedCall(false), vectorISA(VectorISA::NONE), counterLanes(-1), vectorIndex(-1), vectorAligned(nullptr) {
     output = new std::ofstream(filename);
     if (!static_cast<std::ofstream*>(output)->is_open()) {
         delete output;
         throw std::runtime_error("Cannot open output file: " + filename);
     }
-    usedRegisters.resize(MAX_REGISTERS, false);
+    usedRegisters.resize(NUM_REGISTERS, false);
+    usedVectorRegisters.resize(NUM_VECTOR_REGISTERS, false);
 }
 
 CodeGenerator::~CodeGenerator() {
@@ -57,7 +134,7 @@ void CodeGenerator::freeAllRegisters() {
 }
 
 bool CodeGenerator::isValidRegister(int reg) {
-    return reg >= 0 && reg < MAX_REGISTERS;
+    return reg >= 0 && reg < NUM_REGISTERS;
 }
 
 std::string CodeGenerator::getRegisterName(int reg) {
@@ -68,18 +145,79 @@ std::string CodeGenerator::getRegisterName(int reg) {
     return "";
 }
 
+// While a function body is being generated, output is collected into basic
+// blocks for the layout stage instead of being written directly
+AsmBlock& CodeGenerator::currentBlock() {
+    if (blocks.empty() || blocks.back().isTerminated() || !blocks.back().branchOp.empty()) {
+        blocks.emplace_back(generateLabel(".Lbb"), true);
+    }
+    return blocks.back();
+}
+
 void CodeGenerator::emit(const std::string& instruction) {
+    if (collectBlocks) {
+        AsmBlock& block = currentBlock();
+        block.lines.push_back("    " + instruction);
+        if (instruction == "ret") {
+            block.returns = true;
+        }
+        return;
+    }
     *output << "    " << instruction << std::endl;
 }
 
 void CodeGenerator::emitComment(const std::string& comment) {
+    if (collectBlocks) {
+        currentBlock().lines.push_back("    # " + comment);
+        return;
+    }
     *output << "    # " << comment << std::endl;
 }
 
 void CodeGenerator::emitLabel(const std::string& label) {
+    if (collectBlocks) {
+        blocks.emplace_back(label);
+        return;
+    }
     *output << label << ":" << std::endl;
 }
 
+// Emit a jump; 'probability' is the estimated chance a conditional jump is
+// taken and guides block placement
+void CodeGenerator::emitJump(const std::string& op, const std::string& target, double probability) {
+    if (!collectBlocks) {
+        emit(op + " " + target);
+        return;
+    }
+
+    if (op == "jmp") {
+        bool extendsBranch = !blocks.empty() && !blocks.back().branchOp.empty() &&
+                             !blocks.back().isTerminated();
+        AsmBlock& block = extendsBranch ? blocks.back() : currentBlock();
+        block.jumpTarget = target;
+    } else {
+        AsmBlock& block = currentBlock();
+        block.branchOp = op;
+        block.branchTarget = target;
+        block.branchProbability = probability;
+    }
+}
+
+// Jump through a register; 'targets' lists every label it can reach and
+// 'table' is the read-only data the jump reads its target from
+void CodeGenerator::emitIndirectJump(const std::string& reg, const std::vector<std::string>& targets,
+                                     const std::vector<std::string>& table) {
+    if (!collectBlocks) {
+        emit("jmp *" + reg);
+        jumpTables.insert(jumpTables.end(), table.begin(), table.end());
+        return;
+    }
+    AsmBlock& block = currentBlock();
+    block.lines.push_back("    jmp *" + reg);
+    block.tableTargets = targets;
+    block.table = table;
+}
+
 std::string CodeGenerator::generateLabel(const std::string& prefix) {
     return prefix + std::to_string(labelCounter++);
 }
@@ -95,45 +233,715 @@ void CodeGenerator::loadImmediate(int reg, float value) {
 }
 
 // Symbol table management - UPDATED for SymbolTable class
+// The program's body shares its names with the global arrays; a function's
+// locals may hide them
 void CodeGenerator::addVariable(const std::string& name) {
-    if (!symbolTable.addSymbol(name, SymbolType::INTEGER)) {
+    if ((!currentFunction && globalArrays.count(name)) || !symbolTable.addSymbol(name, SymbolType::INTEGER)) {
         error("Variable '" + name + "' already declared");
     }
     emitComment("Variable '" + name + "' declared");
 }
 
-int CodeGenerator::getVariableOffset(const std::string& name) {
-    Symbol* sym = symbolTable.findSymbol(name);
-    if (!sym) {
-        error("Variable '" + name + "' not declared");
+// Give a declared variable the register planned for it, if that register
+// is free; otherwise the variable stays in its stack slot
+void CodeGenerator::promoteVariable(const ASTNode* declaration) {
+    int slot = promotion.slotFor(declaration);
+    if (slot < 0) {
+        return;
+    }
+
+    // Dedicated variable registers come first, then temporaries lent from
+    // the top of the pool
+    int dedicated = NUM_REGISTERS - MAX_REGISTERS;
+    int reg = slot < dedicated ? variableRegisterOrder[slot] : MAX_REGISTERS - 1 - (slot - dedicated);
+    if (reg < 0 || usedRegisters[reg]) {
+        return;
+    }
+
+    usedRegisters[reg] = true;
+    symbolTable.findSymbol(declaration->value)->reg = reg;
+    emitComment("Variable '" + declaration->value + "' lives in " + getRegisterName(reg));
+}
+
+// Leaving a scope releases the registers of the variables declared in it
+void CodeGenerator::exitScope() {
+    for (const auto& entry : symbolTable.getAllSymbols()) {
+        const Symbol& sym = entry.second;
+        if (sym.scope >= symbolTable.getCurrentScope() && sym.reg >= 0) {
+            usedRegisters[sym.reg] = false;
+        }
     }
-    return sym->offset;
+    symbolTable.exitScope();
 }
 
-void CodeGenerator::loadVariable(int reg, const std::string& name) {
+// The scalar variable a name refers to; an array has no value of its own
+Symbol* CodeGenerator::findVariable(const std::string& name) {
     Symbol* sym = symbolTable.findSymbol(name);
+    if (sym ? sym->elements > 0 : globalArrays.count(name) > 0) {
+        error("Array '" + name + "' used as a value");
+    }
     if (!sym) {
         error("Variable '" + name + "' not declared");
     }
+    return sym;
+}
+
+int CodeGenerator::getVariableOffset(const std::string& name) {
+    return findVariable(name)->offset;
+}
+
+void CodeGenerator::loadVariable(int reg, const std::string& name) {
+    Symbol* sym = findVariable(name);
     if (!sym->initialized) {
         error("Variable '" + name + "' used before initialization");
     }
 
+    if (sym->reg >= 0) {
+        emit("movq " + getRegisterName(sym->reg) + ", " + getRegisterName(reg));
+        return;
+    }
     emit("movq " + std::to_string(sym->offset) + "(%rbp), " + getRegisterName(reg));
     emitComment("Load variable '" + name + "'");
 }
 
 void CodeGenerator::storeVariable(const std::string& name, int reg) {
-    Symbol* sym = symbolTable.findSymbol(name);
-    if (!sym) {
-        error("Variable '" + name + "' not declared");
-    }
+    Symbol* sym = findVariable(name);
 
-    emit("movq " + getRegisterName(reg) + ", " + std::to_string(sym->offset) + "(%rbp)");
+    if (sym->reg >= 0) {
+        if (sym->reg != reg) {
+            emit("movq " + getRegisterName(reg) + ", " + getRegisterName(sym->reg));
+        }
+    } else {
+        emit("movq " + getRegisterName(reg) + ", " + std::to_string(sym->offset) + "(%rbp)");
+    }
     symbolTable.markInitialized(name);
     emitComment("Store to variable '" + name + "'");
 }
 
+// Instruction selection
+
+bool CodeGenerator::isLeafOperand(const std::unique_ptr<ASTNode>& node) {
+    if (node->type == ASTNodeType::INTLIT || node->type == ASTNodeType::BOOLLIT ||
+        node->type == ASTNodeType::IDENTIFIER) {
+        return true;
+    }
+    return !pinnedValues.empty() && pinnedValues.count(expressionKey(node));
+}
+
+bool CodeGenerator::isRegisterResident(const std::unique_ptr<ASTNode>& node) {
+    if (node->type == ASTNodeType::IDENTIFIER) {
+        Symbol* sym = symbolTable.findSymbol(node->value);
+        return sym && sym->reg >= 0;
+    }
+    return !pinnedValues.empty() && pinnedValues.count(expressionKey(node));
+}
+
+bool CodeGenerator::leafOperand(const std::unique_ptr<ASTNode>& node, Operand& operand) {
+    if (node->type == ASTNodeType::INTLIT || node->type == ASTNodeType::BOOLLIT) {
+        int value = node->type == ASTNodeType::INTLIT ? node->intValue : (node->boolValue ? 1 : 0);
+        operand = {"$" + std::to_string(value), -1, false, false};
+        return true;
+    }
+
+    int reg;
+    if (findPinned(node, reg)) {
+        operand = {getRegisterName(reg), reg, false, false};
+        return true;
+    }
+
+    if (node->type == ASTNodeType::IDENTIFIER) {
+        Symbol* sym = findVariable(node->value);
+        if (!sym->initialized) {
+            error("Variable '" + node->value + "' used before initialization");
+        }
+        operand = {std::to_string(sym->offset) + "(%rbp)", -1, false, true};
+        return true;
+    }
+    return false;
+}
+
+CodeGenerator::Operand CodeGenerator::selectOperand(const std::unique_ptr<ASTNode>& node, bool allowMemory) {
+    Operand operand;
+    if (leafOperand(node, operand) && (allowMemory || !operand.memory)) {
+        return operand;
+    }
+    int reg = generateExpression(node);
+    return {getRegisterName(reg), reg, true, false};
+}
+
+void CodeGenerator::releaseOperand(const Operand& operand) {
+    if (operand.owned) {
+        freeRegister(operand.reg);
+    }
+}
+
+// Instructions needed to compute a value into a register, or to supply it
+// as the source operand of another instruction
+int CodeGenerator::estimateCost(const std::unique_ptr<ASTNode>& node, bool asOperand) {
+    if (!node) return 0;
+    if (isLeafOperand(node)) return asOperand ? 0 : 1;
+
+    switch (node->type) {
+        case ASTNodeType::ADD:
+        case ASTNodeType::SUBTRACT:
+        case ASTNodeType::MULTIPLY:
+        case ASTNodeType::BITAND:
+        case ASTNodeType::BITOR:
+        case ASTNodeType::BITXOR: {
+            const std::unique_ptr<ASTNode>* left = &node->left;
+            const std::unique_ptr<ASTNode>* right = &node->right;
+            if (node->type != ASTNodeType::SUBTRACT && isLeafOperand(*left) && !isLeafOperand(*right)) {
+                std::swap(left, right);
+            }
+            if (node->type == ASTNodeType::MULTIPLY && (*right)->type == ASTNodeType::INTLIT) {
+                int factor = (*right)->intValue;
+                bool shift = factor > 0 && (factor & (factor - 1)) == 0;
+                return estimateCost(*left, !shift) + 1;
+            }
+            return estimateCost(*left, false) + estimateCost(*right, true) + 1;
+        }
+
+        // A count that is not a literal is moved to %cl, saving %rcx around it
+        case ASTNodeType::LSHIFT:
+        case ASTNodeType::RSHIFT:
+            if (node->right->type == ASTNodeType::INTLIT) return estimateCost(node->left, false) + 1;
+            return estimateCost(node->left, false) + estimateCost(node->right, true) + 4;
+
+        case ASTNodeType::CALL: {
+            // The call itself, the argument moves and the saves around it
+            int cost = CALL_COST;
+            for (const auto& arg : node->children) {
+                cost += estimateCost(arg, false) + 1;
+            }
+            return cost;
+        }
+
+        default:
+            return 2 + estimateCost(node->condition, false) + estimateCost(node->left, false) +
+                   estimateCost(node->right, false);
+    }
+}
+
+// Decompose a sum into base + index * scale + displacement. Sums, constant
+// differences and scaling by 1, 2, 4 or 8 are absorbed; anything else
+// becomes a base or index term computed into a register.
+bool CodeGenerator::matchAddress(const std::unique_ptr<ASTNode>& node, Address& address) {
+    if (node->type == ASTNodeType::INTLIT) {
+        address.displacement += node->intValue;
+        return true;
+    }
+
+    if (!isRegisterResident(node)) {
+        switch (node->type) {
+            case ASTNodeType::ADD:
+                address.operations++;
+                return matchAddress(node->left, address) && matchAddress(node->right, address);
+
+            case ASTNodeType::SUBTRACT:
+                if (node->right->type == ASTNodeType::INTLIT) {
+                    address.operations++;
+                    address.displacement -= node->right->intValue;
+                    return matchAddress(node->left, address);
+                }
+                break;
+
+            case ASTNodeType::MULTIPLY: {
+                if (address.index || node->right->type != ASTNodeType::INTLIT) break;
+                int scale = node->right->intValue;
+                if (scale == 2 || scale == 4 || scale == 8) {
+                    address.operations++;
+                    address.index = &node->left;
+                    address.scale = scale;
+                    return true;
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    if (!address.base) {
+        address.base = &node;
+        return true;
+    }
+    if (!address.index) {
+        address.index = &node;
+        address.scale = 1;
+        return true;
+    }
+    return false;
+}
+
+int CodeGenerator::generateAddress(const Address& address) {
+    auto termOperand = [this](const std::unique_ptr<ASTNode>& term) -> Operand {
+        int reg;
+        if (findPinned(term, reg)) {
+            return {getRegisterName(reg), reg, false, false};
+        }
+        reg = generateExpression(term);
+        return {getRegisterName(reg), reg, true, false};
+    };
+
+    Operand base = {"", -1, false, false};
+    Operand index = {"", -1, false, false};
+    if (address.base) base = termOperand(*address.base);
+    if (address.index) index = termOperand(*address.index);
+
+    std::string text = (address.displacement != 0 ? std::to_string(address.displacement) : "") +
+                       "(" + base.text;
+    if (address.index) {
+        text += "," + index.text + "," + std::to_string(address.scale);
+    }
+    text += ")";
+
+    int reg;
+    if (base.owned) {
+        reg = base.reg;
+        releaseOperand(index);
+    } else if (index.owned) {
+        reg = index.reg;
+    } else {
+        reg = allocateRegister();
+    }
+    emit("leaq " + text + ", " + getRegisterName(reg));
+    return reg;
+}
+
+// Addition, subtraction, multiplication and the bitwise operations: a
+// single lea when the tree has the shape of an address and that is cheaper,
+// otherwise a two-address instruction whose source is an immediate,
+// register or memory operand
+int CodeGenerator::generateArithmetic(const std::unique_ptr<ASTNode>& node) {
+    bool addressLike = node->type == ASTNodeType::ADD || node->type == ASTNodeType::SUBTRACT ||
+                       node->type == ASTNodeType::MULTIPLY;
+    if (addressLike && !hasSideEffects(node)) {
+        Address address;
+        if (matchAddress(node, address) && address.base &&
+            address.displacement >= INT32_MIN && address.displacement <= INT32_MAX) {
+            auto termCost = [this](const std::unique_ptr<ASTNode>* term) {
+                return !term || isRegisterResident(*term) ? 0 : estimateCost(*term, false);
+            };
+            int leaCost = 1 + termCost(address.base) + termCost(address.index);
+            if (leaCost < estimateCost(node, false)) {
+                return generateAddress(address);
+            }
+        }
+    }
+
+    // Commutative operations take the leaf as the source operand; the
+    // operands swap only when that cannot change what either reads
+    const std::unique_ptr<ASTNode>* left = &node->left;
+    const std::unique_ptr<ASTNode>* right = &node->right;
+    if (node->type != ASTNodeType::SUBTRACT &&
+        ((*left)->type == ASTNodeType::INTLIT ||
+         (isLeafOperand(*left) && !isLeafOperand(*right) && !hasSideEffects(*right)))) {
+        std::swap(left, right);
+    }
+
+    if (node->type == ASTNodeType::MULTIPLY && (*right)->type == ASTNodeType::INTLIT) {
+        int factor = (*right)->intValue;
+        if (factor > 0 && (factor & (factor - 1)) == 0) {
+            int reg = generateExpression(*left);
+            int shift = 0;
+            while ((1 << shift) < factor) shift++;
+            if (shift > 0) emit("shlq $" + std::to_string(shift) + ", " + getRegisterName(reg));
+            return reg;
+        }
+        // The three-operand form cannot take an immediate as its source
+        Operand source = selectOperand(*left);
+        if (!source.memory && source.reg < 0) {
+            int reg = generateExpression(*left);
+            source = {getRegisterName(reg), reg, true, false};
+        }
+        int reg = source.owned ? source.reg : allocateRegister();
+        emit("imulq $" + std::to_string(factor) + ", " + source.text + ", " + getRegisterName(reg));
+        return reg;
+    }
+
+    int reg = generateExpression(*left);
+    Operand source = selectOperand(*right);
+    emit(arithmeticMnemonic(node->type) + " " + source.text + ", " + getRegisterName(reg));
+    releaseOperand(source);
+    return reg;
+}
+
+// Shifts by a literal take it as an immediate; any other count must be in
+// %cl, which is saved around the shift while %rcx holds a variable. The
+// instructions use only the low six bits of the count, as the language does.
+int CodeGenerator::generateShift(const std::unique_ptr<ASTNode>& node) {
+    std::string mnemonic = node->type == ASTNodeType::LSHIFT ? "shlq" : "sarq";
+    int reg = generateExpression(node->left);
+    std::string regName = getRegisterName(reg);
+    if (node->right->type == ASTNodeType::INTLIT) {
+        int count = node->right->intValue & 63;
+        if (count != 0) emit(mnemonic + " $" + std::to_string(count) + ", " + regName);
+        return reg;
+    }
+
+    Operand count = selectOperand(node->right);
+    if (count.text == "%rcx") {
+        emit(mnemonic + " %cl, " + regName);
+        releaseOperand(count);
+        return reg;
+    }
+    bool saved = false;
+    for (int r = 0; r < NUM_REGISTERS; r++) {
+        saved = saved || (usedRegisters[r] && getRegisterName(r) == "%rcx");
+    }
+    if (saved) emit("pushq %rcx");
+    emit("movq " + count.text + ", %rcx");
+    emit(mnemonic + " %cl, " + regName);
+    if (saved) emit("popq %rcx");
+    releaseOperand(count);
+    return reg;
+}
+
+// Assignment statements whose value is not needed: 'x = leaf' is a single
+// move and 'x = x op leaf' updates the variable where it lives
+bool CodeGenerator::generateAssignmentInPlace(const std::unique_ptr<ASTNode>& node) {
+    if (node->type == ASTNodeType::ASSIGN && node->left && node->right &&
+        node->left->type == ASTNodeType::INDEX) {
+        generateArrayStore(node, false);
+        return true;
+    }
+    if (node->type != ASTNodeType::ASSIGN || !node->left || !node->right ||
+        node->left->type != ASTNodeType::IDENTIFIER) {
+        return false;
+    }
+    Symbol* sym = symbolTable.findSymbol(node->left->value);
+    if (!sym || sym->elements > 0) return false;
+
+    const std::string& name = node->left->value;
+    bool destMemory = sym->reg < 0;
+    std::string dest = destMemory ? std::to_string(sym->offset) + "(%rbp)" : getRegisterName(sym->reg);
+    const std::unique_ptr<ASTNode>& value = node->right;
+    Operand source;
+
+    if (isLeafOperand(value)) {
+        if (!leafOperand(value, source) || (destMemory && source.memory)) return false;
+        emit("movq " + source.text + ", " + dest);
+        symbolTable.markInitialized(name);
+        emitComment("Store to variable '" + name + "'");
+        return true;
+    }
+
+    bool shift = (value->type == ASTNodeType::LSHIFT || value->type == ASTNodeType::RSHIFT) &&
+                 value->right->type == ASTNodeType::INTLIT;
+    bool arithmetic = value->type == ASTNodeType::ADD || value->type == ASTNodeType::SUBTRACT ||
+                      value->type == ASTNodeType::BITAND || value->type == ASTNodeType::BITOR ||
+                      value->type == ASTNodeType::BITXOR || (value->type == ASTNodeType::MULTIPLY && !destMemory);
+    if ((!arithmetic && !shift) || !sym->initialized) return false;
+
+    auto isSelf = [&name](const std::unique_ptr<ASTNode>& operand) {
+        return operand->type == ASTNodeType::IDENTIFIER && operand->value == name;
+    };
+    if (shift) {
+        if (!isSelf(value->left)) return false;
+        emit(std::string(value->type == ASTNodeType::LSHIFT ? "shlq $" : "sarq $") +
+             std::to_string(value->right->intValue & 63) + ", " + dest);
+        emitComment("Update variable '" + name + "' in place");
+        return true;
+    }
+    const std::unique_ptr<ASTNode>* other = nullptr;
+    if (isSelf(value->left)) {
+        other = &value->right;
+    } else if (value->type != ASTNodeType::SUBTRACT && isSelf(value->right)) {
+        other = &value->left;
+    }
+    if (!other || !isLeafOperand(*other) || !leafOperand(*other, source) || (destMemory && source.memory)) {
+        return false;
+    }
+
+    emit(arithmeticMnemonic(value->type) + " " + source.text + ", " + dest);
+    emitComment("Update variable '" + name + "' in place");
+    return true;
+}
+
+// Arrays
+
+// Arrays declared directly in the program's body are global, visible in
+// every function
+void CodeGenerator::collectGlobalArrays(const std::unique_ptr<ASTNode>& program) {
+    globalArrays.clear();
+    readOnlyData.clear();
+    for (const auto& child : program->children) {
+        if (child->type != ASTNodeType::ARRAY_DECL) continue;
+        if (globalArrays.count(child->value)) {
+            error("Variable '" + child->value + "' already declared");
+        }
+        bool constant = true;
+        if (child->left) {
+            for (const auto& element : child->left->children) {
+                long long value;
+                constant = constant && constantValue(element, value);
+            }
+        }
+        globalArrays[child->value] = {child.get(), constant};
+    }
+}
+
+// A frame array declared in scope, or else a global one
+CodeGenerator::ArrayLocation CodeGenerator::findArray(const std::string& name) {
+    Symbol* sym = symbolTable.findSymbol(name);
+    if (sym) {
+        if (sym->elements == 0) {
+            error("Variable '" + name + "' is not an array");
+        }
+        return {"", sym->offset, sym->elements};
+    }
+    auto it = globalArrays.find(name);
+    if (it == globalArrays.end()) {
+        error("Array '" + name + "' not declared");
+    }
+    return {name + ".arr", 0, it->second.declaration->intValue};
+}
+
+// Memory operand at a constant byte displacement into an array. Globals
+// are addressed relative to %rip so the code stays position-independent.
+std::string CodeGenerator::elementAt(const ArrayLocation& array, long long displacement) {
+    if (array.label.empty()) {
+        return std::to_string(array.offset + displacement) + "(%rbp)";
+    }
+    std::string sign = displacement > 0 ? "+" : "";
+    return array.label + (displacement != 0 ? sign + std::to_string(displacement) : "") + "(%rip)";
+}
+
+// Split an index into a variable term and a constant: literals added to or
+// subtracted from the rest become part of the displacement, unless the sum
+// is already held in a register
+void CodeGenerator::splitIndex(const std::unique_ptr<ASTNode>& node, const std::unique_ptr<ASTNode>*& term,
+                               long long& constant) {
+    int reg;
+    bool sum = (node->type == ASTNodeType::ADD || node->type == ASTNodeType::SUBTRACT) && !findPinned(node, reg);
+    if (node->type == ASTNodeType::INTLIT) {
+        constant += node->intValue;
+    } else if (sum && node->right->type == ASTNodeType::INTLIT) {
+        splitIndex(node->left, term, constant);
+        constant += node->type == ASTNodeType::ADD ? node->right->intValue : -node->right->intValue;
+    } else if (sum && node->type == ASTNodeType::ADD && node->left->type == ASTNodeType::INTLIT) {
+        constant += node->left->intValue;
+        splitIndex(node->right, term, constant);
+    } else {
+        term = &node;
+    }
+}
+
+// Memory operand of an array element. A variable index is scaled by the
+// addressing mode; the register holding it is returned in 'index' for the
+// caller to release. A global array's address is formed in %rax.
+std::string CodeGenerator::elementOperand(const std::unique_ptr<ASTNode>& access, Operand& index) {
+    ArrayLocation array = findArray(access->value);
+    const std::unique_ptr<ASTNode>* term = nullptr;
+    long long constant = 0;
+    splitIndex(access->left, term, constant);
+
+    // The displacement must fit the instruction's 32 bits
+    long long displacement = constant * ELEMENT_SIZE + (array.label.empty() ? array.offset : 0);
+    if (displacement < INT32_MIN || displacement > INT32_MAX) {
+        term = &access->left;
+        constant = 0;
+    }
+
+    index = {"", -1, false, false};
+    if (!term) {
+        return elementAt(array, constant * ELEMENT_SIZE);
+    }
+    int reg;
+    if (findPinned(*term, reg)) {
+        index = {getRegisterName(reg), reg, false, false};
+    } else {
+        reg = generateExpression(*term);
+        index = {getRegisterName(reg), reg, true, false};
+    }
+
+    std::string base = "%rbp";
+    displacement = constant * ELEMENT_SIZE + array.offset;
+    if (!array.label.empty()) {
+        emit("leaq " + array.label + "(%rip), %rax");
+        base = "%rax";
+    }
+    return (displacement != 0 ? std::to_string(displacement) : "") + "(" + base + "," + index.text + "," +
+           std::to_string(ELEMENT_SIZE) + ")";
+}
+
+// Store to an array element. The value is computed before the element's
+// address, which may use %rax. When the value is not needed a constant is
+// stored directly, and 'a[i] = a[i] + x' adds to the element in memory.
+int CodeGenerator::generateArrayStore(const std::unique_ptr<ASTNode>& node, bool valueNeeded) {
+    const std::unique_ptr<ASTNode>& target = node->left;
+    const std::unique_ptr<ASTNode>& value = node->right;
+    Operand source;
+    Operand index;
+
+    bool update = value->type == ASTNodeType::ADD || value->type == ASTNodeType::SUBTRACT;
+    if (!valueNeeded && update && !hasSideEffects(target)) {
+        std::string key = expressionKey(target);
+        const std::unique_ptr<ASTNode>* other = nullptr;
+        if (expressionKey(value->left) == key) {
+            other = &value->right;
+        } else if (value->type == ASTNodeType::ADD && expressionKey(value->right) == key) {
+            other = &value->left;
+        }
+        if (other && !hasSideEffects(*other)) {
+            source = selectOperand(*other, false);
+            std::string element = elementOperand(target, index);
+            emit((value->type == ASTNodeType::ADD ? "addl " : "subl ") + doublewordOperand(source.text) + ", " +
+                 element);
+            emitComment("Update element of '" + target->value + "' in place");
+            releaseOperand(index);
+            releaseOperand(source);
+            return -1;
+        }
+    }
+
+    int valueReg = -1;
+    if (valueNeeded || !leafOperand(value, source) || source.memory) {
+        valueReg = generateExpression(value);
+        source = {getRegisterName(valueReg), valueReg, true, false};
+    }
+    std::string element = elementOperand(target, index);
+    emit("movl " + doublewordOperand(source.text) + ", " + element);
+    emitComment("Store to element of '" + target->value + "'");
+    releaseOperand(index);
+    if (valueNeeded) {
+        return valueReg;
+    }
+    releaseOperand(source);
+    return -1;
+}
+
+// A frame array is added to the symbol table; a global one is already in
+// the data sections. Elements the initializer leaves out are zero, and an
+// array without one is left uninitialized (a global one is zero).
+void CodeGenerator::generateArrayDeclaration(const std::unique_ptr<ASTNode>& node) {
+    auto global = globalArrays.find(node->value);
+    if (global != globalArrays.end() && global->second.declaration == node.get()) {
+        if (global->second.constant || !node->left) return;
+    } else if ((!currentFunction && global != globalArrays.end()) ||
+               !symbolTable.addArray(node->value, node->intValue, ELEMENT_SIZE)) {
+        error("Variable '" + node->value + "' already declared");
+    } else {
+        emitComment("Array '" + node->value + "' declared");
+        if (!node->left) return;
+    }
+
+    ArrayLocation array = findArray(node->value);
+    const auto& initializers = node->left->children;
+    std::vector<long long> values(array.elements, 0);
+    std::vector<bool> computed(array.elements, false);
+    int nonZero = 0;
+    for (size_t i = 0; i < initializers.size(); i++) {
+        computed[i] = !constantValue(initializers[i], values[i]);
+        if (computed[i] || values[i] != 0) nonZero++;
+    }
+
+    // Stores of every element, of the ones not cleared, or of the ones not copied
+    bool storeAll = array.elements <= MAX_STORED_ELEMENTS;
+    bool copy = !storeAll && nonZero > MAX_SPARSE_ELEMENTS;
+    if (copy) {
+        std::string image = generateLabel("array_init_");
+        readOnlyData.push_back(image + ":");
+        for (size_t i = 0; i < values.size(); i += 8) {
+            std::string line = "    .long ";
+            for (size_t j = i; j < values.size() && j < i + 8; j++) {
+                line += (j > i ? ", " : "") + std::to_string(static_cast<int32_t>(values[j]));
+            }
+            readOnlyData.push_back(line);
+        }
+        generateBlockFill(array, image);
+    } else if (!storeAll) {
+        generateBlockFill(array, "");
+    }
+
+    for (int i = 0; i < array.elements; i++) {
+        if (!computed[i] && (copy || (!storeAll && values[i] == 0))) continue;
+        std::string element = elementAt(array, static_cast<long long>(i) * ELEMENT_SIZE);
+        if (computed[i]) {
+            int reg = generateExpression(initializers[i]);
+            emit("movl " + doublewordOperand(getRegisterName(reg)) + ", " + element);
+            freeRegister(reg);
+        } else {
+            emit("movl $" + std::to_string(static_cast<int32_t>(values[i])) + ", " + element);
+        }
+    }
+}
+
+// Clear an array with rep stosq, or copy 'image' over it with rep movsq.
+// The string registers are saved around it while they hold values.
+void CodeGenerator::generateBlockFill(const ArrayLocation& array, const std::string& image) {
+    long long quadwords = (static_cast<long long>(array.elements) * ELEMENT_SIZE + 7) / 8;
+    std::vector<std::string> saved;
+    for (int reg = 0; reg < NUM_REGISTERS; reg++) {
+        std::string name = getRegisterName(reg);
+        if (usedRegisters[reg] && (name == "%rdi" || name == "%rcx" || (name == "%rsi" && !image.empty()))) {
+            saved.push_back(name);
+        }
+    }
+    for (const std::string& reg : saved) {
+        emit("pushq " + reg);
+    }
+    emit("leaq " + elementAt(array, 0) + ", %rdi");
+    if (image.empty()) {
+        emit("xorl %eax, %eax");
+    } else {
+        emit("leaq " + image + "(%rip), %rsi");
+    }
+    emit("movq $" + std::to_string(quadwords) + ", %rcx");
+    emit(image.empty() ? "rep stosq" : "rep movsq");
+    for (auto it = saved.rbegin(); it != saved.rend(); ++it) {
+        emit("popq " + *it);
+    }
+}
+
+// Global arrays and the images of frame array initializers, after the code.
+// Sizes are whole 16-byte units, which block fills may write in full.
+void CodeGenerator::writeArrayData() {
+    auto write = [this](const std::string& section, bool initialized) {
+        bool started = false;
+        for (const auto& entry : globalArrays) {
+            const ASTNode* declaration = entry.second.declaration;
+            bool hasData = entry.second.constant && declaration->left;
+            if (hasData != initialized) continue;
+            if (!started) {
+                *output << "    " << section << std::endl;
+                started = true;
+            }
+            long long bytes = (static_cast<long long>(declaration->intValue) * ELEMENT_SIZE + 15) & ~15LL;
+            long long written = 0;
+            *output << "    .p2align 5" << std::endl;
+            *output << entry.first << ".arr:" << std::endl;
+            if (hasData) {
+                const auto& values = declaration->left->children;
+                for (size_t i = 0; i < values.size(); i += 8) {
+                    *output << "    .long ";
+                    for (size_t j = i; j < values.size() && j < i + 8; j++) {
+                        long long value;
+                        constantValue(values[j], value);
+                        *output << (j > i ? ", " : "") << static_cast<int32_t>(value);
+                    }
+                    *output << std::endl;
+                }
+                written = static_cast<long long>(values.size()) * ELEMENT_SIZE;
+            }
+            if (bytes > written) {
+                *output << "    .zero " << bytes - written << std::endl;
+            }
+        }
+    };
+    write(".data", true);
+    write(".bss", false);
+
+    if (!readOnlyData.empty()) {
+        *output << "    .section .rodata" << std::endl;
+        *output << "    .p2align 4" << std::endl;
+        for (const std::string& line : readOnlyData) {
+            *output << line << std::endl;
+        }
+    }
+}
+
 void CodeGenerator::generateBinaryOp(ASTNodeType op, int leftReg, int rightReg) {
     std::string leftRegName = getRegisterName(leftReg);
     std::string rightRegName = getRegisterName(rightReg);
@@ -148,7 +956,10 @@ void CodeGenerator::generateBinaryOp(ASTNodeType op, int leftReg, int rightReg)
             break;
 
         case ASTNodeType::MULTIPLY:
-            emit("imulq " + rightRegName + ", " + leftRegName);
+        case ASTNodeType::BITAND:
+        case ASTNodeType::BITOR:
+        case ASTNodeType::BITXOR:
+            emit(arithmeticMnemonic(op) + " " + rightRegName + ", " + leftRegName);
             break;
 
         case ASTNodeType::DIVIDE:
@@ -176,82 +987,114 @@ void CodeGenerator::generateBinaryOp(ASTNodeType op, int leftReg, int rightReg)
             break;
 
         case ASTNodeType::EQ:
-            emit("cmpq " + rightRegName + ", " + leftRegName);
-            emit("sete %al");
-            emit("movzbq %al, " + leftRegName);
-            break;
-
         case ASTNodeType::NE:
-            emit("cmpq " + rightRegName + ", " + leftRegName);
-            emit("setne %al");
-            emit("movzbq %al, " + leftRegName);
-            break;
-
         case ASTNodeType::LT:
-            emit("cmpq " + rightRegName + ", " + leftRegName);
-            emit("setl %al");
-            emit("movzbq %al, " + leftRegName);
-            break;
-
         case ASTNodeType::GT:
-            emit("cmpq " + rightRegName + ", " + leftRegName);
-            emit("setg %al");
-            emit("movzbq %al, " + leftRegName);
-            break;
-
         case ASTNodeType::LE:
-            emit("cmpq " + rightRegName + ", " + leftRegName);
-            emit("setle %al");
-            emit("movzbq %al, " + leftRegName);
-            break;
-
         case ASTNodeType::GE:
             emit("cmpq " + rightRegName + ", " + leftRegName);
-            emit("setge %al");
+            emit("set" + conditionCode(op, false) + " %al");
             emit("movzbq %al, " + leftRegName);
             break;
 
-        case ASTNodeType::AND: {
-            // Logical AND - if left is 0, result is 0; otherwise result is right != 0
-            emit("testq " + leftRegName + ", " + leftRegName);
-            std::string andZeroLabel = generateLabel("and_zero_");
-            std::string endLabel = generateLabel("end_and_");
-            emit("jz " + andZeroLabel);  // Jump if left is 0
-
-            // Left is non-zero, so result depends on right
-            emit("testq " + rightRegName + ", " + rightRegName);
-            emit("setnz %al");
-            emit("movzbq %al, " + leftRegName);
-            emit("jmp " + endLabel);
+        default:
+            error("Unsupported binary operation");
+    }
+}
 
-            emitLabel(andZeroLabel);
-            emit("movq $0, " + leftRegName);
-            emitLabel(endLabel);
-            break;
-        }
+bool CodeGenerator::isComparison(ASTNodeType op) {
+    return op == ASTNodeType::EQ || op == ASTNodeType::NE ||
+           op == ASTNodeType::LT || op == ASTNodeType::GT ||
+           op == ASTNodeType::LE || op == ASTNodeType::GE;
+}
 
-        case ASTNodeType::OR: {
-            // Logical OR - if left is non-zero, result is 1; otherwise result is right != 0
-            emit("testq " + leftRegName + ", " + leftRegName);
-            std::string orOneLabel = generateLabel("or_one_");
-            std::string endOrLabel = generateLabel("end_or_");
-            emit("jnz " + orOneLabel);  // Jump if left is non-zero
-
-            // Left is zero, so result depends on right
-            emit("testq " + rightRegName + ", " + rightRegName);
-            emit("setnz %al");
-            emit("movzbq %al, " + leftRegName);
-            emit("jmp " + endOrLabel);
+// Condition-code suffix for setcc/jcc (signed compares), optionally inverted
+std::string CodeGenerator::conditionCode(ASTNodeType op, bool negate) {
+    switch (op) {
+        case ASTNodeType::EQ: return negate ? "ne" : "e";
+        case ASTNodeType::NE: return negate ? "e" : "ne";
+        case ASTNodeType::LT: return negate ? "ge" : "l";
+        case ASTNodeType::GT: return negate ? "le" : "g";
+        case ASTNodeType::LE: return negate ? "g" : "le";
+        case ASTNodeType::GE: return negate ? "l" : "ge";
+        default:
+            error("Not a comparison operator");
+            return "";
+    }
+}
 
-            emitLabel(orOneLabel);
-            emit("movq $1, " + leftRegName);
-            emitLabel(endOrLabel);
-            break;
+// Emit the cmpq for a comparison node and return the condition code that
+// holds when the comparison is true. The caller places its jcc/setcc
+// directly after the cmp so the pair can macro-fuse.
+std::string CodeGenerator::generateCompare(const std::unique_ptr<ASTNode>& node, bool negate) {
+    if (!node->left || !node->right) {
+        error("Comparison missing operands");
+        return "";
+    }
+
+    // cmpq takes its left operand from a register or memory and its right
+    // one from anywhere else, so leaves are compared in place. A left leaf
+    // is only read late if the right side cannot change it.
+    Operand left;
+    if (containsNodeType(node->right, ASTNodeType::ASSIGN) || !leafOperand(node->left, left) ||
+        (!left.memory && left.reg < 0)) {
+        int reg = generateExpression(node->left);
+        left = {getRegisterName(reg), reg, true, false};
+    }
+    Operand right = selectOperand(node->right, !left.memory);
+    emit("cmpq " + right.text + ", " + left.text);
+    releaseOperand(right);
+    releaseOperand(left);
+    return conditionCode(node->type, negate);
+}
+
+// Division and remainder by 2^k use shifts and masks instead of idiv. A
+// dividend the value ranges prove non-negative needs nothing else; other
+// dividends are biased by 2^k - 1 when negative so the result still
+// rounds toward zero.
+int CodeGenerator::generatePowerOfTwoDivision(const std::unique_ptr<ASTNode>& node) {
+    int divisor = node->right->intValue;
+    int shift = 0;
+    while ((1 << shift) < divisor) shift++;
+
+    int reg = generateExpression(node->left);
+    std::string regName = getRegisterName(reg);
+    bool isDivide = node->type == ASTNodeType::DIVIDE;
+
+    if (divisor == 1) {
+        if (!isDivide) emit("movq $0, " + regName);
+        return reg;
+    }
+
+    if (ranges.isNonNegative(node->left.get())) {
+        if (isDivide) {
+            emit("shrq $" + std::to_string(shift) + ", " + regName);
+            emitComment("Divide non-negative value by " + std::to_string(divisor));
+        } else {
+            emit("andq $" + std::to_string(divisor - 1) + ", " + regName);
+            emitComment("Remainder of non-negative value by " + std::to_string(divisor));
         }
+        return reg;
+    }
 
-        default:
-            error("Unsupported binary operation");
+    int biasReg = allocateRegister();
+    std::string biasName = getRegisterName(biasReg);
+    emit("movq " + regName + ", " + biasName);
+    emit("sarq $63, " + biasName);
+    emit("shrq $" + std::to_string(64 - shift) + ", " + biasName);
+    if (isDivide) {
+        emit("addq " + biasName + ", " + regName);
+        emit("sarq $" + std::to_string(shift) + ", " + regName);
+        emitComment("Divide by " + std::to_string(divisor));
+    } else {
+        // x - ((x + bias) & -2^k)
+        emit("addq " + regName + ", " + biasName);
+        emit("andq $" + std::to_string(-divisor) + ", " + biasName);
+        emit("subq " + biasName + ", " + regName);
+        emitComment("Remainder by " + std::to_string(divisor));
     }
+    freeRegister(biasReg);
+    return reg;
 }
 
 void CodeGenerator::generateUnaryOp(ASTNodeType op, int reg) {
@@ -262,6 +1105,10 @@ void CodeGenerator::generateUnaryOp(ASTNodeType op, int reg) {
             emit("negq " + regName);
             break;
 
+        case ASTNodeType::BITNOT:
+            emit("notq " + regName);
+            break;
+
         case ASTNodeType::POSITIVE:
             // No operation needed for unary plus
             break;
@@ -278,12 +1125,189 @@ void CodeGenerator::generateUnaryOp(ASTNodeType op, int reg) {
     }
 }
 
+// Emit a jump to 'target' taken when the condition evaluates to 'jumpIfTrue',
+// falling through otherwise. && and || only evaluate their right operand when
+// the left one does not already decide the outcome.
+void CodeGenerator::generateBranch(const std::unique_ptr<ASTNode>& node, const std::string& target, bool jumpIfTrue,
+                                   double probability) {
+    if (!node) {
+        error("Null condition node");
+        return;
+    }
+
+    int pinnedReg;
+    if (findPinned(node, pinnedReg)) {
+        std::string regName = getRegisterName(pinnedReg);
+        emit("testq " + regName + ", " + regName);
+        emitJump(jumpIfTrue ? "jnz" : "jz", target, probability);
+        return;
+    }
+
+    switch (node->type) {
+        case ASTNodeType::AND: {
+            if (!jumpIfTrue) {
+                // Either operand being false decides the whole condition
+                generateBranch(node->left, target, false, probability);
+                generateBranch(node->right, target, false, probability);
+            } else {
+                std::string skipLabel = generateLabel("and_skip_");
+                generateBranch(node->left, skipLabel, false, 1.0 - probability);
+                generateBranch(node->right, target, true, probability);
+                emitLabel(skipLabel);
+            }
+            break;
+        }
+
+        case ASTNodeType::OR: {
+            if (jumpIfTrue) {
+                // Either operand being true decides the whole condition
+                generateBranch(node->left, target, true, probability);
+                generateBranch(node->right, target, true, probability);
+            } else {
+                std::string skipLabel = generateLabel("or_skip_");
+                generateBranch(node->left, skipLabel, true, 1.0 - probability);
+                generateBranch(node->right, target, false, probability);
+                emitLabel(skipLabel);
+            }
+            break;
+        }
+
+        case ASTNodeType::NOT:
+            generateBranch(node->left, target, !jumpIfTrue, probability);
+            break;
+
+        case ASTNodeType::EQ:
+        case ASTNodeType::NE:
+        case ASTNodeType::LT:
+        case ASTNodeType::GT:
+        case ASTNodeType::LE:
+        case ASTNodeType::GE:
+            emitJump("j" + generateCompare(node, !jumpIfTrue), target, probability);
+            break;
+
+        case ASTNodeType::INTLIT:
+        case ASTNodeType::BOOLLIT: {
+            // Constant condition: either always jump or never jump
+            bool value = node->type == ASTNodeType::INTLIT ? node->intValue != 0 : node->boolValue;
+            if (value == jumpIfTrue) {
+                emitJump("jmp", target);
+            }
+            break;
+        }
+
+        default: {
+            int reg = generateExpression(node);
+            emit("testq " + getRegisterName(reg) + ", " + getRegisterName(reg));
+            emitJump(jumpIfTrue ? "jnz" : "jz", target, probability);
+            freeRegister(reg);
+            break;
+        }
+    }
+}
+
+// Materialize && / || as 0 or 1. The result register is preset to the value
+// the short-circuit paths produce, so only the final operand needs a setcc.
+int CodeGenerator::generateLogicalValue(const std::unique_ptr<ASTNode>& node) {
+    if (!node->left || !node->right) {
+        error("Logical operation missing operands");
+        return -1;
+    }
+
+    bool isAnd = node->type == ASTNodeType::AND;
+    int resultReg = allocateRegister();
+    std::string resultRegName = getRegisterName(resultReg);
+    std::string doneLabel = generateLabel(isAnd ? "and_done_" : "or_done_");
+
+    emitComment(std::string("Logical ") + (isAnd ? "&&" : "||") + " into " + resultRegName);
+    emit(std::string("movq $") + (isAnd ? "0" : "1") + ", " + resultRegName);
+    generateBranch(node->left, doneLabel, !isAnd);
+
+    if (isComparison(node->right->type)) {
+        emit("set" + generateCompare(node->right, false) + " %al");
+    } else {
+        int rightReg = generateExpression(node->right);
+        std::string rightRegName = getRegisterName(rightReg);
+        emit("testq " + rightRegName + ", " + rightRegName);
+        emit("setnz %al");
+        freeRegister(rightReg);
+    }
+    emit("movzbq %al, " + resultRegName);
+
+    emitLabel(doneLabel);
+    return resultReg;
+}
+
+// ?: as a select: when both arms are cheap and can be evaluated
+// unconditionally, both are computed and cmov keeps the one the condition
+// picks, so a data-dependent condition costs no misprediction. Otherwise
+// only the chosen arm runs, behind a branch.
+int CodeGenerator::generateConditional(const std::unique_ptr<ASTNode>& node) {
+    if (!node->condition || !node->left || !node->right) {
+        error("Conditional operation missing operands");
+        return -1;
+    }
+
+    bool select = isSafeExpression(node->left) && isSafeExpression(node->right) &&
+                  !containsNodeType(node->condition, ASTNodeType::ASSIGN) &&
+                  estimateCost(node->left, false) + estimateCost(node->right, false) <= MAX_SELECT_COST;
+
+    if (select) {
+        // The arms are read before the flags are set, and cmov cannot take
+        // an immediate
+        int resultReg = generateExpression(node->left);
+        Operand other = selectOperand(node->right);
+        if (!other.memory && other.reg < 0) {
+            int reg = generateExpression(node->right);
+            other = {getRegisterName(reg), reg, true, false};
+        }
+
+        std::string cc;
+        if (isComparison(node->condition->type)) {
+            cc = generateCompare(node->condition, true);
+        } else {
+            int conditionReg = generateExpression(node->condition);
+            std::string conditionRegName = getRegisterName(conditionReg);
+            emit("testq " + conditionRegName + ", " + conditionRegName);
+            freeRegister(conditionReg);
+            cc = "z";
+        }
+        emit("cmov" + cc + " " + other.text + ", " + getRegisterName(resultReg));
+        releaseOperand(other);
+        return resultReg;
+    }
+
+    int resultReg = allocateRegister();
+    std::string elseLabel = generateLabel("cond_else_");
+    std::string doneLabel = generateLabel("cond_done_");
+
+    generateBranch(node->condition, elseLabel, false);
+    int reg = generateExpression(node->left);
+    emit("movq " + getRegisterName(reg) + ", " + getRegisterName(resultReg));
+    freeRegister(reg);
+    emitJump("jmp", doneLabel);
+
+    emitLabel(elseLabel);
+    reg = generateExpression(node->right);
+    emit("movq " + getRegisterName(reg) + ", " + getRegisterName(resultReg));
+    freeRegister(reg);
+    emitLabel(doneLabel);
+    return resultReg;
+}
+
 int CodeGenerator::generateExpression(const std::unique_ptr<ASTNode>& node) {
     if (!node) {
         error("Null AST node");
         return -1;
     }
 
+    // Loop invariants hoisted into a register only need a copy
+    int pinnedReg;
+    if (findPinned(node, pinnedReg)) {
+        int reg = allocateRegister();
+        emit("movq " + getRegisterName(pinnedReg) + ", " + getRegisterName(reg));
+        return reg;
+    }
+
     switch (node->type) {
         case ASTNodeType::INTLIT: {
             int reg = allocateRegister();
@@ -299,6 +1323,13 @@ int CodeGenerator::generateExpression(const std::unique_ptr<ASTNode>& node) {
             return reg;
         }
 
+        case ASTNodeType::BOOLLIT: {
+            int reg = allocateRegister();
+            loadImmediate(reg, node->boolValue ? 1 : 0);
+            emitComment(std::string("Load boolean literal: ") + (node->boolValue ? "true" : "false"));
+            return reg;
+        }
+
         case ASTNodeType::IDENTIFIER: {
             int reg = allocateRegister();
             loadVariable(reg, node->value);
@@ -311,9 +1342,13 @@ int CodeGenerator::generateExpression(const std::unique_ptr<ASTNode>& node) {
                 return -1;
             }
 
+            if (node->left->type == ASTNodeType::INDEX) {
+                return generateArrayStore(node, true);
+            }
+
             // The left side should be an identifier
             if (node->left->type != ASTNodeType::IDENTIFIER) {
-                error("Left side of assignment must be a variable");
+                error("Left side of assignment must be a variable or array element");
                 return -1;
             }
 
@@ -327,47 +1362,96 @@ int CodeGenerator::generateExpression(const std::unique_ptr<ASTNode>& node) {
             return valueReg;
         }
 
-        // Binary operations
         case ASTNodeType::ADD:
         case ASTNodeType::SUBTRACT:
         case ASTNodeType::MULTIPLY:
-        case ASTNodeType::DIVIDE:
-        case ASTNodeType::MODULO:
+        case ASTNodeType::BITAND:
+        case ASTNodeType::BITOR:
+        case ASTNodeType::BITXOR:
+            if (!node->left || !node->right) {
+                error("Binary operation missing operands");
+                return -1;
+            }
+            return generateArithmetic(node);
+
+        case ASTNodeType::LSHIFT:
+        case ASTNodeType::RSHIFT:
+            if (!node->left || !node->right) {
+                error("Binary operation missing operands");
+                return -1;
+            }
+            return generateShift(node);
+
         case ASTNodeType::EQ:
         case ASTNodeType::NE:
         case ASTNodeType::LT:
         case ASTNodeType::GT:
         case ASTNodeType::LE:
-        case ASTNodeType::GE:
-        case ASTNodeType::AND:
-        case ASTNodeType::OR: {
+        case ASTNodeType::GE: {
+            std::string cc = generateCompare(node, false);
+            int reg = allocateRegister();
+            emit("set" + cc + " %al");
+            emit("movzbq %al, " + getRegisterName(reg));
+            return reg;
+        }
+
+        case ASTNodeType::DIVIDE:
+        case ASTNodeType::MODULO: {
             if (!node->left || !node->right) {
                 error("Binary operation missing operands");
                 return -1;
             }
 
-            int leftReg = generateExpression(node->left);
-            int rightReg = generateExpression(node->right);
+            if (node->right->type == ASTNodeType::INTLIT && node->right->intValue > 0 &&
+                (node->right->intValue & (node->right->intValue - 1)) == 0) {
+                return generatePowerOfTwoDivision(node);
+            }
 
-            emitComment("Binary operation: " +
-                       getRegisterName(leftReg) + " " +
-                       (node->type == ASTNodeType::ADD ? "+" :
-                        node->type == ASTNodeType::SUBTRACT ? "-" :
-                        node->type == ASTNodeType::MULTIPLY ? "*" :
-                        node->type == ASTNodeType::DIVIDE ? "/" :
-                        node->type == ASTNodeType::MODULO ? "%" : "op") + " " +
-                       getRegisterName(rightReg));
+            // A hoisted right operand is used in place, without a copy
+            int leftReg = generateExpression(node->left);
+            int rightReg;
+            bool rightPinned = findPinned(node->right, rightReg);
+            if (!rightPinned) {
+                rightReg = generateExpression(node->right);
+            }
 
+            emitComment("Binary operation: " + getRegisterName(leftReg) +
+                        (node->type == ASTNodeType::DIVIDE ? " / " : " % ") + getRegisterName(rightReg));
             generateBinaryOp(node->type, leftReg, rightReg);
 
-            freeRegister(rightReg);
+            if (!rightPinned) {
+                freeRegister(rightReg);
+            }
             return leftReg;
         }
 
+        // Logical operations short-circuit, so they are lowered to branches
+        case ASTNodeType::AND:
+        case ASTNodeType::OR:
+            return generateLogicalValue(node);
+
+        case ASTNodeType::CONDITIONAL:
+            return generateConditional(node);
+
+        case ASTNodeType::CALL:
+            return generateCall(node);
+
+        // Elements are sign-extended to 64 bits, into the index's register
+        // when it has one of its own
+        case ASTNodeType::INDEX: {
+            Operand index;
+            std::string element = elementOperand(node, index);
+            int reg = index.owned ? index.reg : allocateRegister();
+            emit("movslq " + element + ", " + getRegisterName(reg));
+            emitComment("Load element of '" + node->value + "'");
+            return reg;
+        }
+
         // Unary operations
         case ASTNodeType::NEGATE:
         case ASTNodeType::POSITIVE:
-        case ASTNodeType::NOT: {
+        case ASTNodeType::NOT:
+        case ASTNodeType::BITNOT: {
             if (!node->left) {
                 error("Unary operation missing operand");
                 return -1;
@@ -377,7 +1461,8 @@ int CodeGenerator::generateExpression(const std::unique_ptr<ASTNode>& node) {
 
             emitComment(std::string("Unary operation: ") +
                        (node->type == ASTNodeType::NEGATE ? "-" :
-                        node->type == ASTNodeType::POSITIVE ? "+" : "!") + " " +
+                        node->type == ASTNodeType::POSITIVE ? "+" :
+                        node->type == ASTNodeType::BITNOT ? "~" : "!") + " " +
                        getRegisterName(reg));
 
             generateUnaryOp(node->type, reg);
@@ -395,15 +1480,25 @@ void CodeGenerator::generateStatement(const std::unique_ptr<ASTNode>& node) {
 
     switch (node->type) {
         case ASTNodeType::VAR_DECL: {
-            // Variable declaration - just add to symbol table
+            // Variable declaration - add to symbol table, then store the initializer
             if (!node->value.empty()) {
                 addVariable(node->value);
+                promoteVariable(node.get());
+                if (node->left) {
+                    int reg = generateExpression(node->left);
+                    storeVariable(node->value, reg);
+                    freeRegister(reg);
+                }
             }
             break;
         }
 
+        case ASTNodeType::ARRAY_DECL:
+            generateArrayDeclaration(node);
+            break;
+
         case ASTNodeType::EXPRESSION_STMT: {
-            if (node->left) {
+            if (node->left && !generateAssignmentInPlace(node->left)) {
                 int reg = generateExpression(node->left);
                 freeRegister(reg);
             }
@@ -411,19 +1506,54 @@ void CodeGenerator::generateStatement(const std::unique_ptr<ASTNode>& node) {
         }
 
         case ASTNodeType::COMPOUND_STMT: {
+            symbolTable.enterScope();
             for (const auto& child : node->children) {
                 generateStatement(child);
             }
+            exitScope();
             break;
         }
 
-        // For now, we'll ignore other statement types
-        case ASTNodeType::COUT_STMT:
-        case ASTNodeType::CIN_STMT:
         case ASTNodeType::IF_STMT:
+            generateIfStatement(node);
+            break;
+
         case ASTNodeType::WHILE_STMT:
         case ASTNodeType::FOR_STMT:
-        case ASTNodeType::RETURN_STMT:
+            generateLoop(node);
+            break;
+
+        case ASTNodeType::RETURN_STMT: {
+            if (returnLabel.empty()) {
+                error("Return statement outside of a function body");
+            }
+            if (isTailCall(node->left) && registerNeed(node->left) <= countFreeRegisters()) {
+                generateTailCall(node->left);
+            } else if (node->left) {
+                int reg = generateExpression(node->left);
+                emit("movq " + getRegisterName(reg) + ", %rax");
+                freeRegister(reg);
+            } else {
+                emit("movq $0, %rax");
+            }
+            emitJump("jmp", returnLabel);
+            break;
+        }
+
+        case ASTNodeType::SWITCH_STMT:
+            generateSwitch(node);
+            break;
+
+        case ASTNodeType::BREAK_STMT:
+            if (breakLabels.empty()) {
+                error("Break statement outside of a switch");
+            }
+            emitJump("jmp", breakLabels.back());
+            break;
+
+        // For now, we'll ignore other statement types
+        case ASTNodeType::COUT_STMT:
+        case ASTNodeType::CIN_STMT:
             emitComment("Statement type not yet implemented: " + std::to_string(static_cast<int>(node->type)));
             break;
 
@@ -433,72 +1563,1646 @@ void CodeGenerator::generateStatement(const std::unique_ptr<ASTNode>& node) {
     }
 }
 
-void CodeGenerator::generateProgram(const std::unique_ptr<ASTNode>& node) {
-    if (!node || node->type != ASTNodeType::PROGRAM) {
-        error("Expected program node");
-        return;
+bool CodeGenerator::containsReturn(const std::unique_ptr<ASTNode>& node) {
+    if (!node) return false;
+    if (node->type == ASTNodeType::RETURN_STMT) return true;
+    if (containsReturn(node->left) || containsReturn(node->right)) return true;
+    for (const auto& child : node->children) {
+        if (containsReturn(child)) return true;
     }
+    return false;
+}
 
-    generatePreamble();
-
-    // If the program has children (statements), generate them
-    if (!node->children.empty()) {
-        // For a program with statements, evaluate the last expression statement
-        // and use its result as the exit code
-        int lastExpressionReg = -1;
+// Static branch prediction for an if statement (Ball-Larus heuristics):
+// an arm that returns is an early-exit/error path and unlikely, and
+// equality tests or comparisons against zero are usually false
+double CodeGenerator::predictThenProbability(const std::unique_ptr<ASTNode>& node) {
+    bool thenReturns = containsReturn(node->left);
+    bool elseReturns = containsReturn(node->right);
+    if (thenReturns != elseReturns) {
+        return thenReturns ? 1.0 - RETURN_AVOID_PROBABILITY : RETURN_AVOID_PROBABILITY;
+    }
 
-        for (const auto& child : node->children) {
-            if (child->type == ASTNodeType::EXPRESSION_STMT && child->left) {
-                // Free the previous expression result if any
-                if (lastExpressionReg != -1) {
-                    freeRegister(lastExpressionReg);
-                }
-                // Generate the expression and keep its result
-                lastExpressionReg = generateExpression(child->left);
-            } else {
-                generateStatement(child);
-            }
+    const auto& cond = node->condition;
+    if (cond) {
+        bool againstZero = cond->right && cond->right->type == ASTNodeType::INTLIT &&
+                           cond->right->intValue == 0;
+        switch (cond->type) {
+            case ASTNodeType::EQ:
+                return 1.0 - OPCODE_PROBABILITY;
+            case ASTNodeType::NE:
+                return OPCODE_PROBABILITY;
+            case ASTNodeType::LT:
+            case ASTNodeType::LE:
+                if (againstZero) return 1.0 - OPCODE_PROBABILITY;
+                break;
+            case ASTNodeType::GT:
+            case ASTNodeType::GE:
+                if (againstZero) return OPCODE_PROBABILITY;
+                break;
+            default:
+                break;
         }
+    }
+    return 0.5;
+}
 
-        // Use the last expression's result as exit code, or 0 if none
-        if (lastExpressionReg != -1) {
-            emit("movq " + getRegisterName(lastExpressionReg) + ", %rax");
-            freeRegister(lastExpressionReg);
-            generatePostamble(-1);  // -1 means exit code is already in %rax
-        } else {
-            generatePostamble(0);
+void CodeGenerator::generateIfStatement(const std::unique_ptr<ASTNode>& node) {
+    std::string elseLabel = generateLabel("else_");
+    std::string endLabel = node->right ? generateLabel("end_if_") : elseLabel;
+
+    emitComment("If statement");
+    generateBranch(node->condition, elseLabel, false, 1.0 - predictThenProbability(node));
+    generateStatement(node->left);
+
+    if (node->right) {
+        emitJump("jmp", endLabel);
+        emitLabel(elseLabel);
+        generateStatement(node->right);
+    }
+    emitLabel(endLabel);
+}
+
+// Loops use a rotated layout: a guard test on entry, then the body followed
+// by the condition at the bottom, so each iteration takes only the backward
+// branch. FOR_STMT children are [init, update], either of which may be null.
+void CodeGenerator::generateLoop(const std::unique_ptr<ASTNode>& node) {
+    bool isFor = node->type == ASTNodeType::FOR_STMT;
+    std::string bodyLabel = generateLabel("loop_body_");
+    std::string endLabel = generateLabel("loop_end_");
+
+    symbolTable.enterScope();
+    emitComment(isFor ? "For loop" : "While loop");
+
+    if (isFor && !node->children.empty()) {
+        generateStatement(node->children[0]);
+    }
+
+    // Whole vectors of iterations run first; the loop below does the rest
+    if (isFor && vectorISA != VectorISA::NONE) {
+        generateVectorLoop(node);
+    }
+
+    if (node->condition) {
+        generateBranch(node->condition, endLabel, false, 1.0 - LOOP_TAKEN_PROBABILITY);
+    }
+
+    // The preheader runs once the guard has passed
+    std::vector<std::string> hoisted = hoistLoopInvariants(node);
+
+    emitLabel(bodyLabel);
+    generateStatement(node->left);
+
+    if (isFor && node->children.size() > 1 && node->children[1]) {
+        int reg = generateExpression(node->children[1]);
+        freeRegister(reg);
+    }
+
+    if (node->condition) {
+        generateBranch(node->condition, bodyLabel, true, LOOP_TAKEN_PROBABILITY);
+    } else {
+        emitJump("jmp", bodyLabel);
+    }
+    emitLabel(endLabel);
+
+    for (const std::string& key : hoisted) {
+        freeRegister(pinnedValues[key]);
+        pinnedValues.erase(key);
+    }
+    exitScope();
+}
+
+// Loop vectorization
+
+std::string CodeGenerator::vectorRegister(int reg, bool full) {
+    return (full && vectorISA == VectorISA::AVX2 ? "%ymm" : "%xmm") + std::to_string(reg);
+}
+
+int CodeGenerator::allocateVectorRegister() {
+    for (int reg = 0; reg < NUM_VECTOR_REGISTERS; reg++) {
+        if (!usedVectorRegisters[reg]) {
+            usedVectorRegisters[reg] = true;
+            return reg;
         }
+    }
+    error("Out of vector registers");
+    return -1;
+}
+
+// Copy a 32-bit register or memory operand into every lane
+void CodeGenerator::broadcast(const std::string& source, int reg) {
+    if (vectorISA == VectorISA::AVX2) {
+        emit("vmovd " + source + ", " + vectorRegister(reg, false));
+        emit("vpbroadcastd " + vectorRegister(reg, false) + ", " + vectorRegister(reg));
     } else {
-        // If it's just an expression, evaluate it and exit with its value
-        emitComment("Single expression program");
-        if (node->left) {
-            int reg = generateExpression(node->left);
-            emit("movq " + getRegisterName(reg) + ", %rax");  // Move result to return value
-            freeRegister(reg);
-            generatePostamble(-1);  // -1 means exit code is already in %rax
-        } else {
-            generatePostamble(0);
+        emit("movd " + source + ", " + vectorRegister(reg));
+        emit("pshufd $0, " + vectorRegister(reg) + ", " + vectorRegister(reg));
+    }
+}
+
+// dest = dest op source; AVX2 uses the three-operand VEX form
+void CodeGenerator::generateVectorOp(const std::string& op, int source, int dest) {
+    if (vectorISA == VectorISA::AVX2) {
+        emit("v" + op + " " + vectorRegister(source) + ", " + vectorRegister(dest) + ", " + vectorRegister(dest));
+    } else {
+        emit(op + " " + vectorRegister(source) + ", " + vectorRegister(dest));
+    }
+}
+
+// Vector registers an element-wise expression needs besides the broadcast
+// invariants. SSE2 has no 32-bit multiply; its replacement needs two more.
+int CodeGenerator::vectorNeed(const std::unique_ptr<ASTNode>& node) {
+    switch (node->type) {
+        case ASTNodeType::INDEX:
+            return 1;
+        case ASTNodeType::POSITIVE:
+            return vectorNeed(node->left);
+        case ASTNodeType::NEGATE:
+        case ASTNodeType::BITNOT:
+            return std::max(vectorNeed(node->left), 1) + 1;
+        case ASTNodeType::LSHIFT:
+        case ASTNodeType::RSHIFT:
+            return std::max(vectorNeed(node->left), 1);
+        case ASTNodeType::ADD:
+        case ASTNodeType::SUBTRACT:
+        case ASTNodeType::MULTIPLY:
+        case ASTNodeType::BITAND:
+        case ASTNodeType::BITOR:
+        case ASTNodeType::BITXOR: {
+            int right = vectorNeed(node->right);
+            int need = std::max(std::max(vectorNeed(node->left), 1), 1 + right);
+            if (node->type == ASTNodeType::MULTIPLY && vectorISA == VectorISA::SSE2) {
+                need = std::max(need, 2 + std::max(right, 1) + 1);
+            }
+            return need;
         }
+        default:
+            return 0;
     }
 }
 
-void CodeGenerator::generatePreamble() {
-    *output << "# Generated by C++ Compiler - Code Generation Phase" << std::endl;
-    *output << "# x86-64 Assembly Output for Windows (MinGW64)" << std::endl;
-    *output << std::endl;
+// Scalars and literals of the stored values, each broadcast once before
+// the loop, and whether the values read the counter itself
+void CodeGenerator::collectVectorInvariants(const std::unique_ptr<ASTNode>& node, const std::string& counter,
+                                            std::map<std::string, const std::unique_ptr<ASTNode>*>& invariants,
+                                            bool& readsCounter) {
+    switch (node->type) {
+        case ASTNodeType::IDENTIFIER:
+            if (node->value == counter) {
+                readsCounter = true;
+                return;
+            }
+            invariants[expressionKey(node)] = &node;
+            return;
+        case ASTNodeType::INTLIT:
+        case ASTNodeType::BOOLLIT:
+            invariants[expressionKey(node)] = &node;
+            return;
+        case ASTNodeType::INDEX:
+            return;
+        case ASTNodeType::LSHIFT:
+        case ASTNodeType::RSHIFT:
+            // Shift counts are immediates
+            collectVectorInvariants(node->left, counter, invariants, readsCounter);
+            return;
+        default:
+            if (node->left) collectVectorInvariants(node->left, counter, invariants, readsCounter);
+            if (node->right) collectVectorInvariants(node->right, counter, invariants, readsCounter);
+            return;
+    }
+}
 
-    // Windows-compatible assembly using main instead of _start
-    *output << ".text" << std::endl;
-    *output << ".globl main" << std::endl;
-    *output << std::endl;
+// Key of the register addressing an array in a vector loop: global arrays
+// and offsets by a variable need one, frame arrays are addressed from %rbp
+static std::string vectorBaseKey(const VectorAccess& access) {
+    return access.array + (access.variable.empty() ? "" : (access.negated ? "-" : "+") + access.variable);
+}
 
-    emitLabel("main");
-    emitComment("Program start");
+std::string CodeGenerator::vectorElement(const VectorAccess& access, int displacementBytes) {
+    long long displacement = access.offset * ELEMENT_SIZE + displacementBytes;
+    std::string base = "%rbp";
+    auto it = vectorBases.find(vectorBaseKey(access));
+    if (it != vectorBases.end()) {
+        base = getRegisterName(it->second);
+    } else {
+        displacement += findArray(access.array).offset;
+    }
+    return (displacement != 0 ? std::to_string(displacement) : "") + "(" + base + "," +
+           getRegisterName(vectorIndex) + "," + std::to_string(ELEMENT_SIZE) + ")";
+}
 
-    // Set up stack frame for Windows calling convention
-    emit("pushq %rbp");
-    emit("movq %rsp, %rbp");
-    emit("subq $32, %rsp");  // Shadow space for Windows x64 calling convention
+// The move of a vector of elements, aligned for those the peel aligned
+std::string CodeGenerator::vectorMove(const VectorAccess& access) {
+    bool aligned = vectorAligned && vectorAligned->array == access.array && access.variable.empty() &&
+                   vectorAligned->variable.empty() && vectorAligned->offset == access.offset;
+    return std::string(vectorISA == VectorISA::AVX2 ? "v" : "") + (aligned ? "movdqa " : "movdqu ");
+}
+
+// Compute a stored value for every lane. Invariants and the counter's lanes
+// are returned in their own registers, which the caller must not change.
+int CodeGenerator::generateVectorExpression(const std::unique_ptr<ASTNode>& node, const std::string& counter) {
+    bool avx = vectorISA == VectorISA::AVX2;
+    auto owned = [this](int reg) {
+        if (reg == counterLanes) return false;
+        for (const auto& entry : vectorInvariants) {
+            if (entry.second == reg) return false;
+        }
+        return true;
+    };
+
+    switch (node->type) {
+        case ASTNodeType::INDEX: {
+            VectorAccess access{node->value, 0, "", false, 0, false};
+            long long coefficient = 0;
+            LoopVectorizer::linearIndex(node->left, counter, 1, coefficient, access);
+            int reg = allocateVectorRegister();
+            emit(vectorMove(access) + vectorElement(access) + ", " + vectorRegister(reg));
+            return reg;
+        }
+
+        case ASTNodeType::IDENTIFIER:
+            if (node->value == counter) {
+                return counterLanes;
+            }
+            return vectorInvariants[expressionKey(node)];
+
+        case ASTNodeType::INTLIT:
+        case ASTNodeType::BOOLLIT:
+            return vectorInvariants[expressionKey(node)];
+
+        case ASTNodeType::POSITIVE:
+            return generateVectorExpression(node->left, counter);
+
+        case ASTNodeType::NEGATE: {
+            int value = generateVectorExpression(node->left, counter);
+            int reg = allocateVectorRegister();
+            generateVectorOp("pxor", reg, reg);
+            generateVectorOp("psubd", value, reg);
+            if (owned(value)) usedVectorRegisters[value] = false;
+            return reg;
+        }
+
+        // Comparing a register with itself sets every bit
+        case ASTNodeType::BITNOT: {
+            int value = generateVectorExpression(node->left, counter);
+            int reg = allocateVectorRegister();
+            generateVectorOp("pcmpeqd", reg, reg);
+            generateVectorOp("pxor", value, reg);
+            if (owned(value)) usedVectorRegisters[value] = false;
+            return reg;
+        }
+
+        case ASTNodeType::LSHIFT:
+        case ASTNodeType::RSHIFT: {
+            int value = generateVectorExpression(node->left, counter);
+            int reg = owned(value) ? value : allocateVectorRegister();
+            std::string op = node->type == ASTNodeType::LSHIFT ? "pslld $" : "psrad $";
+            std::string count = std::to_string(node->right->intValue & 63);
+            if (avx) {
+                emit("v" + op + count + ", " + vectorRegister(value) + ", " + vectorRegister(reg));
+            } else {
+                if (reg != value) emit("movdqa " + vectorRegister(value) + ", " + vectorRegister(reg));
+                emit(op + count + ", " + vectorRegister(reg));
+            }
+            return reg;
+        }
+
+        default: {
+            int left = generateVectorExpression(node->left, counter);
+            if (!owned(left)) {
+                int copy = allocateVectorRegister();
+                emit((avx ? "vmovdqa " : "movdqa ") + vectorRegister(left) + ", " + vectorRegister(copy));
+                left = copy;
+            }
+            int right = generateVectorExpression(node->right, counter);
+
+            if (node->type == ASTNodeType::ADD) {
+                generateVectorOp("paddd", right, left);
+            } else if (node->type == ASTNodeType::SUBTRACT) {
+                generateVectorOp("psubd", right, left);
+            } else if (node->type != ASTNodeType::MULTIPLY) {
+                generateVectorOp(node->type == ASTNodeType::BITAND ? "pand" :
+                                 node->type == ASTNodeType::BITOR ? "por" : "pxor", right, left);
+            } else if (avx) {
+                generateVectorOp("pmulld", right, left);
+            } else {
+                // Products of the even lanes and of the odd lanes, interleaved
+                int odd = allocateVectorRegister();
+                int oddRight = allocateVectorRegister();
+                emit("pshufd $0xf5, " + vectorRegister(left) + ", " + vectorRegister(odd));
+                emit("pmuludq " + vectorRegister(right) + ", " + vectorRegister(left));
+                emit("pshufd $0xf5, " + vectorRegister(right) + ", " + vectorRegister(oddRight));
+                emit("pmuludq " + vectorRegister(oddRight) + ", " + vectorRegister(odd));
+                emit("pshufd $0x08, " + vectorRegister(left) + ", " + vectorRegister(left));
+                emit("pshufd $0x08, " + vectorRegister(odd) + ", " + vectorRegister(odd));
+                emit("punpckldq " + vectorRegister(odd) + ", " + vectorRegister(left));
+                usedVectorRegisters[odd] = false;
+                usedVectorRegisters[oddRight] = false;
+            }
+            if (owned(right)) usedVectorRegisters[right] = false;
+            return left;
+        }
+    }
+}
+
+// dest = min or max of dest and source in each 32-bit lane. SSE2 has no
+// such instruction; the lanes where source wins are selected with a
+// comparison mask. Clobbers source.
+void CodeGenerator::generateVectorMinMax(bool max, int source, int dest) {
+    if (vectorISA == VectorISA::AVX2) {
+        generateVectorOp(max ? "pmaxsd" : "pminsd", source, dest);
+        return;
+    }
+    int mask = allocateVectorRegister();
+    emit("movdqa " + vectorRegister(max ? source : dest) + ", " + vectorRegister(mask));
+    emit("pcmpgtd " + vectorRegister(max ? dest : source) + ", " + vectorRegister(mask));
+    emit("pxor " + vectorRegister(dest) + ", " + vectorRegister(source));
+    emit("pand " + vectorRegister(mask) + ", " + vectorRegister(source));
+    emit("pxor " + vectorRegister(source) + ", " + vectorRegister(dest));
+    usedVectorRegisters[mask] = false;
+}
+
+void CodeGenerator::vectorShuffle(const std::string& pattern, int source, int dest) {
+    emit(std::string(vectorISA == VectorISA::AVX2 ? "vpshufd $" : "pshufd $") + pattern + ", " +
+         vectorRegister(source) + ", " + vectorRegister(dest));
+}
+
+// Fold the vector at 'copy' vectors past the counter into a reduction's
+// accumulators. Sums are kept in 64-bit lanes, as the scalar is, with a
+// pair of accumulators per vector.
+void CodeGenerator::generateReductionStep(const VectorReduction& reduction, const VectorAccess& access, int copy,
+                                          const std::vector<int>& accumulators) {
+    int lanes = vectorLanes(vectorISA);
+    std::string element = vectorElement(access, copy * lanes * ELEMENT_SIZE);
+
+    if (reduction.kind != ReductionKind::SUM) {
+        bool max = reduction.kind == ReductionKind::MAX;
+        bool bitOr = reduction.kind == ReductionKind::OR;
+        if (vectorISA == VectorISA::AVX2) {
+            emit(std::string(bitOr ? "vpor " : max ? "vpmaxsd " : "vpminsd ") + element + ", " +
+                 vectorRegister(accumulators[copy]) + ", " + vectorRegister(accumulators[copy]));
+            return;
+        }
+        int value = allocateVectorRegister();
+        emit(vectorMove(access) + element + ", " + vectorRegister(value));
+        if (bitOr) {
+            generateVectorOp("por", value, accumulators[copy]);
+        } else {
+            generateVectorMinMax(max, value, accumulators[copy]);
+        }
+        usedVectorRegisters[value] = false;
+        return;
+    }
+
+    std::string op = reduction.negated ? "psubq" : "paddq";
+    int low = allocateVectorRegister();
+    int high = allocateVectorRegister();
+    if (vectorISA == VectorISA::AVX2) {
+        emit("vpmovsxdq " + element + ", " + vectorRegister(low));
+        emit("vpmovsxdq " + vectorElement(access, copy * lanes * ELEMENT_SIZE + 16) + ", " + vectorRegister(high));
+    } else {
+        int sign = allocateVectorRegister();
+        emit(vectorMove(access) + element + ", " + vectorRegister(low));
+        emit("pxor " + vectorRegister(sign) + ", " + vectorRegister(sign));
+        emit("pcmpgtd " + vectorRegister(low) + ", " + vectorRegister(sign));
+        emit("movdqa " + vectorRegister(low) + ", " + vectorRegister(high));
+        emit("punpckldq " + vectorRegister(sign) + ", " + vectorRegister(low));
+        emit("punpckhdq " + vectorRegister(sign) + ", " + vectorRegister(high));
+        usedVectorRegisters[sign] = false;
+    }
+    generateVectorOp(op, low, accumulators[2 * copy]);
+    generateVectorOp(op, high, accumulators[2 * copy + 1]);
+    usedVectorRegisters[low] = false;
+    usedVectorRegisters[high] = false;
+}
+
+// Combine a reduction's accumulators pairwise, then the lanes of the last
+// one, and fold the result into the scalar. The or of sign-extended
+// elements is the sign extension of their 32-bit or, so ors stay in 32-bit
+// lanes like minimums and maximums.
+void CodeGenerator::finishReduction(const VectorReduction& reduction, const std::vector<int>& accumulators) {
+    bool avx = vectorISA == VectorISA::AVX2;
+    bool sum = reduction.kind == ReductionKind::SUM;
+    bool max = reduction.kind == ReductionKind::MAX;
+    bool bitOr = reduction.kind == ReductionKind::OR;
+    auto combine = [&](int source, int dest) {
+        if (sum) {
+            generateVectorOp("paddq", source, dest);
+        } else if (bitOr) {
+            generateVectorOp("por", source, dest);
+        } else {
+            generateVectorMinMax(max, source, dest);
+        }
+    };
+    size_t count = accumulators.size();
+    for (size_t step = 1; step < count; step *= 2) {
+        for (size_t k = 0; k + step < count; k += 2 * step) {
+            combine(accumulators[k + step], accumulators[k]);
+        }
+    }
+
+    int result = accumulators[0];
+    int other = allocateVectorRegister();
+    if (avx) {
+        emit("vextracti128 $1, " + vectorRegister(result) + ", " + vectorRegister(other, false));
+        combine(other, result);
+    }
+    vectorShuffle("0x4e", result, other);
+    combine(other, result);
+    if (sum) {
+        emit((avx ? "vmovq " : "movq ") + vectorRegister(result, false) + ", %rax");
+    } else {
+        vectorShuffle("0xb1", result, other);
+        combine(other, result);
+        emit((avx ? "vmovd " : "movd ") + vectorRegister(result, false) + ", %eax");
+        emit("movslq %eax, %rax");
+    }
+    usedVectorRegisters[other] = false;
+
+    Symbol* symbol = findVariable(reduction.variable);
+    int reg = symbol->reg >= 0 ? symbol->reg : allocateRegister();
+    std::string name = getRegisterName(reg);
+    if (symbol->reg < 0) {
+        loadVariable(reg, reduction.variable);
+    }
+    if (sum) {
+        emit("addq %rax, " + name);
+    } else if (bitOr) {
+        emit("orq %rax, " + name);
+    } else {
+        emit("cmpq %rax, " + name);
+        emit((max ? "cmovl %rax, " : "cmovg %rax, ") + name);
+    }
+    if (symbol->reg < 0) {
+        storeVariable(reduction.variable, reg);
+        freeRegister(reg);
+    }
+}
+
+// Run whole vectors of a loop's iterations, leaving the counter at the
+// first iteration left for the scalar loop. Run-time checks and loops too
+// short for a vector skip to the scalar loop. Scalar iterations are peeled
+// first until the first stored array (or the first element read) is
+// aligned for the vector's width. Reductions handle REDUCTION_VECTORS
+// vectors per iteration, each into its own accumulators, so the
+// accumulations do not wait on one another.
+void CodeGenerator::generateVectorLoop(const std::unique_ptr<ASTNode>& node) {
+    int lanes = vectorLanes(vectorISA);
+    bool avx = vectorISA == VectorISA::AVX2;
+    VectorLoopPlan plan;
+    if (!LoopVectorizer::analyze(node, lanes, plan)) {
+        return;
+    }
+    Symbol* counter = findVariable(plan.counter);
+    if (!counter->initialized) {
+        return;
+    }
+
+    // Vector registers: the broadcast invariants, the counter's lanes and
+    // their step, the reductions' accumulators and the values' temporaries.
+    // General registers: the limit, the counter, the peel bound, the array
+    // bases, the reduced scalars as they are folded, and what the peeled
+    // scalar iterations need.
+    std::map<std::string, const std::unique_ptr<ASTNode>*> invariants;
+    std::map<std::string, const VectorAccess*> bases;
+    bool readsCounter = false;
+    int vectorTemporaries = plan.reductions.empty() ? 0 : 3;
+    int accumulatorCount = 0;
+    for (const ASTNode* store : plan.stores) {
+        collectVectorInvariants(store->right, plan.counter, invariants, readsCounter);
+        vectorTemporaries = std::max(vectorTemporaries, vectorNeed(store->right));
+    }
+    for (const VectorReduction& reduction : plan.reductions) {
+        if (!findVariable(reduction.variable)->initialized) {
+            return;
+        }
+        accumulatorCount += REDUCTION_VECTORS * (reduction.kind == ReductionKind::SUM ? 2 : 1);
+    }
+    for (const VectorAccess& access : plan.accesses) {
+        if (!access.variable.empty() || !findArray(access.array).label.empty()) {
+            bases[vectorBaseKey(access)] = &access;
+        }
+    }
+    int vectorRegisters = static_cast<int>(invariants.size()) + (readsCounter ? 2 : 0) + accumulatorCount +
+                          vectorTemporaries;
+    int scalarRegisters = std::max(2 + registerNeed(node->left),
+                                   2 + static_cast<int>(bases.size()) + (counter->reg < 0 ? 1 : 0));
+    if (vectorRegisters > NUM_VECTOR_REGISTERS || scalarRegisters > countFreeRegisters()) {
+        return;
+    }
+    int step = lanes * (plan.reductions.empty() ? 1 : REDUCTION_VECTORS);
+
+    std::string skipLabel = generateLabel("vector_skip_");
+    std::string peelLabel = generateLabel("vector_peel_");
+    std::string peelTestLabel = generateLabel("vector_peel_test_");
+    std::string bodyLabel = generateLabel("vector_body_");
+    std::string doneLabel = generateLabel("vector_done_");
+    emitComment("Vector loop: " + std::to_string(step) + " iterations at a time");
+
+    // The last counter value a whole vector can start at
+    int limit = allocateRegister();
+    std::string limitName = getRegisterName(limit);
+    if (plan.bound->type == ASTNodeType::INTLIT) {
+        emit("movq $" + std::to_string(plan.bound->intValue) + ", " + limitName);
+    } else {
+        loadVariable(limit, plan.bound->value);
+    }
+    emit("subq $" + std::to_string(step - (plan.inclusive ? 1 : 0)) + ", " + limitName);
+
+    // Distances between stored and read elements known only now
+    for (const VectorCheck& check : plan.checks) {
+        const VectorAccess& access = plan.accesses[check.access];
+        std::string okLabel = generateLabel("vector_ok_");
+        Operand variable;
+        leafOperand(makeIdentifier(access.variable), variable);
+        emit("movq " + variable.text + ", %rax");
+        if (access.negated) {
+            emit("negq %rax");
+        }
+        if (access.offset != 0) {
+            emit("addq $" + std::to_string(access.offset) + ", %rax");
+        }
+        emit(check.positiveAllowed ? "cmpq $0, %rax" : "testq %rax, %rax");
+        emitJump(check.positiveAllowed ? "jge" : "je", okLabel);
+        emit("cmpq $" + std::to_string(-lanes) + ", %rax");
+        emitJump("jg", skipLabel);
+        emitLabel(okLabel);
+    }
+
+    std::string counterOperand = counter->reg >= 0 ? getRegisterName(counter->reg)
+                                                   : std::to_string(counter->offset) + "(%rbp)";
+    emit("cmpq " + limitName + ", " + counterOperand);
+    emitJump("jg", skipLabel, 1.0 - LOOP_TAKEN_PROBABILITY);
+
+    // Scalar iterations until the first stored element is aligned
+    vectorAligned = nullptr;
+    for (const VectorAccess& access : plan.accesses) {
+        if (access.store) {
+            vectorAligned = &access;
+            break;
+        }
+        if (!vectorAligned && access.variable.empty()) {
+            vectorAligned = &access;
+        }
+    }
+    if (vectorAligned) {
+        ArrayLocation target = findArray(vectorAligned->array);
+        long long displacement = vectorAligned->offset * ELEMENT_SIZE;
+        int peel = allocateRegister();
+        std::string peelName = getRegisterName(peel);
+        emit("movq " + counterOperand + ", " + peelName);
+        if (target.label.empty()) {
+            emit("leaq " + std::to_string(target.offset + displacement) + "(%rbp," + peelName + ",4), " + peelName);
+        } else {
+            emit("leaq " + target.label + "(%rip), %rax");
+            emit("leaq " + std::to_string(displacement) + "(%rax," + peelName + ",4), " + peelName);
+        }
+        emit("negq " + peelName);
+        emit("shrq $2, " + peelName);
+        emit("andq $" + std::to_string(lanes - 1) + ", " + peelName);
+        emit("addq " + counterOperand + ", " + peelName);
+        emitJump("jmp", peelTestLabel);
+        emitLabel(peelLabel);
+        generateStatement(node->left);
+        freeRegister(generateExpression(node->children[1]));
+        emitLabel(peelTestLabel);
+        emit("cmpq " + peelName + ", " + counterOperand);
+        emitJump("jl", peelLabel);
+        freeRegister(peel);
+    }
+
+    // Preheader: the counter, array bases and broadcast invariants
+    vectorIndex = counter->reg >= 0 ? counter->reg : allocateRegister();
+    std::string indexName = getRegisterName(vectorIndex);
+    if (counter->reg < 0) {
+        loadVariable(vectorIndex, plan.counter);
+    }
+    emit("cmpq " + limitName + ", " + indexName);
+    emitJump("jg", doneLabel, 1.0 - LOOP_TAKEN_PROBABILITY);
+
+    for (const auto& entry : bases) {
+        const VectorAccess& access = *entry.second;
+        ArrayLocation array = findArray(access.array);
+        int reg = allocateRegister();
+        std::string name = getRegisterName(reg);
+        vectorBases[entry.first] = reg;
+        if (access.variable.empty()) {
+            emit("leaq " + array.label + "(%rip), " + name);
+            continue;
+        }
+        Operand variable;
+        leafOperand(makeIdentifier(access.variable), variable);
+        emit("movq " + variable.text + ", %rax");
+        if (access.negated) {
+            emit("negq %rax");
+        }
+        if (array.label.empty()) {
+            emit("leaq " + std::to_string(array.offset) + "(%rbp,%rax,4), " + name);
+        } else {
+            emit("leaq " + array.label + "(%rip), " + name);
+            emit("leaq (" + name + ",%rax,4), " + name);
+        }
+    }
+    for (const auto& entry : invariants) {
+        int reg = allocateVectorRegister();
+        vectorInvariants[entry.first] = reg;
+        Operand operand;
+        leafOperand(*entry.second, operand);
+        if (operand.reg < 0 && !operand.memory) {
+            emit("movl " + operand.text + ", %eax");
+            broadcast("%eax", reg);
+        } else {
+            broadcast(operand.memory ? operand.text : doublewordOperand(operand.text), reg);
+        }
+    }
+    int stepLanes = -1;
+    if (readsCounter) {
+        std::string iota = generateLabel("vector_iota_");
+        std::string values;
+        for (int lane = 0; lane < lanes; lane++) {
+            values += (lane > 0 ? ", " : "") + std::to_string(lane);
+        }
+        readOnlyData.push_back("    .p2align 5");
+        readOnlyData.push_back(iota + ":");
+        readOnlyData.push_back("    .long " + values);
+
+        counterLanes = allocateVectorRegister();
+        stepLanes = allocateVectorRegister();
+        broadcast(doublewordOperand(indexName), counterLanes);
+        if (avx) {
+            emit("vpaddd " + iota + "(%rip), " + vectorRegister(counterLanes) + ", " + vectorRegister(counterLanes));
+        } else {
+            emit("paddd " + iota + "(%rip), " + vectorRegister(counterLanes));
+        }
+        emit("movl $" + std::to_string(lanes) + ", %eax");
+        broadcast("%eax", stepLanes);
+    }
+
+    // Accumulators start at the reduction's identity
+    std::vector<std::vector<int>> accumulators;
+    for (const VectorReduction& reduction : plan.reductions) {
+        std::vector<int> regs;
+        for (int k = 0; k < REDUCTION_VECTORS * (reduction.kind == ReductionKind::SUM ? 2 : 1); k++) {
+            regs.push_back(allocateVectorRegister());
+        }
+        if (reduction.kind == ReductionKind::SUM || reduction.kind == ReductionKind::OR) {
+            for (int reg : regs) {
+                generateVectorOp("pxor", reg, reg);
+            }
+        } else {
+            emit(reduction.kind == ReductionKind::MIN ? "movl $2147483647, %eax" : "movl $-2147483648, %eax");
+            broadcast("%eax", regs[0]);
+            for (size_t k = 1; k < regs.size(); k++) {
+                emit((avx ? "vmovdqa " : "movdqa ") + vectorRegister(regs[0]) + ", " + vectorRegister(regs[k]));
+            }
+        }
+        accumulators.push_back(regs);
+    }
+
+    emitLabel(bodyLabel);
+    for (const VectorAccess& access : plan.accesses) {
+        if (!access.store) continue;
+        const ASTNode* store = plan.stores[access.statement];
+        int value = generateVectorExpression(store->right, plan.counter);
+        emit(vectorMove(access) + vectorRegister(value) + ", " + vectorElement(access));
+        emitComment("Store a vector of '" + access.array + "'");
+        if (value != counterLanes && !vectorInvariants.count(expressionKey(store->right))) {
+            usedVectorRegisters[value] = false;
+        }
+    }
+    for (int copy = 0; copy < REDUCTION_VECTORS && !plan.reductions.empty(); copy++) {
+        for (size_t r = 0; r < plan.reductions.size(); r++) {
+            const VectorReduction& reduction = plan.reductions[r];
+            generateReductionStep(reduction, plan.accesses[reduction.access], copy, accumulators[r]);
+        }
+    }
+    if (readsCounter) {
+        generateVectorOp("paddd", stepLanes, counterLanes);
+    }
+    emit("addq $" + std::to_string(step) + ", " + indexName);
+    emit("cmpq " + limitName + ", " + indexName);
+    emitJump("jle", bodyLabel, LOOP_TAKEN_PROBABILITY);
+    for (size_t r = 0; r < plan.reductions.size(); r++) {
+        finishReduction(plan.reductions[r], accumulators[r]);
+    }
+    emitLabel(doneLabel);
+
+    if (avx) {
+        emit("vzeroupper");
+    }
+    if (counter->reg < 0) {
+        storeVariable(plan.counter, vectorIndex);
+        freeRegister(vectorIndex);
+    }
+    for (const auto& entry : vectorBases) {
+        freeRegister(entry.second);
+    }
+    freeRegister(limit);
+    vectorBases.clear();
+    vectorInvariants.clear();
+    std::fill(usedVectorRegisters.begin(), usedVectorRegisters.end(), false);
+    counterLanes = -1;
+    vectorIndex = -1;
+    vectorAligned = nullptr;
+    emitLabel(skipLabel);
+}
+
+// The selector is evaluated once and dispatched to the case labels. The
+// body's statements follow in source order, so control falls through from
+// one case into the next unless a break jumps to the end; consecutive
+// labels share a destination.
+void CodeGenerator::generateSwitch(const std::unique_ptr<ASTNode>& node) {
+    std::string endLabel = generateLabel("switch_end_");
+    std::string defaultLabel = endLabel;
+    std::vector<SwitchCase> cases;
+    std::vector<std::string> destinations(node->children.size());
+    std::string shared;
+    for (size_t i = 0; i < node->children.size(); i++) {
+        const auto& child = node->children[i];
+        if (child->type != ASTNodeType::CASE_LABEL && child->type != ASTNodeType::DEFAULT_LABEL) {
+            shared.clear();
+            continue;
+        }
+        if (shared.empty()) shared = generateLabel("case_");
+        destinations[i] = shared;
+        if (child->type == ASTNodeType::CASE_LABEL) {
+            cases.push_back({child->intValue, shared});
+        } else {
+            defaultLabel = shared;
+        }
+    }
+    std::sort(cases.begin(), cases.end(),
+              [](const SwitchCase& a, const SwitchCase& b) { return a.value < b.value; });
+
+    emitComment("Switch statement");
+    int reg = generateExpression(node->condition);
+    RangeAnalysis::Range known = {LLONG_MIN, LLONG_MAX};
+    ranges.rangeOf(node->condition.get(), known);
+    generateCaseDispatch(reg, cases, 0, cases.size(), defaultLabel, known);
+    freeRegister(reg);
+
+    breakLabels.push_back(endLabel);
+    for (size_t i = 0; i < node->children.size(); i++) {
+        if (destinations[i].empty()) {
+            generateStatement(node->children[i]);
+        } else if (i == 0 || destinations[i - 1] != destinations[i]) {
+            emitLabel(destinations[i]);
+        }
+    }
+    breakLabels.pop_back();
+    emitLabel(endLabel);
+}
+
+// Dispatch on the sorted cases [first, last); the selector in 'reg' is known
+// to lie within 'known'. Each destination, the default included, is assumed
+// equally likely.
+void CodeGenerator::generateCaseDispatch(int reg, const std::vector<SwitchCase>& cases, size_t first, size_t last,
+                                         const std::string& defaultLabel, RangeAnalysis::Range known) {
+    size_t count = last - first;
+    if (count == 0) {
+        emitJump("jmp", defaultLabel);
+        return;
+    }
+
+    long long lo = cases[first].value;
+    long long hi = cases[last - 1].value;
+    long long span = hi - lo + 1;
+    bool checkRange = known.lo < lo || known.hi > hi;
+    std::vector<std::string> targets;
+    for (size_t i = first; i < last; i++) {
+        if (std::find(targets.begin(), targets.end(), cases[i].target) == targets.end()) {
+            targets.push_back(cases[i].target);
+        }
+    }
+
+    if (count > static_cast<size_t>(MAX_LINEAR_CASES) && span <= 64 &&
+        targets.size() <= static_cast<size_t>(MAX_BIT_TEST_TARGETS)) {
+        generateBitTests(reg, cases, first, last, targets, defaultLabel, checkRange);
+        return;
+    }
+    if (count >= static_cast<size_t>(MIN_TABLE_CASES) && count >= MIN_TABLE_DENSITY * span) {
+        generateJumpTable(reg, cases, first, last, defaultLabel, checkRange);
+        return;
+    }
+
+    if (count <= static_cast<size_t>(MAX_LINEAR_CASES)) {
+        for (size_t i = first; i < last; i++) {
+            emit("cmpq $" + std::to_string(cases[i].value) + ", " + getRegisterName(reg));
+            emitJump("je", cases[i].target, 1.0 / (last - i + 1));
+        }
+        emitJump("jmp", defaultLabel);
+        return;
+    }
+
+    // Binary search: values from the middle case up fall through, the lower
+    // half is dispatched after them
+    size_t middle = first + count / 2;
+    long long pivot = cases[middle].value;
+    std::string lowerLabel = generateLabel("case_lower_");
+    emit("cmpq $" + std::to_string(pivot) + ", " + getRegisterName(reg));
+    emitJump("jl", lowerLabel, static_cast<double>(middle - first) / (count + 1));
+    generateCaseDispatch(reg, cases, middle, last, defaultLabel, {std::max(known.lo, pivot), known.hi});
+    emitLabel(lowerLabel);
+    generateCaseDispatch(reg, cases, first, middle, defaultLabel, {known.lo, std::min(known.hi, pivot - 1)});
+}
+
+// Position-independent table of 32-bit offsets from the table to each case,
+// indexed by the selector minus the smallest case
+void CodeGenerator::generateJumpTable(int reg, const std::vector<SwitchCase>& cases, size_t first, size_t last,
+                                      const std::string& defaultLabel, bool checkRange) {
+    long long lo = cases[first].value;
+    long long hi = cases[last - 1].value;
+    std::string table = generateLabel("switch_table_");
+    std::string index = getRegisterName(reg);
+
+    if (lo != 0) emit("subq $" + std::to_string(lo) + ", " + index);
+    if (checkRange) {
+        emit("cmpq $" + std::to_string(hi - lo) + ", " + index);
+        emitJump("ja", defaultLabel, 1.0 / (last - first + 1));
+    }
+
+    int base = allocateRegister();
+    int entry = allocateRegister();
+    emit("leaq " + table + "(%rip), " + getRegisterName(base));
+    emit("movslq (" + getRegisterName(base) + "," + index + ",4), " + getRegisterName(entry));
+    emit("addq " + getRegisterName(base) + ", " + getRegisterName(entry));
+
+    std::vector<std::string> entries;
+    size_t next = first;
+    for (long long value = lo; value <= hi; value++) {
+        entries.push_back(cases[next].value == value ? cases[next++].target : defaultLabel);
+    }
+    std::vector<std::string> data = {table + ":"};
+    for (const std::string& label : entries) {
+        data.push_back("    .long " + label + " - " + table);
+    }
+    emitIndirectJump(getRegisterName(entry), entries, data);
+    freeRegister(base);
+    freeRegister(entry);
+}
+
+// One mask per destination with a bit set for each of its case values,
+// relative to the smallest case
+void CodeGenerator::generateBitTests(int reg, const std::vector<SwitchCase>& cases, size_t first, size_t last,
+                                     const std::vector<std::string>& targets, const std::string& defaultLabel,
+                                     bool checkRange) {
+    long long lo = cases[first].value;
+    long long hi = cases[last - 1].value;
+    std::string index = getRegisterName(reg);
+
+    if (lo != 0) emit("subq $" + std::to_string(lo) + ", " + index);
+    if (checkRange) {
+        emit("cmpq $" + std::to_string(hi - lo) + ", " + index);
+        emitJump("ja", defaultLabel, 1.0 / (last - first + 1));
+    }
+
+    int mask = allocateRegister();
+    size_t remaining = last - first;
+    for (const std::string& target : targets) {
+        uint64_t bits = 0;
+        size_t hits = 0;
+        for (size_t i = first; i < last; i++) {
+            if (cases[i].target != target) continue;
+            bits |= uint64_t(1) << (cases[i].value - lo);
+            hits++;
+        }
+        std::string op = bits > static_cast<uint64_t>(INT32_MAX) ? "movabsq $" : "movq $";
+        emit(op + std::to_string(static_cast<long long>(bits)) + ", " + getRegisterName(mask));
+        emit("btq " + index + ", " + getRegisterName(mask));
+        emitJump("jc", target, static_cast<double>(hits) / (remaining + 1));
+        remaining -= hits;
+    }
+    freeRegister(mask);
+    emitJump("jmp", defaultLabel);
+}
+
+int CodeGenerator::countFreeRegisters() {
+    return static_cast<int>(std::count(usedRegisters.begin(), usedRegisters.begin() + MAX_REGISTERS, false));
+}
+
+bool CodeGenerator::findPinned(const std::unique_ptr<ASTNode>& node, int& reg) {
+    if (!node) {
+        return false;
+    }
+    if (node->type == ASTNodeType::IDENTIFIER) {
+        Symbol* sym = symbolTable.findSymbol(node->value);
+        if (sym && sym->reg >= 0) {
+            if (!sym->initialized) {
+                error("Variable '" + node->value + "' used before initialization");
+            }
+            reg = sym->reg;
+            return true;
+        }
+    }
+    if (pinnedValues.empty()) {
+        return false;
+    }
+    auto it = pinnedValues.find(expressionKey(node));
+    if (it == pinnedValues.end()) {
+        return false;
+    }
+    reg = it->second;
+    return true;
+}
+
+// Variables must already hold a value for a hoisted load to be valid
+bool CodeGenerator::variablesInitialized(const std::unique_ptr<ASTNode>& node) {
+    if (!node) return true;
+    if (node->type == ASTNodeType::IDENTIFIER) {
+        Symbol* sym = symbolTable.findSymbol(node->value);
+        return sym && sym->initialized;
+    }
+    return variablesInitialized(node->left) && variablesInitialized(node->right);
+}
+
+// Walk a loop collecting invariant expressions: whole computations, loads of
+// variables the loop never writes, and constants used as operands. Each use
+// is weighted by how deeply it is nested inside the loop.
+void CodeGenerator::collectInvariantCandidates(const std::unique_ptr<ASTNode>& node, const std::set<std::string>& modified,
+                                               double weight, bool isOperand, InvariantCandidates& candidates) {
+    if (!node) return;
+
+    switch (node->type) {
+        case ASTNodeType::VAR_DECL:
+        case ASTNodeType::EXPRESSION_STMT:
+        case ASTNodeType::RETURN_STMT:
+            if (node->type == ASTNodeType::VAR_DECL && promotion.slotFor(node.get()) >= NUM_REGISTERS - MAX_REGISTERS) {
+                candidates.lentSlots.insert(promotion.slotFor(node.get()));
+            }
+            candidates.maxNeed = std::max(candidates.maxNeed, registerNeed(node->left));
+            collectInvariantCandidates(node->left, modified, weight, false, candidates);
+            return;
+
+        case ASTNodeType::COMPOUND_STMT:
+            for (const auto& child : node->children) {
+                collectInvariantCandidates(child, modified, weight, false, candidates);
+            }
+            return;
+
+        case ASTNodeType::SWITCH_STMT:
+            candidates.maxNeed = std::max(candidates.maxNeed, registerNeed(node));
+            collectInvariantCandidates(node->condition, modified, weight, false, candidates);
+            for (const auto& child : node->children) {
+                collectInvariantCandidates(child, modified, weight * 0.5, false, candidates);
+            }
+            return;
+
+        case ASTNodeType::CASE_LABEL:
+        case ASTNodeType::DEFAULT_LABEL:
+        case ASTNodeType::BREAK_STMT:
+            return;
+
+        case ASTNodeType::IF_STMT:
+            candidates.maxNeed = std::max(candidates.maxNeed, registerNeed(node->condition));
+            collectInvariantCandidates(node->condition, modified, weight, false, candidates);
+            collectInvariantCandidates(node->left, modified, weight * 0.5, false, candidates);
+            collectInvariantCandidates(node->right, modified, weight * 0.5, false, candidates);
+            return;
+
+        case ASTNodeType::WHILE_STMT:
+        case ASTNodeType::FOR_STMT: {
+            double inner = weight * LOOP_WEIGHT;
+            candidates.maxNeed = std::max(candidates.maxNeed, registerNeed(node->condition));
+            collectInvariantCandidates(node->condition, modified, inner, false, candidates);
+            collectInvariantCandidates(node->left, modified, inner, false, candidates);
+            for (size_t i = 0; i < node->children.size(); i++) {
+                if (node->children[i] && node->children[i]->type != ASTNodeType::VAR_DECL &&
+                    node->children[i]->type != ASTNodeType::EXPRESSION_STMT) {
+                    candidates.maxNeed = std::max(candidates.maxNeed, registerNeed(node->children[i]));
+                }
+                collectInvariantCandidates(node->children[i], modified, i == 0 ? weight : inner, false, candidates);
+            }
+            return;
+        }
+
+        case ASTNodeType::ASSIGN:
+            collectInvariantCandidates(node->right, modified, weight, false, candidates);
+            return;
+
+        default:
+            break;
+    }
+
+    if (isInvariantExpression(node, modified) && variablesInitialized(node)) {
+        double benefit = 0.0;
+        if (node->type == ASTNodeType::IDENTIFIER) {
+            Symbol* sym = symbolTable.findSymbol(node->value);
+            benefit = sym && sym->reg >= 0 ? 0.0 : 1.0;     // One load per use
+        } else if (node->type == ASTNodeType::INTLIT || node->type == ASTNodeType::BOOLLIT) {
+            benefit = isOperand ? 0.5 : 0.0;                // Saves a movq $imm to a divisor
+        } else {
+            benefit = countNodes(node);                     // The whole computation
+        }
+
+        if (benefit > 0.0) {
+            std::string key = expressionKey(node);
+            auto it = candidates.index.find(key);
+            if (it == candidates.index.end()) {
+                candidates.index[key] = candidates.list.size();
+                candidates.list.push_back({&node, key, benefit * weight});
+            } else {
+                candidates.list[it->second].benefit += benefit * weight;
+            }
+        }
+        return;
+    }
+
+    // Other constant operands are immediates
+    bool divisor = node->type == ASTNodeType::DIVIDE || node->type == ASTNodeType::MODULO;
+    collectInvariantCandidates(node->left, modified, weight, false, candidates);
+    collectInvariantCandidates(node->right, modified, weight, divisor, candidates);
+}
+
+// Loop-invariant code motion: evaluate the most profitable invariant values
+// once in the preheader and keep them in registers for the whole loop.
+// Registers still needed by the loop's own expressions, and temporaries
+// lent to variables declared inside it, are left free.
+std::vector<std::string> CodeGenerator::hoistLoopInvariants(const std::unique_ptr<ASTNode>& node) {
+    std::set<std::string> modified;
+    collectAssignedVariables(node->condition, modified);
+    collectAssignedVariables(node->left, modified);
+    if (node->type == ASTNodeType::FOR_STMT && node->children.size() > 1) {
+        collectAssignedVariables(node->children[1], modified);
+    }
+
+    InvariantCandidates candidates;
+    candidates.maxNeed = registerNeed(node->condition);
+    collectInvariantCandidates(node->condition, modified, 1.0, false, candidates);
+    collectInvariantCandidates(node->left, modified, 1.0, false, candidates);
+    if (node->type == ASTNodeType::FOR_STMT && node->children.size() > 1 && node->children[1]) {
+        candidates.maxNeed = std::max(candidates.maxNeed, registerNeed(node->children[1]));
+        collectInvariantCandidates(node->children[1], modified, 1.0, false, candidates);
+    }
+
+    std::stable_sort(candidates.list.begin(), candidates.list.end(),
+                     [](const InvariantCandidate& a, const InvariantCandidate& b) {
+                         return a.benefit > b.benefit;
+                     });
+
+    std::vector<std::string> hoisted;
+    int budget = countFreeRegisters() - candidates.maxNeed - static_cast<int>(candidates.lentSlots.size());
+    for (const InvariantCandidate& candidate : candidates.list) {
+        if (static_cast<int>(hoisted.size()) >= budget) break;
+        if (pinnedValues.count(candidate.key)) continue;
+
+        if (hoisted.empty()) {
+            emitComment("Loop preheader: hoisted invariants");
+        }
+        int reg = generateExpression(*candidate.node);
+        pinnedValues[candidate.key] = reg;
+        hoisted.push_back(candidate.key);
+    }
+    return hoisted;
+}
+
+// Record the program's functions so calls can be checked against them
+void CodeGenerator::collectFunctions(const std::unique_ptr<ASTNode>& program) {
+    functions.clear();
+    for (const auto& child : program->children) {
+        if (child->type != ASTNodeType::FUNCTION_DECL) continue;
+        if (child->value == "main") {
+            error("Function 'main' is reserved for the program's top-level statements");
+        }
+
+        auto it = functions.find(child->value);
+        if (it == functions.end()) {
+            functions[child->value] = child.get();
+            continue;
+        }
+        if (it->second->children.size() != child->children.size()) {
+            error("Conflicting declarations of function '" + child->value + "'");
+        }
+        if (it->second->left && child->left) {
+            error("Function '" + child->value + "' already defined");
+        }
+        if (child->left) it->second = child.get();
+    }
+}
+
+// Arguments are evaluated left to right into temporaries. Registers the
+// caller still needs and the callee may clobber are pushed after that, so
+// values computed by the arguments stay where they are; arguments beyond
+// the sixth are pushed last, with padding that keeps %rsp 16-byte aligned
+// at the call. When the arguments need more temporaries than are free,
+// each is stored to an outgoing area as soon as it is computed instead.
+int CodeGenerator::generateCall(const std::unique_ptr<ASTNode>& node) {
+    auto function = functions.find(node->value);
+    if (function == functions.end()) {
+        error("Undefined function '" + node->value + "'");
+    }
+    size_t parameters = function->second->children.size();
+    if (node->children.size() != parameters) {
+        error("Function '" + node->value + "' expects " + std::to_string(parameters) + " argument" +
+              (parameters == 1 ? "" : "s"));
+    }
+    if (registerNeed(node) > countFreeRegisters()) {
+        return generateStagedCall(node);
+    }
+
+    std::vector<int> arguments;
+    for (const auto& arg : node->children) {
+        arguments.push_back(generateExpression(arg));
+    }
+    for (int reg : arguments) {
+        freeRegister(reg);
+    }
+
+    std::vector<std::string> saved = liveClobberedRegisters();
+    size_t stackArguments = arguments.size() > MAX_REGISTER_ARGUMENTS ? arguments.size() - MAX_REGISTER_ARGUMENTS : 0;
+    bool padded = (saved.size() + stackArguments) % 2 != 0;
+
+    emitComment("Call " + node->value);
+    for (const std::string& reg : saved) {
+        emit("pushq " + reg);
+    }
+    if (padded) {
+        emit("subq $8, %rsp");
+    }
+    for (size_t i = arguments.size(); i > MAX_REGISTER_ARGUMENTS; i--) {
+        emit("pushq " + getRegisterName(arguments[i - 1]));
+    }
+    std::vector<std::pair<std::string, std::string>> moves;
+    for (size_t i = 0; i < arguments.size() && i < MAX_REGISTER_ARGUMENTS; i++) {
+        moves.push_back({getRegisterName(arguments[i]), ARGUMENT_REGISTERS[i]});
+    }
+    generateParallelMove(moves);
+
+    emit("call " + node->value);
+    emittedCall = true;
+    size_t popped = stackArguments + (padded ? 1 : 0);
+    if (popped > 0) {
+        emit("addq $" + std::to_string(8 * popped) + ", %rsp");
+    }
+    int result = allocateRegister();
+    emit("movq %rax, " + getRegisterName(result));
+    for (auto reg = saved.rbegin(); reg != saved.rend(); ++reg) {
+        emit("popq " + *reg);
+    }
+    return result;
+}
+
+// The outgoing area holds the stack arguments at its bottom, then the
+// register arguments, then the saved registers. Registers are saved only
+// after every argument is computed, since an argument may assign a
+// variable that lives in one.
+int CodeGenerator::generateStagedCall(const std::unique_ptr<ASTNode>& node) {
+    size_t count = node->children.size();
+    size_t stackArguments = count > MAX_REGISTER_ARGUMENTS ? count - MAX_REGISTER_ARGUMENTS : 0;
+    std::vector<std::string> saved = liveClobberedRegisters();
+    size_t slots = count + saved.size();
+    slots += slots % 2;
+    auto slot = [](size_t index) { return std::to_string(8 * index) + "(%rsp)"; };
+
+    emitComment("Call " + node->value + " with staged arguments");
+    emit("subq $" + std::to_string(8 * slots) + ", %rsp");
+    for (size_t i = 0; i < count; i++) {
+        int reg = generateExpression(node->children[i]);
+        size_t index = i < MAX_REGISTER_ARGUMENTS ? stackArguments + i : i - MAX_REGISTER_ARGUMENTS;
+        emit("movq " + getRegisterName(reg) + ", " + slot(index));
+        freeRegister(reg);
+    }
+    for (size_t i = 0; i < saved.size(); i++) {
+        emit("movq " + saved[i] + ", " + slot(count + i));
+    }
+    for (size_t i = 0; i < count && i < MAX_REGISTER_ARGUMENTS; i++) {
+        emit("movq " + slot(stackArguments + i) + ", " + ARGUMENT_REGISTERS[i]);
+    }
+
+    emit("call " + node->value);
+    emittedCall = true;
+    int result = allocateRegister();
+    emit("movq %rax, " + getRegisterName(result));
+    for (size_t i = 0; i < saved.size(); i++) {
+        emit("movq " + slot(count + i) + ", " + saved[i]);
+    }
+    emit("addq $" + std::to_string(8 * slots) + ", %rsp");
+    return result;
+}
+
+// A returned call that needs nothing from this frame afterwards. Calls to
+// other functions must pass every argument in registers; a self-recursive
+// call reuses the parameters' own homes.
+bool CodeGenerator::isTailCall(const std::unique_ptr<ASTNode>& node) {
+    if (!currentFunction || !node || node->type != ASTNodeType::CALL) return false;
+    auto function = functions.find(node->value);
+    if (function == functions.end() || function->second->children.size() != node->children.size()) return false;
+    return node->value == currentFunction->value || node->children.size() <= MAX_REGISTER_ARGUMENTS;
+}
+
+// Whether a function body makes calls that return to it, and whether it
+// makes self-recursive tail calls
+void CodeGenerator::findTailCalls(const std::unique_ptr<ASTNode>& node, bool& otherCalls, bool& selfCalls) {
+    if (!node) return;
+    if (node->type == ASTNodeType::RETURN_STMT && isTailCall(node->left)) {
+        if (node->left->value == currentFunction->value) selfCalls = true;
+        for (const auto& arg : node->left->children) {
+            if (containsNodeType(arg, ASTNodeType::CALL)) otherCalls = true;
+        }
+        return;
+    }
+    if (node->type == ASTNodeType::CALL) otherCalls = true;
+    findTailCalls(node->condition, otherCalls, selfCalls);
+    findTailCalls(node->left, otherCalls, selfCalls);
+    findTailCalls(node->right, otherCalls, selfCalls);
+    for (const auto& child : node->children) {
+        findTailCalls(child, otherCalls, selfCalls);
+    }
+}
+
+// The arguments are computed before any parameter or argument register is
+// overwritten. A self-recursive call becomes a jump back to the start of
+// the body; any other call moves its arguments into place and jumps to the
+// callee after the epilogue, which generateFunction appends once it knows
+// the registers to restore. The callee returns straight to our caller.
+void CodeGenerator::generateTailCall(const std::unique_ptr<ASTNode>& node) {
+    std::vector<int> arguments;
+    for (const auto& arg : node->children) {
+        arguments.push_back(generateExpression(arg));
+    }
+    for (int reg : arguments) {
+        freeRegister(reg);
+    }
+
+    std::vector<std::pair<std::string, std::string>> moves;
+    if (node->value == currentFunction->value) {
+        emitComment("Tail call " + node->value + " as a loop");
+        for (size_t i = 0; i < arguments.size(); i++) {
+            const std::string& home = parameterHomes[i];
+            if (home.empty()) continue;
+            if (home[0] == '%') {
+                moves.push_back({getRegisterName(arguments[i]), home});
+            } else {
+                emit("movq " + getRegisterName(arguments[i]) + ", " + home);
+            }
+        }
+        generateParallelMove(moves);
+        emitJump("jmp", tailCallLabel);
+        return;
+    }
+
+    emitComment("Tail call " + node->value);
+    for (size_t i = 0; i < arguments.size(); i++) {
+        moves.push_back({getRegisterName(arguments[i]), ARGUMENT_REGISTERS[i]});
+    }
+    generateParallelMove(moves);
+    currentBlock().returns = true;
+    tailCalls.push_back({blocks.size() - 1, node->value});
+}
+
+// Registers in use that a System V callee may overwrite
+std::vector<std::string> CodeGenerator::liveClobberedRegisters() {
+    std::vector<std::string> live;
+    for (int reg = 0; reg < NUM_REGISTERS; reg++) {
+        if (usedRegisters[reg] && !isPreservedAcrossCalls(getRegisterName(reg))) {
+            live.push_back(getRegisterName(reg));
+        }
+    }
+    return live;
+}
+
+// Register-to-register moves that happen at once: a move is emitted when no
+// other pending move still reads its destination, and a cycle is broken by
+// parking one source in %rax
+void CodeGenerator::generateParallelMove(std::vector<std::pair<std::string, std::string>> moves) {
+    moves.erase(std::remove_if(moves.begin(), moves.end(),
+                               [](const std::pair<std::string, std::string>& move) { return move.first == move.second; }),
+                moves.end());
+
+    while (!moves.empty()) {
+        bool progress = false;
+        for (size_t i = 0; i < moves.size() && !progress; i++) {
+            const std::string& target = moves[i].second;
+            bool read = std::any_of(moves.begin(), moves.end(),
+                                    [&target](const std::pair<std::string, std::string>& move) {
+                                        return move.first == target;
+                                    });
+            if (!read) {
+                emit("movq " + moves[i].first + ", " + target);
+                moves.erase(moves.begin() + i);
+                progress = true;
+            }
+        }
+        if (!progress) {
+            std::string parked = moves[0].first;
+            emit("movq " + parked + ", %rax");
+            for (auto& move : moves) {
+                if (move.first == parked) move.first = "%rax";
+            }
+        }
+    }
+}
+
+// A function is generated like the program's body, in a frame of its own:
+// parameters are declared in a scope around the body and moved from the
+// argument registers (or the caller's stack) to the homes promotion gave
+// them. Only %rbx and %r12-%r15 are preserved. A function whose only
+// calls are tail calls counts as a leaf; one whose variables all live in
+// registers needs no frame pointer, and pushes the registers it must
+// preserve and returns directly.
+void CodeGenerator::generateFunction(const std::unique_ptr<ASTNode>& node) {
+    currentFunction = node.get();
+    bool otherCalls = false;
+    bool selfCalls = false;
+    findTailCalls(node->left, otherCalls, selfCalls);
+    bool leaf = !otherCalls;
+    emittedCall = false;
+    tailCalls.clear();
+    parameterHomes.assign(node->children.size(), "");
+    symbolTable.clear();
+    freeAllRegisters();
+    savedRegisters.clear();
+    blocks.clear();
+    blocks.emplace_back();
+    collectBlocks = true;
+    returnLabel = generateLabel(node->value + "_exit_");
+    variableRegisterOrder = leaf ? LEAF_VARIABLE_REGISTERS : CALLER_VARIABLE_REGISTERS;
+
+    promotion.analyze(node);
+    int lendable = std::max(0, MAX_REGISTERS - promotion.getMaxNeed() - 2);
+    promotion.assign(NUM_REGISTERS - MAX_REGISTERS + lendable);
+
+    // Stack homes are written before the register moves overwrite the
+    // argument registers, and stack arguments are loaded after them
+    symbolTable.enterScope();
+    std::vector<std::pair<std::string, std::string>> moves;
+    std::vector<std::string> stackLoads;
+    for (size_t i = 0; i < node->children.size(); i++) {
+        const ASTNode* param = node->children[i].get();
+        addVariable(param->value);
+        promoteVariable(param);
+        symbolTable.markInitialized(param->value);
+        Symbol* sym = symbolTable.findSymbol(param->value);
+
+        if (!readsAnyVariable(node->left, {param->value})) {
+            continue;
+        } else if (i >= MAX_REGISTER_ARGUMENTS) {
+            int incoming = 16 + 8 * static_cast<int>(i - MAX_REGISTER_ARGUMENTS);
+            if (sym->reg >= 0) {
+                stackLoads.push_back("movq " + std::to_string(incoming) + "(%rbp), " + getRegisterName(sym->reg));
+            } else {
+                sym->offset = incoming;
+            }
+        } else if (sym->reg >= 0) {
+            moves.push_back({ARGUMENT_REGISTERS[i], getRegisterName(sym->reg)});
+        } else {
+            emit("movq " + std::string(ARGUMENT_REGISTERS[i]) + ", " + std::to_string(sym->offset) + "(%rbp)");
+        }
+        parameterHomes[i] = sym->reg >= 0 ? getRegisterName(sym->reg) : std::to_string(sym->offset) + "(%rbp)";
+    }
+    generateParallelMove(moves);
+    for (const std::string& load : stackLoads) {
+        emit(load);
+    }
+    tailCallLabel = selfCalls ? generateLabel(node->value + "_tail_") : "";
+    if (selfCalls) {
+        emitLabel(tailCallLabel);
+    }
+
+    generateStatement(node->left);
+    exitScope();
+    emit("movq $0, %rax");
+
+    emitLabel(returnLabel);
+    collectBlocks = false;
+
+    // Tail calls return nowhere here, so they need no aligned frame
+    bool usesFrame = emittedCall;
+    for (const AsmBlock& block : blocks) {
+        for (const std::string& line : block.lines) {
+            if (line.find("(%rbp") != std::string::npos) usesFrame = true;
+        }
+    }
+    savedRegisters = usedCalleeSavedRegisters(true);
+
+    std::vector<std::string> epilogue;
+    for (size_t i = 0; i < savedRegisters.size(); i++) {
+        size_t index = usesFrame ? i : savedRegisters.size() - 1 - i;
+        epilogue.push_back(usesFrame ? "    movq " + std::to_string(savedRegisterOffset(index)) + "(%rbp), " +
+                                           savedRegisters[index]
+                                     : "    popq " + savedRegisters[index]);
+    }
+    if (usesFrame) {
+        epilogue.push_back("    movq %rbp, %rsp");
+        epilogue.push_back("    popq %rbp");
+    }
+    for (const auto& tailCall : tailCalls) {
+        AsmBlock& block = blocks[tailCall.first];
+        block.lines.insert(block.lines.end(), epilogue.begin(), epilogue.end());
+        block.lines.push_back("    jmp " + tailCall.second);
+    }
+    epilogue.push_back("    ret");
+    for (AsmBlock& block : blocks) {
+        if (block.label == returnLabel) {
+            block.lines.insert(block.lines.end(), epilogue.begin(), epilogue.end());
+            block.returns = true;
+        }
+    }
+    returnLabel.clear();
+    currentFunction = nullptr;
+
+    *output << std::endl;
+    *output << ".globl " << node->value << std::endl;
+    emitLabel(node->value);
+    if (usesFrame) {
+        emit("pushq %rbp");
+        emit("movq %rsp, %rbp");
+        int frameSize = getFrameSize(false);
+        if (frameSize > 0) {
+            emit("subq $" + std::to_string(frameSize) + ", %rsp");
+        }
+        for (size_t i = 0; i < savedRegisters.size(); i++) {
+            emit("movq " + savedRegisters[i] + ", " + std::to_string(savedRegisterOffset(i)) + "(%rbp)");
+        }
+    } else {
+        for (const std::string& reg : savedRegisters) {
+            emit("pushq " + reg);
+        }
+    }
+    writeBlocks();
+}
+
+// Schedule the collected blocks and write them in layout order, followed
+// by their jump tables. A table whose dispatch block was dropped as
+// unreachable is dropped with it, as the labels it refers to may be too.
+void CodeGenerator::writeBlocks() {
+    InstructionScheduler scheduler(blocks);
+    scheduler.run();
+    cyclesBefore += scheduler.getCyclesBefore();
+    cyclesAfter += scheduler.getCyclesAfter();
+
+    BlockLayout layout(blocks);
+    layout.run();
+    layout.print(*output);
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (layout.isReachable(i)) {
+            jumpTables.insert(jumpTables.end(), blocks[i].table.begin(), blocks[i].table.end());
+        }
+    }
+    blocks.clear();
+
+    if (!jumpTables.empty()) {
+        *output << "    .section .rodata" << std::endl;
+        *output << "    .p2align 2" << std::endl;
+        for (const std::string& line : jumpTables) {
+            *output << line << std::endl;
+        }
+        *output << "    .text" << std::endl;
+        jumpTables.clear();
+    }
+}
+
+void CodeGenerator::generateProgram(const std::unique_ptr<ASTNode>& node) {
+    if (!node || node->type != ASTNodeType::PROGRAM) {
+        error("Expected program node");
+        return;
+    }
+
+    collectFunctions(node);
+    collectGlobalArrays(node);
+
+    // The body is collected into basic blocks: the frame size is only known
+    // once every local has been declared, and the blocks are reordered by
+    // the layout stage before being written out
+    blocks.clear();
+    blocks.emplace_back();
+    collectBlocks = true;
+    returnLabel = generateLabel("main_exit_");
+    variableRegisterOrder = CALLER_VARIABLE_REGISTERS;
+
+    // Plan which variables live in registers. Temporaries beyond what the
+    // largest expression needs, the held program result and one spare are
+    // lent to variables as well.
+    promotion.analyze(node);
+    ranges.analyze(node);
+    int lendable = std::max(0, MAX_REGISTERS - promotion.getMaxNeed() - 2);
+    promotion.assign(NUM_REGISTERS - MAX_REGISTERS + lendable);
+
+    // If the program has children (statements), generate them
+    if (!node->children.empty()) {
+        // For a program with statements, evaluate the last expression statement
+        // and use its result as the exit code. Earlier ones are plain
+        // statements, so their results are not held across the code between.
+        const ASTNode* lastExpression = nullptr;
+        for (const auto& child : node->children) {
+            if (child->type == ASTNodeType::EXPRESSION_STMT && child->left) {
+                lastExpression = child.get();
+            }
+        }
+        int lastExpressionReg = -1;
+
+        for (const auto& child : node->children) {
+            if (child->type == ASTNodeType::FUNCTION_DECL) {
+                continue;
+            } else if (child.get() == lastExpression) {
+                // Generate the expression and keep its result
+                lastExpressionReg = generateExpression(child->left);
+            } else {
+                generateStatement(child);
+            }
+        }
+
+        // Use the last expression's result as exit code, or 0 if none
+        if (lastExpressionReg != -1) {
+            emit("movq " + getRegisterName(lastExpressionReg) + ", %rax");
+            freeRegister(lastExpressionReg);
+        } else {
+            emit("movq $0, %rax");
+        }
+    } else {
+        // If it's just an expression, evaluate it and exit with its value
+        emitComment("Single expression program");
+        if (node->left) {
+            int reg = generateExpression(node->left);
+            emit("movq " + getRegisterName(reg) + ", %rax");  // Move result to return value
+            freeRegister(reg);
+        } else {
+            emit("movq $0, %rax");
+        }
+    }
+
+    // Return statements jump here with the exit code already in %rax
+    emitLabel(returnLabel);
+    generatePostamble(-1);
+    collectBlocks = false;
+
+    // Callee-saved registers the body uses are saved below the locals in the
+    // prologue and restored on the single exit path
+    savedRegisters = usedCalleeSavedRegisters();
+    for (AsmBlock& block : blocks) {
+        if (block.label != returnLabel) continue;
+        std::vector<std::string> restores;
+        for (size_t i = 0; i < savedRegisters.size(); i++) {
+            restores.push_back("    movq " + std::to_string(savedRegisterOffset(i)) + "(%rbp), " + savedRegisters[i]);
+        }
+        block.lines.insert(block.lines.begin(), restores.begin(), restores.end());
+    }
+    returnLabel.clear();
+
+    generatePreamble();
+    writeBlocks();
+
+    for (const auto& child : node->children) {
+        if (child->type == ASTNodeType::FUNCTION_DECL && child->left) {
+            generateFunction(child);
+        }
+    }
+    writeArrayData();
+}
+
+void CodeGenerator::generatePreamble() {
+    *output << "# Generated by C++ Compiler - Code Generation Phase" << std::endl;
+    *output << "# x86-64 Assembly Output for Windows (MinGW64)" << std::endl;
+    *output << std::endl;
+
+    // Windows-compatible assembly using main instead of _start
+    *output << ".text" << std::endl;
+    *output << ".globl main" << std::endl;
+    *output << std::endl;
+
+    emitLabel("main");
+    emitComment("Program start");
+
+    // Set up stack frame for Windows calling convention
+    emit("pushq %rbp");
+    emit("movq %rsp, %rbp");
+    emit("subq $" + std::to_string(getFrameSize()) + ", %rsp");
+    for (size_t i = 0; i < savedRegisters.size(); i++) {
+        emit("movq " + savedRegisters[i] + ", " + std::to_string(savedRegisterOffset(i)) + "(%rbp)");
+    }
+}
+
+// Locals live below %rbp; 32 bytes of shadow space for the Windows x64
+// calling convention sit below them in main, and %rsp stays 16-byte aligned
+int CodeGenerator::getFrameSize(bool shadowSpace) {
+    int localsSize = -(symbolTable.getCurrentOffset() + 8) + 8 * static_cast<int>(savedRegisters.size());
+    return (localsSize + (shadowSpace ? 32 : 0) + 15) & ~15;
+}
+
+// Save slots follow the last local
+int CodeGenerator::savedRegisterOffset(size_t index) {
+    return symbolTable.getCurrentOffset() - 8 * static_cast<int>(index);
+}
+
+// Registers preserved across calls under both the System V and the
+// Windows x64 conventions, or under System V only
+std::vector<std::string> CodeGenerator::usedCalleeSavedRegisters(bool systemV) {
+    static const char* calleeSaved[] = {"%rbx", "%rsi", "%rdi", "%r12", "%r13", "%r14", "%r15"};
+    std::vector<std::string> used;
+    for (const char* reg : calleeSaved) {
+        if (systemV && !isPreservedAcrossCalls(reg)) continue;
+        bool found = false;
+        for (const AsmBlock& block : blocks) {
+            for (const std::string& line : block.lines) {
+                if (line.compare(0, 6, "    # ") != 0 && line.find(reg) != std::string::npos) {
+                    found = true;
+                    break;
+                }
+            }
+            if (found) break;
+        }
+        if (found) used.push_back(reg);
+    }
+    return used;
 }
 
 void CodeGenerator::generatePostamble(int exitCode) {
@@ -510,7 +3214,6 @@ void CodeGenerator::generatePostamble(int exitCode) {
     // If exitCode is -1, assume the exit code is already in %rax
 
     // Clean up stack frame
-    emit("addq $32, %rsp");
     emit("movq %rbp, %rsp");
     emit("popq %rbp");
     emit("ret");  // Return instead of syscall
@@ -527,6 +3230,11 @@ void CodeGenerator::generateCode(const std::unique_ptr<ASTNode>& ast) {
     labelCounter = 0;
     stackOffset = 0;
     symbolTable.clear();  // Clear the symbol table (assuming it has a clear method)
+    savedRegisters.clear();
+    breakLabels.clear();
+    jumpTables.clear();
+    cyclesBefore = 0;
+    cyclesAfter = 0;
 
     if (ast->type == ASTNodeType::PROGRAM) {
         generateProgram(ast);
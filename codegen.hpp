@@ -3,11 +3,18 @@
 
 #include "parser.hpp"
 #include "symboltable.hpp"
+#include "blocklayout.hpp"
+#include "scheduler.hpp"
+#include "promotion.hpp"
+#include "ranges.hpp"
+#include "vectorize.hpp"
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <vector>
+#include <map>
 #include <unordered_map>
+#include <set>
 #include <stdexcept>
 
 class CodeGenerator {
@@ -22,8 +29,133 @@ private:
     SymbolTable symbolTable;
     int stackOffset;               // Current stack offset
 
+    // Basic blocks of the function being generated
+    std::vector<AsmBlock> blocks;
+    bool collectBlocks;            // Whether output goes to 'blocks'
+    std::string returnLabel;       // Epilogue label for return statements
+    int cyclesBefore;              // Estimated block cycles before and after scheduling
+    int cyclesAfter;
+
+    // Variables kept in registers instead of stack slots
+    RegisterPromotion promotion;
+    std::vector<std::string> savedRegisters;  // Callee-saved registers kept in the frame
+
+    // Value ranges of the program's expressions
+    RangeAnalysis ranges;
+
+    // Functions by name: the definition, or the prototype if there is none.
+    // Dedicated variable registers are handed out in 'variableRegisterOrder'.
+    std::unordered_map<std::string, const ASTNode*> functions;
+    const int* variableRegisterOrder;
+
+    // Function being generated, null for the program's body. A call in tail
+    // position to another function leaves through the epilogue appended to
+    // the block recorded in 'tailCalls'; a self-recursive one rewrites the
+    // parameters' homes and jumps back to 'tailCallLabel'.
+    const ASTNode* currentFunction;
+    std::string tailCallLabel;
+    std::vector<std::string> parameterHomes;    // Register or slot of each parameter, "" if never read
+    std::vector<std::pair<size_t, std::string>> tailCalls;  // Block index and callee
+    bool emittedCall;               // Whether a call returning here was emitted
+
+    // System V arguments beyond this many are passed on the stack
+    static const int MAX_REGISTER_ARGUMENTS = 6;
+
+    // Instructions a call is assumed to cost besides its arguments
+    static const int CALL_COST = 10;
+
+    // Switch statements: the end label of each enclosing switch, innermost
+    // last, and the jump tables written as read-only data after the function
+    // whose dispatch code is kept
+    std::vector<std::string> breakLabels;
+    std::vector<std::string> jumpTables;
+
+    struct SwitchCase {
+        long long value;
+        std::string target;     // Label the case's statements start at
+    };
+
+    // Dispatch lowering: a table for at least MIN_TABLE_CASES cases covering
+    // MIN_TABLE_DENSITY of their range, a bit test per destination when few
+    // destinations share a range of at most 64 values, a compare per case
+    // up to MAX_LINEAR_CASES, and a binary search splitting larger sets
+    static const int MIN_TABLE_CASES = 4;
+    static constexpr double MIN_TABLE_DENSITY = 0.4;
+    static const int MAX_BIT_TEST_TARGETS = 3;
+    static const int MAX_LINEAR_CASES = 3;
+
+    // Arrays hold 32-bit elements. Those declared at the top level of the
+    // program are global: in .data when their initializer is constant, in
+    // .bss otherwise, and initialized where main declares them. The others
+    // live in the frame. An element is addressed as base + index * 4, with
+    // the index's constant terms folded into the displacement.
+    struct ArrayLocation {
+        std::string label;      // Symbol of a global array, "" for a frame array
+        int offset;             // Frame offset of element 0
+        int elements;
+    };
+    struct GlobalArray {
+        const ASTNode* declaration;
+        bool constant;          // Whether the whole initializer is in .data
+    };
+    std::map<std::string, GlobalArray> globalArrays;
+    std::vector<std::string> readOnlyData;   // Images of frame array initializers and vector constants
+
+    static const int ELEMENT_SIZE = 4;
+
+    // Frame arrays of up to MAX_STORED_ELEMENTS are initialized one store per
+    // element. Larger ones are cleared with rep stos and given their other
+    // elements by stores when at most MAX_SPARSE_ELEMENTS are not zero, and
+    // are copied from a read-only image with rep movs otherwise.
+    static const int MAX_STORED_ELEMENTS = 16;
+    static const int MAX_SPARSE_ELEMENTS = 16;
+
+    // Loop vectorization (see LoopVectorizer). While a vector loop is
+    // generated, 'vectorBases' holds the registers addressing its arrays and
+    // 'vectorInvariants' the vector registers of broadcast scalars, keyed by
+    // expressionKey(), and of the counter's lanes.
+    VectorISA vectorISA;
+    std::unordered_map<std::string, int> vectorBases;
+    std::unordered_map<std::string, int> vectorInvariants;
+    std::vector<bool> usedVectorRegisters;
+    int counterLanes;               // Vector register of the counter's values, or -1
+    int vectorIndex;                // Register holding the counter
+    const VectorAccess* vectorAligned;      // Elements the peeled iterations aligned, or nullptr
+
+    static const int NUM_VECTOR_REGISTERS = 16;
+    static const int REDUCTION_VECTORS = 2;     // Vectors a reduction loop iteration folds in
+
+    // Loop-invariant values held in registers while a loop is generated,
+    // keyed by expressionKey()
+    std::unordered_map<std::string, int> pinnedValues;
+
+    struct InvariantCandidate {
+        const std::unique_ptr<ASTNode>* node;
+        std::string key;
+        double benefit;         // Estimated instructions saved per loop entry
+    };
+    struct InvariantCandidates {
+        std::vector<InvariantCandidate> list;
+        std::unordered_map<std::string, size_t> index;
+        int maxNeed = 0;        // Registers the loop's own expressions need
+        std::set<int> lentSlots; // Promotion slots of temporaries lent to the loop's variables
+    };
+
+    // Assumed iterations of a nested loop when weighing hoisting benefits
+    static constexpr double LOOP_WEIGHT = 10.0;
+
+    // Static branch prediction (Ball-Larus heuristic probabilities)
+    static constexpr double LOOP_TAKEN_PROBABILITY = 0.88;
+    static constexpr double RETURN_AVOID_PROBABILITY = 0.72;
+    static constexpr double OPCODE_PROBABILITY = 0.66;
+
+    // Largest combined cost of the two arms of ?: that are both computed so
+    // cmov can select one, instead of branching around them
+    static const int MAX_SELECT_COST = 6;
+
     // Register management
     static const int MAX_REGISTERS = 8;  // Using r8-r15 for temporaries
+    static const int NUM_REGISTERS = 12; // Plus rbx, rsi, rdi, rcx for variables
     static const std::string registers[];
 
     // Private helper methods
@@ -35,13 +167,127 @@ private:
 
     // Variable management methods
     void addVariable(const std::string& name);
+    Symbol* findVariable(const std::string& name);
     int getVariableOffset(const std::string& name);
     void loadVariable(int reg, const std::string& name);
     void storeVariable(const std::string& name, int reg);
+    void promoteVariable(const ASTNode* declaration);
+    void exitScope();
+
+    // Instruction selection. An operand is an immediate, a register that
+    // already holds the value, a stack slot, or a temporary it was computed
+    // into ('owned'). An address is base + index * scale + displacement,
+    // evaluated by a single lea.
+    struct Operand {
+        std::string text;
+        int reg;                // Register index, or -1 for immediates and memory
+        bool owned;
+        bool memory;
+    };
+    struct Address {
+        const std::unique_ptr<ASTNode>* base = nullptr;
+        const std::unique_ptr<ASTNode>* index = nullptr;
+        int scale = 1;
+        long long displacement = 0;
+        int operations = 0;     // Arithmetic nodes the address covers
+    };
+
+    bool isLeafOperand(const std::unique_ptr<ASTNode>& node);
+    bool isRegisterResident(const std::unique_ptr<ASTNode>& node);
+    bool leafOperand(const std::unique_ptr<ASTNode>& node, Operand& operand);
+    Operand selectOperand(const std::unique_ptr<ASTNode>& node, bool allowMemory = true);
+    void releaseOperand(const Operand& operand);
+    int estimateCost(const std::unique_ptr<ASTNode>& node, bool asOperand);
+    bool matchAddress(const std::unique_ptr<ASTNode>& node, Address& address);
+    int generateAddress(const Address& address);
+    int generateArithmetic(const std::unique_ptr<ASTNode>& node);
+    int generateShift(const std::unique_ptr<ASTNode>& node);
+    bool generateAssignmentInPlace(const std::unique_ptr<ASTNode>& node);
+
+    // Arrays
+    void collectGlobalArrays(const std::unique_ptr<ASTNode>& program);
+    ArrayLocation findArray(const std::string& name);
+    std::string elementAt(const ArrayLocation& array, long long displacement);
+    void splitIndex(const std::unique_ptr<ASTNode>& node, const std::unique_ptr<ASTNode>*& term,
+                    long long& constant);
+    std::string elementOperand(const std::unique_ptr<ASTNode>& access, Operand& index);
+    int generateArrayStore(const std::unique_ptr<ASTNode>& node, bool valueNeeded);
+    void generateArrayDeclaration(const std::unique_ptr<ASTNode>& node);
+    void generateBlockFill(const ArrayLocation& array, const std::string& image);
+    void writeArrayData();
+
+    // Loop vectorization
+    void generateVectorLoop(const std::unique_ptr<ASTNode>& node);
+    int vectorNeed(const std::unique_ptr<ASTNode>& node);
+    void collectVectorInvariants(const std::unique_ptr<ASTNode>& node, const std::string& counter,
+                                 std::map<std::string, const std::unique_ptr<ASTNode>*>& invariants,
+                                 bool& readsCounter);
+    std::string vectorRegister(int reg, bool full = true);
+    int allocateVectorRegister();
+    void broadcast(const std::string& source, int reg);
+    std::string vectorElement(const VectorAccess& access, int displacementBytes = 0);
+    std::string vectorMove(const VectorAccess& access);
+    int generateVectorExpression(const std::unique_ptr<ASTNode>& node, const std::string& counter);
+    void generateVectorOp(const std::string& op, int source, int dest);
+    void generateVectorMinMax(bool max, int source, int dest);
+    void vectorShuffle(const std::string& pattern, int source, int dest);
+    void generateReductionStep(const VectorReduction& reduction, const VectorAccess& access, int copy,
+                               const std::vector<int>& accumulators);
+    void finishReduction(const VectorReduction& reduction, const std::vector<int>& accumulators);
 
     // Code generation helpers
     void generateBinaryOp(ASTNodeType op, int leftReg, int rightReg);
     void generateUnaryOp(ASTNodeType op, int reg);
+    int generatePowerOfTwoDivision(const std::unique_ptr<ASTNode>& node);
+
+    // Short-circuit evaluation of && and ||
+    void generateBranch(const std::unique_ptr<ASTNode>& node, const std::string& target, bool jumpIfTrue,
+                        double probability = 0.5);
+    int generateLogicalValue(const std::unique_ptr<ASTNode>& node);
+    int generateConditional(const std::unique_ptr<ASTNode>& node);
+
+    // Comparisons lowered to cmp followed directly by jcc/setcc
+    bool isComparison(ASTNodeType op);
+    std::string conditionCode(ASTNodeType op, bool negate);
+    std::string generateCompare(const std::unique_ptr<ASTNode>& node, bool negate);
+
+    // Control flow statements
+    bool containsReturn(const std::unique_ptr<ASTNode>& node);
+    double predictThenProbability(const std::unique_ptr<ASTNode>& node);
+    void generateIfStatement(const std::unique_ptr<ASTNode>& node);
+    void generateLoop(const std::unique_ptr<ASTNode>& node);
+    void generateSwitch(const std::unique_ptr<ASTNode>& node);
+    void generateCaseDispatch(int reg, const std::vector<SwitchCase>& cases, size_t first, size_t last,
+                              const std::string& defaultLabel, RangeAnalysis::Range known);
+    void generateJumpTable(int reg, const std::vector<SwitchCase>& cases, size_t first, size_t last,
+                           const std::string& defaultLabel, bool checkRange);
+    void generateBitTests(int reg, const std::vector<SwitchCase>& cases, size_t first, size_t last,
+                          const std::vector<std::string>& targets, const std::string& defaultLabel, bool checkRange);
+
+    // Loop-invariant code motion
+    int countFreeRegisters();
+    bool findPinned(const std::unique_ptr<ASTNode>& node, int& reg);
+    bool variablesInitialized(const std::unique_ptr<ASTNode>& node);
+    void collectInvariantCandidates(const std::unique_ptr<ASTNode>& node, const std::set<std::string>& modified,
+                                    double weight, bool isOperand, InvariantCandidates& candidates);
+    std::vector<std::string> hoistLoopInvariants(const std::unique_ptr<ASTNode>& node);
+
+    // Functions and calls
+    void collectFunctions(const std::unique_ptr<ASTNode>& program);
+    int generateCall(const std::unique_ptr<ASTNode>& node);
+    int generateStagedCall(const std::unique_ptr<ASTNode>& node);
+    bool isTailCall(const std::unique_ptr<ASTNode>& node);
+    void findTailCalls(const std::unique_ptr<ASTNode>& node, bool& otherCalls, bool& selfCalls);
+    void generateTailCall(const std::unique_ptr<ASTNode>& node);
+    std::vector<std::string> liveClobberedRegisters();
+    void generateParallelMove(std::vector<std::pair<std::string, std::string>> moves);
+    void generateFunction(const std::unique_ptr<ASTNode>& node);
+    void writeBlocks();
+
+    // Stack frame layout
+    int getFrameSize(bool shadowSpace = true);
+    int savedRegisterOffset(size_t index);
+    std::vector<std::string> usedCalleeSavedRegisters(bool systemV = false);
 
 public:
     // Constructors and destructor
@@ -61,6 +307,10 @@ public:
     void emit(const std::string& instruction);
     void emitComment(const std::string& comment);
     void emitLabel(const std::string& label);
+    void emitJump(const std::string& op, const std::string& target, double probability = 0.5);
+    void emitIndirectJump(const std::string& reg, const std::vector<std::string>& targets,
+                          const std::vector<std::string>& table);
+    AsmBlock& currentBlock();
     std::string generateLabel(const std::string& prefix = "L");
 
     // Code generation structure
@@ -74,8 +324,16 @@ public:
     // Error handling
     void error(const std::string& message);
 
+    // Instruction set loops are vectorized for; NONE disables vectorization
+    void setVectorISA(VectorISA isa) { vectorISA = isa; }
+
     // Symbol table access
     SymbolTable& getSymbolTable() { return symbolTable; }
+
+    // Estimated cycles of the generated blocks in emission order and after
+    // instruction scheduling
+    int getCyclesBefore() const { return cyclesBefore; }
+    int getCyclesAfter() const { return cyclesAfter; }
 };
 
 #endif // CODEGEN_HPP
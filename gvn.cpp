@@ -0,0 +1,424 @@
+#include "gvn.hpp"
+#include "analysis.hpp"
+#include <set>
+#include <utility>
+
+// Arithmetic whose recomputation costs more than reading a variable
+static bool isCandidate(const std::unique_ptr<ASTNode>& node) {
+    switch (node->type) {
+        case ASTNodeType::ADD:
+        case ASTNodeType::SUBTRACT:
+        case ASTNodeType::MULTIPLY:
+        case ASTNodeType::DIVIDE:
+        case ASTNodeType::MODULO:
+        case ASTNodeType::BITAND:
+        case ASTNodeType::BITOR:
+        case ASTNodeType::BITXOR:
+        case ASTNodeType::LSHIFT:
+        case ASTNodeType::RSHIFT:
+            return containsNodeType(node, ASTNodeType::IDENTIFIER);
+        default:
+            return false;
+    }
+}
+
+// A subscript's added literals fold into the element's displacement (see
+// CodeGenerator::splitIndex), so only the rest is worth keeping for reuse
+static std::unique_ptr<ASTNode>* addressTerm(std::unique_ptr<ASTNode>& node) {
+    if (!node) return &node;
+    if ((node->type == ASTNodeType::ADD || node->type == ASTNodeType::SUBTRACT) && node->right &&
+        node->right->type == ASTNodeType::INTLIT) {
+        return addressTerm(node->left);
+    }
+    if (node->type == ASTNodeType::ADD && node->left && node->left->type == ASTNodeType::INTLIT) {
+        return addressTerm(node->right);
+    }
+    return &node;
+}
+
+static bool isCommutative(ASTNodeType type) {
+    return type == ASTNodeType::ADD || type == ASTNodeType::MULTIPLY ||
+           type == ASTNodeType::EQ || type == ASTNodeType::NE || type == ASTNodeType::BITAND ||
+           type == ASTNodeType::BITOR || type == ASTNodeType::BITXOR;
+}
+
+ValueNumbering::ValueNumbering()
+    : currentStatement(nullptr), nextNumber(0), tempCounter(0), eliminatedCount(0) {}
+
+int ValueNumbering::freshNumber() {
+    return nextNumber++;
+}
+
+int ValueNumbering::numberFor(const std::string& key) {
+    auto it = numbers.find(key);
+    if (it != numbers.end()) return it->second;
+    int number = freshNumber();
+    numbers[key] = number;
+    return number;
+}
+
+int ValueNumbering::valueOf(const std::string& name) {
+    auto it = variables.find(name);
+    if (it != variables.end()) return it->second;
+    int number = freshNumber();
+    variables[name] = number;
+    return number;
+}
+
+// Value number of a side-effect-free expression in the current state
+int ValueNumbering::numberOf(const std::unique_ptr<ASTNode>& node) {
+    if (!node) return freshNumber();
+
+    switch (node->type) {
+        case ASTNodeType::IDENTIFIER:
+            return valueOf(node->value);
+
+        case ASTNodeType::INTLIT:
+            return numberFor("#" + std::to_string(node->intValue));
+
+        case ASTNodeType::BOOLLIT:
+            return numberFor(node->boolValue ? "#1" : "#0");
+
+        case ASTNodeType::ADD:
+        case ASTNodeType::SUBTRACT:
+        case ASTNodeType::MULTIPLY:
+        case ASTNodeType::DIVIDE:
+        case ASTNodeType::MODULO:
+        case ASTNodeType::EQ:
+        case ASTNodeType::NE:
+        case ASTNodeType::LT:
+        case ASTNodeType::GT:
+        case ASTNodeType::LE:
+        case ASTNodeType::GE:
+        case ASTNodeType::AND:
+        case ASTNodeType::OR:
+        case ASTNodeType::BITAND:
+        case ASTNodeType::BITOR:
+        case ASTNodeType::BITXOR:
+        case ASTNodeType::LSHIFT:
+        case ASTNodeType::RSHIFT: {
+            int left = numberOf(node->left);
+            int right = numberOf(node->right);
+            if (isCommutative(node->type) && right < left) std::swap(left, right);
+            return numberFor(std::to_string(static_cast<int>(node->type)) + "(" +
+                             std::to_string(left) + "," + std::to_string(right) + ")");
+        }
+
+        case ASTNodeType::NOT:
+        case ASTNodeType::NEGATE:
+        case ASTNodeType::POSITIVE:
+        case ASTNodeType::BITNOT:
+            return numberFor(std::to_string(static_cast<int>(node->type)) + "(" +
+                             std::to_string(numberOf(node->left)) + ")");
+
+        default:
+            return freshNumber();
+    }
+}
+
+void ValueNumbering::assignVariable(const std::string& name, int number) {
+    variables[name] = number;
+
+    // Remember the variable as a holder of the value unless a valid one exists
+    Available* entry = findAvailable(number);
+    if (!entry) {
+        regions.back().available[number] = {name, false, nullptr, nullptr};
+        return;
+    }
+    if (entry->temporary) return;
+    auto holder = variables.find(entry->holder);
+    if (entry->holder.empty() || holder == variables.end() || holder->second != number) {
+        entry->holder = name;
+    }
+}
+
+// Variables written somewhere in a subtree get unknown contents
+void ValueNumbering::invalidate(const std::unique_ptr<ASTNode>& node) {
+    std::set<std::string> modified;
+    collectAssignedVariables(node, modified);
+    for (const auto& name : modified) {
+        auto it = variables.find(name);
+        if (it != variables.end()) it->second = freshNumber();
+    }
+}
+
+// Join point of two paths: a variable keeps its number only if both agree
+void ValueNumbering::mergeValues(const Values& other) {
+    for (auto& entry : variables) {
+        auto it = other.find(entry.first);
+        if (it == other.end() || it->second != entry.second) {
+            entry.second = freshNumber();
+        }
+    }
+}
+
+void ValueNumbering::pushRegion() {
+    regions.emplace_back();
+}
+
+void ValueNumbering::popRegion() {
+    for (const auto& name : regions.back().declared) {
+        variables.erase(name);
+    }
+    regions.pop_back();
+}
+
+ValueNumbering::Available* ValueNumbering::findAvailable(int number) {
+    for (auto region = regions.rbegin(); region != regions.rend(); ++region) {
+        auto it = region->available.find(number);
+        if (it != region->available.end()) return &it->second;
+    }
+    return nullptr;
+}
+
+// Replace a recomputation by a variable holding its value, capturing the
+// dominating first computation in a temporary when no variable does
+bool ValueNumbering::reuse(std::unique_ptr<ASTNode>& node, int number) {
+    Available* entry = findAvailable(number);
+    if (!entry) return false;
+
+    auto holder = variables.find(entry->holder);
+    bool valid = entry->temporary || (holder != variables.end() && holder->second == number);
+    if (!valid) {
+        if (!entry->firstUse) return false;
+        std::string name = "__cse" + std::to_string(tempCounter++);
+        std::unique_ptr<ASTNode>& first = *entry->firstUse;
+        first = makeAssignment(name, std::move(first));
+        declarations[entry->statement].push_back(name);
+        entry->holder = name;
+        entry->temporary = true;
+        entry->firstUse = nullptr;
+    }
+
+    node = makeIdentifier(entry->holder);
+    eliminatedCount++;
+    return true;
+}
+
+void ValueNumbering::visitStatement(std::unique_ptr<ASTNode>& node) {
+    if (!node) return;
+    const ASTNode* saved = currentStatement;
+    currentStatement = node.get();
+
+    switch (node->type) {
+        case ASTNodeType::PROGRAM:
+        case ASTNodeType::COMPOUND_STMT:
+            pushRegion();
+            visitList(node->children);
+            popRegion();
+            break;
+
+        case ASTNodeType::VAR_DECL: {
+            int number = node->left ? visitExpression(node->left) : freshNumber();
+            regions.back().declared.push_back(node->value);
+            assignVariable(node->value, number);
+            break;
+        }
+
+        case ASTNodeType::IF_STMT: {
+            visitExpression(node->condition);
+            Values before = variables;
+            visitBranch(node->left);
+            Values afterThen = std::move(variables);
+            variables = std::move(before);
+            visitBranch(node->right);
+            mergeValues(afterThen);
+            break;
+        }
+
+        case ASTNodeType::WHILE_STMT:
+        case ASTNodeType::FOR_STMT: {
+            bool isFor = node->type == ASTNodeType::FOR_STMT;
+            pushRegion();
+            if (isFor && !node->children.empty()) {
+                visitStatement(node->children[0]);
+            }
+
+            // Variables written in the loop merge with their values from the
+            // previous iteration at the header
+            invalidate(node->condition);
+            invalidate(node->left);
+            if (isFor && node->children.size() > 1) invalidate(node->children[1]);
+
+            visitExpression(node->condition);
+            Values header = variables;
+            pushRegion();
+            visitBranch(node->left);
+            if (isFor && node->children.size() > 1) visitExpression(node->children[1]);
+            popRegion();
+
+            // The loop exits from the header, after the condition
+            variables = std::move(header);
+            popRegion();
+
+            // Temporaries of the init part are declared before the loop
+            if (isFor && !node->children.empty()) {
+                auto it = declarations.find(node->children[0].get());
+                if (it != declarations.end()) {
+                    auto& target = declarations[node.get()];
+                    target.insert(target.end(), it->second.begin(), it->second.end());
+                    declarations.erase(node->children[0].get());
+                }
+            }
+            break;
+        }
+
+        case ASTNodeType::FUNCTION_DECL: {
+            // A function body sees none of the caller's values
+            Values caller = std::move(variables);
+            std::vector<Region> callerRegions = std::move(regions);
+            variables.clear();
+            regions.assign(1, Region());
+            visitStatement(node->left);
+            variables = std::move(caller);
+            regions = std::move(callerRegions);
+            break;
+        }
+
+        case ASTNodeType::SWITCH_STMT:
+            // Every label joins the dispatch with the fall-through path, and
+            // the end of the switch joins them with the breaks
+            visitExpression(node->condition);
+            invalidate(node);
+            for (auto& child : node->children) {
+                if (child->type == ASTNodeType::CASE_LABEL || child->type == ASTNodeType::DEFAULT_LABEL) {
+                    invalidate(node);
+                } else {
+                    visitBranch(child);
+                }
+            }
+            invalidate(node);
+            break;
+
+        case ASTNodeType::COUT_STMT:
+            for (auto& child : node->children) {
+                visitExpression(child);
+            }
+            break;
+
+        case ASTNodeType::CIN_STMT:
+            for (auto& child : node->children) {
+                if (child && child->type == ASTNodeType::IDENTIFIER) {
+                    assignVariable(child->value, freshNumber());
+                }
+            }
+            break;
+
+        default:
+            visitExpression(node->left);
+            break;
+    }
+
+    currentStatement = saved;
+}
+
+// A statement executed conditionally or repeatedly; results computed inside
+// it are not available after it
+void ValueNumbering::visitBranch(std::unique_ptr<ASTNode>& node) {
+    if (!node) return;
+    pushRegion();
+    visitStatement(node);
+    popRegion();
+
+    auto it = declarations.find(node.get());
+    if (it != declarations.end()) {
+        auto block = makeCompound();
+        for (const auto& name : it->second) {
+            block->children.push_back(makeVarDecl(name, nullptr));
+        }
+        declarations.erase(it);
+        block->children.push_back(std::move(node));
+        node = std::move(block);
+    }
+}
+
+void ValueNumbering::visitList(std::vector<std::unique_ptr<ASTNode>>& list) {
+    for (auto& statement : list) {
+        visitStatement(statement);
+    }
+
+    std::vector<std::unique_ptr<ASTNode>> result;
+    for (auto& statement : list) {
+        auto it = statement ? declarations.find(statement.get()) : declarations.end();
+        if (it != declarations.end()) {
+            for (const auto& name : it->second) {
+                result.push_back(makeVarDecl(name, nullptr));
+            }
+            declarations.erase(it);
+        }
+        result.push_back(std::move(statement));
+    }
+    list = std::move(result);
+}
+
+int ValueNumbering::visitExpression(std::unique_ptr<ASTNode>& node) {
+    if (!node) return freshNumber();
+
+    if (node->type == ASTNodeType::ASSIGN && node->left &&
+        node->left->type == ASTNodeType::IDENTIFIER) {
+        int number = visitExpression(node->right);
+        assignVariable(node->left->value, number);
+        return number;
+    }
+
+    // An element store computes its value before the element's index
+    if (node->type == ASTNodeType::ASSIGN && node->left && node->left->type == ASTNodeType::INDEX) {
+        visitExpression(node->right);
+        visitExpression(*addressTerm(node->left->left));
+        return freshNumber();
+    }
+
+    bool pure = !hasSideEffects(node);
+    int number = pure ? numberOf(node) : freshNumber();
+
+    if (node->type == ASTNodeType::AND || node->type == ASTNodeType::OR) {
+        visitExpression(node->left);
+        // The right operand is evaluated only on some paths
+        pushRegion();
+        visitExpression(node->right);
+        popRegion();
+        invalidate(node->right);
+        return number;
+    }
+
+    if (node->type == ASTNodeType::CONDITIONAL) {
+        visitExpression(node->condition);
+        // Each arm is evaluated only on some paths
+        for (auto* arm : {&node->left, &node->right}) {
+            pushRegion();
+            visitExpression(*arm);
+            popRegion();
+            invalidate(*arm);
+        }
+        return number;
+    }
+
+    bool candidate = pure && isCandidate(node);
+    if (candidate && reuse(node, number)) return number;
+
+    if (node->type == ASTNodeType::INDEX) {
+        visitExpression(*addressTerm(node->left));
+        return number;
+    }
+
+    visitExpression(node->left);
+    visitExpression(node->right);
+    visitExpression(node->condition);
+    for (auto& child : node->children) {
+        visitExpression(child);
+    }
+
+    if (candidate) {
+        regions.back().available[number] = {"", false, &node, currentStatement};
+    }
+    return number;
+}
+
+void ValueNumbering::optimize(std::unique_ptr<ASTNode>& program) {
+    numbers.clear();
+    variables.clear();
+    regions.clear();
+    declarations.clear();
+    currentStatement = nullptr;
+    visitStatement(program);
+}
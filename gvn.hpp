@@ -0,0 +1,73 @@
+#ifndef GVN_HPP
+#define GVN_HPP
+
+#include "parser.hpp"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Dominator-based value numbering over the structured AST. In a program
+// without jumps a statement dominates everything after it in its block and
+// everything nested below those statements, so walking the tree in order
+// with a scope per branch, loop body and short-circuit operand visits each
+// region only while its dominators' results are available. Every variable
+// carries the value number of its current contents; an assignment gives it
+// the number of the assigned value and a join or loop header gives it a
+// fresh one when the incoming values differ, so a store invalidates exactly
+// the expressions that read the stored variable. A recomputed arithmetic
+// expression is replaced by a variable that still holds its value, or else
+// its first computation is captured in a new temporary.
+class ValueNumbering {
+private:
+    struct Available {
+        std::string holder;                 // Variable known to hold the value, if any
+        bool temporary;                     // Holder is a temporary, which is never reassigned
+        std::unique_ptr<ASTNode>* firstUse; // First computation, until it is captured
+        const ASTNode* statement;           // Statement the capturing temporary is declared before
+    };
+
+    struct Region {
+        std::unordered_map<int, Available> available;
+        std::vector<std::string> declared;
+    };
+
+    using Values = std::unordered_map<std::string, int>;
+
+    std::unordered_map<std::string, int> numbers;   // Expression key -> value number
+    Values variables;                               // Variable -> number of its contents
+    std::vector<Region> regions;
+    std::unordered_map<const ASTNode*, std::vector<std::string>> declarations;
+    const ASTNode* currentStatement;
+    int nextNumber;
+    int tempCounter;
+    int eliminatedCount;
+
+    int freshNumber();
+    int numberFor(const std::string& key);
+    int valueOf(const std::string& name);
+    int numberOf(const std::unique_ptr<ASTNode>& node);
+    void assignVariable(const std::string& name, int number);
+    void invalidate(const std::unique_ptr<ASTNode>& node);
+    void mergeValues(const Values& other);
+
+    void pushRegion();
+    void popRegion();
+    Available* findAvailable(int number);
+    bool reuse(std::unique_ptr<ASTNode>& node, int number);
+
+    void visitStatement(std::unique_ptr<ASTNode>& node);
+    void visitBranch(std::unique_ptr<ASTNode>& node);
+    void visitList(std::vector<std::unique_ptr<ASTNode>>& list);
+    int visitExpression(std::unique_ptr<ASTNode>& node);
+
+public:
+    ValueNumbering();
+
+    // Eliminate redundant computations of a program in place
+    void optimize(std::unique_ptr<ASTNode>& program);
+
+    int getEliminatedCount() const { return eliminatedCount; }
+};
+
+#endif // GVN_HPP
@@ -0,0 +1,658 @@
+#include "inline.hpp"
+#include "analysis.hpp"
+#include <algorithm>
+
+Inliner::Inliner(const InlineOptions& opts)
+    : options(opts), growth(0), loopDepth(0), programStatements(nullptr), valueUsed(false), inlineCounter(0),
+      inlinedCount(0), specializedCount(0), removedCount(0) {}
+
+// Call graph
+
+void Inliner::collectCalls(const std::unique_ptr<ASTNode>& node, Function* caller) {
+    if (!node) return;
+    if (node->type == ASTNodeType::FUNCTION_DECL) return;
+
+    if (node->type == ASTNodeType::CALL) {
+        auto it = functions.find(node->value);
+        if (it != functions.end()) {
+            it->second.callSites++;
+            if (caller) caller->callees.insert(node->value);
+        }
+    }
+    collectCalls(node->condition, caller);
+    collectCalls(node->left, caller);
+    collectCalls(node->right, caller);
+    for (const auto& child : node->children) {
+        collectCalls(child, caller);
+    }
+}
+
+void Inliner::buildCallGraph(const std::unique_ptr<ASTNode>& program) {
+    functions.clear();
+    for (const auto& child : program->children) {
+        if (child->type == ASTNodeType::FUNCTION_DECL && child->left) {
+            functions[child->value].node = child.get();
+        }
+    }
+
+    collectCalls(program, nullptr);
+    for (auto& entry : functions) {
+        collectCalls(entry.second.node->left, &entry.second);
+    }
+    for (auto& entry : functions) {
+        std::set<std::string> visited;
+        entry.second.recursive = reaches(entry.first, entry.first, visited);
+    }
+}
+
+// Whether 'to' is called, directly or not, from the callees of 'from'
+bool Inliner::reaches(const std::string& from, const std::string& to, std::set<std::string>& visited) {
+    for (const std::string& callee : functions[from].callees) {
+        if (callee == to) return true;
+        if (visited.insert(callee).second && reaches(callee, to, visited)) return true;
+    }
+    return false;
+}
+
+void Inliner::postOrder(const std::string& name, std::set<std::string>& visited, std::vector<std::string>& order) {
+    if (!visited.insert(name).second) return;
+    for (const std::string& callee : functions[name].callees) {
+        postOrder(callee, visited, order);
+    }
+    order.push_back(name);
+}
+
+// Cost model
+
+bool Inliner::usedInCondition(const std::unique_ptr<ASTNode>& node, const std::string& name) {
+    if (!node) return false;
+
+    switch (node->type) {
+        case ASTNodeType::IF_STMT:
+        case ASTNodeType::WHILE_STMT:
+        case ASTNodeType::FOR_STMT:
+        case ASTNodeType::SWITCH_STMT:
+        case ASTNodeType::CONDITIONAL:
+            if (readsAnyVariable(node->condition, {name})) return true;
+            break;
+        default:
+            break;
+    }
+    if (usedInCondition(node->condition, name) || usedInCondition(node->left, name) ||
+        usedInCondition(node->right, name)) {
+        return true;
+    }
+    for (const auto& child : node->children) {
+        if (usedInCondition(child, name)) return true;
+    }
+    return false;
+}
+
+// The returned expression of a function whose body is one return statement
+const std::unique_ptr<ASTNode>* Inliner::singleReturn(const ASTNode* function) {
+    const auto& body = function->left;
+    if (!body || body->children.size() != 1 || !body->children[0] ||
+        body->children[0]->type != ASTNodeType::RETURN_STMT || !body->children[0]->left) {
+        return nullptr;
+    }
+    return &body->children[0]->left;
+}
+
+bool Inliner::alwaysReturns(const std::unique_ptr<ASTNode>& node) {
+    if (!node) return false;
+
+    switch (node->type) {
+        case ASTNodeType::RETURN_STMT:
+            return true;
+        case ASTNodeType::COMPOUND_STMT:
+            for (const auto& child : node->children) {
+                if (alwaysReturns(child)) return true;
+            }
+            return false;
+        case ASTNodeType::IF_STMT:
+            return alwaysReturns(node->left) && alwaysReturns(node->right);
+        default:
+            return false;
+    }
+}
+
+// A callee is inlined when it is small, or when this is its only call and
+// it is not too large; literal arguments the callee branches on make it
+// count as smaller, since the branches fold away afterwards
+bool Inliner::shouldInline(const std::unique_ptr<ASTNode>& call, const Function*& callee) {
+    auto it = functions.find(call->value);
+    if (it == functions.end() || it->second.recursive) return false;
+    const ASTNode* function = it->second.node;
+    if (function->children.size() != call->children.size()) return false;
+
+    int size = countNodes(function->left);
+    int effective = size;
+    for (size_t i = 0; i < call->children.size(); i++) {
+        if (call->children[i]->type == ASTNodeType::INTLIT &&
+            usedInCondition(function->left, function->children[i]->value)) {
+            effective -= CONSTANT_ARGUMENT_BONUS;
+        }
+    }
+
+    bool single = it->second.callSites == 1;
+    int limit = options.smallSize * (loopDepth > 0 ? 2 : 1);
+    if (effective > limit && !(single && effective <= options.singleCallSize)) return false;
+
+    // The only call site's callee is removed afterwards, so the program
+    // does not grow
+    int added = single ? 0 : size;
+    if (growth + added > options.growthBudget) return false;
+    growth += added;
+    callee = &it->second;
+    return true;
+}
+
+// Expression substitution
+
+bool Inliner::canSubstitute(const std::unique_ptr<ASTNode>& call, const std::unique_ptr<ASTNode>& expr,
+                            const ASTNode* function) {
+    if (containsNodeType(expr, ASTNodeType::ASSIGN)) return false;
+
+    std::unordered_map<std::string, int> uses;
+    std::vector<const ASTNode*> pending = {expr.get()};
+    while (!pending.empty()) {
+        const ASTNode* node = pending.back();
+        pending.pop_back();
+        if (!node) continue;
+        if (node->type == ASTNodeType::IDENTIFIER) uses[node->value]++;
+        pending.push_back(node->left.get());
+        pending.push_back(node->right.get());
+        pending.push_back(node->condition.get());
+        for (const auto& child : node->children) {
+            pending.push_back(child.get());
+        }
+    }
+
+    // An argument that is not a leaf is evaluated where its parameter is
+    // used, so it must be used at most once and have no effects
+    for (size_t i = 0; i < call->children.size(); i++) {
+        const auto& arg = call->children[i];
+        bool leaf = arg->type == ASTNodeType::INTLIT || arg->type == ASTNodeType::BOOLLIT ||
+                    arg->type == ASTNodeType::IDENTIFIER;
+        if (!leaf && (!isSafeExpression(arg) || uses[function->children[i]->value] > 1)) return false;
+    }
+    return true;
+}
+
+std::unique_ptr<ASTNode> Inliner::substitute(const std::unique_ptr<ASTNode>& expr, const ASTNode* function,
+                                             std::vector<std::unique_ptr<ASTNode>>& arguments) {
+    if (!expr) return nullptr;
+    if (expr->type == ASTNodeType::IDENTIFIER) {
+        for (size_t i = 0; i < function->children.size(); i++) {
+            if (function->children[i]->value == expr->value) return cloneAST(arguments[i]);
+        }
+    }
+
+    auto copy = std::make_unique<ASTNode>(expr->type);
+    copy->value = expr->value;
+    copy->intValue = expr->intValue;
+    copy->floatValue = expr->floatValue;
+    copy->boolValue = expr->boolValue;
+    copy->condition = substitute(expr->condition, function, arguments);
+    copy->left = substitute(expr->left, function, arguments);
+    copy->right = substitute(expr->right, function, arguments);
+    for (const auto& child : expr->children) {
+        copy->children.push_back(substitute(child, function, arguments));
+    }
+    return copy;
+}
+
+// Body expansion
+
+// Give every parameter and local of an inlined body a fresh name, so none
+// collides with the caller's variables or another inlined copy
+void Inliner::renameLocals(std::unique_ptr<ASTNode>& node, std::unordered_map<std::string, std::string>& names,
+                           const std::string& prefix) {
+    if (!node) return;
+    bool declaration = node->type == ASTNodeType::VAR_DECL || node->type == ASTNodeType::ARRAY_DECL;
+    if (declaration && !node->value.empty() && !names.count(node->value)) {
+        names[node->value] = prefix + node->value;
+    }
+    if ((declaration || node->type == ASTNodeType::IDENTIFIER || node->type == ASTNodeType::INDEX) &&
+        names.count(node->value)) {
+        node->value = names[node->value];
+    }
+    // Children first: a for loop's initializer declares what its condition reads
+    for (auto& child : node->children) {
+        renameLocals(child, names, prefix);
+    }
+    renameLocals(node->condition, names, prefix);
+    renameLocals(node->left, names, prefix);
+    renameLocals(node->right, names, prefix);
+}
+
+static void replaceIdentifier(std::unique_ptr<ASTNode>& node, const std::string& name,
+                              const std::unique_ptr<ASTNode>& value) {
+    if (!node) return;
+    if (node->type == ASTNodeType::IDENTIFIER && node->value == name) {
+        node = cloneAST(value);
+        return;
+    }
+    replaceIdentifier(node->condition, name, value);
+    replaceIdentifier(node->left, name, value);
+    replaceIdentifier(node->right, name, value);
+    for (auto& child : node->children) {
+        replaceIdentifier(child, name, value);
+    }
+}
+
+// Rewrite a statement list so control only leaves it by falling off the
+// end: a return assigns the result (if the value is wanted) and ends its
+// list, and the statements after a block or if that may return move into
+// it, into each arm that can fall through. Fails on returns inside loops
+// and switches.
+bool Inliner::removeReturns(std::vector<std::unique_ptr<ASTNode>>& list, const std::string& result) {
+    for (size_t i = 0; i < list.size(); i++) {
+        std::unique_ptr<ASTNode>& statement = list[i];
+        if (!statement || !containsNodeType(statement, ASTNodeType::RETURN_STMT)) continue;
+
+        std::vector<std::unique_ptr<ASTNode>> rest;
+        for (size_t j = i + 1; j < list.size(); j++) {
+            rest.push_back(std::move(list[j]));
+        }
+        list.resize(i + 1);
+
+        switch (statement->type) {
+            case ASTNodeType::RETURN_STMT:
+                if (!result.empty()) {
+                    auto value = statement->left ? std::move(statement->left) : makeIntLiteral(0);
+                    statement = makeExpressionStatement(makeAssignment(result, std::move(value)));
+                } else if (statement->left && hasSideEffects(statement->left)) {
+                    statement = makeExpressionStatement(std::move(statement->left));
+                } else {
+                    list.pop_back();
+                }
+                return true;
+
+            case ASTNodeType::COMPOUND_STMT:
+                for (auto& moved : rest) {
+                    statement->children.push_back(std::move(moved));
+                }
+                return removeReturns(statement->children, result);
+
+            case ASTNodeType::IF_STMT: {
+                bool duplicate = !alwaysReturns(statement->left) && !alwaysReturns(statement->right);
+                for (auto* arm : {&statement->left, &statement->right}) {
+                    if (!*arm || (*arm)->type != ASTNodeType::COMPOUND_STMT) {
+                        auto block = makeCompound();
+                        if (*arm) block->children.push_back(std::move(*arm));
+                        *arm = std::move(block);
+                    }
+                    if (!alwaysReturns(*arm)) {
+                        for (auto& moved : rest) {
+                            (*arm)->children.push_back(duplicate ? cloneAST(moved) : std::move(moved));
+                        }
+                    }
+                    if (!removeReturns((*arm)->children, result)) return false;
+                }
+                return true;
+            }
+
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+// Find the call evaluated first in an expression; fails if any call is
+// evaluated only on some paths
+static bool firstCall(std::unique_ptr<ASTNode>& node, std::unique_ptr<ASTNode>*& first, bool conditional) {
+    if (!node) return true;
+    if (node->type == ASTNodeType::CALL && conditional) return false;
+
+    bool branches = node->type == ASTNodeType::AND || node->type == ASTNodeType::OR ||
+                    node->type == ASTNodeType::CONDITIONAL;
+    if (!firstCall(node->condition, first, conditional) || !firstCall(node->left, first, conditional || branches) ||
+        !firstCall(node->right, first, conditional || branches)) {
+        return false;
+    }
+    for (auto& child : node->children) {
+        if (!firstCall(child, first, conditional)) return false;
+    }
+    if (node->type == ASTNodeType::CALL && !first) first = &node;
+    return true;
+}
+
+// The call a statement can be expanded at: the whole expression of an
+// expression statement, declaration or return (or the value assigned by
+// it), or else the first of the calls in that expression when all of them
+// run unconditionally and nothing else in the expression has effects. The
+// callee cannot change the caller's variables, so the rest of the
+// expression reads the same values afterwards; it may store to global
+// arrays, so an expression reading elements is left alone.
+std::unique_ptr<ASTNode>* Inliner::findHoistableCall(std::unique_ptr<ASTNode>& statement) {
+    std::unique_ptr<ASTNode>* expr = nullptr;
+    switch (statement->type) {
+        case ASTNodeType::EXPRESSION_STMT:
+        case ASTNodeType::VAR_DECL:
+        case ASTNodeType::RETURN_STMT:
+            expr = &statement->left;
+            break;
+        default:
+            return nullptr;
+    }
+    if (!*expr) return nullptr;
+    if (statement->type == ASTNodeType::EXPRESSION_STMT && (*expr)->type == ASTNodeType::ASSIGN &&
+        (*expr)->left && (*expr)->left->type == ASTNodeType::IDENTIFIER && (*expr)->right) {
+        expr = &(*expr)->right;
+    }
+    if ((*expr)->type == ASTNodeType::CALL) return expr;
+    if (containsNodeType(*expr, ASTNodeType::ASSIGN) || containsNodeType(*expr, ASTNodeType::INDEX)) return nullptr;
+
+    std::unique_ptr<ASTNode>* first = nullptr;
+    return firstCall(*expr, first, false) ? first : nullptr;
+}
+
+bool Inliner::expandCall(std::unique_ptr<ASTNode>& statement, std::vector<std::unique_ptr<ASTNode>>& expansion) {
+    std::unique_ptr<ASTNode>* site = findHoistableCall(statement);
+    const Function* callee = nullptr;
+    if (!site || !shouldInline(*site, callee)) return false;
+    const ASTNode* function = callee->node;
+
+    std::string prefix = "__inl" + std::to_string(inlineCounter++) + "_";
+    std::unordered_map<std::string, std::string> names;
+    for (const auto& param : function->children) {
+        names[param->value] = prefix + param->value;
+    }
+    auto body = cloneAST(function->left);
+    renameLocals(body, names, prefix);
+
+    // The value of a top-level expression statement may be the exit code
+    bool wholeStatement = statement->type == ASTNodeType::EXPRESSION_STMT && &statement->left == site && !valueUsed;
+    std::string result = wholeStatement ? "" : prefix + "result";
+    bool fallsOff = !alwaysReturns(body);
+    if (!removeReturns(body->children, result)) {
+        growth -= callee->callSites == 1 ? 0 : countNodes(function->left);
+        return false;
+    }
+
+    // A function that falls off its end returns 0
+    if (!result.empty()) {
+        expansion.push_back(makeVarDecl(result, fallsOff ? makeIntLiteral(0) : nullptr));
+    }
+    // A literal or variable passed for a parameter the body never assigns
+    // is used directly; the other arguments initialize their parameters
+    std::set<std::string> assigned;
+    collectAssignedVariables(body, assigned);
+    auto block = makeCompound();
+    for (size_t i = 0; i < function->children.size(); i++) {
+        std::unique_ptr<ASTNode>& arg = (*site)->children[i];
+        const std::string& param = names[function->children[i]->value];
+        bool leaf = arg->type == ASTNodeType::INTLIT || arg->type == ASTNodeType::BOOLLIT ||
+                    arg->type == ASTNodeType::IDENTIFIER;
+        if (leaf && !assigned.count(param)) {
+            replaceIdentifier(body, param, arg);
+        } else {
+            block->children.push_back(makeVarDecl(param, std::move(arg)));
+        }
+    }
+    for (auto& inlined : body->children) {
+        if (inlined) block->children.push_back(std::move(inlined));
+    }
+    expansion.push_back(std::move(block));
+    if (wholeStatement) {
+        statement.reset();
+    } else {
+        *site = makeIdentifier(result);
+    }
+    inlinedCount++;
+    return true;
+}
+
+// Specialization
+
+// Redirect a call passing literals for parameters the callee branches on
+// to a clone that declares those parameters as constants, for constant
+// propagation to fold. Clones are shared by calls with the same literals.
+bool Inliner::specialize(std::unique_ptr<ASTNode>& call) {
+    auto it = functions.find(call->value);
+    if (it == functions.end() || it->second.recursive) return false;
+    const ASTNode* function = it->second.node;
+    if (function->children.size() != call->children.size()) return false;
+
+    std::vector<bool> bound;
+    std::string signature = call->value;
+    for (size_t i = 0; i < call->children.size(); i++) {
+        bool constant = call->children[i]->type == ASTNodeType::INTLIT &&
+                        usedInCondition(function->left, function->children[i]->value);
+        bound.push_back(constant);
+        signature += constant ? "," + std::to_string(call->children[i]->intValue) : ",_";
+    }
+    if (std::find(bound.begin(), bound.end(), true) == bound.end()) return false;
+
+    auto existing = specializations.find(signature);
+    std::string name;
+    if (existing != specializations.end()) {
+        name = existing->second;
+    } else {
+        int size = countNodes(function->left);
+        if (specializedCount >= options.maxSpecializations || growth + size > options.growthBudget) return false;
+
+        // Labels may contain '.', identifiers may not, so a clone's name
+        // cannot clash with a function of the program
+        name = call->value + ".spec" + std::to_string(specializedCount);
+        auto clone = std::make_unique<ASTNode>(ASTNodeType::FUNCTION_DECL);
+        clone->value = name;
+        clone->left = cloneAST(function->left);
+        std::vector<std::unique_ptr<ASTNode>> constants;
+        for (size_t i = 0; i < bound.size(); i++) {
+            if (bound[i]) {
+                constants.push_back(makeVarDecl(function->children[i]->value, cloneAST(call->children[i])));
+            } else {
+                clone->children.push_back(cloneAST(function->children[i]));
+            }
+        }
+        clone->left->children.insert(clone->left->children.begin(), std::make_move_iterator(constants.begin()),
+                                     std::make_move_iterator(constants.end()));
+        clones.push_back(std::move(clone));
+        specializations[signature] = name;
+        growth += size;
+        specializedCount++;
+    }
+
+    call->value = name;
+    std::vector<std::unique_ptr<ASTNode>> arguments;
+    for (size_t i = 0; i < bound.size(); i++) {
+        if (!bound[i]) arguments.push_back(std::move(call->children[i]));
+    }
+    call->children = std::move(arguments);
+    return true;
+}
+
+// Traversal
+
+void Inliner::inlineExpression(std::unique_ptr<ASTNode>& node) {
+    if (!node) return;
+    inlineExpression(node->condition);
+    inlineExpression(node->left);
+    inlineExpression(node->right);
+    for (auto& child : node->children) {
+        inlineExpression(child);
+    }
+    if (node->type != ASTNodeType::CALL) return;
+
+    auto it = functions.find(node->value);
+    if (it == functions.end()) return;
+    const std::unique_ptr<ASTNode>* returned = singleReturn(it->second.node);
+    const Function* callee = nullptr;
+    if (!returned || !canSubstitute(node, *returned, it->second.node) || !shouldInline(node, callee)) return;
+
+    node = substitute(*returned, callee->node, node->children);
+    inlinedCount++;
+}
+
+void Inliner::inlineStatement(std::unique_ptr<ASTNode>& node, std::vector<std::unique_ptr<ASTNode>>& expansion) {
+    if (!node) return;
+
+    switch (node->type) {
+        case ASTNodeType::COMPOUND_STMT:
+            inlineList(node->children);
+            break;
+
+        case ASTNodeType::IF_STMT:
+            inlineExpression(node->condition);
+            inlineSlot(node->left);
+            inlineSlot(node->right);
+            break;
+
+        case ASTNodeType::WHILE_STMT:
+        case ASTNodeType::FOR_STMT:
+            // The init declares the loop's variable, so it is not expanded
+            // into a block
+            if (!node->children.empty() && node->children[0]) inlineExpression(node->children[0]->left);
+            loopDepth++;
+            inlineExpression(node->condition);
+            inlineSlot(node->left);
+            if (node->children.size() > 1) inlineExpression(node->children[1]);
+            loopDepth--;
+            break;
+
+        case ASTNodeType::SWITCH_STMT:
+            inlineExpression(node->condition);
+            inlineList(node->children);
+            break;
+
+        case ASTNodeType::FUNCTION_DECL:
+            break;
+
+        case ASTNodeType::COUT_STMT:
+            for (auto& child : node->children) {
+                inlineExpression(child);
+            }
+            break;
+
+        default:
+            // Each expansion leaves the statement with its remaining calls
+            inlineExpression(node->left);
+            while (node && expandCall(node, expansion)) {
+            }
+            if (!expansion.empty() && node) expansion.push_back(std::move(node));
+            break;
+    }
+}
+
+void Inliner::inlineList(std::vector<std::unique_ptr<ASTNode>>& list) {
+    std::vector<std::unique_ptr<ASTNode>> result;
+    for (auto& statement : list) {
+        std::vector<std::unique_ptr<ASTNode>> expansion;
+        valueUsed = &list == programStatements;
+        inlineStatement(statement, expansion);
+        if (expansion.empty()) {
+            result.push_back(std::move(statement));
+        } else {
+            for (auto& expanded : expansion) {
+                result.push_back(std::move(expanded));
+            }
+        }
+    }
+    list = std::move(result);
+}
+
+// A statement in a position that holds exactly one becomes a block when it
+// expands into several
+void Inliner::inlineSlot(std::unique_ptr<ASTNode>& node) {
+    std::vector<std::unique_ptr<ASTNode>> expansion;
+    valueUsed = false;
+    inlineStatement(node, expansion);
+    if (expansion.empty()) return;
+
+    auto block = makeCompound();
+    for (auto& expanded : expansion) {
+        block->children.push_back(std::move(expanded));
+    }
+    node = std::move(block);
+}
+
+void Inliner::specializeCalls(std::unique_ptr<ASTNode>& node) {
+    if (!node || node->type == ASTNodeType::FUNCTION_DECL) return;
+    specializeCalls(node->condition);
+    specializeCalls(node->left);
+    specializeCalls(node->right);
+    for (auto& child : node->children) {
+        specializeCalls(child);
+    }
+    if (node->type == ASTNodeType::CALL) specialize(node);
+}
+
+static void collectCallees(const std::unique_ptr<ASTNode>& node, std::set<std::string>& names) {
+    if (!node || node->type == ASTNodeType::FUNCTION_DECL) return;
+    if (node->type == ASTNodeType::CALL) names.insert(node->value);
+    collectCallees(node->condition, names);
+    collectCallees(node->left, names);
+    collectCallees(node->right, names);
+    for (const auto& child : node->children) {
+        collectCallees(child, names);
+    }
+}
+
+// Drop the definitions and prototypes of functions the program no longer
+// reaches through calls from its top-level statements
+void Inliner::removeUncalled(std::unique_ptr<ASTNode>& program) {
+    std::unordered_map<std::string, const ASTNode*> definitions;
+    for (const auto& child : program->children) {
+        if (child->type == ASTNodeType::FUNCTION_DECL && child->left) definitions[child->value] = child.get();
+    }
+
+    std::set<std::string> live;
+    collectCallees(program, live);
+    std::vector<std::string> pending(live.begin(), live.end());
+    while (!pending.empty()) {
+        auto it = definitions.find(pending.back());
+        pending.pop_back();
+        if (it == definitions.end()) continue;
+        std::set<std::string> callees;
+        collectCallees(it->second->left, callees);
+        for (const std::string& callee : callees) {
+            if (live.insert(callee).second) pending.push_back(callee);
+        }
+    }
+
+    std::vector<std::unique_ptr<ASTNode>> kept;
+    for (auto& child : program->children) {
+        // A function named main is left for code generation to reject
+        if (child->type == ASTNodeType::FUNCTION_DECL && !live.count(child->value) && child->value != "main") {
+            if (child->left) removedCount++;
+            continue;
+        }
+        kept.push_back(std::move(child));
+    }
+    program->children = std::move(kept);
+}
+
+void Inliner::optimize(std::unique_ptr<ASTNode>& program) {
+    if (!program || program->type != ASTNodeType::PROGRAM || options.growthBudget <= 0) return;
+    buildCallGraph(program);
+    if (functions.empty()) return;
+
+    // Callees first, then the program's own statements
+    std::set<std::string> visited;
+    std::vector<std::string> order;
+    for (const auto& child : program->children) {
+        if (child->type == ASTNodeType::FUNCTION_DECL && child->left) postOrder(child->value, visited, order);
+    }
+    for (const std::string& name : order) {
+        loopDepth = 0;
+        inlineSlot(functions[name].node->left);
+    }
+    loopDepth = 0;
+    programStatements = &program->children;
+    inlineList(program->children);
+    programStatements = nullptr;
+
+    for (const std::string& name : order) {
+        specializeCalls(functions[name].node->left);
+    }
+    specializeCalls(program);
+    for (auto& clone : clones) {
+        program->children.push_back(std::move(clone));
+    }
+    clones.clear();
+
+    removeUncalled(program);
+}
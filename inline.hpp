@@ -0,0 +1,98 @@
+#ifndef INLINE_HPP
+#define INLINE_HPP
+
+#include "parser.hpp"
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Tunable parameters of the inliner. Sizes are AST node counts of a
+// callee's body, a rough measure of the instructions it generates.
+struct InlineOptions {
+    int smallSize = 16;            // Callees inlined at every call site (doubled inside loops)
+    int singleCallSize = 120;      // Callees inlined at their only call site
+    int growthBudget = 400;        // Nodes inlining and specialization may add; 0 disables both
+    int maxSpecializations = 8;    // Clones of functions for constant arguments
+};
+
+// Function inlining over the call graph, callees before callers, so a
+// function is inlined with its own calls already expanded. A call is
+// replaced by the callee when the callee is small or the call is its only
+// one, while the program's growth stays within the budget; recursive
+// functions are never inlined. A callee whose body is a single return is
+// substituted into the calling expression. Otherwise a call that is a
+// whole statement, the value of an assignment, declaration or return, or
+// one of the unconditional calls in such an expression, becomes a block: the arguments
+// initialize fresh variables, returns assign a result variable, and the
+// statements after a returning branch move into the branch that falls
+// through. A call that stays but passes literals for parameters the callee
+// branches on is redirected to a clone with those parameters bound.
+// Functions no longer called are removed.
+class Inliner {
+private:
+    struct Function {
+        ASTNode* node;
+        std::set<std::string> callees;
+        int callSites = 0;
+        bool recursive = false;
+    };
+
+    InlineOptions options;
+    std::unordered_map<std::string, Function> functions;
+    std::map<std::string, std::string> specializations;     // Signature -> clone name
+    std::vector<std::unique_ptr<ASTNode>> clones;
+    int growth;
+    int loopDepth;
+    const std::vector<std::unique_ptr<ASTNode>>* programStatements;
+    bool valueUsed;             // Whether the statement being expanded yields the exit code
+    int inlineCounter;
+    int inlinedCount;
+    int specializedCount;
+    int removedCount;
+
+    // Size bonus per literal argument for a parameter the callee branches on
+    static const int CONSTANT_ARGUMENT_BONUS = 4;
+
+    void buildCallGraph(const std::unique_ptr<ASTNode>& program);
+    void collectCalls(const std::unique_ptr<ASTNode>& node, Function* caller);
+    void postOrder(const std::string& name, std::set<std::string>& visited, std::vector<std::string>& order);
+    bool reaches(const std::string& from, const std::string& to, std::set<std::string>& visited);
+
+    static bool usedInCondition(const std::unique_ptr<ASTNode>& node, const std::string& name);
+    static const std::unique_ptr<ASTNode>* singleReturn(const ASTNode* function);
+    static bool alwaysReturns(const std::unique_ptr<ASTNode>& node);
+    bool shouldInline(const std::unique_ptr<ASTNode>& call, const Function*& callee);
+
+    std::unique_ptr<ASTNode> substitute(const std::unique_ptr<ASTNode>& expr, const ASTNode* function,
+                                        std::vector<std::unique_ptr<ASTNode>>& arguments);
+    bool canSubstitute(const std::unique_ptr<ASTNode>& call, const std::unique_ptr<ASTNode>& expr,
+                       const ASTNode* function);
+    void renameLocals(std::unique_ptr<ASTNode>& node, std::unordered_map<std::string, std::string>& names,
+                      const std::string& prefix);
+    bool removeReturns(std::vector<std::unique_ptr<ASTNode>>& list, const std::string& result);
+    std::unique_ptr<ASTNode>* findHoistableCall(std::unique_ptr<ASTNode>& statement);
+    bool expandCall(std::unique_ptr<ASTNode>& statement, std::vector<std::unique_ptr<ASTNode>>& expansion);
+    bool specialize(std::unique_ptr<ASTNode>& call);
+    void specializeCalls(std::unique_ptr<ASTNode>& node);
+
+    void inlineExpression(std::unique_ptr<ASTNode>& node);
+    void inlineStatement(std::unique_ptr<ASTNode>& node, std::vector<std::unique_ptr<ASTNode>>& expansion);
+    void inlineList(std::vector<std::unique_ptr<ASTNode>>& list);
+    void inlineSlot(std::unique_ptr<ASTNode>& node);
+    void removeUncalled(std::unique_ptr<ASTNode>& program);
+
+public:
+    explicit Inliner(const InlineOptions& opts = InlineOptions());
+
+    // Inline and specialize the calls of a program in place
+    void optimize(std::unique_ptr<ASTNode>& program);
+
+    int getInlinedCount() const { return inlinedCount; }
+    int getSpecializedCount() const { return specializedCount; }
+    int getRemovedCount() const { return removedCount; }
+};
+
+#endif // INLINE_HPP
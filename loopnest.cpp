@@ -0,0 +1,368 @@
+#include "loopnest.hpp"
+#include "analysis.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+// Coefficients and offsets past this are not worth reasoning about
+static const long long MAX_AFFINE = 1LL << 40;
+
+LoopNestOptimizer::LoopNestOptimizer(const LoopNestOptions& opts)
+    : options(opts), tempCounter(0), interchangedCount(0), tiledCount(0) {}
+
+std::string LoopNestOptimizer::newTemporary(const std::string& prefix) {
+    return prefix + std::to_string(tempCounter++);
+}
+
+void LoopNestOptimizer::optimize(std::unique_ptr<ASTNode>& program) {
+    arraySizes.clear();
+    collectArrays(program);
+    optimizeStatement(program);
+}
+
+// Array sizes by name; arrays of different functions may share a name, and
+// the largest is assumed
+void LoopNestOptimizer::collectArrays(const std::unique_ptr<ASTNode>& node) {
+    if (!node) return;
+    if (node->type == ASTNodeType::ARRAY_DECL) {
+        long long& size = arraySizes[node->value];
+        size = std::max(size, static_cast<long long>(node->intValue));
+    }
+    collectArrays(node->left);
+    collectArrays(node->right);
+    for (const auto& child : node->children) {
+        collectArrays(child);
+    }
+}
+
+// Outer loops are tried first, since a transformed nest includes its inner loops
+void LoopNestOptimizer::optimizeStatement(std::unique_ptr<ASTNode>& node) {
+    if (!node) return;
+
+    switch (node->type) {
+        case ASTNodeType::PROGRAM:
+        case ASTNodeType::COMPOUND_STMT:
+        case ASTNodeType::SWITCH_STMT:
+            for (auto& child : node->children) {
+                optimizeStatement(child);
+            }
+            break;
+
+        case ASTNodeType::IF_STMT:
+            optimizeStatement(node->left);
+            optimizeStatement(node->right);
+            break;
+
+        case ASTNodeType::FUNCTION_DECL:
+        case ASTNodeType::WHILE_STMT:
+            optimizeStatement(node->left);
+            break;
+
+        case ASTNodeType::FOR_STMT:
+            if (!transformNest(node)) {
+                optimizeStatement(node->left);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+// for (int v = lower; v < upper; v = v + 1), or v <= upper - 1
+bool LoopNestOptimizer::matchLoop(const std::unique_ptr<ASTNode>& node, Loop& loop) {
+    if (!node || node->type != ASTNodeType::FOR_STMT || node->children.size() < 2 || !node->left) {
+        return false;
+    }
+    const auto& init = node->children[0];
+    if (!init || init->type != ASTNodeType::VAR_DECL || !init->left || init->left->type != ASTNodeType::INTLIT) {
+        return false;
+    }
+    loop.variable = init->value;
+    loop.lower = init->left->intValue;
+
+    const auto& condition = node->condition;
+    if (!condition || (condition->type != ASTNodeType::LT && condition->type != ASTNodeType::LE) ||
+        !condition->left || condition->left->type != ASTNodeType::IDENTIFIER ||
+        condition->left->value != loop.variable || !condition->right ||
+        condition->right->type != ASTNodeType::INTLIT) {
+        return false;
+    }
+    loop.upper = static_cast<long long>(condition->right->intValue) + (condition->type == ASTNodeType::LE ? 1 : 0);
+
+    const auto& update = node->children[1];
+    auto isVariable = [&loop](const std::unique_ptr<ASTNode>& n) {
+        return n && n->type == ASTNodeType::IDENTIFIER && n->value == loop.variable;
+    };
+    auto isOne = [](const std::unique_ptr<ASTNode>& n) {
+        return n && n->type == ASTNodeType::INTLIT && n->intValue == 1;
+    };
+    return update && update->type == ASTNodeType::ASSIGN && isVariable(update->left) && update->right &&
+           update->right->type == ASTNodeType::ADD &&
+           ((isVariable(update->right->left) && isOne(update->right->right)) ||
+            (isOne(update->right->left) && isVariable(update->right->right)));
+}
+
+// Add scale * node to 'affine'; false unless it is affine in the loop variables
+bool LoopNestOptimizer::affineSubscript(const std::unique_ptr<ASTNode>& node, const std::set<std::string>& variables,
+                                        long long scale, Affine& affine) {
+    if (!node || std::llabs(scale) > MAX_AFFINE) return false;
+
+    switch (node->type) {
+        case ASTNodeType::INTLIT:
+            affine.constant += scale * node->intValue;
+            return std::llabs(affine.constant) <= MAX_AFFINE;
+
+        case ASTNodeType::IDENTIFIER: {
+            if (!variables.count(node->value)) return false;
+            long long& coefficient = affine.coefficients[node->value];
+            coefficient += scale;
+            if (coefficient == 0) {
+                affine.coefficients.erase(node->value);
+            }
+            return true;
+        }
+
+        case ASTNodeType::ADD:
+        case ASTNodeType::SUBTRACT:
+            return affineSubscript(node->left, variables, scale, affine) &&
+                   affineSubscript(node->right, variables, node->type == ASTNodeType::ADD ? scale : -scale,
+                                   affine);
+
+        case ASTNodeType::MULTIPLY:
+            if (node->right && node->right->type == ASTNodeType::INTLIT) {
+                return affineSubscript(node->left, variables, scale * node->right->intValue, affine);
+            }
+            if (node->left && node->left->type == ASTNodeType::INTLIT) {
+                return affineSubscript(node->right, variables, scale * node->left->intValue, affine);
+            }
+            return false;
+
+        case ASTNodeType::NEGATE:
+            return affineSubscript(node->left, variables, -scale, affine);
+
+        case ASTNodeType::POSITIVE:
+            return affineSubscript(node->left, variables, scale, affine);
+
+        default:
+            return false;
+    }
+}
+
+// The elements an expression reads; false if it has side effects or a
+// subscript is not affine
+bool LoopNestOptimizer::collectAccesses(const std::unique_ptr<ASTNode>& node, const std::set<std::string>& variables,
+                                        std::vector<Access>& accesses) {
+    if (!node) return true;
+    if (node->type == ASTNodeType::INDEX) {
+        Access access{node->value, Affine(), false};
+        if (!affineSubscript(node->left, variables, 1, access.subscript)) return false;
+        accesses.push_back(access);
+        return true;
+    }
+    if (node->type == ASTNodeType::ASSIGN || node->type == ASTNodeType::CALL) {
+        return false;
+    }
+    if (!collectAccesses(node->left, variables, accesses) || !collectAccesses(node->right, variables, accesses) ||
+        !collectAccesses(node->condition, variables, accesses)) {
+        return false;
+    }
+    for (const auto& child : node->children) {
+        if (!collectAccesses(child, variables, accesses)) return false;
+    }
+    return true;
+}
+
+// Every access to a written array uses the same subscript, and it tells
+// apart the iterations of all loops but at most one: its coefficients, in
+// increasing size, each exceed the span of the smaller ones
+bool LoopNestOptimizer::preservesDependences(const std::vector<Loop>& loops, const std::vector<Access>& accesses) {
+    for (const Access& write : accesses) {
+        if (!write.write) continue;
+        for (const Access& access : accesses) {
+            if (access.array == write.array && !(access.subscript == write.subscript)) return false;
+        }
+
+        std::vector<std::pair<long long, long long>> strides;   // |coefficient|, extent
+        int free = 0;
+        for (const Loop& loop : loops) {
+            auto it = write.subscript.coefficients.find(loop.variable);
+            if (it == write.subscript.coefficients.end()) {
+                free++;
+            } else {
+                strides.push_back({std::llabs(it->second), loop.upper - loop.lower});
+            }
+        }
+        if (free > 1) return false;
+
+        std::sort(strides.begin(), strides.end());
+        long long span = 0;
+        for (const auto& stride : strides) {
+            if (stride.first <= span) return false;
+            span += stride.first * (stride.second - 1);
+        }
+    }
+    return true;
+}
+
+// Largest power of two such that a square tile of every array the nest
+// touches fits in half the cache; 0 if the arrays fit the cache already
+int LoopNestOptimizer::tileSize(const std::vector<Access>& accesses) {
+    std::set<std::string> arrays;
+    long long footprint = 0;
+    for (const Access& access : accesses) {
+        if (arrays.insert(access.array).second) {
+            auto it = arraySizes.find(access.array);
+            footprint += (it != arraySizes.end() ? it->second : 0) * 4;
+        }
+    }
+    if (options.cacheSize <= 0 || footprint <= options.cacheSize) return 0;
+
+    long long budget = options.cacheSize / 2 / (4 * static_cast<long long>(arrays.size()));
+    int tile = MIN_TILE;
+    while (static_cast<long long>(tile) * 2 * tile * 2 <= budget) {
+        tile *= 2;
+    }
+    return static_cast<long long>(tile) * tile <= budget ? tile : 0;
+}
+
+std::unique_ptr<ASTNode> LoopNestOptimizer::makeLoop(const std::string& variable, std::unique_ptr<ASTNode> lower,
+                                                     std::unique_ptr<ASTNode> upper, int step,
+                                                     std::unique_ptr<ASTNode> body) {
+    auto loop = std::make_unique<ASTNode>(ASTNodeType::FOR_STMT);
+    loop->children.push_back(makeVarDecl(variable, std::move(lower)));
+    loop->condition = makeBinary(ASTNodeType::LT, makeIdentifier(variable), std::move(upper));
+    loop->children.push_back(
+        makeAssignment(variable, makeBinary(ASTNodeType::ADD, makeIdentifier(variable), makeIntLiteral(step))));
+    loop->left = std::move(body);
+    return loop;
+}
+
+// Reorder and tile a perfect nest rooted at 'node'; false if it is not one
+// or is already in the best shape
+bool LoopNestOptimizer::transformNest(std::unique_ptr<ASTNode>& node) {
+    std::vector<Loop> loops;
+    std::set<std::string> variables;
+    std::unique_ptr<ASTNode>* body = &node;
+    Loop loop;
+    while (matchLoop(*body, loop)) {
+        if (!variables.insert(loop.variable).second || loop.lower >= loop.upper || loop.upper > INT_MAX) {
+            return false;
+        }
+        loops.push_back(loop);
+        body = &(*body)->left;
+        if ((*body)->type == ASTNodeType::COMPOUND_STMT && (*body)->children.size() == 1) {
+            body = &(*body)->children[0];
+        }
+    }
+    if (loops.size() < 2) return false;
+
+    // The innermost body: assignments to elements, reading elements,
+    // loop variables and scalars it never changes
+    std::vector<const std::unique_ptr<ASTNode>*> statements;
+    if ((*body)->type == ASTNodeType::COMPOUND_STMT) {
+        for (const auto& child : (*body)->children) {
+            statements.push_back(&child);
+        }
+    } else {
+        statements.push_back(body);
+    }
+    std::vector<Access> accesses;
+    for (const auto* statement : statements) {
+        const auto& s = *statement;
+        if (!s || s->type != ASTNodeType::EXPRESSION_STMT || !s->left || s->left->type != ASTNodeType::ASSIGN ||
+            !s->left->left || s->left->left->type != ASTNodeType::INDEX) {
+            return false;
+        }
+        if (!collectAccesses(s->left->right, variables, accesses)) return false;
+        Access store{s->left->left->value, Affine(), true};
+        if (!affineSubscript(s->left->left->left, variables, 1, store.subscript)) return false;
+        accesses.push_back(store);
+    }
+    if (!preservesDependences(loops, accesses)) return false;
+
+    // Loops stepping over more elements go further out
+    std::vector<Loop> order = loops;
+    for (Loop& l : order) {
+        for (const Access& access : accesses) {
+            auto it = access.subscript.coefficients.find(l.variable);
+            if (it != access.subscript.coefficients.end()) {
+                l.cost += std::min(std::llabs(it->second), CACHE_LINE_ELEMENTS);
+            }
+        }
+    }
+    if (options.interchange) {
+        std::stable_sort(order.begin(), order.end(), [](const Loop& a, const Loop& b) { return a.cost > b.cost; });
+    }
+    bool interchanged = false;
+    for (size_t i = 0; i < loops.size(); i++) {
+        interchanged = interchanged || order[i].variable != loops[i].variable;
+    }
+
+    // Tiles pay off when an element is used again in a later iteration of
+    // an outer loop, or the innermost loop leaves a cache line per step
+    bool reuse = false;
+    for (const Access& access : accesses) {
+        auto inner = access.subscript.coefficients.find(order.back().variable);
+        reuse = reuse || access.subscript.coefficients.size() < order.size() ||
+                (inner != access.subscript.coefficients.end() && std::llabs(inner->second) >= CACHE_LINE_ELEMENTS);
+    }
+    int tile = reuse ? tileSize(accesses) : 0;
+    std::vector<bool> tiled;
+    bool anyTiled = false;
+    for (const Loop& l : order) {
+        tiled.push_back(tile > 0 && l.upper - l.lower > tile);
+        anyTiled = anyTiled || tiled.back();
+    }
+    if (!interchanged && !anyTiled) return false;
+
+    // Element loops, innermost first, around the original body
+    std::unique_ptr<ASTNode> nest = std::move(*body);
+    std::vector<std::string> tileVariables(order.size());
+    std::vector<std::unique_ptr<ASTNode>> tileEnds;
+    for (size_t i = order.size(); i-- > 0;) {
+        const Loop& l = order[i];
+        if (!tiled[i]) {
+            nest = makeLoop(l.variable, makeIntLiteral(static_cast<int>(l.lower)),
+                            makeIntLiteral(static_cast<int>(l.upper)), 1, std::move(nest));
+            continue;
+        }
+        // The last tile may be partial: end = min(tile start + tile, upper)
+        tileVariables[i] = newTemporary("__tile");
+        std::string end = newTemporary("__tile_end");
+        auto next = makeBinary(ASTNodeType::ADD, makeIdentifier(tileVariables[i]), makeIntLiteral(tile));
+        if ((l.upper - l.lower) % tile != 0) {
+            auto conditional = std::make_unique<ASTNode>(ASTNodeType::CONDITIONAL);
+            conditional->condition = makeBinary(ASTNodeType::LT, cloneAST(next),
+                                                makeIntLiteral(static_cast<int>(l.upper)));
+            conditional->left = std::move(next);
+            conditional->right = makeIntLiteral(static_cast<int>(l.upper));
+            next = std::move(conditional);
+        }
+        tileEnds.push_back(makeVarDecl(end, std::move(next)));
+        nest = makeLoop(l.variable, makeIdentifier(tileVariables[i]), makeIdentifier(end), 1, std::move(nest));
+    }
+
+    // Tile loops outermost, in the same order, with the tile ends computed
+    // once per tile
+    if (anyTiled) {
+        auto block = makeCompound();
+        for (auto it = tileEnds.rbegin(); it != tileEnds.rend(); ++it) {
+            block->children.push_back(std::move(*it));
+        }
+        block->children.push_back(std::move(nest));
+        nest = std::move(block);
+        for (size_t i = order.size(); i-- > 0;) {
+            if (tiled[i]) {
+                nest = makeLoop(tileVariables[i], makeIntLiteral(static_cast<int>(order[i].lower)),
+                                makeIntLiteral(static_cast<int>(order[i].upper)), tile, std::move(nest));
+            }
+        }
+        tiledCount++;
+    }
+    if (interchanged) {
+        interchangedCount++;
+    }
+    node = std::move(nest);
+    return true;
+}
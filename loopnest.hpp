@@ -0,0 +1,96 @@
+#ifndef LOOPNEST_HPP
+#define LOOPNEST_HPP
+
+#include "parser.hpp"
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// Tunable parameters of the loop nest optimizer
+struct LoopNestOptions {
+    bool interchange = true;       // Reorder loops for short innermost strides
+    int cacheSize = 32 * 1024;     // Bytes of L1 data cache tiles are sized for; 0 disables tiling
+};
+
+// Interchange and tiling of perfect nests of counted loops, each
+// 'for (int v = lo; v < hi; v = v + 1)' (or <=) with literal bounds and the
+// next loop as its whole body, the innermost one only assigning array
+// elements whose subscripts are affine in the loop variables. Loops are
+// reordered so the ones stepping through memory by the most elements per
+// iteration are outermost and the innermost one walks along rows. When
+// the arrays the nest touches do not fit the cache and an element or its
+// cache line is used again by a later iteration of an outer loop, loops
+// longer than a tile are split into a loop over tiles and one within a
+// tile, the tile loops outermost, so each tile's data is reused while it
+// is cached.
+//
+// Both transformations preserve every dependence the nest can have:
+// distinct arrays never overlap, arrays only read may be read in any
+// order, and every access to a written array must use one subscript that
+// tells apart the iterations of all loops but at most one. Iterations
+// touching the same element then differ only in that loop, which still
+// runs them in increasing order.
+class LoopNestOptimizer {
+private:
+    struct Loop {
+        std::string variable;
+        long long lower;
+        long long upper;            // Exclusive
+        long long cost = 0;         // Elements stepped over per iteration, summed over the accesses
+    };
+
+    // A subscript: constant + the sum of coefficient * loop variable
+    struct Affine {
+        std::map<std::string, long long> coefficients;
+        long long constant = 0;
+
+        bool operator==(const Affine& other) const {
+            return coefficients == other.coefficients && constant == other.constant;
+        }
+    };
+
+    struct Access {
+        std::string array;
+        Affine subscript;
+        bool write;
+    };
+
+    LoopNestOptions options;
+    std::map<std::string, long long> arraySizes;    // Elements of each declared array
+    int tempCounter;
+    int interchangedCount;
+    int tiledCount;
+
+    // Strides of this many elements or more touch a new cache line every iteration
+    static constexpr long long CACHE_LINE_ELEMENTS = 16;
+    static const int MIN_TILE = 8;
+
+    void collectArrays(const std::unique_ptr<ASTNode>& node);
+    void optimizeStatement(std::unique_ptr<ASTNode>& node);
+
+    static bool matchLoop(const std::unique_ptr<ASTNode>& node, Loop& loop);
+    static bool affineSubscript(const std::unique_ptr<ASTNode>& node, const std::set<std::string>& variables,
+                                long long scale, Affine& affine);
+    static bool collectAccesses(const std::unique_ptr<ASTNode>& node, const std::set<std::string>& variables,
+                                std::vector<Access>& accesses);
+    static bool preservesDependences(const std::vector<Loop>& loops, const std::vector<Access>& accesses);
+    int tileSize(const std::vector<Access>& accesses);
+
+    std::unique_ptr<ASTNode> makeLoop(const std::string& variable, std::unique_ptr<ASTNode> lower,
+                                      std::unique_ptr<ASTNode> upper, int step, std::unique_ptr<ASTNode> body);
+    bool transformNest(std::unique_ptr<ASTNode>& node);
+    std::string newTemporary(const std::string& prefix);
+
+public:
+    explicit LoopNestOptimizer(const LoopNestOptions& opts = LoopNestOptions());
+
+    // Interchange and tile the loop nests of a program in place
+    void optimize(std::unique_ptr<ASTNode>& program);
+
+    int getInterchangedCount() const { return interchangedCount; }
+    int getTiledCount() const { return tiledCount; }
+};
+
+#endif // LOOPNEST_HPP
@@ -0,0 +1,605 @@
+#include "loopopt.hpp"
+#include "analysis.hpp"
+#include "scev.hpp"
+#include "vectorize.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <unordered_map>
+
+LoopOptimizer::LoopOptimizer(const LoopOptions& opts)
+    : options(opts), tempCounter(0), reducedCount(0), unrolledCount(0), closedFormCount(0),
+      unswitchedCount(0), unswitchGrowth(0) {}
+
+void LoopOptimizer::optimize(std::unique_ptr<ASTNode>& program) {
+    optimizeStatement(program);
+}
+
+std::string LoopOptimizer::newTemporary(const std::string& prefix) {
+    return prefix + std::to_string(tempCounter++);
+}
+
+// Inner loops are transformed first, so an outer loop sees their final shape,
+// except that a loop is unswitched before the loops inside it: a test
+// invariant in both is best moved out of the outer one
+void LoopOptimizer::optimizeStatement(std::unique_ptr<ASTNode>& node) {
+    if (!node) return;
+
+    switch (node->type) {
+        case ASTNodeType::PROGRAM:
+        case ASTNodeType::COMPOUND_STMT:
+        case ASTNodeType::SWITCH_STMT:
+            for (auto& child : node->children) {
+                optimizeStatement(child);
+            }
+            break;
+
+        case ASTNodeType::IF_STMT:
+            optimizeStatement(node->left);
+            optimizeStatement(node->right);
+            break;
+
+        case ASTNodeType::FUNCTION_DECL:
+            optimizeStatement(node->left);
+            break;
+
+        case ASTNodeType::WHILE_STMT:
+        case ASTNodeType::FOR_STMT:
+            if (unswitch(node)) {
+                optimizeStatement(node);
+                break;
+            }
+            optimizeStatement(node->left);
+            optimizeLoop(node);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// A transformed loop is replaced by a block holding its init statement, the
+// setup of any derived induction variables and the resulting loop(s)
+void LoopOptimizer::optimizeLoop(std::unique_ptr<ASTNode>& node) {
+    if (node->type == ASTNodeType::WHILE_STMT && !convertWhileToFor(node)) {
+        return;
+    }
+    VectorLoopPlan plan;
+    if (options.vectorLanes > 1 && LoopVectorizer::analyze(node, options.vectorLanes, plan)) {
+        return;
+    }
+
+    InductionVariable iv;
+    std::set<std::string> modified;
+    if (!findInductionVariable(node, iv, modified)) {
+        return;
+    }
+    if (options.closedForms && replaceWithClosedForm(node, iv, modified)) {
+        return;
+    }
+
+    std::unique_ptr<ASTNode> init = std::move(node->children[0]);
+    std::vector<std::unique_ptr<ASTNode>> prologue;
+    std::vector<std::unique_ptr<ASTNode>> loops;
+
+    bool reduced = options.strengthReduce && strengthReduce(node, iv, modified, prologue);
+    bool unrolled = options.unrollFactor > 1 && unroll(node, init, iv, modified, loops);
+    bool pipelined = !unrolled && options.pipeline && pipeline(node, iv);
+
+    if (!reduced && !unrolled && !pipelined) {
+        node->children[0] = std::move(init);
+        return;
+    }
+    if (!unrolled) {
+        loops.push_back(std::move(node));
+    }
+
+    auto block = makeCompound();
+    if (init) {
+        block->children.push_back(std::move(init));
+    }
+    for (auto& stmt : prologue) {
+        block->children.push_back(std::move(stmt));
+    }
+    for (auto& stmt : loops) {
+        block->children.push_back(std::move(stmt));
+    }
+    node = std::move(block);
+}
+
+// The first if statement in a loop body whose condition the loop does not
+// change, other than one already decided
+const ASTNode* LoopOptimizer::findInvariantTest(const std::unique_ptr<ASTNode>& node,
+                                                const std::set<std::string>& modified) {
+    if (!node) return nullptr;
+
+    if (node->type == ASTNodeType::IF_STMT && node->condition && node->condition->type != ASTNodeType::INTLIT &&
+        node->condition->type != ASTNodeType::BOOLLIT && isInvariantExpression(node->condition, modified)) {
+        return node.get();
+    }
+    if (const ASTNode* test = findInvariantTest(node->left, modified)) return test;
+    if (const ASTNode* test = findInvariantTest(node->right, modified)) return test;
+    for (const auto& child : node->children) {
+        if (const ASTNode* test = findInvariantTest(child, modified)) return test;
+    }
+    return nullptr;
+}
+
+// Replace every if statement testing the condition with key 'key' by the
+// branch it takes when the condition is 'outcome'
+static void selectBranch(std::unique_ptr<ASTNode>& node, const std::string& key, bool outcome) {
+    if (!node) return;
+
+    if (node->type == ASTNodeType::IF_STMT && node->condition && expressionKey(node->condition) == key) {
+        std::unique_ptr<ASTNode> branch = std::move(outcome ? node->left : node->right);
+        node = branch ? std::move(branch) : makeCompound();
+        selectBranch(node, key, outcome);
+        return;
+    }
+    selectBranch(node->left, key, outcome);
+    selectBranch(node->right, key, outcome);
+    for (auto& child : node->children) {
+        selectBranch(child, key, outcome);
+    }
+}
+
+// Turn a loop containing 'if (c)' with c invariant into
+// 'if (c) loop else loop', each copy keeping only the branches its outcome
+// takes. The condition is safe to evaluate, so testing it once on entry is
+// the same as testing it in every iteration, even if the loop never runs.
+// Every name the loop declares counts as modified, so each test of c in
+// the loop reads the same variables.
+bool LoopOptimizer::unswitch(std::unique_ptr<ASTNode>& loop) {
+    if (options.unswitchBudget <= 0) return false;
+
+    std::set<std::string> modified;
+    collectAssignedVariables(loop, modified);
+    const ASTNode* test = findInvariantTest(loop->left, modified);
+    if (!test) return false;
+
+    int size = countNodes(loop);
+    if (unswitchGrowth + size > options.unswitchBudget) return false;
+    unswitchGrowth += size;
+    unswitchedCount++;
+
+    std::string key = expressionKey(test->condition);
+    auto guard = std::make_unique<ASTNode>(ASTNodeType::IF_STMT);
+    guard->condition = cloneAST(test->condition);
+    guard->right = cloneAST(loop);
+    selectBranch(loop->left, key, true);
+    selectBranch(guard->right->left, key, false);
+    guard->left = std::move(loop);
+    loop = std::move(guard);
+    return true;
+}
+
+// Match 'name = name + step', 'name = step + name' or 'name = name - step'
+bool LoopOptimizer::matchIncrement(const std::unique_ptr<ASTNode>& expr, std::string& name,
+                                   std::unique_ptr<ASTNode>& step) {
+    if (!expr || expr->type != ASTNodeType::ASSIGN || !expr->left ||
+        expr->left->type != ASTNodeType::IDENTIFIER || !expr->right) {
+        return false;
+    }
+
+    const std::string& var = expr->left->value;
+    const auto& value = expr->right;
+    auto isVar = [&var](const std::unique_ptr<ASTNode>& n) {
+        return n && n->type == ASTNodeType::IDENTIFIER && n->value == var;
+    };
+
+    if (value->type == ASTNodeType::ADD && isVar(value->left) && value->right) {
+        step = cloneAST(value->right);
+    } else if (value->type == ASTNodeType::ADD && isVar(value->right) && value->left) {
+        step = cloneAST(value->left);
+    } else if (value->type == ASTNodeType::SUBTRACT && isVar(value->left) && value->right) {
+        if (value->right->type == ASTNodeType::INTLIT && value->right->intValue != INT_MIN) {
+            step = makeIntLiteral(-value->right->intValue);
+        } else {
+            step = std::make_unique<ASTNode>(ASTNodeType::NEGATE);
+            step->left = cloneAST(value->right);
+        }
+    } else {
+        return false;
+    }
+
+    name = var;
+    return true;
+}
+
+// 'while (c) { S; i = i + k; }' is 'for (; c; i = i + k) { S; }' when S
+// neither assigns i nor declares anything the update reads
+bool LoopOptimizer::convertWhileToFor(std::unique_ptr<ASTNode>& node) {
+    auto& body = node->left;
+    if (!body) return false;
+
+    std::unique_ptr<ASTNode>* last = nullptr;
+    if (body->type == ASTNodeType::COMPOUND_STMT && !body->children.empty()) {
+        last = &body->children.back();
+    } else if (body->type == ASTNodeType::EXPRESSION_STMT) {
+        last = &body;
+    }
+    if (!last || !*last || (*last)->type != ASTNodeType::EXPRESSION_STMT) {
+        return false;
+    }
+
+    std::string name;
+    std::unique_ptr<ASTNode> step;
+    if (!matchIncrement((*last)->left, name, step)) {
+        return false;
+    }
+
+    std::set<std::string> others;
+    collectAssignedVariables(node->condition, others);
+    if (body->type == ASTNodeType::COMPOUND_STMT) {
+        for (size_t i = 0; i + 1 < body->children.size(); i++) {
+            collectAssignedVariables(body->children[i], others);
+        }
+    }
+    if (others.count(name)) return false;
+    others.insert(name);
+    if (!isInvariantExpression(step, others)) return false;
+
+    auto update = std::move((*last)->left);
+    if (last == &body) {
+        body = makeCompound();
+    } else {
+        body->children.pop_back();
+    }
+
+    node->type = ASTNodeType::FOR_STMT;
+    node->children.clear();
+    node->children.push_back(nullptr);
+    node->children.push_back(std::move(update));
+    return true;
+}
+
+// A basic induction variable is updated only by the loop's update
+// expression, by a loop-invariant step. 'modified' receives every variable
+// the loop writes.
+bool LoopOptimizer::findInductionVariable(const std::unique_ptr<ASTNode>& loop, InductionVariable& iv,
+                                          std::set<std::string>& modified) {
+    if (loop->type != ASTNodeType::FOR_STMT || loop->children.size() < 2 || !loop->children[1]) {
+        return false;
+    }
+    if (!matchIncrement(loop->children[1], iv.name, iv.step)) {
+        return false;
+    }
+
+    modified.clear();
+    collectAssignedVariables(loop->left, modified);
+    collectAssignedVariables(loop->condition, modified);
+    if (modified.count(iv.name)) {
+        return false;
+    }
+    modified.insert(iv.name);
+    return isInvariantExpression(iv.step, modified);
+}
+
+void LoopOptimizer::collectProducts(std::unique_ptr<ASTNode>& node, const InductionVariable& iv,
+                                    const std::set<std::string>& modified,
+                                    std::vector<std::unique_ptr<ASTNode>*>& products) {
+    if (!node) return;
+
+    if (node->type == ASTNodeType::MULTIPLY && node->left && node->right) {
+        auto isVar = [&iv](const std::unique_ptr<ASTNode>& n) {
+            return n->type == ASTNodeType::IDENTIFIER && n->value == iv.name;
+        };
+        if ((isVar(node->left) && isInvariantExpression(node->right, modified)) ||
+            (isVar(node->right) && isInvariantExpression(node->left, modified))) {
+            products.push_back(&node);
+            return;
+        }
+    }
+
+    collectProducts(node->left, iv, modified, products);
+    collectProducts(node->right, iv, modified, products);
+    collectProducts(node->condition, iv, modified, products);
+    for (auto& child : node->children) {
+        collectProducts(child, iv, modified, products);
+    }
+}
+
+// Each distinct product i * k becomes a variable t set to i * k before the
+// loop and advanced by step * k at the end of every iteration, so the
+// multiplication turns into an addition
+bool LoopOptimizer::strengthReduce(std::unique_ptr<ASTNode>& loop, const InductionVariable& iv,
+                                   const std::set<std::string>& modified,
+                                   std::vector<std::unique_ptr<ASTNode>>& prologue) {
+    std::vector<std::unique_ptr<ASTNode>*> products;
+    collectProducts(loop->condition, iv, modified, products);
+    collectProducts(loop->left, iv, modified, products);
+    if (products.empty()) {
+        return false;
+    }
+
+    std::unordered_map<std::string, std::string> temporaries;
+    std::vector<std::unique_ptr<ASTNode>> increments;
+
+    for (auto* slot : products) {
+        auto& product = *slot;
+        bool varOnLeft = product->left->type == ASTNodeType::IDENTIFIER && product->left->value == iv.name;
+        const auto& factor = varOnLeft ? product->right : product->left;
+        std::string key = expressionKey(factor);
+
+        auto it = temporaries.find(key);
+        if (it == temporaries.end()) {
+            if (static_cast<int>(temporaries.size()) >= MAX_REDUCTIONS_PER_LOOP) continue;
+
+            std::string name = newTemporary("__iv");
+            prologue.push_back(makeVarDecl(name, makeBinary(ASTNodeType::MULTIPLY,
+                                                            makeIdentifier(iv.name), cloneAST(factor))));
+
+            std::unique_ptr<ASTNode> scaled;
+            long long folded = 0;
+            if (iv.step->type == ASTNodeType::INTLIT && factor->type == ASTNodeType::INTLIT) {
+                folded = static_cast<long long>(iv.step->intValue) * factor->intValue;
+            }
+            if (iv.step->type == ASTNodeType::INTLIT && factor->type == ASTNodeType::INTLIT &&
+                folded >= INT_MIN && folded <= INT_MAX) {
+                scaled = makeIntLiteral(static_cast<int>(folded));
+            } else {
+                scaled = makeBinary(ASTNodeType::MULTIPLY, cloneAST(iv.step), cloneAST(factor));
+            }
+            increments.push_back(makeExpressionStatement(makeAssignment(
+                name, makeBinary(ASTNodeType::ADD, makeIdentifier(name), std::move(scaled)))));
+
+            it = temporaries.emplace(key, name).first;
+        }
+        product = makeIdentifier(it->second);
+    }
+
+    if (!loop->left || loop->left->type != ASTNodeType::COMPOUND_STMT) {
+        auto body = makeCompound();
+        if (loop->left) body->children.push_back(std::move(loop->left));
+        loop->left = std::move(body);
+    }
+    for (auto& stmt : increments) {
+        loop->left->children.push_back(std::move(stmt));
+    }
+
+    reducedCount += static_cast<int>(temporaries.size());
+    return true;
+}
+
+bool LoopOptimizer::knownInitialValue(const std::unique_ptr<ASTNode>& init, const std::string& name,
+                                      long long& value) {
+    if (!init) return false;
+
+    const ASTNode* literal = nullptr;
+    if (init->type == ASTNodeType::VAR_DECL && init->value == name) {
+        literal = init->left.get();
+    } else if (init->type == ASTNodeType::EXPRESSION_STMT && init->left &&
+               init->left->type == ASTNodeType::ASSIGN && init->left->left &&
+               init->left->left->type == ASTNodeType::IDENTIFIER && init->left->left->value == name) {
+        literal = init->left->right.get();
+    }
+    if (!literal || literal->type != ASTNodeType::INTLIT) {
+        return false;
+    }
+    value = literal->intValue;
+    return true;
+}
+
+// The loop runs while 'i op bound' holds, with a constant step moving i
+// towards the bound
+bool LoopOptimizer::matchExitTest(const std::unique_ptr<ASTNode>& loop, const InductionVariable& iv,
+                                  const std::set<std::string>& modified, ASTNodeType& op,
+                                  const std::unique_ptr<ASTNode>*& bound) {
+    const auto& cond = loop->condition;
+    if (!cond || !cond->left || !cond->right || iv.step->type != ASTNodeType::INTLIT ||
+        iv.step->intValue == 0) {
+        return false;
+    }
+
+    op = cond->type;
+    if (cond->left->type == ASTNodeType::IDENTIFIER && cond->left->value == iv.name) {
+        bound = &cond->right;
+    } else if (cond->right->type == ASTNodeType::IDENTIFIER && cond->right->value == iv.name) {
+        bound = &cond->left;
+        switch (op) {
+            case ASTNodeType::LT: op = ASTNodeType::GT; break;
+            case ASTNodeType::GT: op = ASTNodeType::LT; break;
+            case ASTNodeType::LE: op = ASTNodeType::GE; break;
+            case ASTNodeType::GE: op = ASTNodeType::LE; break;
+            default: return false;
+        }
+    } else {
+        return false;
+    }
+
+    bool upward = (op == ASTNodeType::LT || op == ASTNodeType::LE) && iv.step->intValue > 0;
+    bool downward = (op == ASTNodeType::GT || op == ASTNodeType::GE) && iv.step->intValue < 0;
+    return (upward || downward) && isInvariantExpression(*bound, modified);
+}
+
+// Number of iterations from the current value of i, as an expression. The
+// comparison factor zeroes the count when the loop is not entered.
+std::unique_ptr<ASTNode> LoopOptimizer::tripCountExpression(ASTNodeType op, const std::unique_ptr<ASTNode>& bound,
+                                                            const InductionVariable& iv) {
+    int stride = std::abs(iv.step->intValue);
+    auto span = [&]() {
+        return iv.step->intValue > 0 ? makeBinary(ASTNodeType::SUBTRACT, cloneAST(bound), makeIdentifier(iv.name))
+                                     : makeBinary(ASTNodeType::SUBTRACT, makeIdentifier(iv.name), cloneAST(bound));
+    };
+
+    std::unique_ptr<ASTNode> count;
+    std::unique_ptr<ASTNode> entered;
+    if (op == ASTNodeType::LE || op == ASTNodeType::GE) {
+        // span / stride + 1 iterations when span >= 0
+        count = span();
+        if (stride != 1) count = makeBinary(ASTNodeType::DIVIDE, std::move(count), makeIntLiteral(stride));
+        count = makeBinary(ASTNodeType::ADD, std::move(count), makeIntLiteral(1));
+        entered = makeBinary(ASTNodeType::GE, span(), makeIntLiteral(0));
+    } else {
+        // ceil(span / stride) iterations when span > 0
+        count = span();
+        if (stride != 1) {
+            count = makeBinary(ASTNodeType::DIVIDE,
+                               makeBinary(ASTNodeType::ADD, std::move(count), makeIntLiteral(stride - 1)),
+                               makeIntLiteral(stride));
+        }
+        entered = makeBinary(ASTNodeType::GT, span(), makeIntLiteral(0));
+    }
+    return makeBinary(ASTNodeType::MULTIPLY, std::move(count), std::move(entered));
+}
+
+// A counted loop whose body only updates scalars with closed-form results
+// is replaced by the trip count and the exit value of each variable
+bool LoopOptimizer::replaceWithClosedForm(std::unique_ptr<ASTNode>& loop, const InductionVariable& iv,
+                                          const std::set<std::string>& modified) {
+    ASTNodeType op;
+    const std::unique_ptr<ASTNode>* bound = nullptr;
+    if (!matchExitTest(loop, iv, modified, op, bound)) {
+        return false;
+    }
+
+    ScalarEvolution scev(iv.name, iv.step->intValue, modified);
+    if (!scev.analyze(loop->left)) {
+        return false;
+    }
+
+    auto block = makeCompound();
+    if (loop->children[0]) {
+        block->children.push_back(std::move(loop->children[0]));
+    }
+    std::string trips = newTemporary("__trips");
+    block->children.push_back(makeVarDecl(trips, tripCountExpression(op, *bound, iv)));
+
+    // Exit values read the entry values of other variables, so those are
+    // only assigned once every formula reading them has been evaluated
+    auto values = scev.exitValues(trips);
+    std::vector<std::unique_ptr<ASTNode>> delayed;
+    for (size_t i = 0; i < values.size(); i++) {
+        bool readByOthers = false;
+        for (size_t j = 0; j < values.size(); j++) {
+            if (j != i && readsAnyVariable(values[j].second, {values[i].first})) {
+                readByOthers = true;
+                break;
+            }
+        }
+        if (!readByOthers) continue;
+
+        std::string temp = newTemporary("__exit");
+        block->children.push_back(makeVarDecl(temp, std::move(values[i].second)));
+        delayed.push_back(makeExpressionStatement(makeAssignment(values[i].first, makeIdentifier(temp))));
+    }
+    for (auto& value : values) {
+        if (value.second) {
+            block->children.push_back(makeExpressionStatement(makeAssignment(value.first, std::move(value.second))));
+        }
+    }
+    for (auto& stmt : delayed) {
+        block->children.push_back(std::move(stmt));
+    }
+
+    loop = std::move(block);
+    closedFormCount++;
+    return true;
+}
+
+// Unroll an innermost loop whose exit test compares the induction variable
+// with a loop-invariant bound. The main loop runs 'factor' copies of the
+// body while all of them are in range; the leftover iterations run in the
+// original loop, or as straight-line copies when the trip count is a
+// compile-time constant. Small constant-count loops are unrolled completely.
+bool LoopOptimizer::unroll(std::unique_ptr<ASTNode>& loop, const std::unique_ptr<ASTNode>& init,
+                           const InductionVariable& iv, const std::set<std::string>& modified,
+                           std::vector<std::unique_ptr<ASTNode>>& result) {
+    if (iv.step->type != ASTNodeType::INTLIT ||
+        containsNodeType(loop->left, ASTNodeType::WHILE_STMT) ||
+        containsNodeType(loop->left, ASTNodeType::FOR_STMT)) {
+        return false;
+    }
+
+    ASTNodeType op;
+    const std::unique_ptr<ASTNode>* bound = nullptr;
+    if (!matchExitTest(loop, iv, modified, op, bound)) {
+        return false;
+    }
+    long long step = iv.step->intValue;
+    bool upward = step > 0;
+
+    int bodySize = std::max(1, countNodes(loop->left) + countNodes(loop->children[1]));
+    int factor = std::min(options.unrollFactor, options.maxUnrolledSize / bodySize);
+
+    auto appendIteration = [&](std::vector<std::unique_ptr<ASTNode>>& stmts, bool withUpdate) {
+        if (loop->left) stmts.push_back(cloneAST(loop->left));
+        if (withUpdate) stmts.push_back(makeExpressionStatement(cloneAST(loop->children[1])));
+    };
+
+    // Trip count, when both ends of the range are constants
+    long long start = 0;
+    long long tripCount = -1;
+    if ((*bound)->type == ASTNodeType::INTLIT && knownInitialValue(init, iv.name, start)) {
+        long long limit = (*bound)->intValue;
+        long long span = upward ? limit - start : start - limit;
+        long long stride = upward ? step : -step;
+        if (op == ASTNodeType::LE || op == ASTNodeType::GE) {
+            tripCount = span < 0 ? 0 : span / stride + 1;
+        } else {
+            tripCount = span <= 0 ? 0 : (span + stride - 1) / stride;
+        }
+    }
+
+    if (tripCount >= 0 && tripCount * bodySize <= options.maxUnrolledSize) {
+        for (long long i = 0; i < tripCount; i++) {
+            appendIteration(result, true);
+        }
+        unrolledCount++;
+        return true;
+    }
+    if (factor < 2) {
+        return false;
+    }
+
+    // Main loop: run while the last of the 'factor' iterations is in range
+    long long offset = (factor - 1) * step;
+    std::unique_ptr<ASTNode> shifted;
+    if ((*bound)->type == ASTNodeType::INTLIT &&
+        (*bound)->intValue - offset >= INT_MIN && (*bound)->intValue - offset <= INT_MAX) {
+        shifted = makeIntLiteral(static_cast<int>((*bound)->intValue - offset));
+    } else {
+        shifted = makeBinary(ASTNodeType::SUBTRACT, cloneAST(*bound), makeIntLiteral(static_cast<int>(offset)));
+    }
+
+    auto mainLoop = std::make_unique<ASTNode>(ASTNodeType::FOR_STMT);
+    mainLoop->condition = makeBinary(op, makeIdentifier(iv.name), std::move(shifted));
+    mainLoop->children.push_back(nullptr);
+    mainLoop->children.push_back(cloneAST(loop->children[1]));
+    mainLoop->left = makeCompound();
+    for (int i = 0; i < factor; i++) {
+        appendIteration(mainLoop->left->children, i + 1 < factor);
+    }
+    result.push_back(std::move(mainLoop));
+
+    // Remainder
+    if (tripCount >= 0) {
+        for (long long i = 0; i < tripCount % factor; i++) {
+            appendIteration(result, true);
+        }
+    } else {
+        result.push_back(std::move(loop));
+    }
+
+    unrolledCount++;
+    return true;
+}
+
+// Software-pipeline an innermost loop with an exit test against an
+// invariant bound. Strength reduction may have added induction variables,
+// so the variables the body assigns are collected again.
+bool LoopOptimizer::pipeline(std::unique_ptr<ASTNode>& loop, const InductionVariable& iv) {
+    std::set<std::string> modified;
+    collectAssignedVariables(loop->left, modified);
+    modified.insert(iv.name);
+
+    ASTNodeType op;
+    const std::unique_ptr<ASTNode>* bound = nullptr;
+    if (countNodes(loop->left) > options.maxPipelinedSize || !matchExitTest(loop, iv, modified, op, bound)) {
+        return false;
+    }
+
+    auto next = makeBinary(ASTNodeType::ADD, makeIdentifier(iv.name), cloneAST(iv.step));
+    auto nextTest = makeBinary(op, cloneAST(next), cloneAST(*bound));
+    return pipeliner.pipeline(loop, iv.name, modified, std::move(nextTest), next);
+}
@@ -0,0 +1,109 @@
+#ifndef LOOPOPT_HPP
+#define LOOPOPT_HPP
+
+#include "parser.hpp"
+#include "pipeline.hpp"
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// Tunable parameters of the loop optimizer
+struct LoopOptions {
+    bool closedForms = true;       // Replace loops by the closed form of their results
+    bool strengthReduce = true;    // Replace i * k by an added induction variable
+    int unrollFactor = 4;          // Copies of the body per iteration; 1 disables
+    int maxUnrolledSize = 160;     // AST node budget for an unrolled loop body
+    int vectorLanes = 4;           // Lanes of the code generator's vector loops; loops it vectorizes are not unrolled
+    bool pipeline = true;          // Software-pipeline innermost loops that are not unrolled
+    int maxPipelinedSize = 200;    // AST node budget for the body of a pipelined loop
+    int unswitchBudget = 400;      // AST nodes unswitching may add by copying loops; 0 disables
+};
+
+// AST-level loop transformations. Unswitches loops that test a condition
+// they cannot change, leaving one copy of the loop per outcome under a
+// test made once on entry. Recognizes basic induction variables
+// (a variable whose only update is 'i = i + step' once per iteration) in for
+// loops and in while loops that end with such an update, replaces counted
+// loops whose results have a closed form (see ScalarEvolution),
+// strength-reduces products of the induction variable with loop-invariant
+// factors, and unrolls innermost loops whose trip count is known or
+// computable on entry, software-pipelining those too large to unroll (see
+// SoftwarePipeliner). Loops the code generator vectorizes (see
+// LoopVectorizer) are left unchanged.
+class LoopOptimizer {
+private:
+    struct InductionVariable {
+        std::string name;
+        std::unique_ptr<ASTNode> step;   // Invariant amount added per iteration
+    };
+
+    LoopOptions options;
+    SoftwarePipeliner pipeliner;
+    int tempCounter;
+    int reducedCount;
+    int unrolledCount;
+    int closedFormCount;
+    int unswitchedCount;
+    int unswitchGrowth;
+
+    // Derived induction variables introduced per loop, at most
+    static const int MAX_REDUCTIONS_PER_LOOP = 4;
+
+    void optimizeStatement(std::unique_ptr<ASTNode>& node);
+    void optimizeLoop(std::unique_ptr<ASTNode>& node);
+
+    // Unswitching
+    const ASTNode* findInvariantTest(const std::unique_ptr<ASTNode>& node, const std::set<std::string>& modified);
+    bool unswitch(std::unique_ptr<ASTNode>& loop);
+
+    // Induction variable recognition
+    bool matchIncrement(const std::unique_ptr<ASTNode>& expr, std::string& name,
+                        std::unique_ptr<ASTNode>& step);
+    bool convertWhileToFor(std::unique_ptr<ASTNode>& node);
+    bool findInductionVariable(const std::unique_ptr<ASTNode>& loop, InductionVariable& iv,
+                               std::set<std::string>& modified);
+
+    // Counted loops: exit test 'i op bound' with a loop-invariant bound
+    bool matchExitTest(const std::unique_ptr<ASTNode>& loop, const InductionVariable& iv,
+                       const std::set<std::string>& modified, ASTNodeType& op,
+                       const std::unique_ptr<ASTNode>*& bound);
+    std::unique_ptr<ASTNode> tripCountExpression(ASTNodeType op, const std::unique_ptr<ASTNode>& bound,
+                                                 const InductionVariable& iv);
+
+    // Closed-form replacement
+    bool replaceWithClosedForm(std::unique_ptr<ASTNode>& loop, const InductionVariable& iv,
+                               const std::set<std::string>& modified);
+
+    // Strength reduction
+    void collectProducts(std::unique_ptr<ASTNode>& node, const InductionVariable& iv,
+                         const std::set<std::string>& modified,
+                         std::vector<std::unique_ptr<ASTNode>*>& products);
+    bool strengthReduce(std::unique_ptr<ASTNode>& loop, const InductionVariable& iv,
+                        const std::set<std::string>& modified,
+                        std::vector<std::unique_ptr<ASTNode>>& prologue);
+
+    // Unrolling
+    bool knownInitialValue(const std::unique_ptr<ASTNode>& init, const std::string& name, long long& value);
+    bool unroll(std::unique_ptr<ASTNode>& loop, const std::unique_ptr<ASTNode>& init,
+                const InductionVariable& iv, const std::set<std::string>& modified,
+                std::vector<std::unique_ptr<ASTNode>>& result);
+
+    bool pipeline(std::unique_ptr<ASTNode>& loop, const InductionVariable& iv);
+
+    std::string newTemporary(const std::string& prefix);
+
+public:
+    explicit LoopOptimizer(const LoopOptions& opts = LoopOptions());
+
+    // Transform every loop of a program in place
+    void optimize(std::unique_ptr<ASTNode>& program);
+
+    int getReducedCount() const { return reducedCount; }
+    int getUnrolledCount() const { return unrolledCount; }
+    int getClosedFormCount() const { return closedFormCount; }
+    int getUnswitchedCount() const { return unswitchedCount; }
+    int getPipelinedCount() const { return pipeliner.getPipelinedCount(); }
+};
+
+#endif // LOOPOPT_HPP
@@ -2,10 +2,19 @@
 #include <fstream>
 #include <memory>
 #include <iomanip>
+#include <algorithm>
+#include <cstdlib>
 #include "tokens.hpp"
 #include "scanner.hpp"
 #include "parser.hpp"
 #include "codegen.hpp"
+#include "sccp.hpp"
+#include "ranges.hpp"
+#include "loopopt.hpp"
+#include "loopnest.hpp"
+#include "simplify.hpp"
+#include "gvn.hpp"
+#include "inline.hpp"
 
 void printUsage(const char* programName) {
     std::cout << "Usage: " << programName << " [options] <input_file> [output_file]" << std::endl;
@@ -17,6 +26,16 @@ void printUsage(const char* programName) {
     std::cout << "  --expr-only       Parse as expression only (for testing)" << std::endl;
     std::cout << "  -o <file>         Specify output assembly file" << std::endl;
     std::cout << "  --to-stdout       Output assembly to stdout" << std::endl;
+    std::cout << "  -O0               Disable AST optimizations" << std::endl;
+    std::cout << "  --unroll <n>      Unroll loops by a factor of n (default 4, 1 disables)" << std::endl;
+    std::cout << "  --inline-budget <n>  Let inlining grow the program by up to n AST nodes (default 400, 0 disables)"
+              << std::endl;
+    std::cout << "  --unswitch-budget <n>  Let loop unswitching grow the program by up to n AST nodes (default 400, 0 disables)"
+              << std::endl;
+    std::cout << "  --cache-size <n>  Tile loop nests for an n KiB data cache (default 32, 0 disables)" << std::endl;
+    std::cout << "  -mavx2            Vectorize loops with 256-bit AVX2 instead of SSE2" << std::endl;
+    std::cout << "  --no-vectorize    Disable loop vectorization" << std::endl;
+    std::cout << "  --no-pipeline     Disable software pipelining of loops" << std::endl;
     std::cout << std::endl;
     std::cout << "Examples:" << std::endl;
     std::cout << "  " << programName << " program.cpp                    # Output to program.s" << std::endl;
@@ -70,6 +89,11 @@ int main(int argc, char* argv[]) {
         bool parseOnly = false;
         bool exprOnly = false;
         bool toStdout = false;
+        bool optimize = true;
+        LoopOptions loopOptions;
+        LoopNestOptions loopNestOptions;
+        InlineOptions inlineOptions;
+        VectorISA vectorISA = VectorISA::SSE2;
         std::string inputFile;
         std::string outputFile;
 
@@ -90,6 +114,22 @@ int main(int argc, char* argv[]) {
                 exprOnly = true;
             } else if (arg == "--to-stdout") {
                 toStdout = true;
+            } else if (arg == "-O0") {
+                optimize = false;
+            } else if (arg == "--unroll" && i + 1 < argc) {
+                loopOptions.unrollFactor = std::max(1, std::atoi(argv[++i]));
+            } else if (arg == "--inline-budget" && i + 1 < argc) {
+                inlineOptions.growthBudget = std::max(0, std::atoi(argv[++i]));
+            } else if (arg == "--unswitch-budget" && i + 1 < argc) {
+                loopOptions.unswitchBudget = std::max(0, std::atoi(argv[++i]));
+            } else if (arg == "--cache-size" && i + 1 < argc) {
+                loopNestOptions.cacheSize = std::max(0, std::atoi(argv[++i])) * 1024;
+            } else if (arg == "-mavx2") {
+                vectorISA = VectorISA::AVX2;
+            } else if (arg == "--no-vectorize") {
+                vectorISA = VectorISA::NONE;
+            } else if (arg == "--no-pipeline") {
+                loopOptions.pipeline = false;
             } else if (arg == "-o" && i + 1 < argc) {
                 outputFile = argv[++i];
             } else if (arg.empty() || arg[0] == '-') {
@@ -101,6 +141,11 @@ int main(int argc, char* argv[]) {
             }
         }
 
+        if (!optimize) {
+            vectorISA = VectorISA::NONE;
+        }
+        loopOptions.vectorLanes = vectorLanes(vectorISA);
+
         if (inputFile.empty()) {
             std::cerr << "Error: No input file specified" << std::endl;
             printUsage(argv[0]);
@@ -151,6 +196,62 @@ int main(int argc, char* argv[]) {
             std::cout << "\n[PHASE 3] AST Generation completed" << std::endl;
         }
 
+        if (!astOnly && !parseOnly && optimize && ast && ast->type == ASTNodeType::PROGRAM) {
+            // Calls are inlined first, so every later pass sees the callees'
+            // code in its callers
+            Inliner inliner(inlineOptions);
+            inliner.optimize(ast);
+
+            if (verbose) {
+                std::cout << "[OPT] Calls inlined: " << inliner.getInlinedCount()
+                          << ", specialized functions: " << inliner.getSpecializedCount()
+                          << ", functions removed: " << inliner.getRemovedCount() << std::endl;
+            }
+
+            // Constants are propagated before the loop optimizers, so they see
+            // known trip counts, and again to fold the closed forms they build
+            // and prune the branches value ranges decide. Loop nests are
+            // reordered and tiled before their inner loops are unrolled.
+            ConstantPropagation constantPropagation;
+            constantPropagation.optimize(ast);
+            LoopNestOptimizer loopNestOptimizer(loopNestOptions);
+            loopNestOptimizer.optimize(ast);
+            LoopOptimizer loopOptimizer(loopOptions);
+            loopOptimizer.optimize(ast);
+            RangeAnalysis rangeAnalysis;
+            int decided = rangeAnalysis.foldComparisons(ast);
+            constantPropagation.optimize(ast);
+
+            if (verbose) {
+                std::cout << "[OPT] Constants folded: " << constantPropagation.getFoldedCount()
+                          << ", unreachable statements pruned: " << constantPropagation.getPrunedCount()
+                          << std::endl;
+                std::cout << "[OPT] Interchanged loop nests: " << loopNestOptimizer.getInterchangedCount()
+                          << ", tiled loop nests: " << loopNestOptimizer.getTiledCount() << std::endl;
+                std::cout << "[OPT] Unswitched loops: " << loopOptimizer.getUnswitchedCount() << std::endl;
+                std::cout << "[OPT] Closed-form loops: " << loopOptimizer.getClosedFormCount()
+                          << ", strength-reduced products: " << loopOptimizer.getReducedCount()
+                          << ", unrolled loops: " << loopOptimizer.getUnrolledCount()
+                          << ", pipelined loops: " << loopOptimizer.getPipelinedCount() << std::endl;
+                std::cout << "[OPT] Comparisons decided by value ranges: " << decided << std::endl;
+            }
+
+            Simplifier simplifier;
+            simplifier.simplify(ast);
+
+            if (verbose) {
+                std::cout << "[OPT] Algebraic rewrites: " << simplifier.getRewriteCount() << std::endl;
+            }
+
+            ValueNumbering valueNumbering;
+            valueNumbering.optimize(ast);
+
+            if (verbose) {
+                std::cout << "[OPT] Redundant computations eliminated: "
+                          << valueNumbering.getEliminatedCount() << std::endl;
+            }
+        }
+
         if (!astOnly && !parseOnly) {
             if (verbose) {
                 std::cout << "\n[PHASE 4] Code Generation..." << std::endl;
@@ -166,6 +267,7 @@ int main(int argc, char* argv[]) {
                 }
 
                 CodeGenerator codegen(&std::cout);
+                codegen.setVectorISA(vectorISA);
                 codegen.generateCode(ast);
 
             } else {
@@ -177,10 +279,13 @@ int main(int argc, char* argv[]) {
                 }
 
                 CodeGenerator codegen(finalOutputFile);
+                codegen.setVectorISA(vectorISA);
                 codegen.generateCode(ast);
 
                 if (verbose) {
                     std::cout << "[OK] Code generation completed" << std::endl;
+                    std::cout << "[OPT] Estimated block cycles: " << codegen.getCyclesBefore()
+                              << " before scheduling, " << codegen.getCyclesAfter() << " after" << std::endl;
 
                     std::cout << "\n[NEXT STEPS]:" << std::endl;
                     std::cout << "   1. Assemble:  as -64 " << finalOutputFile << " -o " <<
@@ -1,6 +1,8 @@
 #include "parser.hpp"
+#include "analysis.hpp"
 #include <iostream>
 #include <iomanip>
+#include <set>
 
 Parser::Parser(Scanner* s) : scanner(s), ownedScanner(false) {
     nextToken();
@@ -57,6 +59,7 @@ void Parser::synchronize() {
             case TokenType::T_IF:
             case TokenType::T_WHILE:
             case TokenType::T_RETURN:
+            case TokenType::T_SWITCH:
                 return;
             default:
                 break;
@@ -69,6 +72,7 @@ void Parser::synchronize() {
 int Parser::getOperatorPrecedence(TokenType tokenType) {
     switch (tokenType) {
         case TokenType::T_ASSIGN:
+        case TokenType::T_QUESTION:
         case TokenType::T_PLUSEQ:
         case TokenType::T_MINUSEQ:
         case TokenType::T_STAREQ:
@@ -78,6 +82,12 @@ int Parser::getOperatorPrecedence(TokenType tokenType) {
             return 3;
         case TokenType::T_AND:
             return 5;
+        case TokenType::T_BITOR:
+            return 8;
+        case TokenType::T_BITXOR:
+            return 10;
+        case TokenType::T_BITAND:
+            return 12;
         case TokenType::T_EQ:
         case TokenType::T_NE:
             return 20;
@@ -86,12 +96,12 @@ int Parser::getOperatorPrecedence(TokenType tokenType) {
         case TokenType::T_LE:
         case TokenType::T_GE:
             return 25;
+        case TokenType::T_LSHIFT:
+        case TokenType::T_RSHIFT:
+            return 27;
         case TokenType::T_PLUS:
         case TokenType::T_MINUS:
             return 30;
-        case TokenType::T_LSHIFT:
-        case TokenType::T_RSHIFT:
-            return 35;
         case TokenType::T_STAR:
         case TokenType::T_SLASH:
         case TokenType::T_PERCENT:
@@ -128,6 +138,11 @@ ASTNodeType Parser::tokenToASTNode(TokenType tokenType) {
         case TokenType::T_GE:       return ASTNodeType::GE;
         case TokenType::T_AND:      return ASTNodeType::AND;
         case TokenType::T_OR:       return ASTNodeType::OR;
+        case TokenType::T_BITAND:   return ASTNodeType::BITAND;
+        case TokenType::T_BITOR:    return ASTNodeType::BITOR;
+        case TokenType::T_BITXOR:   return ASTNodeType::BITXOR;
+        case TokenType::T_LSHIFT:   return ASTNodeType::LSHIFT;
+        case TokenType::T_RSHIFT:   return ASTNodeType::RSHIFT;
         default:
             error("Invalid token type for AST conversion");
             return ASTNodeType::ADD;
@@ -153,6 +168,18 @@ std::unique_ptr<ASTNode> Parser::parseExpression(int minPrecedence) {
 
         nextToken(); // consume the operator
 
+        // The conditional operator takes any expression between '?' and ':'
+        // and groups to the right
+        if (operatorToken == TokenType::T_QUESTION) {
+            auto conditional = std::make_unique<ASTNode>(ASTNodeType::CONDITIONAL);
+            conditional->condition = std::move(left);
+            conditional->left = parseExpression(0);
+            expectToken(TokenType::T_COLON);
+            conditional->right = parseExpression(operatorPrec);
+            left = std::move(conditional);
+            continue;
+        }
+
         // For right-associative operators, use the same precedence
         // For left-associative operators, use precedence + 1
         int nextMinPrec = isRightAssociative(operatorToken) ? operatorPrec : operatorPrec + 1;
@@ -196,6 +223,14 @@ std::unique_ptr<ASTNode> Parser::parseUnary() {
         return unaryNode;
     }
 
+    if (currentToken.type == TokenType::T_BITNOT) {
+        nextToken();
+        auto expr = parseUnary();
+        auto unaryNode = std::make_unique<ASTNode>(ASTNodeType::BITNOT);
+        unaryNode->left = std::move(expr);
+        return unaryNode;
+    }
+
     return parsePrimary();
 }
 
@@ -235,6 +270,22 @@ std::unique_ptr<ASTNode> Parser::parsePrimary() {
             auto node = std::make_unique<ASTNode>(ASTNodeType::IDENTIFIER);
             node->value = currentToken.value;
             nextToken();
+
+            // A name followed by a subscript is an array element
+            if (currentToken.type == TokenType::T_LBRACKET) {
+                return parseSubscripts(std::move(node));
+            }
+
+            // A name followed by an argument list is a call
+            if (matchToken(TokenType::T_LPAREN)) {
+                node->type = ASTNodeType::CALL;
+                if (currentToken.type != TokenType::T_RPAREN) {
+                    do {
+                        node->children.push_back(parseExpression(0));
+                    } while (matchToken(TokenType::T_COMMA));
+                }
+                expectToken(TokenType::T_RPAREN);
+            }
             return node;
         }
 
@@ -290,11 +341,16 @@ std::unique_ptr<ASTNode> Parser::parseProgram() {
     // Parse statements
     while (currentToken.type != TokenType::T_EOF) {
         try {
-            auto stmt = parseStatement();
+            // Functions are declared only at the top level
+            bool declaration = currentToken.type == TokenType::T_INT || currentToken.type == TokenType::T_FLOAT ||
+                               currentToken.type == TokenType::T_CHAR || currentToken.type == TokenType::T_DOUBLE ||
+                               currentToken.type == TokenType::T_BOOL || currentToken.type == TokenType::T_VOID;
+            auto stmt = declaration ? parseVariableDeclaration(true) : parseStatement();
             if (stmt) {
                 program->children.push_back(std::move(stmt));
             }
         } catch (const std::runtime_error& e) {
+            breakTargets.clear();
             synchronize();
         }
 
@@ -319,6 +375,7 @@ std::unique_ptr<ASTNode> Parser::parseStatement() {
         case TokenType::T_CHAR:
         case TokenType::T_DOUBLE:
         case TokenType::T_BOOL:
+        case TokenType::T_VOID:
             return parseVariableDeclaration();
 
         case TokenType::T_IF:
@@ -333,6 +390,12 @@ std::unique_ptr<ASTNode> Parser::parseStatement() {
         case TokenType::T_RETURN:
             return parseReturnStatement();
 
+        case TokenType::T_SWITCH:
+            return parseSwitchStatement();
+
+        case TokenType::T_BREAK:
+            return parseBreakStatement();
+
         case TokenType::T_COUT:
             return parseCoutStatement();
 
@@ -352,11 +415,12 @@ std::unique_ptr<ASTNode> Parser::parseStatement() {
     }
 }
 
-std::unique_ptr<ASTNode> Parser::parseVariableDeclaration() {
+std::unique_ptr<ASTNode> Parser::parseVariableDeclaration(bool allowFunction) {
     // Parse: int x; or int x = expression;
     auto node = std::make_unique<ASTNode>(ASTNodeType::VAR_DECL);
 
     // Skip the type token (int, float, etc.)
+    bool isVoid = currentToken.type == TokenType::T_VOID;
     nextToken();
 
     // Get variable name
@@ -368,6 +432,20 @@ std::unique_ptr<ASTNode> Parser::parseVariableDeclaration() {
     node->value = currentToken.value;
     nextToken();
 
+    if (currentToken.type == TokenType::T_LPAREN) {
+        if (!allowFunction) {
+            error("Functions can only be declared at the top level");
+        }
+        return parseFunctionDeclaration(node->value);
+    }
+    if (isVoid) {
+        error("Variable '" + node->value + "' declared void");
+    }
+    if (currentToken.type == TokenType::T_LBRACKET) {
+        return parseArrayDeclaration(node->value);
+    }
+    arrayDimensions.erase(node->value);
+
     // Check for initialization
     if (currentToken.type == TokenType::T_ASSIGN) {
         nextToken();
@@ -378,6 +456,172 @@ std::unique_ptr<ASTNode> Parser::parseVariableDeclaration() {
     return node;
 }
 
+std::unique_ptr<ASTNode> Parser::parseArrayDeclaration(const std::string& name) {
+    // Parse: int name[size]...; or int name[size]... = { ... };
+    // Arrays of several dimensions are stored row by row. The first size
+    // may be left out when an initializer gives the elements.
+    auto node = std::make_unique<ASTNode>(ASTNodeType::ARRAY_DECL);
+    node->value = name;
+
+    std::vector<int> dimensions;
+    while (matchToken(TokenType::T_LBRACKET)) {
+        int size = 0;
+        if (currentToken.type != TokenType::T_RBRACKET || !dimensions.empty()) {
+            if (currentToken.type != TokenType::T_INTLIT) {
+                error("Size of array '" + name + "' must be an integer constant");
+            }
+            size = std::stoi(currentToken.value);
+            if (size <= 0) {
+                error("Size of array '" + name + "' must be positive");
+            }
+            nextToken();
+        }
+        expectToken(TokenType::T_RBRACKET);
+        dimensions.push_back(size);
+    }
+
+    long long rowSize = 1;
+    for (size_t i = 1; i < dimensions.size(); i++) {
+        rowSize *= dimensions[i];
+        if (rowSize > (1 << 28)) {
+            error("Array '" + name + "' is too large");
+        }
+    }
+
+    if (matchToken(TokenType::T_ASSIGN)) {
+        auto list = std::make_unique<ASTNode>(ASTNodeType::INIT_LIST);
+        parseInitializer(list.get(), dimensions, 0, name);
+
+        long long count = static_cast<long long>(list->children.size());
+        if (dimensions[0] == 0) {
+            dimensions[0] = static_cast<int>((count + rowSize - 1) / rowSize);
+        } else if (count > dimensions[0] * rowSize) {
+            error("Too many initializers for array '" + name + "'");
+        }
+        node->left = std::move(list);
+    }
+    if (dimensions[0] <= 0) {
+        error("Size of array '" + name + "' must be positive");
+    } else if (dimensions[0] * rowSize > (1 << 28)) {
+        error("Array '" + name + "' is too large");
+    }
+    node->intValue = static_cast<int>(dimensions[0] * rowSize);
+    arrayDimensions[name] = dimensions;
+
+    expectToken(TokenType::T_SEMICOLON);
+    return node;
+}
+
+// Parse a brace-enclosed initializer of dimensions[level...], appending its
+// elements to 'list' in row-major order. A nested list initializes a whole
+// row, padded with zeros.
+void Parser::parseInitializer(ASTNode* list, const std::vector<int>& dimensions, size_t level,
+                              const std::string& name) {
+    long long rowSize = 1;
+    for (size_t i = level + 1; i < dimensions.size(); i++) {
+        rowSize *= dimensions[i];
+    }
+    size_t start = list->children.size();
+    auto padRow = [&]() {
+        while ((list->children.size() - start) % rowSize != 0) {
+            list->children.push_back(makeIntLiteral(0));
+        }
+    };
+
+    expectToken(TokenType::T_LBRACE);
+    while (currentToken.type != TokenType::T_RBRACE && currentToken.type != TokenType::T_EOF) {
+        if (currentToken.type == TokenType::T_LBRACE && level + 1 < dimensions.size()) {
+            padRow();
+            parseInitializer(list, dimensions, level + 1, name);
+            padRow();
+        } else {
+            list->children.push_back(parseExpression(0));
+        }
+        if (!matchToken(TokenType::T_COMMA)) break;
+    }
+    expectToken(TokenType::T_RBRACE);
+
+    if (level > 0 && static_cast<long long>(list->children.size() - start) > dimensions[level] * rowSize) {
+        error("Too many initializers for array '" + name + "'");
+    }
+}
+
+// Parse the subscripts of an element, one per dimension, folding them into
+// the single row-major index of an INDEX node
+std::unique_ptr<ASTNode> Parser::parseSubscripts(std::unique_ptr<ASTNode> node) {
+    node->type = ASTNodeType::INDEX;
+    auto it = arrayDimensions.find(node->value);
+    size_t count = it != arrayDimensions.end() ? it->second.size() : 1;
+
+    for (size_t i = 0; matchToken(TokenType::T_LBRACKET); i++) {
+        if (i == count) {
+            error("Too many subscripts for array '" + node->value + "'");
+        }
+        auto subscript = parseExpression(0);
+        expectToken(TokenType::T_RBRACKET);
+        if (i == 0) {
+            node->left = std::move(subscript);
+        } else {
+            auto row = makeBinary(ASTNodeType::MULTIPLY, std::move(node->left), makeIntLiteral(it->second[i]));
+            node->left = makeBinary(ASTNodeType::ADD, std::move(row), std::move(subscript));
+        }
+        if (i + 1 == count && currentToken.type != TokenType::T_LBRACKET) {
+            return node;
+        }
+    }
+    error("Array '" + node->value + "' needs " + std::to_string(count) + " subscripts");
+    return node;
+}
+
+std::unique_ptr<ASTNode> Parser::parseFunctionDeclaration(const std::string& name) {
+    // Parse: int name(int a, int b) { ... } or a prototype ending in ';'
+    // The parameters are declarations without initializers; a prototype
+    // may leave them unnamed.
+    auto node = std::make_unique<ASTNode>(ASTNodeType::FUNCTION_DECL);
+    node->value = name;
+
+    expectToken(TokenType::T_LPAREN);
+    if (currentToken.type == TokenType::T_VOID) {
+        nextToken();
+    } else if (currentToken.type != TokenType::T_RPAREN) {
+        do {
+            if (currentToken.type != TokenType::T_INT && currentToken.type != TokenType::T_FLOAT &&
+                currentToken.type != TokenType::T_CHAR && currentToken.type != TokenType::T_DOUBLE &&
+                currentToken.type != TokenType::T_BOOL) {
+                error("Expected parameter type");
+            }
+            nextToken();
+            auto param = std::make_unique<ASTNode>(ASTNodeType::VAR_DECL);
+            if (currentToken.type == TokenType::T_IDENT) {
+                param->value = currentToken.value;
+                nextToken();
+            }
+            node->children.push_back(std::move(param));
+        } while (matchToken(TokenType::T_COMMA));
+    }
+    expectToken(TokenType::T_RPAREN);
+
+    if (matchToken(TokenType::T_SEMICOLON)) {
+        return node;
+    }
+
+    // The function's own arrays and parameters go out of scope after it
+    auto outerArrays = arrayDimensions;
+    std::set<std::string> names;
+    for (const auto& param : node->children) {
+        if (param->value.empty()) {
+            error("Parameter of function '" + name + "' needs a name");
+        }
+        if (!names.insert(param->value).second) {
+            error("Duplicate parameter '" + param->value + "'");
+        }
+        arrayDimensions.erase(param->value);
+    }
+    node->left = parseCompoundStatement();
+    arrayDimensions = std::move(outerArrays);
+    return node;
+}
+
 std::unique_ptr<ASTNode> Parser::parseExpressionStatement() {
     auto node = std::make_unique<ASTNode>(ASTNodeType::EXPRESSION_STMT);
     node->left = parseExpression();
@@ -434,7 +678,9 @@ std::unique_ptr<ASTNode> Parser::parseWhileStatement() {
 
     expectToken(TokenType::T_RPAREN);
 
+    breakTargets.push_back(false);
     node->left = parseStatement();
+    breakTargets.pop_back();
 
     return node;
 }
@@ -446,19 +692,19 @@ std::unique_ptr<ASTNode> Parser::parseForStatement() {
     nextToken(); // Skip 'for'
     expectToken(TokenType::T_LPAREN);
 
-    // Init statement (can be empty)
+    // Init statement (can be empty). The children are always [init, update]
+    // so that codegen can tell them apart; missing parts are left null.
     if (currentToken.type != TokenType::T_SEMICOLON) {
         if (currentToken.type == TokenType::T_INT || currentToken.type == TokenType::T_FLOAT ||
             currentToken.type == TokenType::T_CHAR || currentToken.type == TokenType::T_DOUBLE ||
             currentToken.type == TokenType::T_BOOL) {
             node->children.push_back(parseVariableDeclaration());
         } else {
-            auto expr = parseExpression();
-            expectToken(TokenType::T_SEMICOLON);
-            node->children.push_back(std::move(expr));
+            node->children.push_back(parseExpressionStatement());
         }
     } else {
         nextToken(); // Skip semicolon
+        node->children.push_back(nullptr);
     }
 
     // Condition (can be empty)
@@ -470,12 +716,16 @@ std::unique_ptr<ASTNode> Parser::parseForStatement() {
     // Update expression (can be empty)
     if (currentToken.type != TokenType::T_RPAREN) {
         node->children.push_back(parseExpression());
+    } else {
+        node->children.push_back(nullptr);
     }
 
     expectToken(TokenType::T_RPAREN);
 
     // Body
+    breakTargets.push_back(false);
     node->left = parseStatement();
+    breakTargets.pop_back();
 
     return node;
 }
@@ -494,6 +744,80 @@ std::unique_ptr<ASTNode> Parser::parseReturnStatement() {
     return node;
 }
 
+std::unique_ptr<ASTNode> Parser::parseSwitchStatement() {
+    // Parse: switch (condition) { case value: ... default: ... }
+    // The labels stay in the body's statement list, so control falls through
+    // from one case into the next unless a break leaves the switch.
+    auto node = std::make_unique<ASTNode>(ASTNodeType::SWITCH_STMT);
+
+    nextToken(); // Skip 'switch'
+    expectToken(TokenType::T_LPAREN);
+
+    node->condition = parseExpression();
+
+    expectToken(TokenType::T_RPAREN);
+    expectToken(TokenType::T_LBRACE);
+
+    std::set<int> values;
+    bool hasDefault = false;
+    breakTargets.push_back(true);
+
+    while (currentToken.type != TokenType::T_RBRACE && currentToken.type != TokenType::T_EOF) {
+        if (currentToken.type == TokenType::T_CASE) {
+            nextToken(); // Skip 'case'
+            bool negative = matchToken(TokenType::T_MINUS);
+            if (currentToken.type != TokenType::T_INTLIT) {
+                error("Expected integer constant in case label");
+            }
+            auto label = std::make_unique<ASTNode>(ASTNodeType::CASE_LABEL);
+            label->intValue = negative ? -std::stoi(currentToken.value) : std::stoi(currentToken.value);
+            if (!values.insert(label->intValue).second) {
+                error("Duplicate case value " + std::to_string(label->intValue));
+            }
+            nextToken();
+            expectToken(TokenType::T_COLON);
+            node->children.push_back(std::move(label));
+        } else if (currentToken.type == TokenType::T_DEFAULT) {
+            if (hasDefault) {
+                error("Multiple default labels in one switch");
+            }
+            hasDefault = true;
+            nextToken(); // Skip 'default'
+            expectToken(TokenType::T_COLON);
+            node->children.push_back(std::make_unique<ASTNode>(ASTNodeType::DEFAULT_LABEL));
+        } else {
+            // A case label may be reached past any statement of the body,
+            // so declarations need a block of their own
+            if (currentToken.type == TokenType::T_INT || currentToken.type == TokenType::T_FLOAT ||
+                currentToken.type == TokenType::T_CHAR || currentToken.type == TokenType::T_DOUBLE ||
+                currentToken.type == TokenType::T_BOOL) {
+                error("Declaration in a switch body must be inside a block");
+            }
+            auto stmt = parseStatement();
+            if (stmt) {
+                node->children.push_back(std::move(stmt));
+            }
+        }
+    }
+
+    breakTargets.pop_back();
+    expectToken(TokenType::T_RBRACE);
+    return node;
+}
+
+std::unique_ptr<ASTNode> Parser::parseBreakStatement() {
+    // Parse: break;
+    // Loops cannot be left early, so the innermost enclosing statement must be a switch
+    if (breakTargets.empty() || !breakTargets.back()) {
+        error("break is only supported in switch statements");
+    }
+    auto node = std::make_unique<ASTNode>(ASTNodeType::BREAK_STMT);
+
+    nextToken(); // Skip 'break'
+    expectToken(TokenType::T_SEMICOLON);
+    return node;
+}
+
 std::unique_ptr<ASTNode> Parser::parseCoutStatement() {
     // Parse: cout << expression;
     auto node = std::make_unique<ASTNode>(ASTNodeType::COUT_STMT);
@@ -535,6 +859,7 @@ void Parser::printAST(const std::unique_ptr<ASTNode>& node, int depth) {
 
     switch (node->type) {
         case ASTNodeType::INTLIT:
+        case ASTNodeType::CASE_LABEL:
             std::cout << " (" << node->intValue << ")";
             break;
         case ASTNodeType::FLOATLIT:
@@ -543,8 +868,14 @@ void Parser::printAST(const std::unique_ptr<ASTNode>& node, int depth) {
         case ASTNodeType::BOOLLIT:
             std::cout << " (" << (node->boolValue ? "true" : "false") << ")";
             break;
+        case ASTNodeType::ARRAY_DECL:
+            std::cout << " (" << node->value << "[" << node->intValue << "])";
+            break;
         case ASTNodeType::IDENTIFIER:
         case ASTNodeType::VAR_DECL:
+        case ASTNodeType::FUNCTION_DECL:
+        case ASTNodeType::CALL:
+        case ASTNodeType::INDEX:
         case ASTNodeType::STRINGLIT:
         case ASTNodeType::CHARLIT:
             if (!node->value.empty()) {
@@ -606,16 +937,32 @@ std::string Parser::astNodeTypeToString(ASTNodeType type) {
         case ASTNodeType::AND: return "LOGICAL_AND";
         case ASTNodeType::OR: return "LOGICAL_OR";
         case ASTNodeType::NOT: return "LOGICAL_NOT";
+        case ASTNodeType::BITAND: return "BITWISE_AND";
+        case ASTNodeType::BITOR: return "BITWISE_OR";
+        case ASTNodeType::BITXOR: return "BITWISE_XOR";
+        case ASTNodeType::BITNOT: return "BITWISE_NOT";
+        case ASTNodeType::LSHIFT: return "LEFT_SHIFT";
+        case ASTNodeType::RSHIFT: return "RIGHT_SHIFT";
         case ASTNodeType::NEGATE: return "NEGATE";
         case ASTNodeType::POSITIVE: return "POSITIVE";
         case ASTNodeType::ASSIGN: return "ASSIGN";
+        case ASTNodeType::CONDITIONAL: return "CONDITIONAL";
         case ASTNodeType::VAR_DECL: return "VAR_DECLARATION";
+        case ASTNodeType::ARRAY_DECL: return "ARRAY_DECLARATION";
+        case ASTNodeType::INIT_LIST: return "INIT_LIST";
         case ASTNodeType::EXPRESSION_STMT: return "EXPRESSION_STMT";
         case ASTNodeType::COMPOUND_STMT: return "COMPOUND_STMT";
         case ASTNodeType::IF_STMT: return "IF_STATEMENT";
         case ASTNodeType::WHILE_STMT: return "WHILE_STATEMENT";
         case ASTNodeType::FOR_STMT: return "FOR_STATEMENT";
         case ASTNodeType::RETURN_STMT: return "RETURN_STATEMENT";
+        case ASTNodeType::SWITCH_STMT: return "SWITCH_STATEMENT";
+        case ASTNodeType::CASE_LABEL: return "CASE_LABEL";
+        case ASTNodeType::DEFAULT_LABEL: return "DEFAULT_LABEL";
+        case ASTNodeType::BREAK_STMT: return "BREAK_STATEMENT";
+        case ASTNodeType::FUNCTION_DECL: return "FUNCTION_DECLARATION";
+        case ASTNodeType::CALL: return "CALL";
+        case ASTNodeType::INDEX: return "INDEX";
         case ASTNodeType::COUT_STMT: return "COUT_STATEMENT";
         case ASTNodeType::CIN_STMT: return "CIN_STATEMENT";
         case ASTNodeType::PROGRAM: return "PROGRAM";
@@ -647,6 +994,10 @@ void StringScanner::initializeKeywords() {
     keywords["while"] = TokenType::T_WHILE;
     keywords["for"] = TokenType::T_FOR;
     keywords["return"] = TokenType::T_RETURN;
+    keywords["switch"] = TokenType::T_SWITCH;
+    keywords["case"] = TokenType::T_CASE;
+    keywords["default"] = TokenType::T_DEFAULT;
+    keywords["break"] = TokenType::T_BREAK;
 
     // I/O
     keywords["cout"] = TokenType::T_COUT;
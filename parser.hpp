@@ -6,6 +6,8 @@
 #include <memory>
 #include <vector>
 #include <iostream>
+#include <string>
+#include <unordered_map>
 
 // Forward declaration
 class Scanner;
@@ -43,6 +45,14 @@ enum class ASTNodeType {
     OR,          // ||
     NOT,         // !
 
+    // Bitwise operations, on 64-bit values
+    BITAND,      // &
+    BITOR,       // |
+    BITXOR,      // ^
+    BITNOT,      // ~
+    LSHIFT,      // <<
+    RSHIFT,      // >>, arithmetic
+
     // Unary operations
     NEGATE,      // -
     POSITIVE,    // +
@@ -50,14 +60,26 @@ enum class ASTNodeType {
     // Assignment
     ASSIGN,      // =
 
+    // Conditional operator
+    CONDITIONAL, // condition ? left : right
+
     // Statements
     VAR_DECL,           // int x;
+    ARRAY_DECL,         // int value[intValue] = left, an INIT_LIST or none; intValue counts every element
+    INIT_LIST,          // { children }
     EXPRESSION_STMT,    // expression;
     COMPOUND_STMT,      // { ... }
     IF_STMT,           // if (condition) statement
     WHILE_STMT,        // while (condition) statement
     FOR_STMT,          // for (init; condition; update) statement
     RETURN_STMT,       // return expression;
+    SWITCH_STMT,       // switch (condition) { children }
+    CASE_LABEL,        // case intValue:
+    DEFAULT_LABEL,     // default:
+    BREAK_STMT,        // break;
+    FUNCTION_DECL,     // int value(children) left, or a prototype without left
+    CALL,              // value(children)
+    INDEX,             // value[left]; m[i][j] is m[i * columns + j]
 
     // I/O Statements
     COUT_STMT,         // cout << expression;
@@ -95,6 +117,8 @@ private:
     Scanner* scanner;
     Token currentToken;
     bool ownedScanner;  // Whether we own the scanner
+    std::vector<bool> breakTargets;  // Enclosing switch (true) and loop (false) statements
+    std::unordered_map<std::string, std::vector<int>> arrayDimensions;  // Of the arrays in scope
 
     // Token handling
     void nextToken();
@@ -108,13 +132,19 @@ private:
 
     // Statement parsing
     std::unique_ptr<ASTNode> parseStatement();
-    std::unique_ptr<ASTNode> parseVariableDeclaration();
+    std::unique_ptr<ASTNode> parseVariableDeclaration(bool allowFunction = false);
+    std::unique_ptr<ASTNode> parseArrayDeclaration(const std::string& name);
+    void parseInitializer(ASTNode* list, const std::vector<int>& dimensions, size_t level, const std::string& name);
+    std::unique_ptr<ASTNode> parseSubscripts(std::unique_ptr<ASTNode> node);
+    std::unique_ptr<ASTNode> parseFunctionDeclaration(const std::string& name);
     std::unique_ptr<ASTNode> parseExpressionStatement();
     std::unique_ptr<ASTNode> parseCompoundStatement();
     std::unique_ptr<ASTNode> parseIfStatement();
     std::unique_ptr<ASTNode> parseWhileStatement();
     std::unique_ptr<ASTNode> parseForStatement();
     std::unique_ptr<ASTNode> parseReturnStatement();
+    std::unique_ptr<ASTNode> parseSwitchStatement();
+    std::unique_ptr<ASTNode> parseBreakStatement();
     std::unique_ptr<ASTNode> parseCoutStatement();
     std::unique_ptr<ASTNode> parseCinStatement();
 
@@ -0,0 +1,413 @@
+#include "pipeline.hpp"
+#include "analysis.hpp"
+#include "scheduler.hpp"
+#include <algorithm>
+
+SoftwarePipeliner::SoftwarePipeliner() : tempCounter(0), pipelinedCount(0) {}
+
+// Cycles from an operation's operands to its result, for the instructions
+// the code generator emits for it
+int SoftwarePipeliner::operationLatency(const ASTNode& node) {
+    switch (node.type) {
+        case ASTNodeType::INTLIT:
+        case ASTNodeType::BOOLLIT:
+        case ASTNodeType::IDENTIFIER:
+        case ASTNodeType::POSITIVE:
+        case ASTNodeType::ASSIGN:
+            return 0;
+
+        case ASTNodeType::MULTIPLY:
+            return InstructionScheduler::MUL_LATENCY;
+
+        case ASTNodeType::DIVIDE:
+        case ASTNodeType::MODULO:
+            return InstructionScheduler::DIV_LATENCY;
+
+        case ASTNodeType::INDEX:
+            return InstructionScheduler::LOAD_LATENCY;
+
+        // Compare and set, or compare and move
+        case ASTNodeType::EQ:
+        case ASTNodeType::NE:
+        case ASTNodeType::LT:
+        case ASTNodeType::GT:
+        case ASTNodeType::LE:
+        case ASTNodeType::GE:
+        case ASTNodeType::AND:
+        case ASTNodeType::OR:
+        case ASTNodeType::NOT:
+        case ASTNodeType::CONDITIONAL:
+            return 2;
+
+        default:
+            return 1;
+    }
+}
+
+// Timing of an expression, counting the operations it issues. A variable
+// not yet assigned in the iteration holds the value the previous one left.
+SoftwarePipeliner::Timing SoftwarePipeliner::estimate(const std::unique_ptr<ASTNode>& node, Model& model) {
+    Timing timing;
+    if (!node || node->type == ASTNodeType::INTLIT || node->type == ASTNodeType::BOOLLIT) return timing;
+
+    if (node->type == ASTNodeType::IDENTIFIER) {
+        auto it = model.variables.find(node->value);
+        if (it != model.variables.end()) return it->second;
+        timing.carried[node->value] = 0;
+        return timing;
+    }
+
+    if (node->type == ASTNodeType::ASSIGN && node->left) {
+        timing = estimate(node->right, model);
+        if (node->left->type == ASTNodeType::IDENTIFIER) {
+            model.variables[node->left->value] = timing;
+        } else {
+            Timing address = estimate(node->left->left, model);
+            model.operations++;
+            model.criticalPath = std::max(model.criticalPath, std::max(timing.ready, address.ready) + 1);
+        }
+        return timing;
+    }
+
+    auto combine = [&timing, &model](const std::unique_ptr<ASTNode>& child) {
+        if (!child) return;
+        Timing operand = estimate(child, model);
+        timing.ready = std::max(timing.ready, operand.ready);
+        for (const auto& entry : operand.carried) {
+            int& latency = timing.carried[entry.first];
+            latency = std::max(latency, entry.second);
+        }
+    };
+    combine(node->condition);
+    combine(node->left);
+    combine(node->right);
+    for (const auto& child : node->children) {
+        combine(child);
+    }
+
+    int latency = operationLatency(*node);
+    timing.ready += latency;
+    for (auto& entry : timing.carried) {
+        entry.second += latency;
+    }
+
+    model.operations += latency > 0 ? 1 : 0;
+    if (node->type == ASTNodeType::INDEX) model.loads++;
+    if (node->type == ASTNodeType::MULTIPLY) model.multiplies++;
+    if (node->type == ASTNodeType::DIVIDE || node->type == ASTNodeType::MODULO) model.divides++;
+    model.criticalPath = std::max(model.criticalPath, timing.ready);
+    return timing;
+}
+
+// Both branches of a conditional statement count, as if both ran
+void SoftwarePipeliner::estimateStatement(const std::unique_ptr<ASTNode>& node, Model& model) {
+    if (!node) return;
+
+    switch (node->type) {
+        case ASTNodeType::COMPOUND_STMT:
+            for (const auto& child : node->children) {
+                estimateStatement(child, model);
+            }
+            break;
+
+        case ASTNodeType::VAR_DECL:
+            model.variables[node->value] = estimate(node->left, model);
+            break;
+
+        case ASTNodeType::IF_STMT:
+            estimate(node->condition, model);
+            estimateStatement(node->left, model);
+            estimateStatement(node->right, model);
+            break;
+
+        case ASTNodeType::SWITCH_STMT:
+            estimate(node->condition, model);
+            for (const auto& child : node->children) {
+                estimateStatement(child, model);
+            }
+            break;
+
+        case ASTNodeType::EXPRESSION_STMT:
+        case ASTNodeType::RETURN_STMT:
+            estimate(node->left, model);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// The longer of the longest cycle through a loop-carried variable and the
+// cycles the busiest resource needs per iteration
+int SoftwarePipeliner::initiationInterval(const Model& model) {
+    auto cycles = [](int count, int units) { return (count + units - 1) / units; };
+
+    int interval = 1;
+    for (const auto& variable : model.variables) {
+        auto self = variable.second.carried.find(variable.first);
+        if (self != variable.second.carried.end()) interval = std::max(interval, self->second);
+    }
+    const int* ports = InstructionScheduler::PORT_COUNT;
+    interval = std::max(interval, cycles(model.operations, InstructionScheduler::ISSUE_WIDTH));
+    interval = std::max(interval, cycles(model.loads, ports[InstructionScheduler::LOAD]));
+    interval = std::max(interval, cycles(model.multiplies, ports[InstructionScheduler::MUL]));
+    interval = std::max(interval, cycles(model.divides, ports[InstructionScheduler::DIV]));
+    return interval;
+}
+
+// Whether an expression can be evaluated for an iteration before it
+// starts: it reads only the counter, variables the loop does not assign and
+// arrays it does not store to, and it cannot trap
+bool SoftwarePipeliner::independent(const std::unique_ptr<ASTNode>& node, const std::string& counter,
+                                    const std::set<std::string>& modified, const std::set<std::string>& stored) {
+    if (!node) return false;
+
+    switch (node->type) {
+        case ASTNodeType::INTLIT:
+        case ASTNodeType::BOOLLIT:
+            return true;
+
+        case ASTNodeType::IDENTIFIER:
+            return node->value == counter || !modified.count(node->value);
+
+        case ASTNodeType::INDEX:
+            return !stored.count(node->value) && independent(node->left, counter, modified, stored);
+
+        case ASTNodeType::DIVIDE:
+        case ASTNodeType::MODULO:
+            return independent(node->left, counter, modified, stored) && node->right &&
+                   node->right->type == ASTNodeType::INTLIT && node->right->intValue != 0 &&
+                   node->right->intValue != -1;
+
+        case ASTNodeType::ADD:
+        case ASTNodeType::SUBTRACT:
+        case ASTNodeType::MULTIPLY:
+        case ASTNodeType::EQ:
+        case ASTNodeType::NE:
+        case ASTNodeType::LT:
+        case ASTNodeType::GT:
+        case ASTNodeType::LE:
+        case ASTNodeType::GE:
+        case ASTNodeType::BITAND:
+        case ASTNodeType::BITOR:
+        case ASTNodeType::BITXOR:
+        case ASTNodeType::LSHIFT:
+        case ASTNodeType::RSHIFT:
+            return independent(node->left, counter, modified, stored) &&
+                   independent(node->right, counter, modified, stored);
+
+        case ASTNodeType::NEGATE:
+        case ASTNodeType::POSITIVE:
+        case ASTNodeType::NOT:
+        case ASTNodeType::BITNOT:
+            return independent(node->left, counter, modified, stored);
+
+        default:
+            return false;
+    }
+}
+
+// The largest independent subexpressions holding a long-latency operation,
+// among the operands every evaluation of an expression computes
+void SoftwarePipeliner::collectStageValues(const std::unique_ptr<ASTNode>& node, const std::string& counter,
+                                           const std::set<std::string>& modified,
+                                           const std::set<std::string>& stored,
+                                           std::vector<const std::unique_ptr<ASTNode>*>& values) {
+    if (!node || node->type == ASTNodeType::IDENTIFIER || node->type == ASTNodeType::INTLIT) return;
+
+    if (independent(node, counter, modified, stored) &&
+        (containsNodeType(node, ASTNodeType::INDEX) || containsNodeType(node, ASTNodeType::MULTIPLY) ||
+         containsNodeType(node, ASTNodeType::DIVIDE) || containsNodeType(node, ASTNodeType::MODULO))) {
+        values.push_back(&node);
+        return;
+    }
+
+    switch (node->type) {
+        case ASTNodeType::AND:
+        case ASTNodeType::OR:
+            collectStageValues(node->left, counter, modified, stored, values);
+            break;
+
+        case ASTNodeType::CONDITIONAL:
+            collectStageValues(node->condition, counter, modified, stored, values);
+            break;
+
+        case ASTNodeType::ASSIGN:
+            if (node->left && node->left->type == ASTNodeType::INDEX) {
+                collectStageValues(node->left->left, counter, modified, stored, values);
+            }
+            collectStageValues(node->right, counter, modified, stored, values);
+            break;
+
+        default:
+            collectStageValues(node->left, counter, modified, stored, values);
+            collectStageValues(node->right, counter, modified, stored, values);
+            break;
+    }
+}
+
+// Only expressions every iteration evaluates are computed ahead, so no
+// element is loaded that the loop would not load; statements after one
+// that may return are not reached by every iteration
+void SoftwarePipeliner::collectStatementValues(const std::unique_ptr<ASTNode>& node, const std::string& counter,
+                                               const std::set<std::string>& modified,
+                                               const std::set<std::string>& stored,
+                                               std::vector<const std::unique_ptr<ASTNode>*>& values) {
+    if (!node) return;
+
+    switch (node->type) {
+        case ASTNodeType::COMPOUND_STMT:
+            for (const auto& child : node->children) {
+                collectStatementValues(child, counter, modified, stored, values);
+                if (containsNodeType(child, ASTNodeType::RETURN_STMT)) break;
+            }
+            break;
+
+        case ASTNodeType::EXPRESSION_STMT:
+        case ASTNodeType::VAR_DECL:
+            collectStageValues(node->left, counter, modified, stored, values);
+            break;
+
+        case ASTNodeType::IF_STMT:
+        case ASTNodeType::SWITCH_STMT:
+            collectStageValues(node->condition, counter, modified, stored, values);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void collectStoredArrays(const std::unique_ptr<ASTNode>& node, std::set<std::string>& arrays) {
+    if (!node) return;
+    if (node->type == ASTNodeType::ARRAY_DECL ||
+        (node->type == ASTNodeType::ASSIGN && node->left && node->left->type == ASTNodeType::INDEX)) {
+        arrays.insert(node->type == ASTNodeType::ARRAY_DECL ? node->value : node->left->value);
+    }
+    collectStoredArrays(node->condition, arrays);
+    collectStoredArrays(node->left, arrays);
+    collectStoredArrays(node->right, arrays);
+    for (const auto& child : node->children) {
+        collectStoredArrays(child, arrays);
+    }
+}
+
+// Replace every occurrence of a first-stage value by its variable
+static void replaceValues(std::unique_ptr<ASTNode>& node, const std::vector<std::string>& keys,
+                          const std::vector<std::string>& names) {
+    if (!node) return;
+
+    auto it = std::find(keys.begin(), keys.end(), expressionKey(node));
+    if (it != keys.end()) {
+        node = makeIdentifier(names[it - keys.begin()]);
+        return;
+    }
+    replaceValues(node->condition, keys, names);
+    replaceValues(node->left, keys, names);
+    replaceValues(node->right, keys, names);
+    for (auto& child : node->children) {
+        replaceValues(child, keys, names);
+    }
+}
+
+static void substituteCounter(std::unique_ptr<ASTNode>& node, const std::string& counter,
+                              const std::unique_ptr<ASTNode>& replacement) {
+    if (!node) return;
+
+    if (node->type == ASTNodeType::IDENTIFIER && node->value == counter) {
+        node = cloneAST(replacement);
+        return;
+    }
+    substituteCounter(node->condition, counter, replacement);
+    substituteCounter(node->left, counter, replacement);
+    substituteCounter(node->right, counter, replacement);
+    for (auto& child : node->children) {
+        substituteCounter(child, counter, replacement);
+    }
+}
+
+// The loop becomes
+//   if (test) {
+//       int stage = value;                      // prologue
+//       for (; nextTest; update) {
+//           int next = value with nextCounter;  // first stage of the next iteration
+//           body with stage for value;          // second stage of this one
+//           stage = next;
+//       }
+//       body with stage for value;              // epilogue
+//       update;
+//   }
+bool SoftwarePipeliner::pipeline(std::unique_ptr<ASTNode>& loop, const std::string& counter,
+                                 const std::set<std::string>& modified, std::unique_ptr<ASTNode> nextTest,
+                                 const std::unique_ptr<ASTNode>& nextCounter) {
+    auto& body = loop->left;
+    if (!body || containsNodeType(body, ASTNodeType::CALL) || containsNodeType(body, ASTNodeType::WHILE_STMT) ||
+        containsNodeType(body, ASTNodeType::FOR_STMT)) {
+        return false;
+    }
+
+    // Overlapping iterations only pays when one takes two intervals or more
+    Model model;
+    estimateStatement(body, model);
+    estimate(loop->children[1], model);
+    if (model.criticalPath < 2 * initiationInterval(model)) return false;
+
+    std::set<std::string> stored;
+    collectStoredArrays(body, stored);
+    std::vector<const std::unique_ptr<ASTNode>*> candidates;
+    collectStatementValues(body, counter, modified, stored, candidates);
+
+    std::vector<std::string> keys;
+    std::vector<std::unique_ptr<ASTNode>> values;
+    for (const auto* candidate : candidates) {
+        std::unique_ptr<ASTNode> value = cloneAST(*candidate);
+        std::string key = expressionKey(value);
+        if (std::find(keys.begin(), keys.end(), key) != keys.end()) continue;
+        if (static_cast<int>(keys.size()) >= MAX_STAGE_VALUES) break;
+        keys.push_back(key);
+        values.push_back(std::move(value));
+    }
+    if (values.empty()) return false;
+
+    std::vector<std::string> stages;
+    std::vector<std::string> nexts;
+    for (size_t i = 0; i < values.size(); i++) {
+        int id = tempCounter++;
+        stages.push_back("__stage" + std::to_string(id));
+        nexts.push_back("__next" + std::to_string(id));
+    }
+    replaceValues(body, keys, stages);
+
+    auto result = std::make_unique<ASTNode>(ASTNodeType::IF_STMT);
+    result->condition = cloneAST(loop->condition);
+    result->left = makeCompound();
+    auto& block = result->left->children;
+
+    for (size_t i = 0; i < values.size(); i++) {
+        block.push_back(makeVarDecl(stages[i], cloneAST(values[i])));
+    }
+
+    auto kernel = makeCompound();
+    for (size_t i = 0; i < values.size(); i++) {
+        substituteCounter(values[i], counter, nextCounter);
+        kernel->children.push_back(makeVarDecl(nexts[i], std::move(values[i])));
+    }
+    kernel->children.push_back(cloneAST(body));
+    for (size_t i = 0; i < values.size(); i++) {
+        kernel->children.push_back(makeExpressionStatement(makeAssignment(stages[i], makeIdentifier(nexts[i]))));
+    }
+
+    auto epilogue = makeCompound();
+    epilogue->children.push_back(std::move(body));
+    auto update = makeExpressionStatement(cloneAST(loop->children[1]));
+
+    loop->condition = std::move(nextTest);
+    loop->left = std::move(kernel);
+    block.push_back(std::move(loop));
+    block.push_back(std::move(epilogue));
+    block.push_back(std::move(update));
+
+    loop = std::move(result);
+    pipelinedCount++;
+    return true;
+}
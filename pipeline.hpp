@@ -0,0 +1,76 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "parser.hpp"
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// Software pipelining of innermost counted loops, by modulo scheduling the
+// statements of an iteration in two stages. The machine model of the
+// instruction scheduler, applied to the instructions the code generator
+// emits for each operation, gives the latency of an iteration's critical
+// path and the initiation interval the loop could sustain: the longer of
+// its longest loop-carried dependence cycle and the cycles its operations
+// need on the busiest execution resource. When an iteration spans at least
+// two intervals, the loads, multiplies and divides whose operands are the
+// counter, loop-invariant scalars and elements of arrays the loop does not
+// store to form the first stage. The steady-state loop computes them for
+// the next iteration while the rest of its body, the second stage,
+// consumes the values computed one iteration earlier; a prologue computes
+// the first iteration's values and an epilogue runs the last iteration's
+// second stage.
+class SoftwarePipeliner {
+private:
+    // When an operation's result is ready, and its latency from the value
+    // each variable had when the iteration started
+    struct Timing {
+        int ready = 0;
+        std::map<std::string, int> carried;
+    };
+
+    struct Model {
+        std::map<std::string, Timing> variables;    // Values assigned so far in the iteration
+        int criticalPath = 0;
+        int operations = 0;
+        int loads = 0;
+        int multiplies = 0;
+        int divides = 0;
+    };
+
+    int tempCounter;
+    int pipelinedCount;
+
+    // First-stage values per loop, each held in two variables
+    static const int MAX_STAGE_VALUES = 4;
+
+    static int operationLatency(const ASTNode& node);
+    static Timing estimate(const std::unique_ptr<ASTNode>& node, Model& model);
+    static void estimateStatement(const std::unique_ptr<ASTNode>& node, Model& model);
+    static int initiationInterval(const Model& model);
+
+    static bool independent(const std::unique_ptr<ASTNode>& node, const std::string& counter,
+                            const std::set<std::string>& modified, const std::set<std::string>& stored);
+    static void collectStageValues(const std::unique_ptr<ASTNode>& node, const std::string& counter,
+                                   const std::set<std::string>& modified, const std::set<std::string>& stored,
+                                   std::vector<const std::unique_ptr<ASTNode>*>& values);
+    static void collectStatementValues(const std::unique_ptr<ASTNode>& node, const std::string& counter,
+                                       const std::set<std::string>& modified, const std::set<std::string>& stored,
+                                       std::vector<const std::unique_ptr<ASTNode>*>& values);
+
+public:
+    SoftwarePipeliner();
+
+    // Pipeline a loop 'for (; counter op bound; update)' whose body has no
+    // loops or calls; 'modified' holds every variable the loop assigns and
+    // 'nextTest' tells whether the iteration after the current one runs.
+    // On success 'loop' is replaced by the pipelined statement.
+    bool pipeline(std::unique_ptr<ASTNode>& loop, const std::string& counter, const std::set<std::string>& modified,
+                  std::unique_ptr<ASTNode> nextTest, const std::unique_ptr<ASTNode>& nextCounter);
+
+    int getPipelinedCount() const { return pipelinedCount; }
+};
+
+#endif // PIPELINE_HPP
@@ -0,0 +1,168 @@
+#include "promotion.hpp"
+#include "analysis.hpp"
+#include <algorithm>
+
+RegisterPromotion::RegisterPromotion() : position(0), maxNeed(0) {}
+
+void RegisterPromotion::pushScope() {
+    scopes.emplace_back();
+}
+
+void RegisterPromotion::popScope() {
+    for (const auto& entry : scopes.back()) {
+        declarations[entry.second].end = position;
+    }
+    scopes.pop_back();
+    position++;
+}
+
+void RegisterPromotion::use(const std::string& name, double weight) {
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+        auto it = scope->find(name);
+        if (it != scope->end()) {
+            declarations[it->second].weight += weight;
+            return;
+        }
+    }
+}
+
+void RegisterPromotion::noteNeed(const std::unique_ptr<ASTNode>& expr) {
+    maxNeed = std::max(maxNeed, registerNeed(expr));
+}
+
+// Mirrors the scopes the code generator opens: the program, every block,
+// and every loop (which owns its init declaration)
+void RegisterPromotion::visitStatement(const std::unique_ptr<ASTNode>& node, double weight) {
+    if (!node) return;
+    position++;
+
+    switch (node->type) {
+        case ASTNodeType::PROGRAM:
+        case ASTNodeType::COMPOUND_STMT:
+            pushScope();
+            for (const auto& child : node->children) {
+                visitStatement(child, weight);
+            }
+            popScope();
+            break;
+
+        case ASTNodeType::VAR_DECL:
+            noteNeed(node->left);
+            visitExpression(node->left, weight);
+            declarations.push_back({node.get(), position, position, node->left ? weight : 0.0, -1});
+            scopes.back()[node->value] = declarations.size() - 1;
+            break;
+
+        case ASTNodeType::IF_STMT:
+            noteNeed(node->condition);
+            visitExpression(node->condition, weight);
+            visitStatement(node->left, weight);
+            visitStatement(node->right, weight);
+            break;
+
+        case ASTNodeType::WHILE_STMT:
+        case ASTNodeType::FOR_STMT: {
+            double inner = weight * LOOP_WEIGHT;
+            pushScope();
+            if (node->type == ASTNodeType::FOR_STMT && !node->children.empty()) {
+                visitStatement(node->children[0], weight);
+            }
+            noteNeed(node->condition);
+            visitExpression(node->condition, inner);
+            visitStatement(node->left, inner);
+            if (node->type == ASTNodeType::FOR_STMT && node->children.size() > 1) {
+                noteNeed(node->children[1]);
+                visitExpression(node->children[1], inner);
+            }
+            popScope();
+            break;
+        }
+
+        case ASTNodeType::FUNCTION_DECL:
+            // Each function is planned on its own
+            break;
+
+        case ASTNodeType::SWITCH_STMT:
+            noteNeed(node);
+            visitExpression(node->condition, weight);
+            for (const auto& child : node->children) {
+                visitStatement(child, weight);
+            }
+            break;
+
+        default:
+            noteNeed(node->left);
+            visitExpression(node->left, weight);
+            break;
+    }
+}
+
+void RegisterPromotion::visitExpression(const std::unique_ptr<ASTNode>& node, double weight) {
+    if (!node) return;
+    position++;
+
+    if (node->type == ASTNodeType::IDENTIFIER) {
+        use(node->value, weight);
+        return;
+    }
+    visitExpression(node->left, weight);
+    visitExpression(node->right, weight);
+    visitExpression(node->condition, weight);
+    for (const auto& child : node->children) {
+        visitExpression(child, weight);
+    }
+}
+
+void RegisterPromotion::analyze(const std::unique_ptr<ASTNode>& program) {
+    declarations.clear();
+    scopes.clear();
+    slots.clear();
+    position = 0;
+    maxNeed = 0;
+    if (program->type != ASTNodeType::FUNCTION_DECL) {
+        visitStatement(program, 1.0);
+        return;
+    }
+
+    // Parameters arrive in registers; only their uses count, so one the
+    // body never mentions gets no register
+    pushScope();
+    for (const auto& param : program->children) {
+        position++;
+        declarations.push_back({param.get(), position, position, 0.0, -1});
+        scopes.back()[param->value] = declarations.size() - 1;
+    }
+    visitStatement(program->left, 1.0);
+    popScope();
+}
+
+void RegisterPromotion::assign(int registerCount) {
+    std::vector<size_t> order;
+    for (size_t i = 0; i < declarations.size(); i++) {
+        if (declarations[i].weight > 0.0) order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return declarations[a].weight > declarations[b].weight;
+    });
+
+    slots.clear();
+    for (size_t i : order) {
+        Declaration& decl = declarations[i];
+        std::vector<bool> taken(registerCount, false);
+        for (const Declaration& other : declarations) {
+            if (other.slot >= 0 && other.start <= decl.end && decl.start <= other.end) {
+                taken[other.slot] = true;
+            }
+        }
+        auto freeSlot = std::find(taken.begin(), taken.end(), false);
+        if (freeSlot != taken.end()) {
+            decl.slot = static_cast<int>(freeSlot - taken.begin());
+            slots[decl.node] = decl.slot;
+        }
+    }
+}
+
+int RegisterPromotion::slotFor(const ASTNode* declaration) const {
+    auto it = slots.find(declaration);
+    return it != slots.end() ? it->second : -1;
+}
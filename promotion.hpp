@@ -0,0 +1,59 @@
+#ifndef PROMOTION_HPP
+#define PROMOTION_HPP
+
+#include "parser.hpp"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Memory-to-register promotion plan for local variables. The language has
+// no address-of operator, so any scalar local may live in a register for
+// its whole lifetime instead of a stack slot. Lifetimes follow block
+// scopes, so they nest; declarations are colored greedily in order of
+// loop-weighted use count, which gives the hottest variables registers
+// when there are more variables than registers.
+class RegisterPromotion {
+private:
+    struct Declaration {
+        const ASTNode* node;
+        int start;              // Program position of the declaration
+        int end;                // Position where its scope closes
+        double weight;          // Loop-weighted number of reads and writes
+        int slot;               // Assigned register slot, or -1
+    };
+
+    std::vector<Declaration> declarations;
+    std::vector<std::unordered_map<std::string, size_t>> scopes;
+    std::unordered_map<const ASTNode*, int> slots;
+    int position;
+    int maxNeed;
+
+    // Weight multiplier for each level of loop nesting
+    static constexpr double LOOP_WEIGHT = 10.0;
+
+    void pushScope();
+    void popScope();
+    void use(const std::string& name, double weight);
+    void noteNeed(const std::unique_ptr<ASTNode>& expr);
+    void visitStatement(const std::unique_ptr<ASTNode>& node, double weight);
+    void visitExpression(const std::unique_ptr<ASTNode>& node, double weight);
+
+public:
+    RegisterPromotion();
+
+    // Collect declarations, their lifetimes and use counts, of the program's
+    // top-level statements or of one function and its parameters
+    void analyze(const std::unique_ptr<ASTNode>& program);
+
+    // Assign up to 'registerCount' register slots
+    void assign(int registerCount);
+
+    // Register slot of a declaration, or -1 if it stays in memory
+    int slotFor(const ASTNode* declaration) const;
+
+    // Most temporaries any single expression of the program needs
+    int getMaxNeed() const { return maxNeed; }
+};
+
+#endif // PROMOTION_HPP
@@ -0,0 +1,639 @@
+#include "ranges.hpp"
+#include "analysis.hpp"
+#include <algorithm>
+#include <climits>
+#include <set>
+#include <utility>
+
+static bool isComparison(ASTNodeType type) {
+    return type == ASTNodeType::EQ || type == ASTNodeType::NE ||
+           type == ASTNodeType::LT || type == ASTNodeType::GT ||
+           type == ASTNodeType::LE || type == ASTNodeType::GE;
+}
+
+// Comparison that holds exactly when the given one does not
+static ASTNodeType negateComparison(ASTNodeType type) {
+    switch (type) {
+        case ASTNodeType::EQ: return ASTNodeType::NE;
+        case ASTNodeType::NE: return ASTNodeType::EQ;
+        case ASTNodeType::LT: return ASTNodeType::GE;
+        case ASTNodeType::GT: return ASTNodeType::LE;
+        case ASTNodeType::LE: return ASTNodeType::GT;
+        default:              return ASTNodeType::LT;
+    }
+}
+
+// Comparison with its operands swapped
+static ASTNodeType mirrorComparison(ASTNodeType type) {
+    switch (type) {
+        case ASTNodeType::LT: return ASTNodeType::GT;
+        case ASTNodeType::GT: return ASTNodeType::LT;
+        case ASTNodeType::LE: return ASTNodeType::GE;
+        case ASTNodeType::GE: return ASTNodeType::LE;
+        default:              return type;
+    }
+}
+
+RangeAnalysis::RangeAnalysis() : recording(false) {}
+
+RangeAnalysis::Range RangeAnalysis::full() {
+    return {LLONG_MIN, LLONG_MAX};
+}
+
+// Bounds computed exactly; if either leaves the 64-bit range the
+// operation may wrap, and the result could be anything
+RangeAnalysis::Range RangeAnalysis::clamp(__int128 lo, __int128 hi) {
+    if (lo < LLONG_MIN || hi > LLONG_MAX) return full();
+    return {static_cast<long long>(lo), static_cast<long long>(hi)};
+}
+
+void RangeAnalysis::join(State& target, const State& other) {
+    if (!other.reachable) return;
+    if (!target.reachable) {
+        target = other;
+        return;
+    }
+    for (auto it = target.ranges.begin(); it != target.ranges.end();) {
+        auto match = other.ranges.find(it->first);
+        if (match == other.ranges.end()) {
+            it = target.ranges.erase(it);
+        } else {
+            it->second.lo = std::min(it->second.lo, match->second.lo);
+            it->second.hi = std::max(it->second.hi, match->second.hi);
+            ++it;
+        }
+    }
+}
+
+bool RangeAnalysis::includes(const State& outer, const State& inner) {
+    if (!inner.reachable) return true;
+    if (!outer.reachable) return false;
+    for (const auto& entry : outer.ranges) {
+        auto match = inner.ranges.find(entry.first);
+        if (match == inner.ranges.end() || match->second.lo < entry.second.lo ||
+            match->second.hi > entry.second.hi) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void RangeAnalysis::widen(State& header, const State& next) {
+    for (auto it = header.ranges.begin(); it != header.ranges.end();) {
+        auto match = next.ranges.find(it->first);
+        if (match == next.ranges.end()) {
+            it = header.ranges.erase(it);
+            continue;
+        }
+        if (match->second.lo < it->second.lo) it->second.lo = LLONG_MIN;
+        if (match->second.hi > it->second.hi) it->second.hi = LLONG_MAX;
+        if (it->second.lo == LLONG_MIN && it->second.hi == LLONG_MAX) {
+            it = header.ranges.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void RangeAnalysis::pushScope() {
+    scopes.emplace_back();
+}
+
+void RangeAnalysis::popScope() {
+    for (const auto& name : scopes.back()) {
+        state.ranges.erase(name);
+    }
+    scopes.pop_back();
+}
+
+RangeAnalysis::Range RangeAnalysis::lookup(const std::string& name) const {
+    auto it = state.ranges.find(name);
+    return it != state.ranges.end() ? it->second : full();
+}
+
+void RangeAnalysis::setRange(const std::string& name, Range range) {
+    if (range.lo == LLONG_MIN && range.hi == LLONG_MAX) {
+        state.ranges.erase(name);
+    } else {
+        state.ranges[name] = range;
+    }
+}
+
+RangeAnalysis::Range RangeAnalysis::evaluate(const std::unique_ptr<ASTNode>& node) {
+    Range range = evaluateNode(node);
+    if (recording && node && state.reachable) {
+        results[node.get()] = range;
+    }
+    return range;
+}
+
+RangeAnalysis::Range RangeAnalysis::rangeWithoutRecording(const std::unique_ptr<ASTNode>& node) {
+    bool wasRecording = recording;
+    recording = false;
+    Range range = evaluate(node);
+    recording = wasRecording;
+    return range;
+}
+
+RangeAnalysis::Range RangeAnalysis::evaluateNode(const std::unique_ptr<ASTNode>& node) {
+    if (!node) return full();
+
+    switch (node->type) {
+        case ASTNodeType::INTLIT:
+            return {node->intValue, node->intValue};
+
+        case ASTNodeType::BOOLLIT:
+            return {node->boolValue ? 1 : 0, node->boolValue ? 1 : 0};
+
+        case ASTNodeType::IDENTIFIER:
+            return lookup(node->value);
+
+        case ASTNodeType::ASSIGN:
+            if (node->left && node->left->type == ASTNodeType::IDENTIFIER) {
+                Range value = evaluate(node->right);
+                setRange(node->left->value, value);
+                return value;
+            }
+            // An element store computes its value before the element's index
+            if (node->left && node->left->type == ASTNodeType::INDEX) {
+                Range value = evaluate(node->right);
+                evaluate(node->left->left);
+                return value;
+            }
+            break;
+
+        case ASTNodeType::INDEX:
+            // Elements are 32-bit
+            evaluate(node->left);
+            return {INT_MIN, INT_MAX};
+
+        case ASTNodeType::AND:
+        case ASTNodeType::OR:
+            return evaluateLogical(node);
+
+        case ASTNodeType::CONDITIONAL: {
+            // Each arm runs under its outcome of the condition
+            Range condition = evaluate(node->condition);
+            bool conditionTrue = condition.lo > 0 || condition.hi < 0;
+            bool conditionFalse = condition.lo == 0 && condition.hi == 0;
+            if (conditionTrue || conditionFalse) {
+                refine(node->condition, conditionTrue);
+                return evaluate(conditionTrue ? node->left : node->right);
+            }
+
+            State skipped = state;
+            refine(node->condition, true);
+            Range left = evaluate(node->left);
+            State afterLeft = std::move(state);
+            state = std::move(skipped);
+            refine(node->condition, false);
+            Range right = evaluate(node->right);
+            join(state, afterLeft);
+            return {std::min(left.lo, right.lo), std::max(left.hi, right.hi)};
+        }
+
+        case ASTNodeType::NOT: {
+            Range operand = evaluate(node->left);
+            if (operand.lo == 0 && operand.hi == 0) return {1, 1};
+            if (operand.lo > 0 || operand.hi < 0) return {0, 0};
+            return {0, 1};
+        }
+
+        case ASTNodeType::NEGATE: {
+            Range operand = evaluate(node->left);
+            return clamp(-static_cast<__int128>(operand.hi), -static_cast<__int128>(operand.lo));
+        }
+
+        case ASTNodeType::POSITIVE:
+            return evaluate(node->left);
+
+        // ~x is -x - 1
+        case ASTNodeType::BITNOT: {
+            Range operand = evaluate(node->left);
+            return {-1 - operand.hi, -1 - operand.lo};
+        }
+
+        case ASTNodeType::BITAND:
+        case ASTNodeType::BITOR:
+        case ASTNodeType::BITXOR:
+        case ASTNodeType::LSHIFT:
+        case ASTNodeType::RSHIFT: {
+            Range a = evaluate(node->left);
+            Range b = evaluate(node->right);
+
+            switch (node->type) {
+                case ASTNodeType::BITAND:
+                    // A non-negative operand keeps the result within it
+                    if (a.lo >= 0 && b.lo >= 0) return {0, std::min(a.hi, b.hi)};
+                    if (a.lo >= 0 || b.lo >= 0) return {0, a.lo >= 0 ? a.hi : b.hi};
+                    return full();
+                case ASTNodeType::BITOR:
+                case ASTNodeType::BITXOR: {
+                    // Of non-negative operands, no bit above their highest is set
+                    if (a.lo < 0 || b.lo < 0) return full();
+                    long long mask = 0;
+                    while (mask < std::max(a.hi, b.hi)) mask = mask * 2 + 1;
+                    return {node->type == ASTNodeType::BITOR ? std::max(a.lo, b.lo) : 0, mask};
+                }
+                case ASTNodeType::LSHIFT: {
+                    if (b.lo != b.hi || b.lo < 0 || b.lo > 62) return full();
+                    __int128 scale = static_cast<__int128>(1) << b.lo;
+                    return clamp(a.lo * scale, a.hi * scale);
+                }
+                default: {
+                    // Monotone in each operand while the count stays in 0..63
+                    if (b.lo < 0 || b.hi > 63) return full();
+                    long long corners[4] = {a.lo >> b.lo, a.lo >> b.hi, a.hi >> b.lo, a.hi >> b.hi};
+                    return {*std::min_element(corners, corners + 4), *std::max_element(corners, corners + 4)};
+                }
+            }
+        }
+
+        case ASTNodeType::ADD:
+        case ASTNodeType::SUBTRACT:
+        case ASTNodeType::MULTIPLY:
+        case ASTNodeType::DIVIDE:
+        case ASTNodeType::MODULO: {
+            Range a = evaluate(node->left);
+            Range b = evaluate(node->right);
+            __int128 alo = a.lo, ahi = a.hi, blo = b.lo, bhi = b.hi;
+
+            switch (node->type) {
+                case ASTNodeType::ADD:
+                    return clamp(alo + blo, ahi + bhi);
+                case ASTNodeType::SUBTRACT:
+                    return clamp(alo - bhi, ahi - blo);
+                case ASTNodeType::MULTIPLY:
+                case ASTNodeType::DIVIDE: {
+                    // Both operations are monotone in each operand on either
+                    // side of zero, so the extremes are at the corners
+                    bool divide = node->type == ASTNodeType::DIVIDE;
+                    if (divide && blo <= 0 && bhi >= 0) return full();
+                    __int128 corners[4] = {
+                        divide ? alo / blo : alo * blo, divide ? alo / bhi : alo * bhi,
+                        divide ? ahi / blo : ahi * blo, divide ? ahi / bhi : ahi * bhi};
+                    return clamp(*std::min_element(corners, corners + 4),
+                                 *std::max_element(corners, corners + 4));
+                }
+                default: {
+                    // The remainder is smaller than the divisor and has the
+                    // sign of the dividend
+                    __int128 limit = std::max(blo < 0 ? -blo : blo, bhi < 0 ? -bhi : bhi) - 1;
+                    if (limit < 0) return full();
+                    if (alo >= 0) return clamp(0, std::min(ahi, limit));
+                    if (ahi <= 0) return clamp(std::max(alo, -limit), 0);
+                    return clamp(-limit, limit);
+                }
+            }
+        }
+
+        case ASTNodeType::EQ:
+        case ASTNodeType::NE:
+        case ASTNodeType::LT:
+        case ASTNodeType::GT:
+        case ASTNodeType::LE:
+        case ASTNodeType::GE: {
+            Range a = evaluate(node->left);
+            Range b = evaluate(node->right);
+            bool alwaysTrue = false;
+            bool alwaysFalse = false;
+
+            switch (node->type) {
+                case ASTNodeType::EQ:
+                case ASTNodeType::NE: {
+                    bool same = a.lo == a.hi && b.lo == b.hi && a.lo == b.lo;
+                    bool disjoint = a.hi < b.lo || b.hi < a.lo;
+                    alwaysTrue = node->type == ASTNodeType::EQ ? same : disjoint;
+                    alwaysFalse = node->type == ASTNodeType::EQ ? disjoint : same;
+                    break;
+                }
+                case ASTNodeType::LT: alwaysTrue = a.hi < b.lo;  alwaysFalse = a.lo >= b.hi; break;
+                case ASTNodeType::GT: alwaysTrue = a.lo > b.hi;  alwaysFalse = a.hi <= b.lo; break;
+                case ASTNodeType::LE: alwaysTrue = a.hi <= b.lo; alwaysFalse = a.lo > b.hi;  break;
+                default:              alwaysTrue = a.lo >= b.hi; alwaysFalse = a.hi < b.lo;  break;
+            }
+            if (alwaysTrue) return {1, 1};
+            if (alwaysFalse) return {0, 0};
+            return {0, 1};
+        }
+
+        default:
+            break;
+    }
+
+    evaluate(node->left);
+    evaluate(node->right);
+    evaluate(node->condition);
+    for (const auto& child : node->children) {
+        evaluate(child);
+    }
+    return full();
+}
+
+// The right operand runs only on the paths where the left one did not
+// decide the result, and under that outcome of the left operand
+RangeAnalysis::Range RangeAnalysis::evaluateLogical(const std::unique_ptr<ASTNode>& node) {
+    bool isAnd = node->type == ASTNodeType::AND;
+    Range left = evaluate(node->left);
+    bool leftFalse = left.lo == 0 && left.hi == 0;
+    bool leftTrue = left.lo > 0 || left.hi < 0;
+    if (isAnd ? leftFalse : leftTrue) return isAnd ? Range{0, 0} : Range{1, 1};
+
+    State skipped = state;
+    refine(node->left, isAnd);
+    Range right = evaluate(node->right);
+    bool rightFalse = right.lo == 0 && right.hi == 0;
+    bool rightTrue = right.lo > 0 || right.hi < 0;
+
+    if (!(isAnd ? leftTrue : leftFalse)) {
+        State evaluated = std::move(state);
+        state = std::move(skipped);
+        refine(node->left, !isAnd);
+        join(state, evaluated);
+    }
+
+    if (isAnd) {
+        if (leftTrue && rightTrue) return {1, 1};
+        if (rightFalse) return {0, 0};
+    } else {
+        if (leftFalse && rightFalse) return {0, 0};
+        if (rightTrue) return {1, 1};
+    }
+    return {0, 1};
+}
+
+// Restrict the state to the paths where a condition has the given truth
+void RangeAnalysis::refine(const std::unique_ptr<ASTNode>& condition, bool truth) {
+    if (!condition || !state.reachable || containsNodeType(condition, ASTNodeType::ASSIGN)) return;
+
+    switch (condition->type) {
+        case ASTNodeType::NOT:
+            refine(condition->left, !truth);
+            return;
+
+        case ASTNodeType::AND:
+        case ASTNodeType::OR:
+            // Both operands are known only when the whole is true for &&,
+            // and false for ||
+            if (truth == (condition->type == ASTNodeType::AND)) {
+                refine(condition->left, truth);
+                refine(condition->right, truth);
+            }
+            return;
+
+        case ASTNodeType::IDENTIFIER:
+            constrain(condition->value, truth ? ASTNodeType::NE : ASTNodeType::EQ, {0, 0});
+            return;
+
+        default:
+            break;
+    }
+
+    if (!isComparison(condition->type)) return;
+    ASTNodeType op = truth ? condition->type : negateComparison(condition->type);
+    if (condition->left && condition->left->type == ASTNodeType::IDENTIFIER) {
+        constrain(condition->left->value, op, rangeWithoutRecording(condition->right));
+    }
+    if (condition->right && condition->right->type == ASTNodeType::IDENTIFIER) {
+        constrain(condition->right->value, mirrorComparison(op), rangeWithoutRecording(condition->left));
+    }
+}
+
+// Narrow a variable to the values for which 'name op bound' can hold
+void RangeAnalysis::constrain(const std::string& name, ASTNodeType op, Range bound) {
+    if (!state.reachable) return;
+    Range current = lookup(name);
+    __int128 lo = current.lo, hi = current.hi;
+
+    switch (op) {
+        case ASTNodeType::LT: hi = std::min(hi, static_cast<__int128>(bound.hi) - 1); break;
+        case ASTNodeType::LE: hi = std::min(hi, static_cast<__int128>(bound.hi)); break;
+        case ASTNodeType::GT: lo = std::max(lo, static_cast<__int128>(bound.lo) + 1); break;
+        case ASTNodeType::GE: lo = std::max(lo, static_cast<__int128>(bound.lo)); break;
+        case ASTNodeType::EQ:
+            lo = std::max(lo, static_cast<__int128>(bound.lo));
+            hi = std::min(hi, static_cast<__int128>(bound.hi));
+            break;
+        default:
+            if (bound.lo == bound.hi) {
+                if (lo == bound.lo) lo++;
+                if (hi == bound.lo) hi--;
+            }
+            break;
+    }
+
+    if (lo > hi) {
+        state.reachable = false;
+        return;
+    }
+    setRange(name, {static_cast<long long>(lo), static_cast<long long>(hi)});
+}
+
+void RangeAnalysis::visitStatement(const std::unique_ptr<ASTNode>& node) {
+    if (node && node->type == ASTNodeType::FUNCTION_DECL) {
+        // A function body starts with nothing known about its parameters
+        State caller = std::move(state);
+        state = State();
+        visitStatement(node->left);
+        state = std::move(caller);
+        return;
+    }
+    if (!node || !state.reachable) return;
+
+    switch (node->type) {
+        case ASTNodeType::PROGRAM:
+        case ASTNodeType::COMPOUND_STMT:
+            pushScope();
+            for (const auto& child : node->children) {
+                visitStatement(child);
+            }
+            popScope();
+            break;
+
+        case ASTNodeType::VAR_DECL:
+            scopes.back().push_back(node->value);
+            setRange(node->value, node->left ? evaluate(node->left) : full());
+            break;
+
+        case ASTNodeType::IF_STMT: {
+            evaluate(node->condition);
+            State before = state;
+            refine(node->condition, true);
+            visitStatement(node->left);
+            State afterThen = std::move(state);
+            state = std::move(before);
+            refine(node->condition, false);
+            visitStatement(node->right);
+            join(state, afterThen);
+            break;
+        }
+
+        case ASTNodeType::WHILE_STMT:
+        case ASTNodeType::FOR_STMT:
+            visitLoop(node);
+            break;
+
+        case ASTNodeType::SWITCH_STMT:
+            visitSwitch(node);
+            break;
+
+        case ASTNodeType::BREAK_STMT:
+            if (!breakStates.empty()) join(breakStates.back(), state);
+            state.reachable = false;
+            break;
+
+        case ASTNodeType::RETURN_STMT:
+            evaluate(node->left);
+            state.reachable = false;
+            break;
+
+        case ASTNodeType::COUT_STMT:
+            for (const auto& child : node->children) {
+                evaluate(child);
+            }
+            break;
+
+        case ASTNodeType::CIN_STMT:
+            for (const auto& child : node->children) {
+                if (child && child->type == ASTNodeType::IDENTIFIER) {
+                    state.ranges.erase(child->value);
+                }
+            }
+            break;
+
+        default:
+            evaluate(node->left);
+            break;
+    }
+}
+
+// Each case is entered from the dispatch with a selector variable equal to
+// its value, or by falling through; the switch is left at the end of the
+// body, through a break, or from the dispatch when there is no default
+void RangeAnalysis::visitSwitch(const std::unique_ptr<ASTNode>& node) {
+    evaluate(node->condition);
+    State dispatch = state;
+    const ASTNode* selector = node->condition.get();
+    bool hasDefault = false;
+
+    State unreachable;
+    unreachable.reachable = false;
+    breakStates.push_back(unreachable);
+    state = unreachable;
+    for (const auto& child : node->children) {
+        if (child->type == ASTNodeType::CASE_LABEL) {
+            State fallthrough = std::move(state);
+            state = dispatch;
+            if (selector->type == ASTNodeType::IDENTIFIER) {
+                constrain(selector->value, ASTNodeType::EQ, {child->intValue, child->intValue});
+            }
+            join(state, fallthrough);
+        } else if (child->type == ASTNodeType::DEFAULT_LABEL) {
+            hasDefault = true;
+            join(state, dispatch);
+        } else {
+            visitStatement(child);
+        }
+    }
+
+    join(state, breakStates.back());
+    breakStates.pop_back();
+    if (!hasDefault) join(state, dispatch);
+}
+
+void RangeAnalysis::visitLoop(const std::unique_ptr<ASTNode>& node) {
+    bool isFor = node->type == ASTNodeType::FOR_STMT;
+    const ASTNode* update = isFor && node->children.size() > 1 ? node->children[1].get() : nullptr;
+
+    pushScope();
+    if (isFor && !node->children.empty()) {
+        visitStatement(node->children[0]);
+    }
+    State entry = state;
+
+    // Iterate the header state to a fixed point, widening bounds that move
+    bool wasRecording = recording;
+    recording = false;
+    State header = entry;
+    bool stable = false;
+    for (int i = 0; i < MAX_LOOP_ITERATIONS && !stable; i++) {
+        state = header;
+        evaluate(node->condition);
+        refine(node->condition, true);
+        visitStatement(node->left);
+        if (update && state.reachable) evaluate(node->children[1]);
+
+        State next = entry;
+        join(next, state);
+        stable = includes(header, next);
+        if (!stable) widen(header, next);
+    }
+    if (!stable) {
+        std::set<std::string> modified;
+        collectAssignedVariables(node, modified);
+        for (const auto& name : modified) {
+            header.ranges.erase(name);
+        }
+    }
+    recording = wasRecording;
+
+    state = header;
+    evaluate(node->condition);
+    State afterTest = state;
+    refine(node->condition, true);
+    visitStatement(node->left);
+    if (update && state.reachable) evaluate(node->children[1]);
+
+    // The loop leaves from the header when the condition fails
+    state = std::move(afterTest);
+    refine(node->condition, false);
+    popScope();
+}
+
+void RangeAnalysis::analyze(const std::unique_ptr<ASTNode>& program) {
+    state = State();
+    scopes.clear();
+    breakStates.clear();
+    results.clear();
+    recording = true;
+    visitStatement(program);
+    recording = false;
+}
+
+bool RangeAnalysis::rangeOf(const ASTNode* expr, Range& range) const {
+    auto it = results.find(expr);
+    if (it == results.end()) return false;
+    range = it->second;
+    return true;
+}
+
+bool RangeAnalysis::isNonNegative(const ASTNode* expr) const {
+    Range range;
+    return rangeOf(expr, range) && range.lo >= 0;
+}
+
+int RangeAnalysis::foldDecided(std::unique_ptr<ASTNode>& node) {
+    if (!node) return 0;
+
+    Range range;
+    bool logical = isComparison(node->type) || node->type == ASTNodeType::AND ||
+                   node->type == ASTNodeType::OR || node->type == ASTNodeType::NOT;
+    if (logical && rangeOf(node.get(), range) && range.lo == range.hi &&
+        !hasSideEffects(node)) {
+        node = makeIntLiteral(static_cast<int>(range.lo));
+        return 1;
+    }
+
+    int count = foldDecided(node->left) + foldDecided(node->right) + foldDecided(node->condition);
+    for (auto& child : node->children) {
+        count += foldDecided(child);
+    }
+    return count;
+}
+
+int RangeAnalysis::foldComparisons(std::unique_ptr<ASTNode>& program) {
+    analyze(program);
+    int count = foldDecided(program);
+    results.clear();
+    return count;
+}
@@ -0,0 +1,80 @@
+#ifndef RANGES_HPP
+#define RANGES_HPP
+
+#include "parser.hpp"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Interval analysis of integer values. The state on each path maps
+// variables to the interval of values they may hold (an absent variable may
+// hold any value). Branch conditions narrow the intervals of the variables
+// they compare, joins take the hull, and loop headers are widened: a bound
+// that still moves after an iteration goes to the limit of the type, after
+// which the exit test of a counted loop bounds its counter again. The
+// interval of every expression evaluated on a reachable path is recorded
+// for later queries.
+class RangeAnalysis {
+public:
+    struct Range {
+        long long lo;
+        long long hi;
+    };
+
+private:
+    struct State {
+        bool reachable = true;
+        std::unordered_map<std::string, Range> ranges;
+    };
+
+    State state;
+    std::vector<std::vector<std::string>> scopes;
+    std::vector<State> breakStates;     // Paths leaving each enclosing switch
+    std::unordered_map<const ASTNode*, Range> results;
+    bool recording;
+
+    // Header iterations before a loop's variables are given up on
+    static const int MAX_LOOP_ITERATIONS = 16;
+
+    static Range full();
+    static Range clamp(__int128 lo, __int128 hi);
+    static void join(State& target, const State& other);
+    static bool includes(const State& outer, const State& inner);
+    static void widen(State& header, const State& next);
+
+    void pushScope();
+    void popScope();
+    Range lookup(const std::string& name) const;
+    void setRange(const std::string& name, Range range);
+
+    Range evaluate(const std::unique_ptr<ASTNode>& node);
+    Range evaluateNode(const std::unique_ptr<ASTNode>& node);
+    Range evaluateLogical(const std::unique_ptr<ASTNode>& node);
+    Range rangeWithoutRecording(const std::unique_ptr<ASTNode>& node);
+    void refine(const std::unique_ptr<ASTNode>& condition, bool truth);
+    void constrain(const std::string& name, ASTNodeType op, Range bound);
+
+    void visitStatement(const std::unique_ptr<ASTNode>& node);
+    void visitLoop(const std::unique_ptr<ASTNode>& node);
+    void visitSwitch(const std::unique_ptr<ASTNode>& node);
+    int foldDecided(std::unique_ptr<ASTNode>& node);
+
+public:
+    RangeAnalysis();
+
+    // Compute the intervals of the expressions of a program
+    void analyze(const std::unique_ptr<ASTNode>& program);
+
+    // Interval of an expression, if it was evaluated on a reachable path
+    bool rangeOf(const ASTNode* expr, Range& range) const;
+
+    // Whether an expression provably never evaluates to a negative value
+    bool isNonNegative(const ASTNode* expr) const;
+
+    // Analyze a program and replace comparisons and logical operations whose
+    // outcome the intervals decide by literals; returns how many were replaced
+    int foldComparisons(std::unique_ptr<ASTNode>& program);
+};
+
+#endif // RANGES_HPP
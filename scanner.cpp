@@ -33,6 +33,10 @@ void Scanner::initializeKeywords() {
     keywords["while"] = TokenType::T_WHILE;
     keywords["for"] = TokenType::T_FOR;
     keywords["return"] = TokenType::T_RETURN;
+    keywords["switch"] = TokenType::T_SWITCH;
+    keywords["case"] = TokenType::T_CASE;
+    keywords["default"] = TokenType::T_DEFAULT;
+    keywords["break"] = TokenType::T_BREAK;
 
     // I/O
     keywords["cout"] = TokenType::T_COUT;
@@ -0,0 +1,443 @@
+#include "sccp.hpp"
+#include "analysis.hpp"
+#include <climits>
+#include <utility>
+
+ConstantPropagation::ConstantPropagation() : rewriting(false), foldedCount(0), prunedCount(0) {}
+
+// Join of two incoming paths: a variable stays constant only if both paths
+// agree on its value. Paths that cannot execute do not contribute.
+void ConstantPropagation::meet(State& target, const State& other) {
+    if (!other.reachable) return;
+    if (!target.reachable) {
+        target = other;
+        return;
+    }
+    for (auto it = target.constants.begin(); it != target.constants.end();) {
+        auto match = other.constants.find(it->first);
+        if (match == other.constants.end() || match->second != it->second) {
+            it = target.constants.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ConstantPropagation::pushScope() {
+    scopes.emplace_back();
+}
+
+void ConstantPropagation::popScope() {
+    for (const auto& name : scopes.back()) {
+        state.constants.erase(name);
+    }
+    scopes.pop_back();
+}
+
+// Value of an expression if it is constant on the current path; applies the
+// expression's assignments to the state and, when rewriting, folds it
+bool ConstantPropagation::evaluate(std::unique_ptr<ASTNode>& node, long long& value) {
+    bool known = evaluateNode(node, value);
+    if (known && rewriting && node->type != ASTNodeType::INTLIT && node->type != ASTNodeType::BOOLLIT &&
+        value >= INT_MIN && value <= INT_MAX && !hasSideEffects(node)) {
+        node = makeIntLiteral(static_cast<int>(value));
+        foldedCount++;
+    }
+    return known;
+}
+
+bool ConstantPropagation::evaluateNode(std::unique_ptr<ASTNode>& node, long long& value) {
+    if (!node) return false;
+
+    switch (node->type) {
+        case ASTNodeType::INTLIT:
+            value = node->intValue;
+            return true;
+
+        case ASTNodeType::BOOLLIT:
+            value = node->boolValue ? 1 : 0;
+            return true;
+
+        case ASTNodeType::IDENTIFIER: {
+            auto it = state.constants.find(node->value);
+            if (it == state.constants.end()) return false;
+            value = it->second;
+            return true;
+        }
+
+        case ASTNodeType::ASSIGN:
+            if (node->left && node->left->type == ASTNodeType::IDENTIFIER) {
+                bool known = evaluate(node->right, value);
+                if (known) {
+                    state.constants[node->left->value] = value;
+                } else {
+                    state.constants.erase(node->left->value);
+                }
+                return known;
+            }
+            // An element store computes its value before the element's index
+            if (node->left && node->left->type == ASTNodeType::INDEX) {
+                long long ignored;
+                evaluate(node->right, ignored);
+                evaluate(node->left->left, ignored);
+                return false;
+            }
+            break;
+
+        case ASTNodeType::AND:
+        case ASTNodeType::OR: {
+            bool isAnd = node->type == ASTNodeType::AND;
+            long long left;
+            bool leftKnown = evaluate(node->left, left);
+            if (leftKnown && (isAnd ? left == 0 : left != 0)) {
+                // The right operand never executes
+                value = isAnd ? 0 : 1;
+                if (rewriting && !hasSideEffects(node->left)) {
+                    node = makeIntLiteral(static_cast<int>(value));
+                    foldedCount++;
+                }
+                return true;
+            }
+
+            State before = state;
+            long long right;
+            bool rightKnown = evaluate(node->right, right);
+            if (!leftKnown) meet(state, before);
+            if (leftKnown && rightKnown) {
+                value = right != 0;
+                return true;
+            }
+            return false;
+        }
+
+        case ASTNodeType::CONDITIONAL: {
+            long long condition;
+            if (evaluate(node->condition, condition)) {
+                // Only one arm executes
+                std::unique_ptr<ASTNode>& taken = condition != 0 ? node->left : node->right;
+                bool known = evaluate(taken, value);
+                if (rewriting && !hasSideEffects(node->condition)) {
+                    auto arm = std::move(taken);
+                    node = std::move(arm);
+                    prunedCount++;
+                }
+                return known;
+            }
+
+            State before = state;
+            long long left, right;
+            bool leftKnown = evaluate(node->left, left);
+            State afterLeft = std::move(state);
+            state = std::move(before);
+            bool rightKnown = evaluate(node->right, right);
+            meet(state, afterLeft);
+            if (leftKnown && rightKnown && left == right) {
+                value = left;
+                return true;
+            }
+            return false;
+        }
+
+        case ASTNodeType::NOT:
+        case ASTNodeType::NEGATE:
+        case ASTNodeType::POSITIVE:
+        case ASTNodeType::BITNOT: {
+            long long operand;
+            if (!evaluate(node->left, operand)) return false;
+            if (node->type == ASTNodeType::NOT) {
+                value = operand == 0;
+            } else if (node->type == ASTNodeType::BITNOT) {
+                value = ~operand;
+            } else if (node->type == ASTNodeType::NEGATE) {
+                value = static_cast<long long>(0ULL - static_cast<unsigned long long>(operand));
+            } else {
+                value = operand;
+            }
+            return true;
+        }
+
+        case ASTNodeType::ADD:
+        case ASTNodeType::SUBTRACT:
+        case ASTNodeType::MULTIPLY:
+        case ASTNodeType::DIVIDE:
+        case ASTNodeType::MODULO:
+        case ASTNodeType::EQ:
+        case ASTNodeType::NE:
+        case ASTNodeType::LT:
+        case ASTNodeType::GT:
+        case ASTNodeType::LE:
+        case ASTNodeType::GE:
+        case ASTNodeType::BITAND:
+        case ASTNodeType::BITOR:
+        case ASTNodeType::BITXOR:
+        case ASTNodeType::LSHIFT:
+        case ASTNodeType::RSHIFT: {
+            long long left, right;
+            bool leftKnown = evaluate(node->left, left);
+            bool rightKnown = evaluate(node->right, right);
+            return leftKnown && rightKnown && foldBinaryConstant(node->type, left, right, value);
+        }
+
+        default:
+            break;
+    }
+
+    // Unknown operation: its operands are still evaluated for their effects
+    long long ignored;
+    evaluate(node->left, ignored);
+    evaluate(node->right, ignored);
+    evaluate(node->condition, ignored);
+    for (auto& child : node->children) {
+        evaluate(child, ignored);
+    }
+    return false;
+}
+
+// Replace a pruned statement by the parts of it that still execute
+void ConstantPropagation::replaceStatement(std::unique_ptr<ASTNode>& node,
+                                          std::vector<std::unique_ptr<ASTNode>> kept) {
+    if (kept.size() == 1 && kept[0]->type == ASTNodeType::COMPOUND_STMT) {
+        node = std::move(kept[0]);
+        return;
+    }
+    auto block = makeCompound();
+    for (auto& statement : kept) {
+        block->children.push_back(std::move(statement));
+    }
+    node = std::move(block);
+}
+
+void ConstantPropagation::visitStatement(std::unique_ptr<ASTNode>& node) {
+    if (!node || !state.reachable) return;
+    long long value;
+
+    switch (node->type) {
+        case ASTNodeType::PROGRAM:
+        case ASTNodeType::COMPOUND_STMT:
+            pushScope();
+            visitList(node->children);
+            popScope();
+            break;
+
+        case ASTNodeType::VAR_DECL:
+            scopes.back().push_back(node->value);
+            if (node->left && evaluate(node->left, value)) {
+                state.constants[node->value] = value;
+            } else {
+                state.constants.erase(node->value);
+            }
+            break;
+
+        case ASTNodeType::IF_STMT:
+            visitIf(node);
+            break;
+
+        case ASTNodeType::WHILE_STMT:
+        case ASTNodeType::FOR_STMT:
+            visitLoop(node);
+            break;
+
+        case ASTNodeType::SWITCH_STMT:
+            visitSwitch(node);
+            break;
+
+        case ASTNodeType::BREAK_STMT:
+            if (!breakStates.empty()) meet(breakStates.back(), state);
+            state.reachable = false;
+            break;
+
+        case ASTNodeType::RETURN_STMT:
+            evaluate(node->left, value);
+            state.reachable = false;
+            break;
+
+        case ASTNodeType::COUT_STMT:
+            for (auto& child : node->children) {
+                evaluate(child, value);
+            }
+            break;
+
+        case ASTNodeType::CIN_STMT:
+            for (const auto& child : node->children) {
+                if (child && child->type == ASTNodeType::IDENTIFIER) {
+                    state.constants.erase(child->value);
+                }
+            }
+            break;
+
+        default:
+            evaluate(node->left, value);
+            break;
+    }
+}
+
+void ConstantPropagation::visitList(std::vector<std::unique_ptr<ASTNode>>& list) {
+    for (auto& statement : list) {
+        if (statement && statement->type == ASTNodeType::FUNCTION_DECL) {
+            visitFunction(statement);
+        } else if (state.reachable) {
+            visitStatement(statement);
+        } else if (rewriting && statement) {
+            // Everything after a return is dead
+            statement.reset();
+            prunedCount++;
+        }
+    }
+
+    if (rewriting) {
+        std::vector<std::unique_ptr<ASTNode>> kept;
+        for (auto& statement : list) {
+            if (!statement) continue;
+            if (statement->type == ASTNodeType::COMPOUND_STMT && statement->children.empty()) continue;
+            kept.push_back(std::move(statement));
+        }
+        list = std::move(kept);
+    }
+}
+
+void ConstantPropagation::visitIf(std::unique_ptr<ASTNode>& node) {
+    long long value;
+    if (evaluate(node->condition, value)) {
+        std::unique_ptr<ASTNode>& taken = value != 0 ? node->left : node->right;
+        visitStatement(taken);
+        if (rewriting) {
+            std::vector<std::unique_ptr<ASTNode>> kept;
+            if (hasSideEffects(node->condition)) {
+                kept.push_back(makeExpressionStatement(std::move(node->condition)));
+            }
+            if (taken) kept.push_back(std::move(taken));
+            replaceStatement(node, std::move(kept));
+            prunedCount++;
+        }
+        return;
+    }
+
+    State before = state;
+    visitStatement(node->left);
+    State afterThen = std::move(state);
+    state = std::move(before);
+    visitStatement(node->right);
+    meet(state, afterThen);
+}
+
+void ConstantPropagation::visitLoop(std::unique_ptr<ASTNode>& node) {
+    bool isFor = node->type == ASTNodeType::FOR_STMT;
+    std::unique_ptr<ASTNode>* update = isFor && node->children.size() > 1 ? &node->children[1] : nullptr;
+    long long value;
+
+    pushScope();
+    if (isFor && !node->children.empty()) {
+        visitStatement(node->children[0]);
+    }
+    State entry = state;
+
+    // Iterate the header state: entry met with the back edge, starting from
+    // the optimistic assumption that the back edge changes nothing
+    bool wasRewriting = rewriting;
+    rewriting = false;
+    State header = entry;
+    bool stable = false;
+    for (int i = 0; i < MAX_LOOP_ITERATIONS && !stable; i++) {
+        state = header;
+        if (evaluate(node->condition, value) && value == 0) {
+            stable = true;
+            break;
+        }
+        visitStatement(node->left);
+        if (update && state.reachable) evaluate(*update, value);
+
+        State next = entry;
+        meet(next, state);
+        stable = next == header;
+        header = std::move(next);
+    }
+    if (!stable) {
+        std::set<std::string> modified;
+        collectAssignedVariables(node, modified);
+        for (const auto& name : modified) {
+            header.constants.erase(name);
+        }
+    }
+    rewriting = wasRewriting;
+
+    state = header;
+    bool known = evaluate(node->condition, value);
+    if (known && value == 0) {
+        // The body never executes
+        if (rewriting) {
+            std::vector<std::unique_ptr<ASTNode>> kept;
+            if (isFor && !node->children.empty() && node->children[0]) {
+                kept.push_back(std::move(node->children[0]));
+            }
+            if (hasSideEffects(node->condition)) {
+                kept.push_back(makeExpressionStatement(std::move(node->condition)));
+            }
+            replaceStatement(node, std::move(kept));
+            prunedCount++;
+        }
+        popScope();
+        return;
+    }
+
+    // The loop leaves from the header, after the condition; a condition that
+    // is always true leaves only through return
+    State exit = state;
+    visitStatement(node->left);
+    if (update && state.reachable) evaluate(*update, value);
+    state = std::move(exit);
+    if (known) state.reachable = false;
+    popScope();
+}
+
+// A switch body is entered at the labels the dispatch can select and falls
+// through between them; the switch is left at the end of the body, through
+// a break, or from the dispatch when no label matches
+void ConstantPropagation::visitSwitch(std::unique_ptr<ASTNode>& node) {
+    long long value;
+    bool known = evaluate(node->condition, value);
+    State dispatch = state;
+
+    bool matched = false;
+    bool hasDefault = false;
+    for (const auto& child : node->children) {
+        if (child->type == ASTNodeType::CASE_LABEL && known && child->intValue == value) matched = true;
+        if (child->type == ASTNodeType::DEFAULT_LABEL) hasDefault = true;
+    }
+    bool defaultTaken = !known || !matched;
+
+    State unreachable;
+    unreachable.reachable = false;
+    breakStates.push_back(unreachable);
+    state = unreachable;
+    for (auto& child : node->children) {
+        if (child->type == ASTNodeType::CASE_LABEL) {
+            if (!known || child->intValue == value) meet(state, dispatch);
+        } else if (child->type == ASTNodeType::DEFAULT_LABEL) {
+            if (defaultTaken) meet(state, dispatch);
+        } else {
+            visitStatement(child);
+        }
+    }
+
+    meet(state, breakStates.back());
+    breakStates.pop_back();
+    if (!hasDefault && defaultTaken) meet(state, dispatch);
+}
+
+// A function body starts from its own state: nothing is known about the
+// parameters, and the caller's variables are out of scope
+void ConstantPropagation::visitFunction(std::unique_ptr<ASTNode>& node) {
+    if (!node->left) return;
+    State caller = std::move(state);
+    state = State();
+    visitStatement(node->left);
+    state = std::move(caller);
+}
+
+void ConstantPropagation::optimize(std::unique_ptr<ASTNode>& program) {
+    state = State();
+    scopes.clear();
+    breakStates.clear();
+    rewriting = true;
+    visitStatement(program);
+}
@@ -0,0 +1,63 @@
+#ifndef SCCP_HPP
+#define SCCP_HPP
+
+#include "parser.hpp"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Sparse conditional constant propagation over the structured AST. The
+// state on each path maps variables to known constants (an absent variable
+// may hold anything). Only the arms of a branch that can execute are
+// visited, and the states of the arms that can reach a join are met there;
+// loop headers are iterated optimistically from the entry state until the
+// back edge agrees. Constant expressions are then folded to literals and
+// branches, loops and statements that cannot execute are deleted.
+class ConstantPropagation {
+private:
+    struct State {
+        bool reachable = true;
+        std::unordered_map<std::string, long long> constants;
+
+        bool operator==(const State& other) const {
+            return reachable == other.reachable && constants == other.constants;
+        }
+    };
+
+    State state;
+    std::vector<std::vector<std::string>> scopes;
+    std::vector<State> breakStates;     // Paths leaving each enclosing switch
+    bool rewriting;
+    int foldedCount;
+    int prunedCount;
+
+    // Header iterations before a loop's variables are given up on
+    static const int MAX_LOOP_ITERATIONS = 32;
+
+    static void meet(State& target, const State& other);
+    void pushScope();
+    void popScope();
+
+    bool evaluate(std::unique_ptr<ASTNode>& node, long long& value);
+    bool evaluateNode(std::unique_ptr<ASTNode>& node, long long& value);
+
+    void visitStatement(std::unique_ptr<ASTNode>& node);
+    void visitList(std::vector<std::unique_ptr<ASTNode>>& list);
+    void visitIf(std::unique_ptr<ASTNode>& node);
+    void visitLoop(std::unique_ptr<ASTNode>& node);
+    void visitSwitch(std::unique_ptr<ASTNode>& node);
+    void visitFunction(std::unique_ptr<ASTNode>& node);
+    void replaceStatement(std::unique_ptr<ASTNode>& node, std::vector<std::unique_ptr<ASTNode>> kept);
+
+public:
+    ConstantPropagation();
+
+    // Propagate constants and prune unreachable code of a program in place
+    void optimize(std::unique_ptr<ASTNode>& program);
+
+    int getFoldedCount() const { return foldedCount; }
+    int getPrunedCount() const { return prunedCount; }
+};
+
+#endif // SCCP_HPP
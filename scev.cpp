@@ -0,0 +1,401 @@
+#include "scev.hpp"
+#include "analysis.hpp"
+#include <algorithm>
+#include <climits>
+
+// Constant-folding expression builders, so closed forms of simple loops stay small
+
+static bool literalValue(const std::unique_ptr<ASTNode>& node, long long& value) {
+    if (node && node->type == ASTNodeType::INTLIT) {
+        value = node->intValue;
+        return true;
+    }
+    return false;
+}
+
+static bool fitsInt(long long value) {
+    return value >= INT_MIN && value <= INT_MAX;
+}
+
+static std::unique_ptr<ASTNode> foldAdd(std::unique_ptr<ASTNode> a, std::unique_ptr<ASTNode> b) {
+    long long x = 0, y = 0;
+    bool ca = literalValue(a, x), cb = literalValue(b, y);
+    if (ca && cb && fitsInt(x + y)) return makeIntLiteral(static_cast<int>(x + y));
+    if (ca && x == 0) return b;
+    if (cb && y == 0) return a;
+    return makeBinary(ASTNodeType::ADD, std::move(a), std::move(b));
+}
+
+static std::unique_ptr<ASTNode> foldSub(std::unique_ptr<ASTNode> a, std::unique_ptr<ASTNode> b) {
+    long long x = 0, y = 0;
+    bool ca = literalValue(a, x), cb = literalValue(b, y);
+    if (ca && cb && fitsInt(x - y)) return makeIntLiteral(static_cast<int>(x - y));
+    if (cb && y == 0) return a;
+    return makeBinary(ASTNodeType::SUBTRACT, std::move(a), std::move(b));
+}
+
+static std::unique_ptr<ASTNode> foldMul(std::unique_ptr<ASTNode> a, std::unique_ptr<ASTNode> b) {
+    long long x = 0, y = 0;
+    bool ca = literalValue(a, x), cb = literalValue(b, y);
+    if (ca && cb && fitsInt(x * y)) return makeIntLiteral(static_cast<int>(x * y));
+    // Coefficients are side-effect free, so a zero factor drops the other
+    if ((ca && x == 0) || (cb && y == 0)) return makeIntLiteral(0);
+    if (ca && x == 1) return b;
+    if (cb && y == 1) return a;
+    return makeBinary(ASTNodeType::MULTIPLY, std::move(a), std::move(b));
+}
+
+static std::unique_ptr<ASTNode> foldNegate(std::unique_ptr<ASTNode> a) {
+    long long x = 0;
+    if (literalValue(a, x) && fitsInt(-x)) return makeIntLiteral(static_cast<int>(-x));
+    auto node = std::make_unique<ASTNode>(ASTNodeType::NEGATE);
+    node->left = std::move(a);
+    return node;
+}
+
+// Chain-of-recurrence algebra
+
+static std::unique_ptr<ASTNode> coefficient(const AddRecurrence& rec, size_t j) {
+    return j < rec.coefficients.size() ? cloneAST(rec.coefficients[j]) : makeIntLiteral(0);
+}
+
+static void trim(AddRecurrence& rec) {
+    long long value = 0;
+    while (rec.coefficients.size() > 1 && literalValue(rec.coefficients.back(), value) && value == 0) {
+        rec.coefficients.pop_back();
+    }
+}
+
+static AddRecurrence invariant(std::unique_ptr<ASTNode> value) {
+    AddRecurrence rec;
+    rec.coefficients.push_back(std::move(value));
+    return rec;
+}
+
+static AddRecurrence cloneRecurrence(const AddRecurrence& rec) {
+    AddRecurrence copy;
+    for (const auto& c : rec.coefficients) {
+        copy.coefficients.push_back(cloneAST(c));
+    }
+    return copy;
+}
+
+static AddRecurrence addRecurrences(const AddRecurrence& a, const AddRecurrence& b, bool subtract) {
+    AddRecurrence sum;
+    size_t size = std::max(a.coefficients.size(), b.coefficients.size());
+    for (size_t j = 0; j < size; j++) {
+        sum.coefficients.push_back(subtract ? foldSub(coefficient(a, j), coefficient(b, j))
+                                            : foldAdd(coefficient(a, j), coefficient(b, j)));
+    }
+    trim(sum);
+    return sum;
+}
+
+static AddRecurrence scaleRecurrence(const AddRecurrence& rec, const std::unique_ptr<ASTNode>& factor) {
+    AddRecurrence scaled;
+    for (const auto& c : rec.coefficients) {
+        scaled.coefficients.push_back(foldMul(cloneAST(c), cloneAST(factor)));
+    }
+    trim(scaled);
+    return scaled;
+}
+
+// {a0,+,a1} * {b0,+,b1} = {a0*b0, +, a0*b1 + a1*b0 + a1*b1, +, 2*a1*b1}
+static bool multiplyRecurrences(const AddRecurrence& a, const AddRecurrence& b, AddRecurrence& product) {
+    if (a.order() == 0) {
+        product = scaleRecurrence(b, a.coefficients[0]);
+        return true;
+    }
+    if (b.order() == 0) {
+        product = scaleRecurrence(a, b.coefficients[0]);
+        return true;
+    }
+    if (a.order() != 1 || b.order() != 1) {
+        return false;
+    }
+
+    product.coefficients.clear();
+    product.coefficients.push_back(foldMul(coefficient(a, 0), coefficient(b, 0)));
+    product.coefficients.push_back(foldAdd(foldAdd(foldMul(coefficient(a, 0), coefficient(b, 1)),
+                                                   foldMul(coefficient(a, 1), coefficient(b, 0))),
+                                           foldMul(coefficient(a, 1), coefficient(b, 1))));
+    product.coefficients.push_back(foldMul(makeIntLiteral(2), foldMul(coefficient(a, 1), coefficient(b, 1))));
+    trim(product);
+    return true;
+}
+
+// Value one iteration later: c'j = cj + c(j+1)
+static AddRecurrence shiftRecurrence(const AddRecurrence& rec) {
+    AddRecurrence next;
+    for (size_t j = 0; j < rec.coefficients.size(); j++) {
+        next.coefficients.push_back(foldAdd(coefficient(rec, j), coefficient(rec, j + 1)));
+    }
+    trim(next);
+    return next;
+}
+
+ScalarEvolution::ScalarEvolution(const std::string& iv, int ivStep, const std::set<std::string>& loopModified)
+    : inductionVariable(iv), step(ivStep), modified(loopModified) {}
+
+bool ScalarEvolution::collectAssignments(const std::unique_ptr<ASTNode>& node) {
+    if (!node) return true;
+
+    if (node->type == ASTNodeType::COMPOUND_STMT) {
+        for (const auto& child : node->children) {
+            if (!collectAssignments(child)) return false;
+        }
+        return true;
+    }
+
+    if (node->type != ASTNodeType::EXPRESSION_STMT || !node->left ||
+        node->left->type != ASTNodeType::ASSIGN || !node->left->left ||
+        node->left->left->type != ASTNodeType::IDENTIFIER || !isSafeExpression(node->left->right)) {
+        return false;
+    }
+    assignments.push_back({node->left->left->value, &node->left->right, static_cast<int>(assignments.size())});
+    return true;
+}
+
+// Recurrence of an expression evaluated at 'position' in the body. Variables
+// assigned earlier in the body already hold their next-iteration value.
+bool ScalarEvolution::evaluate(const std::unique_ptr<ASTNode>& node, int position, AddRecurrence& result) {
+    if (!node) return false;
+
+    switch (node->type) {
+        case ASTNodeType::INTLIT:
+            result = invariant(cloneAST(node));
+            return true;
+
+        case ASTNodeType::IDENTIFIER: {
+            if (node->value == selfVariable) {
+                result = invariant(makeIntLiteral(0));
+                return true;
+            }
+            if (node->value == inductionVariable) {
+                result = invariant(makeIdentifier(node->value));
+                result.coefficients.push_back(makeIntLiteral(step));
+                return true;
+            }
+            if (!modified.count(node->value)) {
+                result = invariant(makeIdentifier(node->value));
+                return true;
+            }
+
+            auto it = evolutions.find(node->value);
+            if (it == evolutions.end()) {
+                return false;
+            }
+            const Evolution& evolution = it->second;
+            bool updated = evolution.index < position;
+            if (evolution.plain) {
+                // Before its assignment the variable holds last iteration's value
+                if (!updated) return false;
+                result = cloneRecurrence(evolution.recurrence);
+            } else {
+                result = updated ? shiftRecurrence(evolution.recurrence) : cloneRecurrence(evolution.recurrence);
+            }
+            return true;
+        }
+
+        case ASTNodeType::ADD:
+        case ASTNodeType::SUBTRACT: {
+            AddRecurrence left, right;
+            if (!evaluate(node->left, position, left) || !evaluate(node->right, position, right)) {
+                return false;
+            }
+            result = addRecurrences(left, right, node->type == ASTNodeType::SUBTRACT);
+            break;
+        }
+
+        case ASTNodeType::MULTIPLY: {
+            AddRecurrence left, right;
+            if (!evaluate(node->left, position, left) || !evaluate(node->right, position, right) ||
+                !multiplyRecurrences(left, right, result)) {
+                return false;
+            }
+            break;
+        }
+
+        case ASTNodeType::NEGATE: {
+            AddRecurrence operand;
+            if (!evaluate(node->left, position, operand)) return false;
+            result.coefficients.clear();
+            for (auto& c : operand.coefficients) {
+                result.coefficients.push_back(foldNegate(std::move(c)));
+            }
+            break;
+        }
+
+        case ASTNodeType::POSITIVE:
+            return evaluate(node->left, position, result);
+
+        default:
+            if (!isInvariantExpression(node, modified)) {
+                return false;
+            }
+            result = invariant(cloneAST(node));
+            return true;
+    }
+
+    return result.order() <= MAX_ORDER;
+}
+
+// Coefficient of 'name' in an expression that is a sum of terms; fails when
+// the variable also appears inside a product or any other operator
+static bool selfCoefficient(const std::unique_ptr<ASTNode>& node, const std::string& name, int& coefficient) {
+    if (!node) return true;
+
+    switch (node->type) {
+        case ASTNodeType::IDENTIFIER:
+            if (node->value == name) coefficient++;
+            return true;
+
+        case ASTNodeType::ADD:
+            return selfCoefficient(node->left, name, coefficient) && selfCoefficient(node->right, name, coefficient);
+
+        case ASTNodeType::SUBTRACT: {
+            int right = 0;
+            if (!selfCoefficient(node->left, name, coefficient) || !selfCoefficient(node->right, name, right)) {
+                return false;
+            }
+            coefficient -= right;
+            return true;
+        }
+
+        case ASTNodeType::NEGATE: {
+            int operand = 0;
+            if (!selfCoefficient(node->left, name, operand)) return false;
+            coefficient -= operand;
+            return true;
+        }
+
+        case ASTNodeType::POSITIVE:
+            return selfCoefficient(node->left, name, coefficient);
+
+        default:
+            return !readsAnyVariable(node, {name});
+    }
+}
+
+bool ScalarEvolution::resolve(const Assignment& assignment) {
+    const auto& value = *assignment.value;
+    std::set<std::string> self = {assignment.name};
+    Evolution evolution;
+    evolution.index = assignment.index;
+
+    if (!readsAnyVariable(value, self)) {
+        evolution.plain = true;
+        if (!evaluate(value, assignment.index, evolution.recurrence)) return false;
+        evolutions[assignment.name] = std::move(evolution);
+        return true;
+    }
+
+    // v = v + d, where d does not read v, makes v the recurrence {v, +, d}.
+    // The increment is evaluated with v read as zero.
+    int coefficient = 0;
+    if (!selfCoefficient(value, assignment.name, coefficient) || coefficient != 1) {
+        return false;
+    }
+
+    AddRecurrence increment;
+    selfVariable = assignment.name;
+    bool evaluated = evaluate(value, assignment.index, increment);
+    selfVariable.clear();
+    if (!evaluated || increment.order() >= MAX_ORDER) {
+        return false;
+    }
+
+    evolution.plain = false;
+    evolution.recurrence = invariant(makeIdentifier(assignment.name));
+    for (auto& c : increment.coefficients) {
+        evolution.recurrence.coefficients.push_back(std::move(c));
+    }
+    trim(evolution.recurrence);
+    evolutions[assignment.name] = std::move(evolution);
+    return true;
+}
+
+bool ScalarEvolution::analyze(const std::unique_ptr<ASTNode>& body) {
+    assignments.clear();
+    evolutions.clear();
+    if (!collectAssignments(body)) {
+        return false;
+    }
+
+    std::set<std::string> assigned;
+    for (const Assignment& a : assignments) {
+        if (a.name == inductionVariable || !assigned.insert(a.name).second) {
+            return false;
+        }
+    }
+    for (const std::string& name : modified) {
+        if (name != inductionVariable && !assigned.count(name)) {
+            return false;
+        }
+    }
+
+    // Resolve variables once everything they read is known
+    std::vector<const Assignment*> pending;
+    for (const Assignment& a : assignments) {
+        pending.push_back(&a);
+    }
+    bool progress = true;
+    while (!pending.empty() && progress) {
+        progress = false;
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (resolve(**it)) {
+                it = pending.erase(it);
+                progress = true;
+            } else {
+                ++it;
+            }
+        }
+    }
+    return pending.empty();
+}
+
+// C(k, 2) = k(k-1)/2 without a wrapping intermediate product: halve whichever
+// factor is even, i.e. (k/2)*(k-1) + (k%2)*((k-1)/2)
+static std::unique_ptr<ASTNode> choose2(const std::unique_ptr<ASTNode>& k) {
+    auto kMinus1 = [&k]() { return foldSub(cloneAST(k), makeIntLiteral(1)); };
+    auto even = foldMul(makeBinary(ASTNodeType::DIVIDE, cloneAST(k), makeIntLiteral(2)), kMinus1());
+    auto odd = foldMul(makeBinary(ASTNodeType::MODULO, cloneAST(k), makeIntLiteral(2)),
+                       makeBinary(ASTNodeType::DIVIDE, kMinus1(), makeIntLiteral(2)));
+    return foldAdd(std::move(even), std::move(odd));
+}
+
+std::unique_ptr<ASTNode> ScalarEvolution::valueAt(const AddRecurrence& rec, const std::unique_ptr<ASTNode>& k) {
+    auto value = coefficient(rec, 0);
+    if (rec.order() >= 1) {
+        value = foldAdd(std::move(value), foldMul(coefficient(rec, 1), cloneAST(k)));
+    }
+    if (rec.order() >= 2) {
+        value = foldAdd(std::move(value), foldMul(coefficient(rec, 2), choose2(k)));
+    }
+    return value;
+}
+
+std::vector<std::pair<std::string, std::unique_ptr<ASTNode>>> ScalarEvolution::exitValues(const std::string& tripCount) {
+    std::vector<std::pair<std::string, std::unique_ptr<ASTNode>>> values;
+    auto trips = makeIdentifier(tripCount);
+
+    for (const Assignment& a : assignments) {
+        const Evolution& evolution = evolutions[a.name];
+        if (!evolution.plain) {
+            values.emplace_back(a.name, valueAt(evolution.recurrence, trips));
+            continue;
+        }
+
+        // The last value assigned, or the entry value if the loop never ran:
+        // v + (E(trips - 1) - v) * (trips > 0)
+        auto last = valueAt(evolution.recurrence, foldSub(cloneAST(trips), makeIntLiteral(1)));
+        auto ran = makeBinary(ASTNodeType::GT, cloneAST(trips), makeIntLiteral(0));
+        values.emplace_back(a.name, foldAdd(makeIdentifier(a.name),
+                                            foldMul(foldSub(std::move(last), makeIdentifier(a.name)),
+                                                    std::move(ran))));
+    }
+
+    values.emplace_back(inductionVariable,
+                        foldAdd(makeIdentifier(inductionVariable), foldMul(makeIntLiteral(step), std::move(trips))));
+    return values;
+}
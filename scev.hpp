@@ -0,0 +1,70 @@
+#ifndef SCEV_HPP
+#define SCEV_HPP
+
+#include "parser.hpp"
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Chain of recurrences {c0, +, c1, +, c2}: the value at the start of
+// iteration k is c0 + c1*k + c2*C(k, 2). Coefficients are loop-invariant
+// expressions.
+struct AddRecurrence {
+    std::vector<std::unique_ptr<ASTNode>> coefficients;
+
+    int order() const { return static_cast<int>(coefficients.size()) - 1; }
+};
+
+// Scalar evolution of a counted loop whose body is a sequence of scalar
+// assignments. Every variable the loop writes must be either an
+// add-recurrence (v = v + d, where d is itself at most an affine
+// recurrence) or a plain function of such recurrences, so that its value
+// after the loop has a closed form in the trip count. All arithmetic is
+// modulo 2^64, like the loop it replaces.
+class ScalarEvolution {
+private:
+    struct Assignment {
+        std::string name;
+        const std::unique_ptr<ASTNode>* value;
+        int index;              // Position in the body
+    };
+    struct Evolution {
+        AddRecurrence recurrence;
+        bool plain;             // Recurrence gives the value assigned, not the value at iteration start
+        int index;              // Position of the assignment in the body
+    };
+
+    std::string inductionVariable;
+    int step;
+    std::set<std::string> modified;
+    std::vector<Assignment> assignments;
+    std::map<std::string, Evolution> evolutions;
+    std::string selfVariable;   // Variable read as zero while evaluating its own increment
+
+    // Highest order the closed forms support
+    static const int MAX_ORDER = 2;
+
+    bool collectAssignments(const std::unique_ptr<ASTNode>& node);
+    bool evaluate(const std::unique_ptr<ASTNode>& node, int position, AddRecurrence& result);
+    bool resolve(const Assignment& assignment);
+
+public:
+    ScalarEvolution(const std::string& iv, int ivStep, const std::set<std::string>& loopModified);
+
+    // Model every variable assigned by the loop body; false when some
+    // variable has no closed form
+    bool analyze(const std::unique_ptr<ASTNode>& body);
+
+    // Exit value of every variable the loop modifies, including the
+    // induction variable, as expressions over the values on loop entry and
+    // the trip count variable
+    std::vector<std::pair<std::string, std::unique_ptr<ASTNode>>> exitValues(const std::string& tripCount);
+
+    // Value of a recurrence at iteration 'k'
+    static std::unique_ptr<ASTNode> valueAt(const AddRecurrence& rec, const std::unique_ptr<ASTNode>& k);
+};
+
+#endif // SCEV_HPP
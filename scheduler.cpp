@@ -0,0 +1,403 @@
+#include "scheduler.hpp"
+#include <algorithm>
+#include <array>
+
+const int InstructionScheduler::PORT_COUNT[NUM_PORTS] = {
+    4,  // ALU: integer arithmetic, moves, compares
+    2,  // SHIFT: shifts and setcc
+    2,  // LEA: address arithmetic
+    1,  // MUL: integer multiply
+    1,  // DIV: integer divide
+    2,  // LOAD
+    1,  // STORE
+};
+
+InstructionScheduler::InstructionScheduler(std::vector<AsmBlock>& b)
+    : blocks(b), cyclesBefore(0), cyclesAfter(0) {}
+
+// Name of the 64-bit register a register operand is part of
+std::string InstructionScheduler::canonicalRegister(const std::string& name) {
+    static const char* aliases[][4] = {
+        {"rax", "eax", "ax", "al"}, {"rbx", "ebx", "bx", "bl"},
+        {"rcx", "ecx", "cx", "cl"}, {"rdx", "edx", "dx", "dl"},
+        {"rsi", "esi", "si", "sil"}, {"rdi", "edi", "di", "dil"},
+        {"rbp", "ebp", "bp", "bpl"}, {"rsp", "esp", "sp", "spl"},
+    };
+    std::string reg = name[0] == '%' ? name.substr(1) : name;
+    for (const auto& family : aliases) {
+        for (const char* alias : family) {
+            if (reg == alias) return family[0];
+        }
+    }
+    // r8-r15 and their d/w/b forms
+    while (!reg.empty() && (reg.back() == 'd' || reg.back() == 'w' || reg.back() == 'b')) {
+        reg.pop_back();
+    }
+    return reg;
+}
+
+// Operands are separated by commas outside of memory references
+std::vector<std::string> InstructionScheduler::splitOperands(const std::string& text) {
+    std::vector<std::string> operands;
+    std::string current;
+    int depth = 0;
+    for (char c : text) {
+        if (c == '(') depth++;
+        if (c == ')') depth--;
+        if (c == ',' && depth == 0) {
+            operands.push_back(current);
+            current.clear();
+        } else if (c != ' ') {
+            current += c;
+        }
+    }
+    if (!current.empty()) operands.push_back(current);
+    return operands;
+}
+
+// Record what an operand reads and writes. Registers of an address are
+// always read; a stack slot is its own location, any other memory reference
+// may alias everything.
+void InstructionScheduler::addOperand(const std::string& operand, bool read, bool write, Instruction& inst) {
+    if (operand.empty() || operand[0] == '$') return;
+
+    if (operand[0] == '%') {
+        std::string reg = canonicalRegister(operand);
+        if (read) inst.reads.push_back(reg);
+        if (write) inst.writes.push_back(reg);
+        return;
+    }
+
+    size_t open = operand.find('(');
+    size_t close = operand.find(')');
+    if (open == std::string::npos || close == std::string::npos) {
+        inst.barrier = true;
+        return;
+    }
+    std::vector<std::string> parts = splitOperands(operand.substr(open + 1, close - open - 1));
+    for (const std::string& part : parts) {
+        if (!part.empty() && part[0] == '%') inst.reads.push_back(canonicalRegister(part));
+    }
+
+    std::string displacement = operand.substr(0, open);
+    bool stackSlot = parts.size() == 1 && parts[0] == "%rbp" &&
+                     displacement.find_first_not_of("-0123456789") == std::string::npos;
+    std::string location = stackSlot ? "mem:" + displacement : "mem:*";
+    if (read) inst.reads.push_back(location);
+    if (write) inst.writes.push_back(location);
+}
+
+// Operands, latency and execution ports of an instruction. Anything not
+// described here is a barrier that no instruction moves across.
+InstructionScheduler::Instruction InstructionScheduler::decode(const std::string& line) {
+    Instruction inst;
+    inst.lines.push_back(line);
+
+    size_t start = line.find_first_not_of(' ');
+    std::string text = start == std::string::npos ? "" : line.substr(start);
+    size_t space = text.find(' ');
+    std::string op = text.substr(0, space);
+    std::vector<std::string> operands;
+    if (space != std::string::npos) operands = splitOperands(text.substr(space + 1));
+
+    auto isMemory = [](const std::string& operand) { return operand.find('(') != std::string::npos; };
+    auto startsWith = [&op](const char* prefix) { return op.compare(0, std::string(prefix).size(), prefix) == 0; };
+
+    if ((op == "movq" || op == "movl" || op == "movzbq" || op == "movzbl" || op == "movslq" || op == "movabsq") &&
+        operands.size() == 2) {
+        addOperand(operands[0], true, false, inst);
+        addOperand(operands[1], false, true, inst);
+        if (isMemory(operands[0])) {
+            inst.latency = LOAD_LATENCY;
+            inst.ports = {LOAD};
+        } else {
+            inst.ports = {isMemory(operands[1]) ? STORE : ALU};
+        }
+    } else if (op == "leaq" && operands.size() == 2) {
+        addOperand(operands[0], false, false, inst);
+        addOperand(operands[1], false, true, inst);
+        inst.ports = {LEA};
+    } else if ((op == "addq" || op == "subq" || op == "andq" || op == "orq" || op == "xorq" ||
+                op == "imulq" || op == "cmpq" || op == "testq" || op == "btq") && operands.size() == 2) {
+        bool compare = op == "cmpq" || op == "testq" || op == "btq";
+        addOperand(operands[0], true, false, inst);
+        addOperand(operands[1], true, !compare, inst);
+        inst.writesFlags = true;
+        inst.ports = {op == "imulq" ? MUL : ALU};
+        inst.latency = op == "imulq" ? MUL_LATENCY : 1;
+        if (isMemory(operands[0]) || isMemory(operands[1])) {
+            inst.latency += LOAD_LATENCY;
+            inst.ports.push_back(LOAD);
+        }
+        if (isMemory(operands[1]) && !compare) inst.ports.push_back(STORE);
+    } else if (op == "imulq" && operands.size() == 3) {
+        addOperand(operands[1], true, false, inst);
+        addOperand(operands[2], false, true, inst);
+        inst.writesFlags = true;
+        inst.ports = {MUL};
+        inst.latency = MUL_LATENCY;
+        if (isMemory(operands[1])) {
+            inst.latency += LOAD_LATENCY;
+            inst.ports.push_back(LOAD);
+        }
+    } else if ((op == "shlq" || op == "shrq" || op == "sarq") && operands.size() == 2 && !isMemory(operands[1])) {
+        addOperand(operands[0], true, false, inst);
+        addOperand(operands[1], true, true, inst);
+        inst.writesFlags = true;
+        inst.ports = {SHIFT};
+    } else if ((op == "negq" || op == "notq") && operands.size() == 1 && !isMemory(operands[0])) {
+        addOperand(operands[0], true, true, inst);
+        inst.writesFlags = true;
+        inst.ports = {ALU};
+    } else if ((op == "pushq" || op == "popq") && operands.size() == 1 && operands[0][0] == '%') {
+        // The stack below %rsp never overlaps the frame's slots
+        bool push = op == "pushq";
+        addOperand(operands[0], push, !push, inst);
+        inst.reads.push_back("rsp");
+        inst.writes.push_back("rsp");
+        (push ? inst.writes : inst.reads).push_back("mem:rsp");
+        inst.ports = {push ? STORE : LOAD};
+        inst.latency = push ? 1 : LOAD_LATENCY;
+    } else if (op == "cqto" && operands.empty()) {
+        inst.reads = {"rax"};
+        inst.writes = {"rdx"};
+        inst.ports = {ALU};
+    } else if (op == "idivq" && operands.size() == 1) {
+        addOperand(operands[0], true, false, inst);
+        inst.reads.push_back("rax");
+        inst.reads.push_back("rdx");
+        inst.writes = {"rax", "rdx"};
+        inst.writesFlags = true;
+        inst.ports = {DIV};
+        inst.latency = DIV_LATENCY;
+    } else if (startsWith("set") && operands.size() == 1 && operands[0][0] == '%') {
+        // A byte write merges into the rest of the register
+        addOperand(operands[0], true, true, inst);
+        inst.readsFlags = true;
+        inst.ports = {SHIFT};
+    } else if (startsWith("cmov") && operands.size() == 2) {
+        addOperand(operands[0], true, false, inst);
+        addOperand(operands[1], true, true, inst);
+        inst.readsFlags = true;
+        inst.ports = {ALU};
+        if (isMemory(operands[0])) {
+            inst.latency += LOAD_LATENCY;
+            inst.ports.push_back(LOAD);
+        }
+    } else {
+        inst.barrier = true;
+    }
+
+    // Moving the frame would change what the slots refer to
+    bool stackOperation = op == "pushq" || op == "popq";
+    for (const std::string& reg : inst.writes) {
+        if (reg == "rbp" || (reg == "rsp" && !stackOperation)) inst.barrier = true;
+    }
+    return inst;
+}
+
+bool InstructionScheduler::conflicts(const std::string& a, const std::string& b) {
+    if (a == b) return true;
+    bool memoryA = a.compare(0, 4, "mem:") == 0;
+    bool memoryB = b.compare(0, 4, "mem:") == 0;
+    return memoryA && memoryB && (a == "mem:*" || b == "mem:*");
+}
+
+// Register and memory dependences, with the latency a consumer waits for
+// its producer. Only flag values that are read order the instructions that
+// set flags; every other flags write may move, as long as it stays out of
+// the interval between a flags producer and its readers.
+void InstructionScheduler::buildDependences(Region& region, bool flagsLiveOut) {
+    const std::vector<Instruction>& insts = region.instructions;
+    int count = static_cast<int>(insts.size());
+    region.successors.assign(count, {});
+    region.predecessors.assign(count, {});
+
+    auto addEdge = [&region](int from, int to, int latency) {
+        region.successors[from].push_back({to, latency});
+        region.predecessors[to].push_back({from, latency});
+    };
+
+    for (int j = 0; j < count; j++) {
+        for (int i = 0; i < j; i++) {
+            int latency = -1;
+            for (const std::string& read : insts[j].reads) {
+                for (const std::string& written : insts[i].writes) {
+                    if (!conflicts(read, written)) continue;
+                    bool memory = read.compare(0, 4, "mem:") == 0;
+                    latency = std::max(latency, memory ? STORE_FORWARD_LATENCY : insts[i].latency);
+                }
+            }
+            for (const std::string& written : insts[j].writes) {
+                for (const std::string& other : insts[i].writes) {
+                    if (conflicts(written, other)) latency = std::max(latency, 0);
+                }
+                for (const std::string& other : insts[i].reads) {
+                    if (conflicts(written, other)) latency = std::max(latency, 0);
+                }
+            }
+            if (latency >= 0) addEdge(i, j, latency);
+        }
+    }
+
+    std::vector<bool> live(count, false);
+    int lastWriter = -1;
+    for (int i = 0; i < count; i++) {
+        if (insts[i].readsFlags && lastWriter >= 0) {
+            live[lastWriter] = true;
+            addEdge(lastWriter, i, insts[lastWriter].latency);
+        }
+        if (insts[i].writesFlags) lastWriter = i;
+    }
+    if (flagsLiveOut && lastWriter >= 0) live[lastWriter] = true;
+
+    for (int i = 0; i < count; i++) {
+        if (!insts[i].writesFlags) continue;
+        for (int r = 0; r < i; r++) {
+            if (insts[r].readsFlags) addEdge(r, i, 0);
+        }
+        if (live[i]) continue;
+        for (int p = i + 1; p < count; p++) {
+            if (live[p]) {
+                addEdge(i, p, 0);
+                break;
+            }
+        }
+    }
+}
+
+// Cycles until every instruction has completed when they issue in the
+// given order, each as soon as its operands, the issue width and its ports
+// allow
+int InstructionScheduler::simulate(const Region& region, const std::vector<int>& order) {
+    std::vector<std::array<int, NUM_PORTS + 1>> usage;
+    std::vector<int> issue(region.instructions.size(), 0);
+    int cycle = 0;
+    int finish = 0;
+
+    for (int index : order) {
+        const Instruction& inst = region.instructions[index];
+        for (const Dependence& dep : region.predecessors[index]) {
+            cycle = std::max(cycle, issue[dep.to] + dep.latency);
+        }
+        for (;; cycle++) {
+            if (cycle >= static_cast<int>(usage.size())) usage.resize(cycle + 1, {});
+            bool fits = usage[cycle][NUM_PORTS] < ISSUE_WIDTH;
+            for (Port port : inst.ports) {
+                fits = fits && usage[cycle][port] < PORT_COUNT[port];
+            }
+            if (fits) break;
+        }
+        usage[cycle][NUM_PORTS]++;
+        for (Port port : inst.ports) usage[cycle][port]++;
+        issue[index] = cycle;
+        finish = std::max(finish, cycle + inst.latency);
+    }
+    return finish;
+}
+
+// Cycle-by-cycle list scheduling; among the ready instructions the one with
+// the longest path to the end of the region goes first
+std::vector<int> InstructionScheduler::schedule(const Region& region) {
+    const std::vector<Instruction>& insts = region.instructions;
+    int count = static_cast<int>(insts.size());
+
+    // Edges always point forward, so heights are computed back to front
+    std::vector<int> height(count, 0);
+    for (int i = count - 1; i >= 0; i--) {
+        height[i] = insts[i].latency;
+        for (const Dependence& dep : region.successors[i]) {
+            height[i] = std::max(height[i], dep.latency + height[dep.to]);
+        }
+    }
+
+    std::vector<int> order;
+    std::vector<int> issue(count, -1);
+    std::array<int, NUM_PORTS + 1> usage = {};
+    int cycle = 0;
+
+    while (static_cast<int>(order.size()) < count) {
+        int best = -1;
+        for (int i = 0; i < count; i++) {
+            if (issue[i] >= 0) continue;
+            bool ready = usage[NUM_PORTS] < ISSUE_WIDTH;
+            for (const Dependence& dep : region.predecessors[i]) {
+                ready = ready && issue[dep.to] >= 0 && issue[dep.to] + dep.latency <= cycle;
+            }
+            for (Port port : insts[i].ports) {
+                ready = ready && usage[port] < PORT_COUNT[port];
+            }
+            if (ready && (best < 0 || height[i] > height[best])) best = i;
+        }
+
+        if (best < 0) {
+            cycle++;
+            usage = {};
+            continue;
+        }
+        issue[best] = cycle;
+        usage[NUM_PORTS]++;
+        for (Port port : insts[best].ports) usage[port]++;
+        order.push_back(best);
+    }
+    return order;
+}
+
+void InstructionScheduler::scheduleBlock(AsmBlock& block) {
+    std::vector<std::string> result;
+    std::vector<std::string> comments;
+    Region region;
+
+    // Comments travel with the instruction that follows them
+    auto flush = [&](bool flagsLiveOut) {
+        if (region.instructions.empty()) return;
+        buildDependences(region, flagsLiveOut);
+
+        std::vector<int> original(region.instructions.size());
+        for (size_t i = 0; i < original.size(); i++) original[i] = static_cast<int>(i);
+        std::vector<int> order = schedule(region);
+        int before = simulate(region, original);
+        int after = simulate(region, order);
+        if (after > before) {
+            order = original;
+            after = before;
+        }
+        cyclesBefore += before;
+        cyclesAfter += after;
+
+        for (int index : order) {
+            const auto& lines = region.instructions[index].lines;
+            result.insert(result.end(), lines.begin(), lines.end());
+        }
+        region = Region();
+    };
+
+    for (const std::string& line : block.lines) {
+        size_t start = line.find_first_not_of(' ');
+        if (start == std::string::npos || line[start] == '#') {
+            comments.push_back(line);
+            continue;
+        }
+
+        Instruction inst = decode(line);
+        if (inst.barrier) {
+            flush(true);
+            result.insert(result.end(), comments.begin(), comments.end());
+            result.push_back(line);
+        } else {
+            inst.lines.insert(inst.lines.begin(), comments.begin(), comments.end());
+            region.instructions.push_back(std::move(inst));
+        }
+        comments.clear();
+    }
+    // Flags reach the branch that ends the block
+    flush(!block.branchOp.empty());
+    result.insert(result.end(), comments.begin(), comments.end());
+    block.lines = std::move(result);
+}
+
+void InstructionScheduler::run() {
+    for (AsmBlock& block : blocks) {
+        scheduleBlock(block);
+    }
+}
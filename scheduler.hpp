@@ -0,0 +1,78 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include "blocklayout.hpp"
+#include <string>
+#include <vector>
+
+// Latency-aware list scheduling within basic blocks. Each block is split at
+// instructions the model does not understand or that move the frame (calls,
+// returns, writes to %rbp and %rsp), and the instructions between them are
+// reordered so independent dependency chains are interleaved: at every
+// cycle the ready instruction with the longest latency path to the end of
+// the region issues first, as long as the issue width and its execution
+// ports allow.
+class InstructionScheduler {
+public:
+    // Execution resources of a generic modern x86-64 core
+    enum Port { ALU, SHIFT, LEA, MUL, DIV, LOAD, STORE, NUM_PORTS };
+
+    // Machine model, also used by the software pipeliner
+    static const int ISSUE_WIDTH = 4;
+    static const int LOAD_LATENCY = 4;
+    static constexpr int STORE_FORWARD_LATENCY = 4;
+    static const int MUL_LATENCY = 3;
+    static const int DIV_LATENCY = 40;
+    static const int PORT_COUNT[NUM_PORTS];
+
+private:
+    struct Instruction {
+        std::vector<std::string> lines;     // Preceding comments and the instruction
+        std::vector<std::string> reads;     // Registers ("rax") and memory ("mem:-8", "mem:*")
+        std::vector<std::string> writes;
+        bool readsFlags = false;
+        bool writesFlags = false;
+        bool barrier = false;
+        int latency = 1;
+        std::vector<Port> ports;
+    };
+
+    struct Dependence {
+        int to;
+        int latency;
+    };
+
+    struct Region {
+        std::vector<Instruction> instructions;
+        std::vector<std::vector<Dependence>> successors;
+        std::vector<std::vector<Dependence>> predecessors;
+    };
+
+    std::vector<AsmBlock>& blocks;
+    int cyclesBefore;
+    int cyclesAfter;
+
+    static std::string canonicalRegister(const std::string& name);
+    static std::vector<std::string> splitOperands(const std::string& text);
+    static void addOperand(const std::string& operand, bool read, bool write, Instruction& inst);
+    static Instruction decode(const std::string& line);
+    static bool conflicts(const std::string& a, const std::string& b);
+
+    void buildDependences(Region& region, bool flagsLiveOut);
+    int simulate(const Region& region, const std::vector<int>& order);
+    std::vector<int> schedule(const Region& region);
+    void scheduleBlock(AsmBlock& block);
+
+public:
+    explicit InstructionScheduler(std::vector<AsmBlock>& b);
+
+    // Reorder the instructions of every block
+    void run();
+
+    // Estimated cycles to issue and complete every block, summed over the
+    // blocks, in emission order and in scheduled order
+    int getCyclesBefore() const { return cyclesBefore; }
+    int getCyclesAfter() const { return cyclesAfter; }
+};
+
+#endif // SCHEDULER_HPP
@@ -0,0 +1,282 @@
+#include "simplify.hpp"
+#include "analysis.hpp"
+#include <climits>
+
+// The rewrite table. Rules are tried in order at each node, so more
+// specific rules come before general ones.
+static const RewriteRule RULES[] = {
+    // Identities
+    {"x + 0", "x", false},
+    {"x - 0", "x", false},
+    {"x * 1", "x", false},
+    {"x / 1", "x", false},
+    {"x * 0", "0", false},
+    {"x % 1", "0", false},
+    {"0 - x", "-x", false},
+    {"x - x", "0", false},
+    {"-(-x)", "x", false},
+    {"+x", "x", false},
+    {"x & 0", "0", false},
+    {"x | 0", "x", false},
+    {"x ^ 0", "x", false},
+    {"x << 0", "x", false},
+    {"x >> 0", "x", false},
+    {"x & x", "x", false},
+    {"x | x", "x", false},
+    {"x ^ x", "0", false},
+    {"~(~x)", "x", false},
+
+    // Comparisons of a value with itself
+    {"x == x", "1", false},
+    {"x != x", "0", false},
+    {"x < x", "0", false},
+    {"x > x", "0", false},
+    {"x <= x", "1", false},
+    {"x >= x", "1", false},
+
+    // Negations
+    {"!(!x)", "x", true},
+    {"!(!x)", "x != 0", false},
+    {"!(x == y)", "x != y", false},
+    {"!(x != y)", "x == y", false},
+    {"!(x < y)", "x >= y", false},
+    {"!(x > y)", "x <= y", false},
+    {"!(x <= y)", "x > y", false},
+    {"!(x >= y)", "x < y", false},
+
+    // Selects
+    {"x ? y : y", "y", false},
+    {"!x ? y : z", "x ? z : y", false},
+
+    // Canonical order: constant operands on the right
+    {"c + e", "e + c", false},
+    {"c * e", "e * c", false},
+    {"c & e", "e & c", false},
+    {"c | e", "e | c", false},
+    {"c ^ e", "e ^ c", false},
+    {"c == e", "e == c", false},
+    {"c != e", "e != c", false},
+    {"c < e", "e > c", false},
+    {"c > e", "e < c", false},
+    {"c <= e", "e >= c", false},
+    {"c >= e", "e <= c", false},
+
+    // Reassociation of constant operands
+    {"(x + c1) + c2", "x + (c1 + c2)", false},
+    {"(x + c1) - c2", "x + (c1 - c2)", false},
+    {"(x - c1) + c2", "x + (c2 - c1)", false},
+    {"(x - c1) - c2", "x - (c1 + c2)", false},
+    {"(x * c1) * c2", "x * (c1 * c2)", false},
+    {"(x & c1) & c2", "x & (c1 & c2)", false},
+    {"(x | c1) | c2", "x | (c1 | c2)", false},
+    {"(x ^ c1) ^ c2", "x ^ (c1 ^ c2)", false},
+    {"(x + c) + e", "(x + e) + c", false},
+    {"(x - c) + e", "(x + e) - c", false},
+    {"(x + c) - e", "(x - e) + c", false},
+};
+
+static void countUses(const std::unique_ptr<ASTNode>& node, std::unordered_map<std::string, int>& uses) {
+    if (!node) return;
+    if (node->type == ASTNodeType::IDENTIFIER) {
+        uses[node->value]++;
+        return;
+    }
+    countUses(node->condition, uses);
+    countUses(node->left, uses);
+    countUses(node->right, uses);
+}
+
+Simplifier::Simplifier(int rewriteBudget) : budget(rewriteBudget), rewriteCount(0) {
+    for (const RewriteRule& rule : RULES) {
+        CompiledRule compiled;
+        compiled.pattern = Parser(rule.pattern).parseExpressionOnly();
+        compiled.replacement = Parser(rule.replacement).parseExpressionOnly();
+        compiled.conditionOnly = rule.conditionOnly;
+        countUses(compiled.pattern, compiled.patternUses);
+        countUses(compiled.replacement, compiled.replacementUses);
+        rules.push_back(std::move(compiled));
+    }
+}
+
+bool Simplifier::match(const std::unique_ptr<ASTNode>& pattern, const std::unique_ptr<ASTNode>& node,
+                       Bindings& bindings) {
+    if (!pattern || !node) return !pattern && !node;
+
+    if (pattern->type == ASTNodeType::IDENTIFIER) {
+        const std::string& name = pattern->value;
+        bool literal = node->type == ASTNodeType::INTLIT;
+        if (name[0] == 'c' && !literal) return false;
+        if (name[0] == 'e' && (literal || node->type == ASTNodeType::BOOLLIT)) return false;
+
+        auto bound = bindings.find(name);
+        if (bound != bindings.end()) {
+            return expressionKey(*bound->second) == expressionKey(node);
+        }
+        bindings[name] = &node;
+        return true;
+    }
+
+    if (pattern->type != node->type) return false;
+    if (pattern->type == ASTNodeType::INTLIT) return pattern->intValue == node->intValue;
+    return match(pattern->condition, node->condition, bindings) && match(pattern->left, node->left, bindings) &&
+           match(pattern->right, node->right, bindings);
+}
+
+std::unique_ptr<ASTNode> Simplifier::instantiate(const std::unique_ptr<ASTNode>& pattern,
+                                                 const Bindings& bindings, bool& valid) {
+    if (!pattern) return nullptr;
+    if (pattern->type == ASTNodeType::IDENTIFIER) {
+        return cloneAST(*bindings.at(pattern->value));
+    }
+
+    auto node = std::make_unique<ASTNode>(pattern->type);
+    node->value = pattern->value;
+    node->intValue = pattern->intValue;
+    node->boolValue = pattern->boolValue;
+    node->condition = instantiate(pattern->condition, bindings, valid);
+    node->left = instantiate(pattern->left, bindings, valid);
+    node->right = instantiate(pattern->right, bindings, valid);
+
+    // Arithmetic on matched literals must still fit a literal
+    if (!node->condition && node->left && node->right && node->left->type == ASTNodeType::INTLIT &&
+        node->right->type == ASTNodeType::INTLIT) {
+        long long value;
+        if (!foldBinaryConstant(node->type, node->left->intValue, node->right->intValue, value) ||
+            value < INT_MIN || value > INT_MAX) {
+            valid = false;
+            return node;
+        }
+        return makeIntLiteral(static_cast<int>(value));
+    }
+    return node;
+}
+
+bool Simplifier::applyRule(const CompiledRule& rule, std::unique_ptr<ASTNode>& node) {
+    Bindings bindings;
+    if (!match(rule.pattern, node, bindings)) return false;
+
+    // A subexpression the rule drops or duplicates must have no effects
+    for (const auto& binding : bindings) {
+        auto used = rule.replacementUses.find(binding.first);
+        int uses = used != rule.replacementUses.end() ? used->second : 0;
+        if ((uses != 1 || rule.patternUses.at(binding.first) != 1) &&
+            !isSafeExpression(*binding.second)) {
+            return false;
+        }
+    }
+
+    bool valid = true;
+    auto replacement = instantiate(rule.replacement, bindings, valid);
+    if (!valid) return false;
+    node = std::move(replacement);
+    return true;
+}
+
+bool Simplifier::foldConstants(std::unique_ptr<ASTNode>& node) {
+    const auto& left = node->left;
+    const auto& right = node->right;
+    long long value;
+
+    if (left && right && left->type == ASTNodeType::INTLIT && right->type == ASTNodeType::INTLIT) {
+        if (!foldBinaryConstant(node->type, left->intValue, right->intValue, value)) return false;
+    } else if (!right && left && left->type == ASTNodeType::INTLIT &&
+               (node->type == ASTNodeType::NEGATE || node->type == ASTNodeType::NOT)) {
+        value = node->type == ASTNodeType::NOT ? left->intValue == 0 : -static_cast<long long>(left->intValue);
+    } else {
+        return false;
+    }
+
+    if (value < INT_MIN || value > INT_MAX) return false;
+    node = makeIntLiteral(static_cast<int>(value));
+    return true;
+}
+
+bool Simplifier::rewriteNode(std::unique_ptr<ASTNode>& node, bool condition) {
+    if (foldConstants(node)) return true;
+    for (const CompiledRule& rule : rules) {
+        if (rule.conditionOnly && !condition) continue;
+        if (applyRule(rule, node)) return true;
+    }
+    return false;
+}
+
+// Operands first, then the node itself until no rule applies
+bool Simplifier::rewriteExpression(std::unique_ptr<ASTNode>& node, bool condition) {
+    if (!node) return false;
+
+    bool logical = node->type == ASTNodeType::AND || node->type == ASTNodeType::OR ||
+                   node->type == ASTNodeType::NOT ||
+                   (node->type == ASTNodeType::CONDITIONAL && condition);
+    bool changed = rewriteExpression(node->condition, true);
+    changed = rewriteExpression(node->left, logical) || changed;
+    changed = rewriteExpression(node->right, logical) || changed;
+    for (auto& child : node->children) {
+        changed = rewriteExpression(child, false) || changed;
+    }
+
+    while (rewriteCount < budget && rewriteNode(node, condition)) {
+        rewriteCount++;
+        changed = true;
+    }
+    return changed;
+}
+
+bool Simplifier::visitStatement(std::unique_ptr<ASTNode>& node) {
+    if (!node) return false;
+    bool changed = false;
+
+    switch (node->type) {
+        case ASTNodeType::PROGRAM:
+        case ASTNodeType::COMPOUND_STMT:
+            for (auto& child : node->children) {
+                changed = visitStatement(child) || changed;
+            }
+            break;
+
+        case ASTNodeType::IF_STMT:
+            changed = rewriteExpression(node->condition, true);
+            changed = visitStatement(node->left) || changed;
+            changed = visitStatement(node->right) || changed;
+            break;
+
+        case ASTNodeType::WHILE_STMT:
+        case ASTNodeType::FOR_STMT:
+            if (!node->children.empty()) changed = visitStatement(node->children[0]);
+            changed = rewriteExpression(node->condition, true) || changed;
+            changed = visitStatement(node->left) || changed;
+            if (node->children.size() > 1) changed = rewriteExpression(node->children[1], false) || changed;
+            break;
+
+        case ASTNodeType::FUNCTION_DECL:
+            changed = visitStatement(node->left);
+            break;
+
+        case ASTNodeType::SWITCH_STMT:
+            changed = rewriteExpression(node->condition, false);
+            for (auto& child : node->children) {
+                changed = visitStatement(child) || changed;
+            }
+            break;
+
+        case ASTNodeType::COUT_STMT:
+            for (auto& child : node->children) {
+                changed = rewriteExpression(child, false) || changed;
+            }
+            break;
+
+        case ASTNodeType::CIN_STMT:
+            break;
+
+        default:
+            changed = rewriteExpression(node->left, false);
+            break;
+    }
+    return changed;
+}
+
+void Simplifier::simplify(std::unique_ptr<ASTNode>& program) {
+    // Rewrites can expose new matches in the nodes they build, so whole
+    // passes repeat until nothing changes
+    while (rewriteCount < budget && visitStatement(program)) {
+    }
+}
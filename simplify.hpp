@@ -0,0 +1,65 @@
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP
+
+#include "parser.hpp"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// An algebraic rewrite rule: expressions matching 'pattern' are replaced by
+// 'replacement'. Both are written in the source language. In a pattern an
+// identifier starting with 'c' matches an integer literal, one starting with
+// 'e' matches any expression except a literal, and any other identifier
+// matches any expression; an identifier used twice must match equal
+// expressions. Arithmetic on matched literals in a replacement is evaluated
+// when the rule is applied.
+struct RewriteRule {
+    const char* pattern;
+    const char* replacement;
+    bool conditionOnly;        // Valid only where just the truth of the value matters
+};
+
+// Rule-driven expression simplifier. Expressions are rewritten bottom-up,
+// trying the rules of the table in order at each node, until no rule
+// applies anywhere or the rewrite budget is spent.
+class Simplifier {
+private:
+    struct CompiledRule {
+        std::unique_ptr<ASTNode> pattern;
+        std::unique_ptr<ASTNode> replacement;
+        bool conditionOnly;
+        std::unordered_map<std::string, int> patternUses;
+        std::unordered_map<std::string, int> replacementUses;
+    };
+
+    using Bindings = std::unordered_map<std::string, const std::unique_ptr<ASTNode>*>;
+
+    std::vector<CompiledRule> rules;
+    int budget;
+    int rewriteCount;
+
+    bool match(const std::unique_ptr<ASTNode>& pattern, const std::unique_ptr<ASTNode>& node,
+               Bindings& bindings);
+    std::unique_ptr<ASTNode> instantiate(const std::unique_ptr<ASTNode>& pattern,
+                                         const Bindings& bindings, bool& valid);
+    bool applyRule(const CompiledRule& rule, std::unique_ptr<ASTNode>& node);
+    bool foldConstants(std::unique_ptr<ASTNode>& node);
+    bool rewriteNode(std::unique_ptr<ASTNode>& node, bool condition);
+
+    bool rewriteExpression(std::unique_ptr<ASTNode>& node, bool condition);
+    bool visitStatement(std::unique_ptr<ASTNode>& node);
+
+public:
+    // Total rewrites allowed per program
+    static const int DEFAULT_BUDGET = 10000;
+
+    explicit Simplifier(int rewriteBudget = DEFAULT_BUDGET);
+
+    // Simplify every expression of a program in place
+    void simplify(std::unique_ptr<ASTNode>& program);
+
+    int getRewriteCount() const { return rewriteCount; }
+};
+
+#endif // SIMPLIFY_HPP
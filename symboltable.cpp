@@ -11,6 +11,21 @@ bool SymbolTable::addSymbol(const std::string& name, SymbolType type) {
     return true;
 }
 
+// The array takes whole 16-byte units below the last slot
+bool SymbolTable::addArray(const std::string& name, int elements, int elementSize) {
+    if (exists(name)) {
+        return false;
+    }
+
+    int size = (elements * elementSize + 15) & ~15;
+    int base = -((size - (currentOffset + 8) + 15) & ~15);
+    Symbol sym(name, SymbolType::INTEGER, base, currentScope);
+    sym.elements = elements;
+    symbols.emplace(name, sym);
+    currentOffset = base - 8;
+    return true;
+}
+
 Symbol* SymbolTable::findSymbol(const std::string& name) {
     auto it = symbols.find(name);
     return (it != symbols.end()) ? &it->second : nullptr;
@@ -20,11 +20,13 @@ struct Symbol {
     int offset;        // Stack offset from base pointer
     bool initialized;  // Whether the variable has been initialized
     int scope;        // Scope level (for nested scopes)
+    int reg;          // Register holding the variable, or -1 if it lives at 'offset'
+    int elements;     // Element count of an array starting at 'offset', 0 for a scalar
 
-    Symbol() : type(SymbolType::INTEGER), offset(0), initialized(false), scope(0) {}
+    Symbol() : type(SymbolType::INTEGER), offset(0), initialized(false), scope(0), reg(-1), elements(0) {}
 
     Symbol(const std::string& n, SymbolType t, int off, int sc = 0)
-        : name(n), type(t), offset(off), initialized(false), scope(sc) {}
+        : name(n), type(t), offset(off), initialized(false), scope(sc), reg(-1), elements(0) {}
 };
 
 // Symbol table class
@@ -40,6 +42,9 @@ public:
     // Add a new symbol
     bool addSymbol(const std::string& name, SymbolType type);
 
+    // Add an array of 'elements' elements of 'elementSize' bytes, 16-byte aligned
+    bool addArray(const std::string& name, int elements, int elementSize);
+
     // Find a symbol
     Symbol* findSymbol(const std::string& name);
 
@@ -61,6 +66,9 @@ public:
 
     // Get current offset
     int getCurrentOffset() const { return currentOffset; }
+
+    // Get current scope level
+    int getCurrentScope() const { return currentScope; }
 };
 
 #endif // SYMBOLTABLE_HPP
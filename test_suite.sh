@@ -107,6 +107,18 @@ run_test "Precedence 2" "20 - 2 * 3;" 14
 run_test "Precedence 3" "(2 + 3) * 4;" 20
 run_test "Complex precedence" "2 + 3 * 4 - 1;" 13
 
+# Bitwise operators and shifts
+run_test "Bitwise operators" "int a = 12; int b = 10; (a & b) + (a | b) * 3 + (a ^ b) * 7 + ~a + 100;" 179
+run_test "Shift precedence and counts" "int x = 1; int n = 40; (1 << 2 + 3) + ((x << n) >> 36) + (-100 >> 2);" 23
+
+# Arithmetic the optimizer cannot fold away (g[0] is unknown)
+run_test "Reassociated constants" "int g[4]; int a = 12 + g[0]; int b = a + 1 + 2 + a*2*3; b;" 87
+run_test "Algebraic identities" "int g[4]; int a = 12 + g[0]; int b = 0; (b = 2) * 0 + b + a * 0 + (a == a) + (a - a);" 3
+run_test "Power-of-two division of negative values" "int g[4]; int a = 12 + g[0]; int b = 0 - a - 7; (b / 8) * 10 + b % 8 + 100;" 77
+run_test "Scaled sums as addresses" "int g[4]; int a = 12 + g[0]; int b = a - 2; (a + b * 4 - 3) + (b * 8 + 5) * 2;" 219
+run_test "Interleaved independent chains" "int g[4]; int a = 12 + g[0]; int b = a + 1; int c = a - 1; int d = (a * b * c + 7) * (b * c * 9 + a); d % 256;" 225
+run_test "Scheduled divisions" "int g[4]; int a = 12 + g[0]; int b = a + 1; int e = (a * 5 / 3 + b % 4) - (b * b / 7 - a % 5); e + 100;" 99
+
 # ==============================================
 # PHASE 2: COMPARISON OPERATIONS
 # ==============================================
@@ -136,6 +148,11 @@ run_test "OR true" "1 || 0;" 1
 run_test "OR false" "0 || 0;" 0
 run_test "NOT true" "!0;" 1
 run_test "NOT false" "!1;" 0
+run_test "AND chain" "1 && 2 && 3;" 1
+run_test "Mixed AND/OR" "(0 || 2) && !0;" 1
+run_test "AND short-circuit" "0 && 1 / 0;" 0
+run_test "OR short-circuit" "1 || 1 / 0;" 1
+run_test "Short-circuit skips assignment" "int x; x = 1; 0 && (x = 5); x;" 1
 
 # ==============================================
 # PHASE 4: VARIABLES
@@ -146,6 +163,10 @@ run_test "Variable declaration" "int x = 5; x;" 5
 run_test "Variable assignment" "int x = 3; x = 7; x;" 7
 run_test "Multiple variables" "int a = 2; int b = 3; a + b;" 5
 run_test "Variable in expression" "int x = 4; x * 2 + 1;" 9
+run_test "More variables than registers" "int a = 1; int b = 2; int c = 3; int d = 4; int e = 5; int f = 6; int g = 7; int h = 8; int i = 9; int j = 10; a + b * c + d * e - f + g * h - i + j;" 78
+run_test "Register variables in sibling scopes" "int x = 5; { int y = 6; x = x + y; } { int z = 7; x = x * z; } x;" 77
+
+run_test "Operands read after a store" "int g[4]; int a = 12 + g[0]; int x = a; int y = x < (x = 5); x = x - 7; x = 3 * x; y + x;" 250
 
 # ==============================================
 # PHASE 5: CONTROL FLOW (if available)
@@ -157,6 +178,14 @@ run_test "If statement true" "int x = 5; if (x > 3) x = 10; x;" 10
 run_test "If statement false" "int x = 2; if (x > 3) x = 10; x;" 2
 run_test "If-else true" "int x = 5; if (x > 3) x = 10; else x = 1; x;" 10
 run_test "If-else false" "int x = 2; if (x > 3) x = 10; else x = 1; x;" 1
+run_test "If with && condition" "int x = 5; int y = 0; if (x > 3 && x < 10) y = 1; y;" 1
+run_test "If-else chain" "int x = 7; int y = 0; if (x < 5) y = 1; else if (x < 8) y = 2; else y = 3; y;" 2
+run_test "Block statement" "int x = 1; if (x) { x = x + 1; x = x * 3; } x;" 6
+
+# Conditional operator
+run_test "Conditional operator" "int g[4]; int a = 12 + g[0]; int b = a < 3 ? 1 : a == 12 ? 2 : 3; int c = !(a > 3) ? 7 : 8; b * 10 + c;" 28
+run_test "Conditional arms with effects" "int g[4]; int a = 12 + g[0]; int x = 0; int d = 0; int b = a > 2 ? (x = 4) : 100 / d; b * 10 + x;" 44
+run_test "Untaken trapping arm not selected" "int g[4]; int x = 1073741824 + g[1]; x = x * x * 8; int c = g[0]; int r = c ? x / -1 : 7; r;" 7
 
 # ==============================================
 # PHASE 6: LOOPS (if available)
@@ -165,6 +194,70 @@ echo "=== PHASE 6: LOOP STATEMENTS ==="
 
 run_test "While loop" "int x = 0; while (x < 3) x = x + 1; x;" 3
 run_test "For loop" "int i = 0; for (i = 0; i < 5; i = i + 1) ; i;" 5
+run_test "While loop not entered" "int x = 9; while (x < 3) x = x + 1; x;" 9
+run_test "For loop with declaration" "int s = 0; for (int i = 1; i <= 10; i = i + 1) s = s + i; s;" 55
+run_test "Nested loops" "int s = 0; for (int i = 0; i < 4; i = i + 1) for (int j = 0; j < 5; j = j + 1) s = s + 1; s;" 20
+run_test "For loop without init" "int i = 2; for (; i < 7; i = i + 1) ; i;" 7
+run_test "Early return" "int x = 3; if (x > 2) return 7; x;" 7
+run_test "Return from loop" "int i = 0; while (i < 100) { if (i == 42) return i; i = i + 1; } 0;" 42
+run_test "Loop invariant hoisted" "int n = 7; int k = 3; int s = 0; for (int i = 0; i < 10; i = i + 1) s = s + n * k + i; s;" 255
+run_test "Loop variant not hoisted" "int a = 1; int s = 0; for (int i = 0; i < 5; i = i + 1) { s = s + a * 2; a = a + 1; } s;" 30
+run_test "Invariant in nested loop" "int n = 3; int s = 0; for (int i = 0; i < 4; i = i + 1) for (int j = 0; j < n * 2; j = j + 1) s = s + n; s;" 72
+run_test "Guarded division by -1 not hoisted" "int g[4]; int x = 1073741824 + g[1]; x = x * x * 8; int s = 0; int i = 0; while (i < 10) { if (g[i] > 0) { s = s + x / -1; } i = i + 1; } s;" 0
+run_test "If-else in loop" "int a = 0; int b = 0; for (int i = 0; i < 10; i = i + 1) { if (i < 3) a = a + 1; else b = b + 1; } a * 10 + b;" 37
+run_test "Strength-reduced product" "int n = 37; int s = 0; for (int i = 0; i < n; i = i + 2) s = s + i * 3; s;" 2
+run_test "While loop induction variable" "int n = 10; int s = 0; int i = 0; while (i < n) { s = s + i * n; i = i + 1; } s + i;" 204
+run_test "Unrolled loop with remainder" "int n = 37; int s = 0; for (int i = 0; i < n; i = i + 1) s = s + i * i; s;" 78
+run_test "Unrolled countdown loop" "int s = 0; for (int i = 10; i >= 0; i = i - 2) { int t = i * 2; s = s + t; } s;" 60
+run_test "Closed-form sum" "int n = 100; int s = 0; for (int i = 0; i < n; i = i + 1) s = s + i; s;" 86
+run_test "Closed-form coupled recurrences" "int n = 20; int s = 1; int t = 0; for (int i = 0; i < n; i = i + 1) { t = t + 2; s = t + s - 1; } s + t;" 185
+run_test "Closed-form loop not entered" "int n = 0; int x = 5; for (int i = 0; i < n; i = i + 1) x = i * 3 + 1; x;" 5
+run_test "Closed-form wrapping sum" "int k = 2000000000; k = k * k + 12345; int s = 7; for (int i = 0; i < 1001; i = i + 1) s = s + i * k; s / 1000000 / 1000000 % 256 + 256;" 169
+run_test "Common subexpressions" "int a = 3; int b = 4; int x = (a*b + 1) * (a*b - 1); x - a*b;" 131
+run_test "Common subexpression after store" "int a = 3; int b = 4; int x = a*b; a = 5; int y = b*a; x + y;" 32
+run_test "Common subexpression across branches" "int a = 5; int b = 6; int r = a*b; if (a > 2) a = 1; r + a*b;" 36
+run_test "Constant flag prunes branch" "int debug = 0; int s = 1; if (debug) { s = s + 100; } s;" 1
+run_test "Constant flag through loop" "int debug = 0; int s = 0; int i = 0; while (i < 10) { if (debug) { debug = 1; s = s + 100; } s = s + i; i = i + 1; } s + debug;" 45
+run_test "Loop never entered is removed" "int x = 0; while (x > 0) { x = x - 1; } x + 3;" 3
+run_test "Non-negative division by shift" "int s = 0; int i = 100; while (i > 0) { s = s + i % 2; i = i / 2; } s;" 3
+run_test "Comparisons decided by ranges" "int s = 0; for (int i = 0; i < 20; i = i + 1) { if (i >= 0) s = s + 1; if (i > 25) s = s + 100; } s;" 20
+run_test "Select in a loop" "int s = 0; int m = 0; for (int j = 0; j < 50; j = j + 1) { int v = j * 7 % 11; m = v > m ? v : m; s = s + (j % 3 == 0 ? j : 1); } s + m;" 195
+run_test "Branching conditional register need" "int v0 = 2; int v1 = 5; int v2 = 19; for (int i = 0; i < 3; i = i + 1) { for (int j = 0; j < 3; j = j + 1) { for (int k = 0; k < 3; k = k + 1) { v0 = v0 + 1; } v0 = 7 / ((v2 ? ((v0 % 16) && 3) : (v1 && v0)) % 7 + 8); } } v0;" 0
+run_test "Switch jump table" "int r = 0; int i = 0; while (i < 12) { switch (i) { case 0: r = r + 1; break; case 1: r = r + 2; case 2: r = r + 3; break; case 3: case 4: r = r * 2; break; case 5: r = r - 1; break; case 7: r = r + 10; break; default: r = r + 100; } i = i + 1; } r;" 33
+run_test "Sparse switch" "int r = 0; int i = 0; while (i < 40) { switch (i * 7 % 40) { case 1: r = r + 1; break; case 10: r = r + 2; break; case 100: r = r + 50; break; case 21: r = r + 3; break; case 35: r = r + 4; break; case -5: r = r + 60; break; case 1000: r = r + 70; break; case 28: r = r * 2; break; } i = i + 1; } r;" 13
+run_test "Switch bit tests" "int r = 0; int i = 0; while (i < 20) { switch (i) { case 1: case 3: case 5: case 7: case 11: r = r + 1; break; case 2: case 4: case 8: case 16: r = r + 10; break; default: r = r + 100; } i = i + 1; } r % 256;" 121
+run_test "Unreachable jump table" "int p = 3; int q = 0; for (;;) { q = q + p; if (q > 10) return q; } switch (p) { case 1: q = 5; break; case 2: q = 6; break; case 3: q = 2; case 4: q = 3; } q;" 12
+run_test "Recursive function" "int fib(int n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); } fib(12) % 256;" 144
+run_test "Stack arguments" "int s8(int a, int b, int c, int d, int e, int f, int g, int h) { return a - b + c - d + e - f + g * h; } int x = 1; s8(x, 2, 3, 4, 5, 6, 7, s8(1, 1, 1, 1, 1, 1, 1, x + 7));" 53
+run_test "Function prototypes" "int isEven(int n); int isOdd(int n) { if (n == 0) return 0; return isEven(n - 1); } int isEven(int n) { if (n == 0) return 1; return isOdd(n - 1); } isEven(10) * 10 + isOdd(7);" 11
+run_test "Inlined call in loop" "int clamp(int v, int lo, int hi) { if (v < lo) { return lo; } if (v > hi) { return hi; } return v; } int s = 0; for (int i = 0; i < 20; i = i + 1) { s = s + clamp(i * 3, 5, 10); } s;" 185
+run_test "Specialized calls" "int pick(int mode, int x) { if (mode == 0) { return x + 1; } if (mode == 1) { return x * 2; } return x * x; } int f(int n) { int s = 0; for (int i = 0; i < n; i = i + 1) { s = s + pick(1, i) + pick(2, i); } return s; } int g(int n) { return f(n) + f(n + 1); } g(4) + g(5);" 211
+run_test "Several inlined calls" "int sign(int x) { if (x < 0) { return 0 - 1; } if (x > 0) { return 1; } return 0; } int a = 0 - 7; sign(a) + sign(9) * 10 + sign(0) * 100 + 21;" 30
+run_test "Tail recursion as a loop" "int sum(int n, int acc) { if (n == 0) { return acc; } return sum(n - 1, acc + n); } sum(1000000, 0) % 256;" 32
+run_test "Mutual tail calls" "int isEven(int n); int isOdd(int n) { if (n == 0) return 0; return isEven(n - 1); } int isEven(int n) { if (n == 0) return 1; return isOdd(n - 1); } isEven(1000000) * 10 + isOdd(777777);" 11
+run_test "Tail call argument swap" "int gcd(int a, int b) { if (b == 0) { return a; } return gcd(b, a % b); } gcd(1071, 462);" 21
+run_test "Global array sieve" "int p[50]; int cnt = 0; for (int i = 2; i < 50; i = i + 1) p[i] = 1; for (int i = 2; i < 50; i = i + 1) { if (p[i]) { cnt = cnt + 1; for (int j = i * i; j < 50; j = j + i) p[j] = 0; } } cnt;" 15
+run_test "Local array initializer" "int f(int k) { int t[40] = {k, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21}; return t[0] + t[20] + t[30]; } f(20);" 41
+run_test "Array element update" "int h[4]; for (int i = 0; i < 20; i = i + 1) { h[i % 4] = h[i % 4] + 1; } h[0] + h[3];" 10
+run_test "Element loads after a top-level store" "int g1[100]; int g2[8]; g2[2] = 0; int w = 0; int i = 0; while (i < 100) { w = w + ((i < ((w / 4) + (w * g1[i] < g1[i] + g1[i] ? g1[i] + g1[i] : g1[i] % 3))) ? ((w / 4) + (w * g1[i] < g1[i] + g1[i] ? g1[i] + g1[i] : g1[i] % 3)) : 5); i = i + 1; } w % 256;" 134
+run_test "Vectorized element loop" "int a[103]; int b[103]; int c[103]; int k = 3; for (int i = 0; i < 103; i = i + 1) { a[i] = i; b[i] = 2 * i + 1; } for (int i = 0; i < 103; i = i + 1) { c[i] = a[i] + b[i] * k; } c[0] + c[50] + c[102] - 1000;" 73
+run_test "Vectorized shift within an array" "int a[40]; for (int i = 0; i < 40; i = i + 1) { a[i] = i; } for (int i = 0; i < 39; i = i + 1) { a[i] = a[i + 1]; } a[0] + a[10] + a[38] + a[39];" 90
+run_test "Vector loop distance checked at run time" "int a[60]; int f(int k) { for (int i = 0; i < 60; i = i + 1) { a[i] = 1; } for (int i = 10; i < 60; i = i + 1) { a[i] = a[i - k] + 1; } return a[59]; } f(3) + f(9);" 25
+run_test "Vectorized sum reduction" "int a[1000]; for (int i = 0; i < 1000; i = i + 1) { a[i] = 2000000000 - i; } int s = 0; for (int i = 0; i < 1000; i = i + 1) { s = s + a[i]; } s / 1000000 - 1999900;" 99
+run_test "Vectorized minimum reduction" "int a[500]; for (int i = 0; i < 500; i = i + 1) { a[i] = (i * 37) % 101 - 50; } int m = 1000; for (int i = 0; i < 500; i = i + 1) { m = a[i] < m ? a[i] : m; } m + 100;" 50
+run_test "Vectorized maximum reduction" "int a[500]; for (int i = 0; i < 500; i = i + 1) { a[i] = (i * 37) % 101 - 50; } int m = -1000; for (int i = 3; i < 497; i = i + 1) { if (a[i] > m) m = a[i]; } m;" 50
+run_test "Braced reduction body under pressure" "int a[203]; int v1 = 1; int v2 = 2; int v3 = 3; int v4 = 4; int v5 = 5; int v6 = 6; for (int i = 0; i < 203; i = i + 1) { a[i] = i * 7 - 600; } int s = 0; int m = 0; int z = 0; for (int k = 0; k < 2; k = k + 1) { for (int i = 1; i < 203; i = i + 1) { s = s + a[i]; m = a[i] > m ? a[i] : m; if (a[i] < z) { z = a[i]; } } v1 = v1 * 3 + s; v2 = v2 * 3 + m; v3 = v3 * 3 + z; v4 = v4 + v1; v5 = v5 + v2; v6 = v6 + v3; } (s + m + z + v1 + v2 + v3 + v4 + v5 + v6) % 256 + 256;" 172
+run_test "Two-dimensional array initializer" "int m[2][3] = {{1}, {4, 5}}; m[0][0] + m[0][1] + m[1][0] * 10 + m[1][1] * 3 + m[1][2];" 56
+run_test "Tiled matrix multiply" "int a[70][70]; int b[70][70]; int c[70][70]; for (int i = 0; i < 70; i = i + 1) { for (int j = 0; j < 70; j = j + 1) { a[i][j] = i * 3 + j; b[i][j] = i - 2 * j; } } for (int i = 0; i < 70; i = i + 1) { for (int j = 0; j < 70; j = j + 1) { for (int k = 0; k < 70; k = k + 1) { c[i][j] = c[i][j] * 3 + a[i][k] * b[k][j]; } } } (c[3][5] + c[69][0] + c[10][69]) % 256;" 227
+run_test "Interchanged column loop" "int a[100][100]; int b[100][100]; for (int j = 0; j < 100; j = j + 1) { for (int i = 0; i < 100; i = i + 1) { a[i][j] = (i * 7 + j * 3) % 11; } } for (int j = 1; j < 99; j = j + 1) { for (int i = 1; i < 99; i = i + 1) { b[i][j] = a[i - 1][j] + a[i + 1][j] + a[i][j - 1] + a[i][j + 1] - 4 * a[i][j]; } } (b[5][7] + b[98][1] + 100) % 256;" 111
+run_test "Unswitched invariant test" "int s = 0; for (int m = 0; m < 3; m = m + 1) { for (int i = 0; i < 10; i = i + 1) { if (m == 2) s = s + i; else s = s - 1; } } s + 20;" 45
+run_test "Unswitched element loop" "int a[64]; int b[64]; for (int i = 0; i < 64; i = i + 1) { b[i] = i; } int t = 0; for (int m = 0; m < 2; m = m + 1) { for (int i = 0; i < 64; i = i + 1) { if (m == 1) a[i] = b[i] * 2; else a[i] = b[i] + 1; } t = t + a[63]; } t;" 190
+run_test "Unswitched nested tests" "int s = 0; for (int m = 0; m < 2; m = m + 1) { for (int k = 0; k < 2; k = k + 1) { for (int i = 0; i < 5; i = i + 1) { if (m == 1) s = s + 3; if (k > 0) s = s + i; } } } s;" 50
+run_test "Pipelined products loop" "int a[300]; int b[300]; for (int i = 0; i < 300; i = i + 1) { a[i] = (i * 37) % 101; b[i] = (i * 53) % 97 - 40; } int s = 0; int t = 0; int u = 0; for (int i = 0; i < 300; i = i + 1) { s = s + a[i] * b[i] / 7 + (a[i] + 3) * (b[i] - 2) / 5; t = t + (a[i] - b[i]) * (a[i] + b[i]) % 5 + a[i] * a[i] % 11; u = u + (a[i] * 3 + b[i] * 5) / 4 + (b[i] * b[i]) % 9 - a[i] * 7 / 6; } (s + t + u) % 256;" 167
+run_test "Pipelined hash loop" "int a[300]; int b[300]; for (int i = 0; i < 300; i = i + 1) { a[i] = (i * 37) % 101; b[i] = (i * 53) % 97 - 40; } int h = 17; for (int i = 0; i < 300; i = i + 1) { int x = a[i] * 131 + b[i] * 137 + a[i] * b[i] / 3 + (a[i] + b[i]) * (a[i] - 5) % 17; int y = (x % 1009) * (a[i] + 11) - (b[i] * 7) % 13 + (a[i] - b[i]) * 3 + (b[i] + 9) * (a[i] + 2) / 11; h = h * 3 + y + x % 5; } (h % 256 + 256) % 256;" 235
+run_test "Pipelined short loops" "int a[8] = {5, -3, 8, 1, 9, -7, 2, 4}; int b[8] = {2, 6, -1, 3, 7, 5, -4, 8}; int s = 0; for (int n = 0; n < 4; n = n + 1) { for (int i = 0; i < n; i = i + 1) { s = s + a[i] * b[i] / 3 + (a[i] + 3) * (b[i] - 2) % 5 + (a[i] - b[i]) * (a[i] + b[i]) / 4 + a[i] * a[i] % 7 + (b[i] * b[i] + a[i] * 5) / 6 + (a[i] * 11 - b[i] * 13) % 9 + (a[i] + b[i]) * (a[i] - 5) % 17; } } s + 100;" 143
+run_test "Vectorized mask loop" "int a[64]; for (int i = 0; i < 64; i = i + 1) { a[i] = i * 37 - 900; } int b[64]; for (int i = 0; i < 64; i = i + 1) { b[i] = (a[i] & 255) | (a[i] << 3) ^ ~a[i]; } int s = 0; for (int i = 0; i < 64; i = i + 1) { s = s + (b[i] >> 4); } s % 256 + 256;" 196
+run_test "Vectorized or reduction" "int a[300]; for (int i = 0; i < 300; i = i + 1) { a[i] = (i * 37) % 101 * (i % 3 == 0 ? -1 : 1) << (i % 7); } int s = 8; for (int i = 2; i < 297; i = i + 1) { s = a[i] | s; } (s < 0) * 100 + (s & 65535) % 97;" 160
 
 # ==============================================
 # PHASE 7: I/O STATEMENTS (if available)
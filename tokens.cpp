@@ -25,6 +25,10 @@ void initializeKeywords() {
     keywords["while"] = TokenType::T_WHILE;
     keywords["for"] = TokenType::T_FOR;
     keywords["return"] = TokenType::T_RETURN;
+    keywords["switch"] = TokenType::T_SWITCH;
+    keywords["case"] = TokenType::T_CASE;
+    keywords["default"] = TokenType::T_DEFAULT;
+    keywords["break"] = TokenType::T_BREAK;
 
     // I/O
     keywords["cout"] = TokenType::T_COUT;
@@ -92,6 +96,14 @@ std::string getTokenTypeName(TokenType type) {
             return "for";
         case TokenType::T_RETURN:
             return "return";
+        case TokenType::T_SWITCH:
+            return "switch";
+        case TokenType::T_CASE:
+            return "case";
+        case TokenType::T_DEFAULT:
+            return "default";
+        case TokenType::T_BREAK:
+            return "break";
 
         // I/O keywords
         case TokenType::T_COUT:
@@ -30,6 +30,10 @@ enum class TokenType {
     T_WHILE,        // while
     T_FOR,          // for
     T_RETURN,       // return
+    T_SWITCH,       // switch
+    T_CASE,         // case
+    T_DEFAULT,      // default
+    T_BREAK,        // break
     T_COUT,         // cout
     T_CIN,          // cin
     T_ENDL,         // endl
@@ -0,0 +1,319 @@
+#include "vectorize.hpp"
+#include "analysis.hpp"
+
+// Largest constant offset of an element read, so displacements stay 32-bit
+static const long long MAX_OFFSET = 1 << 28;
+
+int vectorLanes(VectorISA isa) {
+    switch (isa) {
+        case VectorISA::SSE2:
+            return 4;
+        case VectorISA::AVX2:
+            return 8;
+        default:
+            return 1;
+    }
+}
+
+// Accumulate an index of the form counter * coefficient + constant plus or
+// minus one other variable
+bool LoopVectorizer::linearIndex(const std::unique_ptr<ASTNode>& node, const std::string& counter, int sign,
+                                 long long& coefficient, VectorAccess& access) {
+    if (!node) return false;
+
+    switch (node->type) {
+        case ASTNodeType::INTLIT:
+            access.offset += sign * static_cast<long long>(node->intValue);
+            return true;
+
+        case ASTNodeType::IDENTIFIER:
+            if (node->value == counter) {
+                coefficient += sign;
+            } else if (access.variable.empty()) {
+                access.variable = node->value;
+                access.negated = sign < 0;
+            } else {
+                return false;
+            }
+            return true;
+
+        case ASTNodeType::ADD:
+            return linearIndex(node->left, counter, sign, coefficient, access) &&
+                   linearIndex(node->right, counter, sign, coefficient, access);
+
+        case ASTNodeType::SUBTRACT:
+            return linearIndex(node->left, counter, sign, coefficient, access) &&
+                   linearIndex(node->right, counter, -sign, coefficient, access);
+
+        default:
+            return false;
+    }
+}
+
+// A read of a[counter + offset], possibly plus or minus a variable
+bool LoopVectorizer::elementAccess(const std::unique_ptr<ASTNode>& node, const std::string& counter,
+                                   size_t statement, VectorAccess& access) {
+    access = VectorAccess{node->value, 0, "", false, statement, false};
+    long long coefficient = 0;
+    return node->type == ASTNodeType::INDEX && linearIndex(node->left, counter, 1, coefficient, access) &&
+           coefficient == 1 && access.offset >= -MAX_OFFSET && access.offset <= MAX_OFFSET;
+}
+
+static int countUses(const std::unique_ptr<ASTNode>& node, const std::string& name) {
+    if (!node) return 0;
+    int uses = node->type == ASTNodeType::IDENTIFIER && node->value == name ? 1 : 0;
+    uses += countUses(node->left, name) + countUses(node->right, name) + countUses(node->condition, name);
+    for (const auto& child : node->children) {
+        uses += countUses(child, name);
+    }
+    return uses;
+}
+
+// Recognize a reduction statement (see VectorReduction) and add it to the plan
+bool LoopVectorizer::addReduction(const std::unique_ptr<ASTNode>& statement, const std::string& counter,
+                                  size_t index, VectorLoopPlan& plan) {
+    auto isVariable = [](const std::unique_ptr<ASTNode>& n, const std::string& name) {
+        return n && n->type == ASTNodeType::IDENTIFIER && n->value == name;
+    };
+
+    // Normalized to: s = (e compare s) ? chosen : other, s = s +/- e or s = s | e
+    std::string variable;
+    const std::unique_ptr<ASTNode>* element = nullptr;
+    const ASTNode* compare = nullptr;
+    const std::unique_ptr<ASTNode>* chosen = nullptr;
+    const std::unique_ptr<ASTNode>* other = nullptr;
+    VectorReduction reduction{"", ReductionKind::SUM, 0, false};
+
+    if (statement->type == ASTNodeType::IF_STMT) {
+        const std::unique_ptr<ASTNode>* then = &statement->left;
+        if (*then && (*then)->type == ASTNodeType::COMPOUND_STMT && (*then)->children.size() == 1) {
+            then = &(*then)->children[0];
+        }
+        if (statement->right || !*then || (*then)->type != ASTNodeType::EXPRESSION_STMT || !(*then)->left ||
+            (*then)->left->type != ASTNodeType::ASSIGN || !(*then)->left->left ||
+            (*then)->left->left->type != ASTNodeType::IDENTIFIER) {
+            return false;
+        }
+        variable = (*then)->left->left->value;
+        compare = statement->condition.get();
+        chosen = &(*then)->left->right;
+    } else if (statement->type == ASTNodeType::EXPRESSION_STMT && statement->left &&
+               statement->left->type == ASTNodeType::ASSIGN && statement->left->left &&
+               statement->left->left->type == ASTNodeType::IDENTIFIER && statement->left->right) {
+        variable = statement->left->left->value;
+        const auto& value = statement->left->right;
+        if (value->type == ASTNodeType::ADD && isVariable(value->left, variable)) {
+            element = &value->right;
+        } else if (value->type == ASTNodeType::ADD && isVariable(value->right, variable)) {
+            element = &value->left;
+        } else if (value->type == ASTNodeType::SUBTRACT && isVariable(value->left, variable)) {
+            element = &value->right;
+            reduction.negated = true;
+        } else if (value->type == ASTNodeType::BITOR && isVariable(value->left, variable)) {
+            element = &value->right;
+            reduction.kind = ReductionKind::OR;
+        } else if (value->type == ASTNodeType::BITOR && isVariable(value->right, variable)) {
+            element = &value->left;
+            reduction.kind = ReductionKind::OR;
+        } else if (value->type == ASTNodeType::CONDITIONAL) {
+            compare = value->condition.get();
+            chosen = &value->left;
+            other = &value->right;
+        } else {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    if (compare) {
+        if (!compare->left || !compare->right) return false;
+        bool mirrored = isVariable(compare->left, variable);
+        element = mirrored ? &compare->right : &compare->left;
+        if (!isVariable(mirrored ? compare->left : compare->right, variable)) return false;
+
+        bool less;
+        switch (compare->type) {
+            case ASTNodeType::LT:
+            case ASTNodeType::LE:
+                less = !mirrored;
+                break;
+            case ASTNodeType::GT:
+            case ASTNodeType::GE:
+                less = mirrored;
+                break;
+            default:
+                return false;
+        }
+        // The element replaces s when it compares 'less' ? below : above s
+        std::string elementKey = expressionKey(*element);
+        bool chooseElement;
+        if (*chosen && expressionKey(*chosen) == elementKey && (!other || isVariable(*other, variable))) {
+            chooseElement = true;
+        } else if (other && isVariable(*chosen, variable) && *other && expressionKey(*other) == elementKey) {
+            chooseElement = false;
+        } else {
+            return false;
+        }
+        reduction.kind = less == chooseElement ? ReductionKind::MIN : ReductionKind::MAX;
+    }
+
+    VectorAccess access;
+    if (!elementAccess(*element, counter, index, access) || access.variable == variable ||
+        variable == counter) {
+        return false;
+    }
+    reduction.variable = variable;
+    reduction.access = plan.accesses.size();
+    plan.accesses.push_back(access);
+    plan.reductions.push_back(reduction);
+    return true;
+}
+
+// Element-wise operations of a stored value, recording the elements read
+bool LoopVectorizer::collectAccesses(const std::unique_ptr<ASTNode>& node, const std::string& counter,
+                                     size_t statement, VectorLoopPlan& plan) {
+    if (!node) return false;
+
+    switch (node->type) {
+        case ASTNodeType::INTLIT:
+        case ASTNodeType::BOOLLIT:
+        case ASTNodeType::IDENTIFIER:
+            return true;
+
+        case ASTNodeType::ADD:
+        case ASTNodeType::SUBTRACT:
+        case ASTNodeType::MULTIPLY:
+        case ASTNodeType::BITAND:
+        case ASTNodeType::BITOR:
+        case ASTNodeType::BITXOR:
+            return collectAccesses(node->left, counter, statement, plan) &&
+                   collectAccesses(node->right, counter, statement, plan);
+
+        case ASTNodeType::LSHIFT:
+            return node->right->type == ASTNodeType::INTLIT && collectAccesses(node->left, counter, statement, plan);
+
+        case ASTNodeType::RSHIFT:
+            return node->right->type == ASTNodeType::INTLIT && node->left->type == ASTNodeType::INDEX &&
+                   collectAccesses(node->left, counter, statement, plan);
+
+        case ASTNodeType::NEGATE:
+        case ASTNodeType::POSITIVE:
+        case ASTNodeType::BITNOT:
+            return collectAccesses(node->left, counter, statement, plan);
+
+        case ASTNodeType::INDEX: {
+            VectorAccess access;
+            if (!elementAccess(node, counter, statement, access)) return false;
+            plan.accesses.push_back(access);
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+bool LoopVectorizer::analyze(const std::unique_ptr<ASTNode>& loop, int lanes, VectorLoopPlan& plan) {
+    plan = VectorLoopPlan();
+    if (lanes <= 1 || !loop || loop->type != ASTNodeType::FOR_STMT || !loop->left || !loop->condition ||
+        loop->children.size() < 2 || !loop->children[1]) {
+        return false;
+    }
+
+    // Exit test: counter < bound or counter <= bound
+    const auto& condition = loop->condition;
+    if ((condition->type != ASTNodeType::LT && condition->type != ASTNodeType::LE) || !condition->left ||
+        condition->left->type != ASTNodeType::IDENTIFIER || !condition->right) {
+        return false;
+    }
+    plan.counter = condition->left->value;
+    plan.inclusive = condition->type == ASTNodeType::LE;
+    plan.bound = condition->right.get();
+    if (plan.bound->type != ASTNodeType::INTLIT &&
+        (plan.bound->type != ASTNodeType::IDENTIFIER || plan.bound->value == plan.counter)) {
+        return false;
+    }
+
+    // Update: counter = counter + 1
+    const auto& update = loop->children[1];
+    if (update->type != ASTNodeType::ASSIGN || !update->left || update->left->type != ASTNodeType::IDENTIFIER ||
+        update->left->value != plan.counter || !update->right || update->right->type != ASTNodeType::ADD) {
+        return false;
+    }
+    const auto& sum = update->right;
+    auto isCounter = [&plan](const std::unique_ptr<ASTNode>& n) {
+        return n && n->type == ASTNodeType::IDENTIFIER && n->value == plan.counter;
+    };
+    auto isOne = [](const std::unique_ptr<ASTNode>& n) {
+        return n && n->type == ASTNodeType::INTLIT && n->intValue == 1;
+    };
+    if (!(isCounter(sum->left) && isOne(sum->right)) && !(isOne(sum->left) && isCounter(sum->right))) {
+        return false;
+    }
+
+    // Body: element assignments a[counter] = value
+    std::vector<const std::unique_ptr<ASTNode>*> statements;
+    if (loop->left->type == ASTNodeType::COMPOUND_STMT) {
+        for (const auto& child : loop->left->children) {
+            statements.push_back(&child);
+        }
+    } else {
+        statements.push_back(&loop->left);
+    }
+    if (statements.empty()) return false;
+
+    for (size_t i = 0; i < statements.size(); i++) {
+        const auto& statement = *statements[i];
+        if (statement && addReduction(statement, plan.counter, i, plan)) continue;
+        if (!statement || statement->type != ASTNodeType::EXPRESSION_STMT || !statement->left ||
+            statement->left->type != ASTNodeType::ASSIGN) {
+            return false;
+        }
+        const auto& assign = statement->left;
+        if (!assign->left || assign->left->type != ASTNodeType::INDEX || !assign->right) return false;
+
+        VectorAccess store{assign->left->value, 0, "", false, i, true};
+        long long coefficient = 0;
+        if (!linearIndex(assign->left->left, plan.counter, 1, coefficient, store) || coefficient != 1 ||
+            store.offset != 0 || !store.variable.empty()) {
+            return false;
+        }
+        if (!collectAccesses(assign->right, plan.counter, i, plan)) return false;
+        plan.accesses.push_back(store);
+        plan.stores.push_back(assign.get());
+    }
+
+    // A reduced scalar is used only by its own statement
+    if (!plan.reductions.empty() && !plan.stores.empty()) return false;
+    for (const VectorReduction& reduction : plan.reductions) {
+        const auto& own = *statements[plan.accesses[reduction.access].statement];
+        if (countUses(loop->left, reduction.variable) != countUses(own, reduction.variable) ||
+            countUses(loop->condition, reduction.variable) > 0) {
+            return false;
+        }
+    }
+
+    // Reads of stored arrays: a read before the store may run ahead of it,
+    // one after it may not; both may look back a whole vector or more
+    for (size_t r = 0; r < plan.accesses.size(); r++) {
+        const VectorAccess& read = plan.accesses[r];
+        if (read.store) continue;
+
+        bool stored = false;
+        bool positiveAllowed = true;
+        for (const VectorAccess& store : plan.accesses) {
+            if (!store.store || store.array != read.array) continue;
+            stored = true;
+            positiveAllowed = positiveAllowed && read.statement <= store.statement;
+        }
+        if (!stored) continue;
+
+        if (!read.variable.empty()) {
+            plan.checks.push_back({r, positiveAllowed});
+        } else if (read.offset != 0 && !(positiveAllowed && read.offset > 0) && read.offset > -lanes) {
+            return false;
+        }
+    }
+    return true;
+}
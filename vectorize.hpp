@@ -0,0 +1,99 @@
+#ifndef VECTORIZE_HPP
+#define VECTORIZE_HPP
+
+#include "parser.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Instruction sets the loop vectorizer can target: 128-bit SSE2 registers
+// of four elements, or 256-bit AVX2 registers of eight
+enum class VectorISA {
+    NONE,
+    SSE2,
+    AVX2
+};
+
+int vectorLanes(VectorISA isa);
+
+// An array element the loop reads or writes: array[counter + offset], plus
+// or minus a loop-invariant variable
+struct VectorAccess {
+    std::string array;
+    long long offset;
+    std::string variable;       // "" if the index has no variable term
+    bool negated;               // Whether 'variable' is subtracted
+    size_t statement;           // Body statement the access is in
+    bool store;
+};
+
+// A read from an array the loop also stores to, whose distance from the
+// stored element is only known at run time. The vector loop runs when the
+// distance is zero, is non-negative and 'positiveAllowed' (the read comes
+// before every store), or reaches back at least a whole vector.
+struct VectorCheck {
+    size_t access;
+    bool positiveAllowed;
+};
+
+// How a reduction folds elements into its scalar
+enum class ReductionKind {
+    SUM,
+    MIN,
+    MAX,
+    OR
+};
+
+// A scalar the loop folds one element into per iteration: s = s + a[i + c]
+// (or s - a[i + c]), s = s | a[i + c], or the smaller or larger of s and
+// the element, written as s = a[i + c] < s ? a[i + c] : s or
+// if (a[i + c] < s) s = a[i + c]
+struct VectorReduction {
+    std::string variable;
+    ReductionKind kind;
+    size_t access;              // The element read, in 'accesses'
+    bool negated;               // s = s - a[i + c]
+};
+
+struct VectorLoopPlan {
+    std::string counter;
+    const ASTNode* bound;           // Loop-invariant literal or variable
+    bool inclusive;                 // counter <= bound rather than counter < bound
+    std::vector<const ASTNode*> stores;     // The body's element assignments, in order
+    std::vector<VectorReduction> reductions;
+    std::vector<VectorAccess> accesses;
+    std::vector<VectorCheck> checks;
+};
+
+// Recognizes innermost counted loops that can run 'lanes' iterations at a
+// time: 'for (...; i < n; i = i + 1)' (or <=) whose body only assigns
+// a[i] = e, where e combines elements b[i + c] (c a constant, possibly plus
+// or minus an invariant variable), invariant scalars, literals and the
+// counter with +, -, *, the bitwise operators and shifts left by a
+// literal. Their low 32 bits, all an element keeps, are the same whether
+// computed in 64-bit registers or 32-bit lanes; so are those of an element
+// shifted right by a literal, which is only 32 bits wide to begin with.
+// Distinct arrays never overlap; a read of a stored array must not see an
+// element the same vector stores, which is decided here for constant
+// distances and left to a run-time check otherwise. A body may instead
+// consist only of reductions of distinct scalars not otherwise used in the
+// loop. Every value is an integer, so reassociating them is exact.
+class LoopVectorizer {
+private:
+    static bool elementAccess(const std::unique_ptr<ASTNode>& node, const std::string& counter, size_t statement,
+                              VectorAccess& access);
+    static bool addReduction(const std::unique_ptr<ASTNode>& statement, const std::string& counter,
+                             size_t index, VectorLoopPlan& plan);
+    static bool collectAccesses(const std::unique_ptr<ASTNode>& node, const std::string& counter,
+                                size_t statement, VectorLoopPlan& plan);
+
+public:
+    static bool analyze(const std::unique_ptr<ASTNode>& loop, int lanes, VectorLoopPlan& plan);
+
+    // Add an index of the form counter * coefficient + offset, plus or minus
+    // one other variable, to 'coefficient' and 'access'
+    static bool linearIndex(const std::unique_ptr<ASTNode>& node, const std::string& counter, int sign,
+                            long long& coefficient, VectorAccess& access);
+};
+
+#endif // VECTORIZE_HPP